@@ -0,0 +1,1252 @@
+#include "aarch64.h"
+#include "aarch64_burs.h"
+#include "regalloc.h"
+#include "label.h"
+#include "sched.h"
+#include "opt.h"
+#include "encode.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+- instruction selection from the IR into AArch64, plus the frame layout and printing
+  - struct a64_func * aarch64_select( struct ir_func *f );
+  - void aarch64_codegen( struct ir_program *p, FILE *out );
+
+- registers come from regalloc: values that die before the next call go in x9-x15, values that live across
+  a call go in x19-x28 (saved in the prologue), anything left over is spilled to the frame
+- x16, x17 and x8 are never handed out, they reload spilled operands and hold intermediate results
+- frame, when the function needs one:
+    [x29]                 saved x29/x30, x29 points here
+    [sp + out + 8*i]      callee-saved registers, then spill slots
+    [sp + 0 .. out]       outgoing stack arguments for calls with more than 8 of them
+  incoming stack arguments are at [x29 + 16 + 8*(k-8)]
+- a leaf function that fits in caller-saved registers gets no frame at all
+- arithmetic, comparisons, copies, selects and branches are selected by tree pattern matching (see burs.h): an
+  instruction is a tree together with the single-use instructions right before it that compute its operands,
+  and so on back, burs_label finds the cheapest cover with the rules of aarch64.brg and a64_reduce emits it,
+  so madd, shifted operands, immediates, cinc and csel/csinc/cneg come out wherever the rules allow
+- at -O2 the whole function is scheduled once it's selected and its labels are final, see sched.c
+*/
+
+// allocation order
+const int a64_caller_regs[] = { 9, 10, 11, 12, 13, 14, 15 };
+const int a64_callee_regs[] = { 19, 20, 21, 22, 23, 24, 25, 26, 27, 28 };
+
+#define A64_NCALLER (sizeof(a64_caller_regs) / sizeof(a64_caller_regs[0]))
+#define A64_NCALLEE (sizeof(a64_callee_regs) / sizeof(a64_callee_regs[0]))
+
+#define A64_POOL_MIN 4	// instructions a constant would take to build before it's loaded from the literal pool instead,
+						// one load and 8 bytes of data against 16 bytes of movz and movk, in about the same time
+
+// state for the function being selected
+struct a64_func  *a64_cur        = 0;
+struct regalloc  *a64_ra         = 0;
+int              *a64_block_lbl  = 0;	// label of each IR block, by id
+int               a64_epilogue   = 0;	// label of the epilogue
+int               a64_has_frame  = 0;
+int               a64_frame_sub  = 0;	// bytes below the saved x29/x30
+int               a64_out_bytes  = 0;	// outgoing argument area
+int               a64_saved[16];		// callee-saved registers this function uses
+int               a64_nsaved     = 0;
+struct ir_inst  **a64_const_def  = 0;	// by vreg, the constant it always holds if its only definition is one
+int              *a64_ndefs      = 0;	// by vreg, instructions defining it, a parameter's entry value counts
+int              *a64_absorbed   = 0;	// by vreg, reads of a constant the selected rules take as an immediate
+char             *a64_in_tree    = 0;	// by vreg, its instruction is selected as part of a later one's tree
+struct ir_block  *a64_next_bb    = 0;	// block laid out after the one being selected
+
+// nodes of the tree being selected, reused from one tree to the next
+struct burs_node **a64_nodes     = 0;
+int                a64_nnodes    = 0;
+int                a64_cap_nodes = 0;
+
+int aarch64_selected      = 0;
+int aarch64_naive         = 0;
+int aarch64_cycles_before = 0;
+int aarch64_cycles_after  = 0;
+int aarch64_pooled        = 0;
+
+/* append a machine instruction to the current function */
+struct a64_inst * a64_emit(a64_op_t op, int rd, int rn, int rm)
+{
+	struct a64_inst *i = calloc(1, sizeof(*i));
+	i->op    = op;
+	i->rd    = rd;
+	i->rn    = rn;
+	i->rm    = rm;
+	i->label = -1;
+
+	if (a64_cur->last) a64_cur->last->next = i;
+	else               a64_cur->first      = i;
+	a64_cur->last = i;
+	return i;
+}
+
+/* stack offset of a spilled vreg */
+int a64_slot_offset(int v)
+{
+	return a64_out_bytes + 8 * (a64_nsaved + a64_ra->slot[v]);
+}
+
+/* get vreg v into a register for reading, reloading it into tmp if it was spilled */
+int a64_use(int v, int tmp)
+{
+	if (a64_ra->reg[v] != REGALLOC_NONE) return a64_ra->reg[v];
+
+	a64_emit(A64_LDR, tmp, A64_SP, 0)->imm = a64_slot_offset(v);
+	return tmp;
+}
+
+/* register to compute vreg v into, x16 if v lives in memory */
+int a64_def(int v)
+{
+	if (a64_ra->reg[v] != REGALLOC_NONE) return a64_ra->reg[v];
+	return A64_TMP0;
+}
+
+/* write back a value computed by a64_def if v lives in memory */
+void a64_def_done(int v, int r)
+{
+	if (a64_ra->reg[v] != REGALLOC_NONE) return;
+	if (a64_ra->slot[v] < 0) return; // never live, nothing to keep
+	a64_emit(A64_STR, r, A64_SP, 0)->imm = a64_slot_offset(v);
+}
+
+/* is vreg v always the constant *imm */
+int a64_known(int v, long *imm)
+{
+	if (v < 0 || !a64_const_def[v]) return 0;
+	*imm = a64_const_def[v]->imm;
+	return 1;
+}
+
+// the cheapest way to build a constant, one instruction after another into the same register
+struct a64_const_seq {
+	int n;
+	a64_op_t op[4];
+	long imm[4];
+	int shift[4];
+};
+
+/* a64_const_plan: the shortest sequence of instructions that builds imm */
+/*
+- one mov when a single movz or movn (at any shift) or an orr with a bitmask immediate takes it
+- otherwise a movz and a movk for every other 16-bit chunk that isn't 0, or a movn and a movk for every other
+  chunk that isn't 0xffff, whichever leaves fewer chunks
+- an orr with a bitmask and one movk when that's shorter, a bitmask that only differs from imm in one chunk
+  by taking another chunk's value there
+*/
+void a64_const_plan(long imm, struct a64_const_seq *s)
+{
+	unsigned long u = (unsigned long) imm;
+	int zeros = 0;
+	int ones  = 0;
+	for (int c=0;c<64;c+=16)
+	{
+		zeros += ((u >> c) & 0xffff) != 0;
+		ones  += ((u >> c) & 0xffff) != 0xffff;
+	}
+
+	s->n = 0;
+	if (zeros <= 1 || ones <= 1 || encode_bitmask(u) >= 0)
+	{
+		s->op[0]    = A64_MOVI;
+		s->imm[0]   = imm;
+		s->shift[0] = 0;
+		s->n        = 1;
+		return;
+	}
+
+	if (zeros > 2 && ones > 2)
+	{
+		for (int c=0;c<64;c+=16)
+		{
+			for (int from=0;from<64;from+=16)
+			{
+				unsigned long b = (u & ~(0xffffUL << c)) | (((u >> from) & 0xffff) << c);
+				if (from == c || encode_bitmask(b) < 0) continue;
+				s->op[0]    = A64_MOVI;
+				s->imm[0]   = (long) b;
+				s->shift[0] = 0;
+				s->op[1]    = A64_MOVK;
+				s->imm[1]   = (u >> c) & 0xffff;
+				s->shift[1] = c;
+				s->n        = 2;
+				return;
+			}
+		}
+	}
+
+	unsigned long fill = ones < zeros ? 0xffff : 0;
+	for (int c=0;c<64;c+=16)
+	{
+		unsigned long chunk = (u >> c) & 0xffff;
+		if (chunk == fill) continue;
+		if (!s->n) s->op[0] = fill ? A64_MOVN : A64_MOVZ;
+		else       s->op[s->n] = A64_MOVK;
+		s->imm[s->n]   = !s->n && fill ? (~chunk & 0xffff) : chunk;
+		s->shift[s->n] = c;
+		s->n++;
+	}
+}
+
+/* label of imm in the current function's literal pool, added if it isn't there yet */
+int a64_pool(long imm)
+{
+	struct a64_func *mf = a64_cur;
+	for (int k=0;k<mf->npool;k++) if (mf->pool[k] == imm) return mf->pool_label[k];
+
+	mf->pool       = realloc(mf->pool, (mf->npool + 1) * sizeof(long));
+	mf->pool_label = realloc(mf->pool_label, (mf->npool + 1) * sizeof(int));
+	mf->pool[mf->npool]       = imm;
+	mf->pool_label[mf->npool] = label_create();
+	return mf->pool_label[mf->npool++];
+}
+
+/* a64_const: put a 64-bit constant in register rd */
+/*
+- the sequence a64_const_plan picks, or a load from the function's literal pool when that would take
+  A64_POOL_MIN instructions or more
+*/
+void a64_const(int rd, long imm)
+{
+	struct a64_const_seq s;
+	a64_const_plan(imm, &s);
+	if (s.n >= A64_POOL_MIN)
+	{
+		a64_emit(A64_LDRLIT, rd, 0, 0)->label = a64_pool(imm);
+		return;
+	}
+
+	for (int k=0;k<s.n;k++)
+	{
+		struct a64_inst *i = a64_emit(s.op[k], rd, 0, 0);
+		i->imm   = s.imm[k];
+		i->shift = s.shift[k];
+	}
+}
+
+/* instructions a64_const takes for imm */
+int a64_const_length(long imm)
+{
+	struct a64_const_seq s;
+	a64_const_plan(imm, &s);
+	return s.n >= A64_POOL_MIN ? 1 : s.n;
+}
+
+/* condition for an IR comparison */
+a64_cond_t a64_cond(ir_op_t op)
+{
+	switch (op)
+	{
+		case IR_EQ: return A64_EQ;
+		case IR_NE: return A64_NE;
+		case IR_LT: return A64_LT;
+		case IR_LE: return A64_LE;
+		case IR_GT: return A64_GT;
+		default:    return A64_GE;
+	}
+}
+
+/* the condition that holds exactly when c doesn't */
+a64_cond_t a64_cond_invert(a64_cond_t c)
+{
+	switch (c)
+	{
+		case A64_EQ: return A64_NE;
+		case A64_NE: return A64_EQ;
+		case A64_LT: return A64_GE;
+		case A64_LE: return A64_GT;
+		case A64_GT: return A64_LE;
+		default:     return A64_LT;
+	}
+}
+
+/* emit a branch to an IR block */
+void a64_branch(a64_op_t op, struct ir_block *target)
+{
+	a64_emit(op, 0, 0, 0)->label = a64_block_lbl[target->id];
+}
+
+/* restore callee-saved registers and pop the frame, everything but the ret */
+void a64_emit_teardown()
+{
+	if (!a64_has_frame) return;
+
+	for (int k=0;k+1<a64_nsaved;k+=2)
+	{
+		struct a64_inst *i = a64_emit(A64_LDP, a64_saved[k], A64_SP, 0);
+		i->ra  = a64_saved[k+1];
+		i->imm = a64_out_bytes + 8 * k;
+	}
+	if (a64_nsaved % 2)
+	{
+		a64_emit(A64_LDR, a64_saved[a64_nsaved-1], A64_SP, 0)->imm = a64_out_bytes + 8 * (a64_nsaved - 1);
+	}
+
+	if (a64_frame_sub) a64_emit(A64_MOV, A64_SP, 29, 0);
+	struct a64_inst *i = a64_emit(A64_LDP_POST, 29, A64_SP, 0);
+	i->ra  = 30;
+	i->imm = 16;
+}
+
+/* a64_imm12: a constant add, sub and cmp take as an immediate, 12 bits shifted by 0 or 12, either sign */
+int a64_imm12(struct burs_node *n)
+{
+	unsigned long v = n->imm < 0 ? -(unsigned long) n->imm : (unsigned long) n->imm;	// the smallest integer has no negation
+	return v < 4096 || (!(v & 0xfff) && v < (4096UL << 12));
+}
+
+/* a64_imm16: a constant a single mov builds */
+int a64_imm16(struct burs_node *n)
+{
+	return (n->imm >= 0 && n->imm <= 0xffff) || (n->imm < 0 && n->imm >= -0x10000);
+}
+
+/* a64_pow2: a power of two a multiply can shift by instead */
+int a64_pow2(struct burs_node *n)
+{
+	return n->imm > 1 && !(n->imm & (n->imm - 1));
+}
+
+/* a64_zero: the constant xzr holds */
+int a64_zero(struct burs_node *n)
+{
+	return n->imm == 0;
+}
+
+/* a64_one: the constant csinc adds */
+int a64_one(struct burs_node *n)
+{
+	return n->imm == 1;
+}
+
+/* is op one the selection rules cover */
+int a64_tree_op(ir_op_t op)
+{
+	switch (op)
+	{
+		case IR_MOV:
+		case IR_ADD:
+		case IR_SUB:
+		case IR_MUL:
+		case IR_DIV:
+		case IR_MOD:
+		case IR_AND:
+		case IR_OR:
+		case IR_NEG:
+		case IR_NOT:
+		case IR_EQ:
+		case IR_NE:
+		case IR_LT:
+		case IR_LE:
+		case IR_GT:
+		case IR_GE:
+		case IR_SEL:
+		case IR_BR:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+/* operands a tree op reads */
+int a64_tree_arity(ir_op_t op)
+{
+	if (op == IR_SEL) return 3;
+	return op == IR_MOV || op == IR_NEG || op == IR_NOT || op == IR_BR ? 1 : 2;
+}
+
+/* a fresh node for the tree being built */
+struct burs_node * a64_node_new()
+{
+	if (a64_nnodes == a64_cap_nodes)
+	{
+		a64_cap_nodes = a64_cap_nodes * 2 + 16;
+		a64_nodes = realloc(a64_nodes, a64_cap_nodes * sizeof(*a64_nodes));
+		for (int k=a64_nnodes;k<a64_cap_nodes;k++) a64_nodes[k] = malloc(sizeof(struct burs_node));
+	}
+	struct burs_node *n = a64_nodes[a64_nnodes++];
+	memset(n, 0, sizeof(*n));
+	return n;
+}
+
+/* a leaf reading vreg v, a constant if v always holds one */
+struct burs_node * a64_leaf(int v)
+{
+	struct burs_node *n = a64_node_new();
+	n->vreg = v;
+	n->op   = a64_known(v, &n->imm) ? IR_CONST : BURS_REG;
+	return n;
+}
+
+/* a64_folded: can p become part of the tree of n, whose operand it computes */
+/*
+- the value has to be read only there and defined only there
+*/
+int a64_folded(struct ir_inst *p, struct ir_inst *n, int *uses)
+{
+	if (!a64_tree_op(n->op)) return 0;
+	if (!a64_tree_op(p->op) || p->op == IR_MOV || p->op == IR_BR) return 0;
+	if (p->dst < 0 || uses[p->dst] != 1 || a64_ndefs[p->dst] != 1) return 0;
+
+	for (int k=0;k<a64_tree_arity(n->op);k++) if (n->src[k] == p->dst) return 1;
+	return 0;
+}
+
+/* a64_tree: the tree rooted at i, with whatever folds into it */
+/*
+- what folds is the instructions right before i, each one with its own tree: going back from i, as long as
+  the next one computes an operand of i, so a tree covers a run of the block and a64_reduce emits the
+  folded instructions in the order the IR has them, they just don't write their registers until i, and
+  nothing in between can have reused the register of an operand before it's read
+- past the instruction right before i, only a value that got a register folds, and no comparison, so the
+  scratch registers and the flags are only ever taken by the last one
+outputs
+- first: the earliest instruction of the run
+*/
+struct burs_node * a64_tree(struct ir_inst *i, int *uses, struct ir_inst **first)
+{
+	struct burs_node *n = a64_node_new();
+	n->op   = i->op;
+	n->inst = i;
+	for (int k=0;k<a64_tree_arity(i->op);k++) n->kids[k] = a64_leaf(i->src[k]);
+
+	*first = i;
+	struct ir_inst *p = i->prev;
+	while (p && a64_folded(p, i, uses))
+	{
+		if (p != i->prev && ((p->op >= IR_EQ && p->op <= IR_GE) || a64_ra->reg[p->dst] == REGALLOC_NONE)) break;
+
+		int k;
+		for (k=0;k<a64_tree_arity(i->op);k++) if (i->src[k] == p->dst && !n->kids[k]->inst) break;
+		if (k == a64_tree_arity(i->op)) break;
+		n->kids[k] = a64_tree(p, uses, first);
+		a64_in_tree[p->dst] = 1;
+		p = (*first)->prev;
+	}
+	return n;
+}
+
+/* count the reads of constants a tree takes as immediates */
+void a64_absorb(struct burs_node *n, int nt)
+{
+	if (!n->inst)
+	{
+		if (n->op == IR_CONST && nt != BURS_NT_reg) a64_absorbed[n->vreg]++;
+		return;
+	}
+
+	struct burs_node *leaves[BURS_MAX_LEAVES];
+	int r = n->rule[nt];
+	int nleaves = burs_leaves(r, n, leaves);
+	for (int k=0;k<nleaves;k++) a64_absorb(leaves[k], burs_rules[r].leaf_nt[k]);
+}
+
+/* a branch a tree ends in, taken to the BR's target when the condition holds, the next block falls through */
+void a64_tree_branch(a64_op_t op, a64_cond_t cond, int rn, struct ir_inst *br)
+{
+	if (br->target == a64_next_bb)
+	{
+		// branch the other way to the false target
+		if (op == A64_BCOND) cond = a64_cond_invert(cond);
+		else                 op   = op == A64_CBZ ? A64_CBNZ : A64_CBZ;
+		struct a64_inst *i = a64_emit(op, 0, rn, 0);
+		i->cond  = cond;
+		i->label = a64_block_lbl[br->target_false->id];
+		return;
+	}
+
+	struct a64_inst *i = a64_emit(op, 0, rn, 0);
+	i->cond  = cond;
+	i->label = a64_block_lbl[br->target->id];
+	if (br->target_false != a64_next_bb) a64_branch(A64_B, br->target_false);
+}
+
+// where the register leaves of a rule are reloaded, in order, when they were spilled
+const int a64_leaf_tmp[3] = { A64_TMP0, A64_TMP1, A64_TMP2 };
+
+/* how far back from root instruction i is, they're in the same run of a tree */
+int a64_distance(struct ir_inst *root, struct ir_inst *i)
+{
+	int d = 0;
+	for (struct ir_inst *p = root; p != i; p = p->prev) d++;
+	return d;
+}
+
+/* a64_reduce: emit the rule picked at n for nonterminal nt */
+/*
+inputs:
+- d: register the result goes in
+- tmp: where to reload a leaf that was spilled
+outputs:
+- the register the value ended up in, a leaf in a register stays where it is
+*/
+int a64_reduce(struct burs_node *n, int nt, int d, int tmp)
+{
+	if (!n->inst) return nt == BURS_NT_reg ? a64_use(n->vreg, tmp) : -1;
+
+	int r = n->rule[nt];
+	const struct burs_rule *rule = &burs_rules[r];
+	struct burs_node *leaves[BURS_MAX_LEAVES];
+	int regs[BURS_MAX_LEAVES];
+	int nleaves = burs_leaves(r, n, leaves);
+
+	int tmps[BURS_MAX_LEAVES];
+	int ntmps = 0;
+	for (int k=0;k<nleaves;k++) tmps[k] = rule->leaf_nt[k] == BURS_NT_reg ? a64_leaf_tmp[ntmps++] : A64_TMP0;
+
+	// the folded instructions first, earliest first, each is computed right here now, into its own register or
+	// a scratch one, or straight into d when all the rule does is copy it there
+	int order[BURS_MAX_LEAVES];
+	int nfolded = 0;
+	for (int k=0;k<nleaves;k++)
+	{
+		if (!leaves[k]->inst) continue;
+		int j = nfolded++;
+		while (j && a64_distance(n->inst, leaves[order[j-1]]->inst) < a64_distance(n->inst, leaves[k]->inst))
+		{
+			order[j] = order[j-1];
+			j--;
+		}
+		order[j] = k;
+	}
+	for (int f=0;f<nfolded;f++)
+	{
+		int k  = order[f];
+		int to = tmps[k];
+		int v  = leaves[k]->inst->dst;
+		if (leaves[k] == n) to = d;
+		else if (rule->len == 1 && rule->tmpl[0].op == A64_MOV) to = d;
+		else if (a64_ra->reg[v] != REGALLOC_NONE) to = a64_ra->reg[v];
+		regs[k] = a64_reduce(leaves[k], rule->leaf_nt[k], to, tmps[k]);
+	}
+	// then the leaves, reloading one doesn't touch the flags a comparison above may have set
+	for (int k=0;k<nleaves;k++)
+	{
+		if (!leaves[k]->inst) regs[k] = a64_reduce(leaves[k], rule->leaf_nt[k], -1, tmps[k]);
+	}
+
+	a64_cur->nselected += rule->len;
+	for (int t=0;t<rule->len;t++)
+	{
+		const struct burs_tmpl *tmpl = &rule->tmpl[t];
+		int field[BURS_NFIELDS] = { 0 };
+		long imm = 0;
+		a64_cond_t cond = A64_EQ;
+		for (int f=0;f<BURS_NFIELDS;f++)
+		{
+			const struct burs_operand *o = &tmpl->f[f];
+			long value = 0;
+			switch (o->kind)
+			{
+				case 'd': value = d;                                          break;
+				case 'r': value = regs[(int) o->leaf];                        break;
+				case 'i': value = leaves[(int) o->leaf]->imm;                 break;
+				case 'l': value = __builtin_ctzl(leaves[(int) o->leaf]->imm); break;
+				case 'k': value = o->value;                                   break;
+				case 't': value = A64_TMP2;                                   break;
+				case 'z': value = A64_XZR;                                    break;
+				case 'c': cond = a64_cond(leaves[(int) o->leaf]->op);         break;
+				case 'n': cond = a64_cond_invert(a64_cond(leaves[(int) o->leaf]->op)); break;
+			}
+			if (f == BURS_IMM)       imm = value;
+			else if (f == BURS_COND) { if (o->kind == 'k') cond = value; }
+			else                     field[f] = value;
+		}
+
+		if (tmpl->op == A64_MOV && field[BURS_RD] == field[BURS_RN]) continue;
+		if (tmpl->op == A64_BCOND || tmpl->op == A64_CBZ || tmpl->op == A64_CBNZ)
+		{
+			a64_tree_branch(tmpl->op, cond, field[BURS_RN], n->inst);
+			continue;
+		}
+
+		struct a64_inst *i = a64_emit(tmpl->op, field[BURS_RD], field[BURS_RN], field[BURS_RM]);
+		i->ra    = field[BURS_RA];
+		i->imm   = imm;
+		i->shift = field[BURS_SHIFT];
+		i->cond  = cond;
+	}
+	return d;
+}
+
+/* a64_select_tree: select an instruction the rules cover, with the instructions folded into it */
+void a64_select_tree(struct ir_inst *i, int *uses)
+{
+	// it's emitted as part of a later instruction
+	if (i->dst >= 0 && a64_in_tree[i->dst]) return;
+
+	struct ir_inst *first;
+	a64_nnodes = 0;
+	struct burs_node *n = a64_tree(i, uses, &first);
+	burs_label(n);
+
+	if (i->op == IR_BR)
+	{
+		a64_cur->nnaive += n->naive[BURS_NT_stmt];
+		a64_reduce(n, BURS_NT_stmt, -1, A64_TMP0);
+		return;
+	}
+
+	a64_cur->nnaive += n->naive[BURS_NT_reg];
+	int d = a64_def(i->dst);
+	a64_reduce(n, BURS_NT_reg, d, A64_TMP0);
+	a64_def_done(i->dst, d);
+}
+
+/* move call arguments into x0-x7 and the outgoing area */
+/*
+- allocated registers are never x0-x7, so the argument registers can be filled in any order without
+  overwriting an argument that hasn't been moved yet
+*/
+void a64_call_args(struct ir_inst *i)
+{
+	for (int k=0;k<i->nargs;k++)
+	{
+		int v = i->args[k];
+		if (k >= 8)
+		{
+			int r = a64_use(v, A64_TMP0);
+			a64_emit(A64_STR, r, A64_SP, 0)->imm = 8 * (k - 8);
+		}
+		else if (a64_ra->reg[v] == REGALLOC_NONE)
+		{
+			a64_use(v, k);
+		}
+		else if (a64_ra->reg[v] != k)
+		{
+			a64_emit(A64_MOV, k, a64_ra->reg[v], 0);
+		}
+	}
+}
+
+/* a64_select_inst: select machine instructions for one IR instruction */
+/*
+returns the instruction to carry on from, which skips ahead when two IR instructions were selected together
+*/
+struct ir_inst * a64_select_inst(struct ir_inst *i, int *uses, struct ir_block *next_bb)
+{
+	int d, a, b, c;
+	a64_next_bb = next_bb;
+
+	switch (i->op)
+	{
+		case IR_CONST:
+		{
+			// a constant every reader takes as an immediate never has to be built
+			int n = a64_const_length(i->imm);
+			a64_cur->nnaive += n;
+			if (a64_absorbed[i->dst] == uses[i->dst]) break;
+
+			a64_cur->nselected += n;
+			d = a64_def(i->dst);
+			a64_const(d, i->imm);
+			a64_def_done(i->dst, d);
+			break;
+		}
+		case IR_MOV:
+		case IR_ADD:
+		case IR_SUB:
+		case IR_MUL:
+		case IR_DIV:
+		case IR_MOD:
+		case IR_AND:
+		case IR_OR:
+		case IR_EQ:
+		case IR_NE:
+		case IR_LT:
+		case IR_LE:
+		case IR_GT:
+		case IR_GE:
+		case IR_NEG:
+		case IR_NOT:
+		case IR_SEL:
+		case IR_BR:
+			a64_select_tree(i, uses);
+			break;
+		case IR_ADDR:
+			d = a64_def(i->dst);
+			a64_emit(A64_ADRP, d, 0, 0)->sym = i->name;
+			a64_emit(A64_ADDLO, d, d, 0)->sym = i->name;
+			a64_def_done(i->dst, d);
+			break;
+		case IR_LOADG:
+			d = a64_def(i->dst);
+			a64_emit(A64_ADRP, d, 0, 0)->sym = i->name;
+			a64_emit(A64_LDRLO, d, d, 0)->sym = i->name;
+			a64_def_done(i->dst, d);
+			break;
+		case IR_STOREG:
+			a = a64_use(i->src[0], A64_TMP0);
+			a64_emit(A64_ADRP, A64_TMP1, 0, 0)->sym = i->name;
+			a64_emit(A64_STRLO, a, A64_TMP1, 0)->sym = i->name;
+			break;
+		case IR_LOAD:
+		case IR_STORE:
+		{
+			int load = i->op == IR_LOAD;
+			a = a64_use(i->src[0], A64_TMP0);
+			b = i->src[1] != IR_NO_REG ? a64_use(i->src[1], A64_TMP1) : -1;
+			c = load ? a64_def(i->dst) : a64_use(i->src[2], A64_TMP2);
+
+			// "ldr x, [p]" followed by "p = p + k" is a single post-indexed access
+			struct ir_inst *n = i->next;
+			long k;
+			if (b < 0 && !i->imm && n && n->op == IR_ADD && n->dst == i->src[0] && a == a64_ra->reg[i->src[0]]
+				&& ((n->src[0] == n->dst && a64_known(n->src[1], &k)) || (n->src[1] == n->dst && a64_known(n->src[0], &k)))
+				&& k >= -256 && k < 256 && !(load && c == a))
+			{
+				a64_emit(load ? A64_LDR_POST : A64_STR_POST, c, a, 0)->imm = k;
+				if (load) a64_def_done(i->dst, c);
+				return n;
+			}
+
+			if (b >= 0 && i->imm)
+			{
+				// base + offset first, the indexed form has no room for both
+				a64_emit(A64_ADDI, A64_TMP0, a, 0)->imm = i->imm;
+				a = A64_TMP0;
+			}
+			if (b >= 0) a64_emit(load ? A64_LDRX : A64_STRX, c, a, b);
+			else        a64_emit(load ? A64_LDR  : A64_STR,  c, a, 0)->imm = i->imm;
+
+			if (load) a64_def_done(i->dst, c);
+			break;
+		}
+		case IR_VLOAD:
+		case IR_VSTORE:
+		{
+			int load = i->op == IR_VLOAD;
+			a = a64_use(i->src[0], A64_TMP0);
+			b = i->src[1] != IR_NO_REG ? a64_use(i->src[1], A64_TMP1) : -1;
+
+			struct ir_inst *n = i->next;
+			long k;
+			if (b < 0 && !i->imm && n && n->op == IR_ADD && n->dst == i->src[0] && a == a64_ra->reg[i->src[0]]
+				&& ((n->src[0] == n->dst && a64_known(n->src[1], &k)) || (n->src[1] == n->dst && a64_known(n->src[0], &k)))
+				&& k >= -256 && k < 256)
+			{
+				a64_emit(load ? A64_LDRQ_POST : A64_STRQ_POST, i->vec[0], a, 0)->imm = k;
+				return n;
+			}
+
+			long imm = i->imm;
+			if (b >= 0)
+			{
+				// no scaled index for 8-byte elements of a 16-byte register, the address is worked out first
+				a64_emit(A64_ADD, A64_TMP0, a, b)->shift = 3;
+				a = A64_TMP0;
+			}
+			if ((imm < 0 || imm % 16 || imm > 65520) && (imm < -256 || imm > 255))
+			{
+				a64_emit(A64_ADDI, A64_TMP0, a, 0)->imm = imm;
+				a = A64_TMP0;
+				imm = 0;
+			}
+			a64_emit(load ? A64_LDRQ : A64_STRQ, i->vec[0], a, 0)->imm = imm;
+			break;
+		}
+		case IR_VDUP:
+			a = a64_use(i->src[0], A64_TMP0);
+			a64_emit(A64_DUP, i->vec[0], a, 0);
+			break;
+		case IR_VBIN:
+			a64_emit(i->imm == IR_ADD ? A64_VADD : A64_VSUB, i->vec[0], i->vec[1], i->vec[2]);
+			break;
+		case IR_VSUM:
+			// the register is an accumulator on its way out, its low lane can take the sum
+			d = a64_def(i->dst);
+			a64_emit(A64_ADDP, i->vec[1], i->vec[1], 0);
+			a64_emit(A64_FMOV, d, i->vec[1], 0);
+			a64_def_done(i->dst, d);
+			break;
+		case IR_CALL:
+			a64_call_args(i);
+
+			// a call whose result is returned right away doesn't have to come back here
+			if (i->tail && i->nargs <= 8 && i->next && i->next->op == IR_RET && i->next->src[0] == i->dst)
+			{
+				a64_emit_teardown();
+				a64_emit(A64_B, 0, 0, 0)->sym = i->name;
+				return i->next;
+			}
+
+			a64_emit(A64_BL, 0, 0, 0)->sym = i->name;
+			if (i->dst != IR_NO_REG)
+			{
+				d = a64_def(i->dst);
+				a64_emit(A64_MOV, d, 0, 0);
+				a64_def_done(i->dst, d);
+			}
+			break;
+		case IR_JMP:
+			if (i->target != next_bb) a64_branch(A64_B, i->target);
+			break;
+		case IR_RET:
+			if (i->src[0] != IR_NO_REG)
+			{
+				if (a64_ra->reg[i->src[0]] == REGALLOC_NONE) a64_use(i->src[0], 0);
+				else a64_emit(A64_MOV, 0, a64_ra->reg[i->src[0]], 0);
+			}
+			// the epilogue comes right after the last block
+			if (next_bb) a64_emit(A64_B, 0, 0, 0)->label = a64_epilogue;
+			break;
+		case IR_PHI:
+			printf("codegen error: phi left in %s, SSA has to be taken down before instruction selection\n", a64_cur->name);
+			exit(1);
+	}
+
+	return i;
+}
+
+/* aarch64_select: select instructions for a whole function, prologue and epilogue included */
+struct a64_func * aarch64_select(struct ir_func *f)
+{
+	struct a64_func *mf = calloc(1, sizeof(*mf));
+	mf->name = f->name;
+	a64_cur  = mf;
+
+	a64_ra = regalloc_run(f, a64_caller_regs, A64_NCALLER, a64_callee_regs, A64_NCALLEE);
+
+	// frame layout
+	a64_nsaved = 0;
+	for (int k=0;k<A64_NCALLEE;k++)
+	{
+		if (a64_ra->used & (1ULL << a64_callee_regs[k])) a64_saved[a64_nsaved++] = a64_callee_regs[k];
+	}
+	a64_out_bytes = a64_ra->max_args > 8 ? (a64_ra->max_args - 8) * 8 : 0;
+	a64_frame_sub = (a64_out_bytes + 8 * (a64_nsaved + a64_ra->nslots) + 15) & ~15;
+	a64_has_frame = a64_ra->ncalls || a64_frame_sub;
+
+	// labels for every block, and how often each vreg gets read
+	a64_block_lbl = realloc(a64_block_lbl, (f->nblocks + 1) * sizeof(int));
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next) a64_block_lbl[bb->id] = label_create();
+	a64_epilogue = label_create();
+
+	int *uses = calloc(f->nvregs + 1, sizeof(int));
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			int *slot;
+			for (int k=0;(slot = ir_inst_use(i, k));k++) if (*slot >= 0) uses[*slot]++;
+		}
+	}
+
+	// vregs defined once, by a constant
+	a64_ndefs = realloc(a64_ndefs, (f->nvregs + 1) * sizeof(int));
+	memset(a64_ndefs, 0, (f->nvregs + 1) * sizeof(int));
+	a64_const_def = realloc(a64_const_def, (f->nvregs + 1) * sizeof(*a64_const_def));
+	memset(a64_const_def, 0, (f->nvregs + 1) * sizeof(*a64_const_def));
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			if (i->dst < 0) continue;
+			a64_ndefs[i->dst]++;
+			a64_const_def[i->dst] = i->op == IR_CONST && a64_ndefs[i->dst] == 1 ? i : 0;
+		}
+	}
+	for (int p=0;p<f->nparams;p++)
+	{
+		a64_const_def[p] = 0;
+		a64_ndefs[p]++;
+	}
+
+	// build and label every tree once up front, last to first in each block so the instructions folded into
+	// one are known before they're reached, and to see which constants are only ever read as immediates
+	a64_absorbed = realloc(a64_absorbed, (f->nvregs + 1) * sizeof(int));
+	memset(a64_absorbed, 0, (f->nvregs + 1) * sizeof(int));
+	a64_in_tree = realloc(a64_in_tree, f->nvregs + 1);
+	memset(a64_in_tree, 0, f->nvregs + 1);
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->last; i; i = i->prev)
+		{
+			if (!a64_tree_op(i->op) || (i->dst >= 0 && a64_in_tree[i->dst])) continue;
+			struct ir_inst *first;
+			a64_nnodes = 0;
+			struct burs_node *n = a64_tree(i, uses, &first);
+			burs_label(n);
+			a64_absorb(n, i->op == IR_BR ? BURS_NT_stmt : BURS_NT_reg);
+		}
+	}
+
+	// prologue
+	if (a64_has_frame)
+	{
+		struct a64_inst *i = a64_emit(A64_STP_PRE, 29, A64_SP, 0);
+		i->ra  = 30;
+		i->imm = -16;
+		a64_emit(A64_MOV, 29, A64_SP, 0);
+		if (a64_frame_sub) a64_emit(A64_SUBI, A64_SP, A64_SP, 0)->imm = a64_frame_sub;
+
+		for (int k=0;k+1<a64_nsaved;k+=2)
+		{
+			i = a64_emit(A64_STP, a64_saved[k], A64_SP, 0);
+			i->ra  = a64_saved[k+1];
+			i->imm = a64_out_bytes + 8 * k;
+		}
+		if (a64_nsaved % 2)
+		{
+			a64_emit(A64_STR, a64_saved[a64_nsaved-1], A64_SP, 0)->imm = a64_out_bytes + 8 * (a64_nsaved - 1);
+		}
+	}
+
+	// parameters go from x0-x7 (or the caller's stack) to wherever they were allocated
+	for (int p=0;p<f->nparams;p++)
+	{
+		int r    = a64_ra->reg[p];
+		int slot = a64_ra->slot[p];
+		if (r == REGALLOC_NONE && slot < 0) continue; // never used
+
+		int src = p;
+		if (p >= 8)
+		{
+			src = r != REGALLOC_NONE ? r : A64_TMP0;
+			if (a64_has_frame) a64_emit(A64_LDR, src, 29, 0)->imm = 16 + 8 * (p - 8);
+			else               a64_emit(A64_LDR, src, A64_SP, 0)->imm = 8 * (p - 8);
+		}
+
+		if (r != REGALLOC_NONE)
+		{
+			if (r != src) a64_emit(A64_MOV, r, src, 0);
+		}
+		else
+		{
+			a64_emit(A64_STR, src, A64_SP, 0)->imm = a64_slot_offset(p);
+		}
+	}
+
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		a64_emit(A64_LABEL, 0, 0, 0)->label = a64_block_lbl[bb->id];
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			i = a64_select_inst(i, uses, bb->next);
+		}
+	}
+
+	// epilogue
+	a64_emit(A64_LABEL, 0, 0, 0)->label = a64_epilogue;
+	a64_emit_teardown();
+	a64_emit(A64_RET, 0, 0, 0);
+
+	// a branch straight to the label right after it does nothing, turn it into a label that gets dropped below
+	for (struct a64_inst *i = mf->first; i; i = i->next)
+	{
+		struct a64_inst *n = i->next;
+		if (i->op == A64_B && i->label >= 0 && n && n->op == A64_LABEL && n->label == i->label)
+		{
+			i->op    = A64_LABEL;
+			i->label = -1;
+		}
+	}
+
+	// drop the labels nothing branches to
+	// (the literal pool's labels aren't in the code)
+	int *targeted = calloc(a64_epilogue + 1, sizeof(int));
+	for (struct a64_inst *i = mf->first; i; i = i->next)
+	{
+		if (i->op != A64_LABEL && i->op != A64_LDRLIT && i->label >= 0) targeted[i->label] = 1;
+	}
+	struct a64_inst **link = &mf->first;
+	mf->last = 0;
+	while (*link)
+	{
+		struct a64_inst *i = *link;
+		if (i->op == A64_LABEL && (i->label < 0 || !targeted[i->label]))
+		{
+			*link = i->next;
+			free(i);
+			continue;
+		}
+		mf->last = i;
+		link = &i->next;
+	}
+
+	free(targeted);
+	free(uses);
+	regalloc_delete(a64_ra);
+	a64_ra = 0;
+
+	// the labels are final now, so are the regions between them
+	sched_func(mf, opt_level >= 2);
+
+	return mf;
+}
+
+/* name of a register as it appears in the assembly */
+const char * a64_reg_name(int r)
+{
+	static char names[33][4];
+	if (r == A64_SP)  return "sp";
+	if (r == A64_XZR) return "xzr";
+	sprintf(names[r], "x%i", r);
+	return names[r];
+}
+
+/* name of a condition code */
+const char * a64_cond_name(a64_cond_t c)
+{
+	switch (c)
+	{
+		case A64_EQ: return "eq";
+		case A64_NE: return "ne";
+		case A64_LT: return "lt";
+		case A64_LE: return "le";
+		case A64_GT: return "gt";
+		default:     return "ge";
+	}
+}
+
+/* aarch64_print_inst: print one machine instruction */
+void aarch64_print_inst(struct a64_inst *i, FILE *out)
+{
+	// registers are looked up one at a time since a64_reg_name reuses its buffers per register
+	const char *rd = a64_reg_name(i->rd);
+	const char *rn = a64_reg_name(i->rn);
+	const char *rm = a64_reg_name(i->rm);
+	const char *ra = a64_reg_name(i->ra);
+
+	switch (i->op)
+	{
+		case A64_LABEL:
+			fprintf(out, "%s:\n", label_name(i->label));
+			break;
+		case A64_MOV:
+			fprintf(out, "\tmov\t%s, %s\n", rd, rn);
+			break;
+		case A64_MOVI:
+			fprintf(out, "\tmov\t%s, %li\n", rd, i->imm);
+			break;
+		case A64_MOVZ:
+		case A64_MOVN:
+		case A64_MOVK:
+		{
+			const char *op = i->op == A64_MOVZ ? "movz" : i->op == A64_MOVN ? "movn" : "movk";
+			if (i->shift) fprintf(out, "\t%s\t%s, %li, lsl %i\n", op, rd, i->imm, i->shift);
+			else          fprintf(out, "\t%s\t%s, %li\n", op, rd, i->imm);
+			break;
+		}
+		case A64_ADD:
+			if (i->shift) fprintf(out, "\tadd\t%s, %s, %s, lsl %i\n", rd, rn, rm, i->shift);
+			else          fprintf(out, "\tadd\t%s, %s, %s\n", rd, rn, rm);
+			break;
+		case A64_ADDI:
+			fprintf(out, "\tadd\t%s, %s, %li\n", rd, rn, i->imm);
+			break;
+		case A64_SUB:
+			if (i->shift) fprintf(out, "\tsub\t%s, %s, %s, lsl %i\n", rd, rn, rm, i->shift);
+			else          fprintf(out, "\tsub\t%s, %s, %s\n", rd, rn, rm);
+			break;
+		case A64_SUBI:
+			fprintf(out, "\tsub\t%s, %s, %li\n", rd, rn, i->imm);
+			break;
+		case A64_MUL:
+			fprintf(out, "\tmul\t%s, %s, %s\n", rd, rn, rm);
+			break;
+		case A64_SDIV:
+			fprintf(out, "\tsdiv\t%s, %s, %s\n", rd, rn, rm);
+			break;
+		case A64_MADD:
+			fprintf(out, "\tmadd\t%s, %s, %s, %s\n", rd, rn, rm, ra);
+			break;
+		case A64_MSUB:
+			fprintf(out, "\tmsub\t%s, %s, %s, %s\n", rd, rn, rm, ra);
+			break;
+		case A64_LSLI:
+			fprintf(out, "\tlsl\t%s, %s, %li\n", rd, rn, i->imm);
+			break;
+		case A64_AND:
+			fprintf(out, "\tand\t%s, %s, %s\n", rd, rn, rm);
+			break;
+		case A64_ORR:
+			fprintf(out, "\torr\t%s, %s, %s\n", rd, rn, rm);
+			break;
+		case A64_EORI:
+			fprintf(out, "\teor\t%s, %s, %li\n", rd, rn, i->imm);
+			break;
+		case A64_NEG:
+			fprintf(out, "\tneg\t%s, %s\n", rd, rm);
+			break;
+		case A64_CMP:
+			fprintf(out, "\tcmp\t%s, %s\n", rn, rm);
+			break;
+		case A64_CMPI:
+			fprintf(out, "\tcmp\t%s, %li\n", rn, i->imm);
+			break;
+		case A64_CSET:
+			fprintf(out, "\tcset\t%s, %s\n", rd, a64_cond_name(i->cond));
+			break;
+		case A64_CINC:
+			fprintf(out, "\tcinc\t%s, %s, %s\n", rd, rn, a64_cond_name(i->cond));
+			break;
+		case A64_CSEL:
+			fprintf(out, "\tcsel\t%s, %s, %s, %s\n", rd, rn, rm, a64_cond_name(i->cond));
+			break;
+		case A64_CSINC:
+		case A64_CSNEG:
+			if (i->rn == i->rm)
+			{
+				fprintf(out, "\t%s\t%s, %s, %s\n", i->op == A64_CSINC ? "cinc" : "cneg", rd, rn, a64_cond_name(a64_cond_invert(i->cond)));
+				break;
+			}
+			fprintf(out, "\t%s\t%s, %s, %s, %s\n", i->op == A64_CSINC ? "csinc" : "csneg", rd, rn, rm, a64_cond_name(i->cond));
+			break;
+		case A64_LDR:
+		case A64_STR:
+			if (i->imm) fprintf(out, "\t%s\t%s, [%s, %li]\n", i->op == A64_LDR ? "ldr" : "str", rd, rn, i->imm);
+			else        fprintf(out, "\t%s\t%s, [%s]\n", i->op == A64_LDR ? "ldr" : "str", rd, rn);
+			break;
+		case A64_LDRX:
+		case A64_STRX:
+			fprintf(out, "\t%s\t%s, [%s, %s, lsl 3]\n", i->op == A64_LDRX ? "ldr" : "str", rd, rn, rm);
+			break;
+		case A64_LDR_POST:
+		case A64_STR_POST:
+			fprintf(out, "\t%s\t%s, [%s], %li\n", i->op == A64_LDR_POST ? "ldr" : "str", rd, rn, i->imm);
+			break;
+		case A64_LDP:
+		case A64_STP:
+			fprintf(out, "\t%s\t%s, %s, [%s, %li]\n", i->op == A64_LDP ? "ldp" : "stp", rd, ra, rn, i->imm);
+			break;
+		case A64_STP_PRE:
+			fprintf(out, "\tstp\t%s, %s, [%s, %li]!\n", rd, ra, rn, i->imm);
+			break;
+		case A64_LDP_POST:
+			fprintf(out, "\tldp\t%s, %s, [%s], %li\n", rd, ra, rn, i->imm);
+			break;
+		case A64_ADRP:
+			fprintf(out, "\tadrp\t%s, %s\n", rd, i->sym);
+			break;
+		case A64_ADDLO:
+			fprintf(out, "\tadd\t%s, %s, :lo12:%s\n", rd, rn, i->sym);
+			break;
+		case A64_LDRLO:
+			fprintf(out, "\tldr\t%s, [%s, :lo12:%s]\n", rd, rn, i->sym);
+			break;
+		case A64_STRLO:
+			fprintf(out, "\tstr\t%s, [%s, :lo12:%s]\n", rd, rn, i->sym);
+			break;
+		case A64_LDRLIT:
+			fprintf(out, "\tldr\t%s, %s\n", rd, label_name(i->label));
+			break;
+		case A64_B:
+			if (i->label >= 0) fprintf(out, "\tb\t%s\n", label_name(i->label));
+			else               fprintf(out, "\tb\t%s\n", i->sym);
+			break;
+		case A64_BCOND:
+			fprintf(out, "\tb.%s\t%s\n", a64_cond_name(i->cond), label_name(i->label));
+			break;
+		case A64_CBZ:
+		case A64_CBNZ:
+			fprintf(out, "\t%s\t%s, %s\n", i->op == A64_CBZ ? "cbz" : "cbnz", rn, label_name(i->label));
+			break;
+		case A64_BL:
+			fprintf(out, "\tbl\t%s\n", i->sym);
+			break;
+		case A64_RET:
+			fprintf(out, "\tret\n");
+			break;
+		case A64_LDRQ:
+		case A64_STRQ:
+		{
+			const char *op = i->op == A64_LDRQ ? "ldr" : "str";
+			if (i->imm < 0 || i->imm % 16) fprintf(out, "\t%s\tq%i, [%s, %li]\n", i->op == A64_LDRQ ? "ldur" : "stur", i->rd, rn, i->imm);
+			else if (i->imm)               fprintf(out, "\t%s\tq%i, [%s, %li]\n", op, i->rd, rn, i->imm);
+			else                           fprintf(out, "\t%s\tq%i, [%s]\n", op, i->rd, rn);
+			break;
+		}
+		case A64_LDRQ_POST:
+		case A64_STRQ_POST:
+			fprintf(out, "\t%s\tq%i, [%s], %li\n", i->op == A64_LDRQ_POST ? "ldr" : "str", i->rd, rn, i->imm);
+			break;
+		case A64_DUP:
+			fprintf(out, "\tdup\tv%i.2d, %s\n", i->rd, rn);
+			break;
+		case A64_VADD:
+		case A64_VSUB:
+			fprintf(out, "\t%s\tv%i.2d, v%i.2d, v%i.2d\n", i->op == A64_VADD ? "add" : "sub", i->rd, i->rn, i->rm);
+			break;
+		case A64_ADDP:
+			fprintf(out, "\taddp\td%i, v%i.2d\n", i->rd, i->rn);
+			break;
+		case A64_FMOV:
+			fprintf(out, "\tfmov\t%s, d%i\n", rd, i->rn);
+			break;
+	}
+}
+
+/* aarch64_size: bytes of code a selected function takes, every instruction is 4, and its literal pool */
+int aarch64_size(struct a64_func *mf)
+{
+	int n = 0;
+	for (struct a64_inst *i = mf->first; i; i = i->next) if (i->op != A64_LABEL) n++;
+	return 4 * n + 8 * mf->npool;
+}
+
+/* aarch64_print_const: build a constant in the register named rd, for code that's printed as it goes */
+/*
+- the same sequence the IR backend would pick, there's no literal pool to put it in
+*/
+void aarch64_print_const(const char *rd, long imm, FILE *out)
+{
+	struct a64_const_seq s;
+	a64_const_plan(imm, &s);
+	for (int k=0;k<s.n;k++)
+	{
+		const char *op = s.op[k] == A64_MOVZ ? "movz" : s.op[k] == A64_MOVN ? "movn" : "movk";
+		if (s.op[k] == A64_MOVI) fprintf(out, "\tmov\t%s, %li\n", rd, s.imm[k]);
+		else if (s.shift[k])     fprintf(out, "\t%s\t%s, %li, lsl %i\n", op, rd, s.imm[k], s.shift[k]);
+		else                     fprintf(out, "\t%s\t%s, %li\n", op, rd, s.imm[k]);
+	}
+}
+
+/* aarch64_print_func: print a selected function along with its directives */
+void aarch64_print_func(struct a64_func *mf, FILE *out)
+{
+	fprintf(out, "\t.text\n");
+	fprintf(out, "\t.align\t2\n");
+	fprintf(out, "\t.global\t%s\n", mf->name);
+	fprintf(out, "\t.type\t%s, %%function\n", mf->name);
+	fprintf(out, "%s:\n", mf->name);
+
+	for (struct a64_inst *i = mf->first; i; i = i->next)
+	{
+		aarch64_print_inst(i, out);
+	}
+
+	// the literal pool comes after the code, nothing falls into it
+	if (mf->npool) fprintf(out, "\t.align\t3\n");
+	for (int k=0;k<mf->npool;k++)
+	{
+		fprintf(out, "%s:\n", label_name(mf->pool_label[k]));
+		fprintf(out, "\t.xword\t%li\n", mf->pool[k]);
+	}
+
+	fprintf(out, "\t.size\t%s, .-%s\n", mf->name, mf->name);
+}
+
+/* aarch64_codegen: select and print every function of the program */
+void aarch64_codegen(struct ir_program *p, FILE *out)
+{
+	for (struct ir_func *f = p->funcs; f; f = f->next)
+	{
+		struct a64_func *mf = aarch64_select(f);
+		aarch64_print_func(mf, out);
+		aarch64_selected += mf->nselected;
+		aarch64_naive    += mf->nnaive;
+		aarch64_cycles_before += mf->cycles_before;
+		aarch64_cycles_after  += mf->cycles_after;
+		aarch64_pooled        += mf->npool;
+	}
+	printf("select: %i instructions for arithmetic, comparisons, copies and branches, %i one IR instruction at a time\n",
+		aarch64_selected, aarch64_naive);
+	printf("sched: %i cycles predicted on %s in program order, %i as scheduled\n",
+		aarch64_cycles_before, sched_cpu->name, aarch64_cycles_after);
+	printf("pool: %i constants loaded from literal pools\n", aarch64_pooled);
+}
@@ -0,0 +1,137 @@
+#ifndef AARCH64_H
+#define AARCH64_H
+
+#include "ir.h"
+#include <stdio.h>
+
+/*
+- AArch64 backend: selects machine instructions from the IR, one function at a time
+- instructions are built as a list first and only printed once the whole function is done,
+  that way the prologue can depend on what the body ended up needing
+- arithmetic, comparisons and branches are selected by tree pattern matching with the rules in aarch64.brg
+- at -O2 the selected code is scheduled for the core -mcpu= picks (see sched.h)
+*/
+
+// registers are numbered like the hardware, x0-x30, plus these two that share encoding 31
+#define A64_SP  (31)
+#define A64_XZR (32)
+
+// scratch registers the backend keeps to itself: reloading spilled operands and multi-instruction sequences
+#define A64_TMP0 (16)
+#define A64_TMP1 (17)
+#define A64_TMP2 (8)
+
+typedef enum {
+	A64_LABEL,		// label:
+	A64_MOV,		// mov rd, rn
+	A64_MOVI,		// mov rd, #imm (anything a single movz, movn or orr with a bitmask can build)
+	A64_MOVZ,		// movz rd, #imm, lsl #shift
+	A64_MOVN,		// movn rd, #imm, lsl #shift
+	A64_MOVK,		// movk rd, #imm, lsl #shift
+	A64_ADD,		// add rd, rn, rm, lsl #shift
+	A64_ADDI,		// add rd, rn, #imm
+	A64_SUB,		// sub rd, rn, rm, lsl #shift
+	A64_SUBI,		// sub rd, rn, #imm
+	A64_MUL,		// mul rd, rn, rm
+	A64_SDIV,		// sdiv rd, rn, rm
+	A64_MADD,		// madd rd, rn, rm, ra
+	A64_MSUB,		// msub rd, rn, rm, ra
+	A64_LSLI,		// lsl rd, rn, #imm
+	A64_AND,		// and rd, rn, rm
+	A64_ORR,		// orr rd, rn, rm
+	A64_EORI,		// eor rd, rn, #imm
+	A64_NEG,		// neg rd, rm
+	A64_CMP,		// cmp rn, rm
+	A64_CMPI,		// cmp rn, #imm
+	A64_CSET,		// cset rd, cond
+	A64_CINC,		// cinc rd, rn, cond
+	A64_CSEL,		// csel rd, rn, rm, cond
+	A64_CSINC,		// csinc rd, rn, rm, cond, printed as cinc when rn and rm are the same
+	A64_CSNEG,		// csneg rd, rn, rm, cond, printed as cneg when rn and rm are the same
+	A64_LDR,		// ldr rd, [rn, #imm]
+	A64_STR,		// str rd, [rn, #imm]
+	A64_LDRX,		// ldr rd, [rn, rm, lsl #3]
+	A64_STRX,		// str rd, [rn, rm, lsl #3]
+	A64_LDR_POST,	// ldr rd, [rn], #imm
+	A64_STR_POST,	// str rd, [rn], #imm
+	A64_LDP,		// ldp rd, ra, [rn, #imm]
+	A64_STP,		// stp rd, ra, [rn, #imm]
+	A64_STP_PRE,	// stp rd, ra, [rn, #imm]!
+	A64_LDP_POST,	// ldp rd, ra, [rn], #imm
+	A64_ADRP,		// adrp rd, sym
+	A64_ADDLO,		// add rd, rn, :lo12:sym
+	A64_LDRLO,		// ldr rd, [rn, :lo12:sym]
+	A64_STRLO,		// str rd, [rn, :lo12:sym]
+	A64_LDRLIT,		// ldr rd, label, the label of a constant in the function's literal pool
+	A64_B,			// b label, or b sym for a tail call
+	A64_BCOND,		// b.cond label
+	A64_CBZ,		// cbz rn, label
+	A64_CBNZ,		// cbnz rn, label
+	A64_BL,			// bl sym
+	A64_RET,		// ret
+
+	// Advanced SIMD, rd/rn/rm are vector register numbers here (except the x registers noted)
+	A64_LDRQ,		// ldr qd, [xn, #imm], ldur when imm doesn't scale
+	A64_STRQ,		// str qd, [xn, #imm], stur when imm doesn't scale
+	A64_LDRQ_POST,	// ldr qd, [xn], #imm
+	A64_STRQ_POST,	// str qd, [xn], #imm
+	A64_DUP,		// dup vd.2d, xn
+	A64_VADD,		// add vd.2d, vn.2d, vm.2d
+	A64_VSUB,		// sub vd.2d, vn.2d, vm.2d
+	A64_ADDP,		// addp dd, vn.2d
+	A64_FMOV		// fmov xd, dn
+} a64_op_t;
+
+typedef enum {
+	A64_EQ,
+	A64_NE,
+	A64_LT,
+	A64_LE,
+	A64_GT,
+	A64_GE
+} a64_cond_t;
+
+struct a64_inst {
+	a64_op_t op;
+	int rd;
+	int rn;
+	int rm;
+	int ra;
+	long imm;
+	int shift;
+	a64_cond_t cond;
+	const char *sym;
+	int label;			// -1 when the target is sym instead
+	struct a64_inst *next;
+};
+
+struct a64_func {
+	const char *name;
+	int nselected;		// instructions the selection rules emitted
+	int nnaive;			// what one IR instruction at a time would have taken for the same code
+	int cycles_before;	// predicted by the model of the core, in program order and as scheduled (see sched.h)
+	int cycles_after;
+	struct a64_inst *first;
+	struct a64_inst *last;
+	long *pool;			// constants too long to build, emitted after the code, each under its own label
+	int *pool_label;
+	int npool;
+};
+
+extern int aarch64_selected;		// over the whole program, see struct a64_func
+extern int aarch64_naive;
+extern int aarch64_cycles_before;
+extern int aarch64_cycles_after;
+extern int aarch64_pooled;			// constants put in literal pools
+
+struct a64_func * aarch64_select( struct ir_func *f );
+
+int aarch64_size( struct a64_func *mf );
+
+void aarch64_print_inst( struct a64_inst *i, FILE *out );
+void aarch64_print_const( const char *rd, long imm, FILE *out );
+void aarch64_print_func( struct a64_func *mf, FILE *out );
+
+void aarch64_codegen( struct ir_program *p, FILE *out );
+
+#endif
@@ -0,0 +1,486 @@
+#!/usr/bin/env python3
+# A small AArch64 simulator that runs the assembly bminor generates straight from the text, so the code generator
+# can be checked and measured without an ARM machine or an assembler.
+#
+# - covers the instructions the backend emits (integer, the 2d Advanced SIMD forms the vectorizer uses, literal
+#   pools in .text) and the runtime library calls, which are done natively: print_values, print_*,
+#   integer_power, and the write/exit system calls of the freestanding runtime
+# - a native call clobbers x1-x18 with junk like a real callee could, so a value the code forgets to save shows
+# - prints the program's output, then its exit code, on stdout and the instructions it executed on stderr
+#
+# For example:
+#     ./bminor -codegen tests/student/codegen/good26.bminor good26.s
+#     python3 bench/armsim.py good26.s
+import sys, re, struct
+M64 = (1 << 64) - 1
+def s64(v):
+    v &= M64
+    return v - (1 << 64) if v >> 63 else v
+
+class Sim:
+    def __init__(self, text, natives=None):
+        self.mem = bytearray(1 << 22)
+        self.labels = {}
+        self.insts = []          # (label_ctx, mnemonic, ops, line)
+        self.data_ptr = 0x1000
+        self.x = [0] * 32
+        self.v = [[0, 0] for _ in range(32)]
+        self.sp = len(self.mem) - 16
+        self.flags = (0, 0, 0, 0)
+        self.out = []
+        self.icount = 0
+        self.natives = natives or {}
+        self.parse(text)
+
+    def unesc(self, s):
+        s = s.strip()
+        assert s[0] == '"'
+        s = s[1:-1]
+        out = bytearray(); i = 0
+        while i < len(s):
+            c = s[i]
+            if c == '\\':
+                i += 1; c = s[i]
+                if c == 'n': out.append(10)
+                elif c == 't': out.append(9)
+                elif c in '01234567':
+                    j = i
+                    while j < len(s) and j < i + 3 and s[j] in '01234567': j += 1
+                    out.append(int(s[i:j], 8)); i = j; continue
+                else: out.append(ord(c))
+            else: out.append(ord(c))
+            i += 1
+        return bytes(out)
+
+    def parse(self, text):
+        section = 'text'
+        pending_relocs = []
+        for raw in text.split('\n'):
+            line = raw.split('//')[0].rstrip()
+            if not line.strip(): continue
+            m = re.match(r'^([A-Za-z_.$][\w.$]*):(.*)$', line.strip())
+            if m:
+                lab = m.group(1)
+                if section == 'text': self.labels[lab] = ('text', len(self.insts))
+                else: self.labels[lab] = ('data', self.data_ptr)
+                line = m.group(2)
+                if not line.strip(): continue
+            t = line.strip()
+            if t.startswith('.'):
+                parts = t.split(None, 1)
+                d = parts[0]; arg = parts[1] if len(parts) > 1 else ''
+                if d == '.text': section = 'text'
+                elif d in ('.data', '.bss'): section = 'data'
+                elif d == '.section':
+                    section = 'text' if arg.startswith('.text') else 'data'
+                elif d == '.align' or d == '.p2align':
+                    a = 1 << int(arg.split(',')[0])
+                    if section == 'data': self.data_ptr = (self.data_ptr + a - 1) & ~(a - 1)
+                elif d == '.balign':
+                    a = int(arg.split(',')[0])
+                    if section == 'data': self.data_ptr = (self.data_ptr + a - 1) & ~(a - 1)
+                elif d in ('.xword', '.quad', '.dword', '.word', '.byte', '.hword', '.short', '.long', '.4byte', '.8byte'):
+                    if section == 'text':
+                        # literal pool in code: its labels point at data instead
+                        self.data_ptr = (self.data_ptr + 7) & ~7
+                        for lab, where in list(self.labels.items()):
+                            if where == ('text', len(self.insts)): self.labels[lab] = ('data', self.data_ptr)
+                    size = {'.xword': 8, '.quad': 8, '.dword': 8, '.8byte': 8, '.word': 4, '.long': 4, '.4byte': 4, '.hword': 2, '.short': 2, '.byte': 1}[d]
+                    for item in arg.split(','):
+                        item = item.strip()
+                        try:
+                            val = int(item, 0)
+                            self.mem[self.data_ptr:self.data_ptr + size] = (val & ((1 << (8 * size)) - 1)).to_bytes(size, 'little')
+                        except ValueError:
+                            pending_relocs.append((self.data_ptr, item, size))
+                        self.data_ptr += size
+                elif d in ('.string', '.asciz'):
+                    b = self.unesc(arg) + b'\0'
+                    self.mem[self.data_ptr:self.data_ptr + len(b)] = b; self.data_ptr += len(b)
+                elif d == '.ascii':
+                    b = self.unesc(arg)
+                    self.mem[self.data_ptr:self.data_ptr + len(b)] = b; self.data_ptr += len(b)
+                elif d in ('.zero', '.skip', '.space'):
+                    self.data_ptr += int(arg.split(',')[0], 0)
+                elif d in ('.comm', '.lcomm'):
+                    name, size = [p.strip() for p in arg.split(',')[:2]]
+                    self.data_ptr = (self.data_ptr + 7) & ~7
+                    self.labels[name] = ('data', self.data_ptr); self.data_ptr += int(size)
+                continue
+            mm = t.split(None, 1)
+            mn = mm[0]; ops = self.split_ops(mm[1]) if len(mm) > 1 else []
+            if section != 'text':
+                raise Exception('instruction in data section: ' + t)
+            self.insts.append((mn, ops, t))
+        for addr, item, size in pending_relocs:
+            self.mem[addr:addr + size] = self.addr_of(item).to_bytes(size, 'little')
+
+    def split_ops(self, s):
+        ops, depth, cur = [], 0, ''
+        for c in s:
+            if c in '[{': depth += 1
+            if c in ']}': depth -= 1
+            if c == ',' and depth == 0:
+                ops.append(cur.strip()); cur = ''
+            else: cur += c
+        if cur.strip(): ops.append(cur.strip())
+        return ops
+
+    def addr_of(self, name):
+        off = 0
+        m = re.match(r'^(.*?)([+-]\d+)$', name)
+        if m and m.group(1): name, off = m.group(1), int(m.group(2))
+        k, v = self.labels[name]
+        if k == 'data': return v + off
+        return 0x40000000 + v * 4 + off
+
+    # registers
+    def reg(self, r):
+        r = r.strip()
+        if r in ('sp', 'wsp'): return self.sp
+        if r in ('xzr', 'wzr'): return 0
+        if r == 'lr': return self.x[30]
+        if r == 'fp': return self.x[29]
+        v = self.x[int(r[1:])]
+        return v & 0xffffffff if r[0] == 'w' else v
+    def setreg(self, r, v):
+        r = r.strip()
+        if r in ('sp', 'wsp'): self.sp = v & M64; return
+        if r in ('xzr', 'wzr'): return
+        if r == 'lr': r = 'x30'
+        if r == 'fp': r = 'x29'
+        self.x[int(r[1:])] = (v & 0xffffffff) if r[0] == 'w' else (v & M64)
+    def isreg(self, s):
+        return bool(re.match(r'^([xw]([0-9]|[12][0-9]|30)|sp|xzr|wzr|lr|fp)$', s.strip()))
+    def imm(self, s):
+        s = s.strip().lstrip('#')
+        if s.startswith(':lo12:'): return self.addr_of(s[6:]) & 0xfff
+        return int(s, 0)
+    def val(self, s):
+        s = s.strip()
+        if self.isreg(s): return self.reg(s)
+        return self.imm(s)
+    def shifted(self, ops, i):
+        # operand ops[i] with optional shift/extend at ops[i+1]
+        v = self.val(ops[i])
+        if len(ops) > i + 1:
+            sh = ops[i + 1].split()
+            kind, amt = sh[0], int(sh[1].lstrip('#')) if len(sh) > 1 else 0
+            if kind == 'lsl': v = (v << amt) & M64
+            elif kind == 'lsr': v = (v & M64) >> amt
+            elif kind == 'asr': v = (s64(v) >> amt) & M64
+            elif kind == 'sxtw': v = (s64(v << 32) >> 32) << amt
+        return v
+
+    def load(self, a, n, signed=False):
+        v = int.from_bytes(self.mem[a:a + n], 'little')
+        if signed and v >> (8 * n - 1): v -= 1 << (8 * n)
+        return v & M64
+    def store(self, a, n, v):
+        self.mem[a:a + n] = (v & ((1 << (8 * n)) - 1)).to_bytes(n, 'little')
+
+    def memop(self, ops, idx):
+        # returns (address, writeback_fn)
+        m = ops[idx]
+        pre = m.endswith('!')
+        inner = m.rstrip('!').strip()[1:-1]
+        parts = [p.strip() for p in inner.split(',')]
+        base = self.reg(parts[0]); off = 0
+        if len(parts) > 1:
+            if self.isreg(parts[1]):
+                off = self.reg(parts[1])
+                if parts[1].startswith('w'): off = s64(off << 32) >> 32
+                if len(parts) > 2:
+                    sh = parts[2].split()
+                    if len(sh) > 1: off <<= int(sh[1].lstrip('#'))
+            else:
+                off = self.imm(parts[1])
+        if pre:
+            addr = (base + off) & M64
+            return addr, lambda: self.setreg(parts[0], addr)
+        if len(ops) > idx + 1:
+            post = self.imm(ops[idx + 1])
+            return base, lambda: self.setreg(parts[0], base + post)
+        return (base + off) & M64, None
+
+    def cond(self, c):
+        n, z, cc, v = self.flags
+        return {'eq': z, 'ne': not z, 'lt': n != v, 'ge': n == v, 'gt': (not z) and n == v,
+                'le': z or n != v, 'hs': cc, 'cs': cc, 'lo': not cc, 'cc': not cc, 'hi': cc and not z,
+                'ls': (not cc) or z, 'mi': n, 'pl': not n, 'al': True}[c]
+    def setflags_sub(self, a, b, w=64):
+        mask = (1 << w) - 1
+        a &= mask; b &= mask
+        r = (a - b) & mask
+        n = r >> (w - 1); z = r == 0; c = a >= b
+        sa, sb, sr = a >> (w - 1), b >> (w - 1), r >> (w - 1)
+        v = (sa != sb) and (sr != sa)
+        self.flags = (n, z, c, v)
+        return r
+    def setflags_add(self, a, b, w=64):
+        mask = (1 << w) - 1
+        a &= mask; b &= mask
+        r = (a + b) & mask
+        n = r >> (w - 1); z = r == 0; c = (a + b) > mask
+        sa, sb, sr = a >> (w - 1), b >> (w - 1), r >> (w - 1)
+        v = (sa == sb) and (sr != sa)
+        self.flags = (n, z, c, v)
+        return r
+
+    def cstr(self, a):
+        e = self.mem.index(0, a)
+        return bytes(self.mem[a:e])
+
+    def call_native(self, name):
+        x = self.x
+        if name in self.natives:
+            self.natives[name](self); return
+        if name == 'print_integer': self.out.append(str(s64(x[0])).encode())
+        elif name == 'print_string': self.out.append(self.cstr(x[0]))
+        elif name == 'print_boolean': self.out.append(b'true' if x[0] & 0xffffffff else b'false')
+        elif name == 'print_character': self.out.append(bytes([x[0] & 0xff]))
+        elif name == 'integer_power':
+            r = 1; b = s64(x[0]); e = s64(x[1])
+            while e > 0: r *= b; e -= 1
+            x[0] = r & M64
+        elif name == 'print_values':
+            self.print_values()
+        else:
+            raise Exception('unknown native ' + name)
+        # clobber caller-saved registers like a real callee would
+        for i in range(1, 19):
+            if not (name == 'integer_power' and i == 0): x[i] = 0xdeadbeef0000 + i
+
+    def print_values(self):
+        # descriptor: literal bytes with \001 int, \002 bool, \003 char, \004 string markers
+        a = self.x[0]; argi = 1
+        d = self.cstr(a)
+        stack_args = self.sp
+        for ch in d:
+            if ch in (1, 2, 3, 4):
+                if argi <= 7: v = self.x[argi]
+                else: v = self.load(stack_args + 8 * (argi - 8), 8)
+                argi += 1
+                if ch == 1: self.out.append(str(s64(v)).encode())
+                elif ch == 2: self.out.append(b'true' if v & 0xffffffff else b'false')
+                elif ch == 3: self.out.append(bytes([v & 0xff]))
+                else: self.out.append(self.cstr(v))
+            else: self.out.append(bytes([ch]))
+
+    def run(self, entry='main', limit=3_000_000):
+        self.x[30] = 0xffffffff  # sentinel return
+        k, pc = self.labels[entry]
+        depth = 0
+        while True:
+            if pc == 0x3fffffff or pc * 4 + 0x40000000 == 0xffffffff: break
+            mn, ops, t = self.insts[pc]
+            self.icount += 1
+            if self.icount > limit: raise Exception('instruction limit')
+            npc = pc + 1
+            try:
+                npc = self.step(mn, ops, pc, npc)
+            except Exception as ex:
+                raise Exception('at "%s": %s' % (t, ex))
+            if npc is None: break
+            pc = npc
+        return s64(self.x[0])
+
+    def target(self, lab):
+        k, v = self.labels[lab]
+        return v
+
+    def step(self, mn, ops, pc, npc):
+        x = self.x
+        w = 32 if ops and ops[0].startswith('w') else 64
+        mask = (1 << w) - 1
+        if mn == 'mov':
+            if ops[0].startswith('v'):
+                raise Exception('vector mov unsupported')
+            self.setreg(ops[0], self.val(ops[1]))
+        elif mn == 'movz':
+            self.setreg(ops[0], self.shifted(ops, 1))
+        elif mn == 'movn':
+            self.setreg(ops[0], ~self.shifted(ops, 1))
+        elif mn == 'movk':
+            sh = int(ops[2].split()[1].lstrip('#')) if len(ops) > 2 else 0
+            old = self.reg(ops[0])
+            self.setreg(ops[0], (old & ~(0xffff << sh)) | ((self.imm(ops[1]) & 0xffff) << sh))
+        elif mn in ('add', 'sub', 'adds', 'subs', 'and', 'orr', 'eor', 'ands', 'bic'):
+            if ops[0].startswith('v'): return self.vec(mn, ops, npc)
+            a = self.val(ops[1])
+            b = self.shifted(ops, 2)
+            if mn == 'add': r = a + b
+            elif mn == 'sub': r = a - b
+            elif mn == 'adds': r = self.setflags_add(a, b, w)
+            elif mn == 'subs': r = self.setflags_sub(a, b, w)
+            elif mn == 'and': r = a & b
+            elif mn == 'ands':
+                r = a & b & mask; self.flags = (r >> (w - 1), r == 0, 0, 0)
+            elif mn == 'bic': r = a & ~b
+            elif mn == 'orr': r = a | b
+            else: r = a ^ b
+            self.setreg(ops[0], r)
+        elif mn == 'cmp': self.setflags_sub(self.val(ops[0]), self.shifted(ops, 1), w)
+        elif mn == 'cmn': self.setflags_add(self.val(ops[0]), self.shifted(ops, 1), w)
+        elif mn == 'tst':
+            r = self.val(ops[0]) & self.shifted(ops, 1) & mask
+            self.flags = (r >> (w - 1), r == 0, 0, 0)
+        elif mn in ('neg', 'mvn') and ops[0].startswith('v'): return self.vec(mn, ops, npc)
+        elif mn == 'neg': self.setreg(ops[0], -self.shifted(ops, 1))
+        elif mn == 'mvn': self.setreg(ops[0], ~self.shifted(ops, 1))
+        elif mn == 'mul': self.setreg(ops[0], self.val(ops[1]) * self.val(ops[2]))
+        elif mn == 'madd': self.setreg(ops[0], self.val(ops[3]) + self.val(ops[1]) * self.val(ops[2]))
+        elif mn == 'msub': self.setreg(ops[0], self.val(ops[3]) - self.val(ops[1]) * self.val(ops[2]))
+        elif mn == 'mneg': self.setreg(ops[0], -(self.val(ops[1]) * self.val(ops[2])))
+        elif mn == 'sdiv':
+            a, b = s64(self.val(ops[1])), s64(self.val(ops[2]))
+            if b == 0: r = 0
+            else:
+                r = abs(a) // abs(b)
+                if (a < 0) != (b < 0): r = -r
+            self.setreg(ops[0], r)
+        elif mn in ('lsl', 'lsr', 'asr'):
+            a = self.val(ops[1]); b = self.val(ops[2]) & 63
+            if mn == 'lsl': r = a << b
+            elif mn == 'lsr': r = (a & M64) >> b
+            else: r = s64(a) >> b
+            self.setreg(ops[0], r)
+        elif mn == 'cset': self.setreg(ops[0], 1 if self.cond(ops[1]) else 0)
+        elif mn == 'csetm': self.setreg(ops[0], M64 if self.cond(ops[1]) else 0)
+        elif mn == 'csel': self.setreg(ops[0], self.val(ops[1]) if self.cond(ops[3]) else self.val(ops[2]))
+        elif mn == 'csinc': self.setreg(ops[0], self.val(ops[1]) if self.cond(ops[3]) else self.val(ops[2]) + 1)
+        elif mn == 'csinv': self.setreg(ops[0], self.val(ops[1]) if self.cond(ops[3]) else ~self.val(ops[2]))
+        elif mn == 'csneg': self.setreg(ops[0], self.val(ops[1]) if self.cond(ops[3]) else -self.val(ops[2]))
+        elif mn == 'cneg': self.setreg(ops[0], -self.val(ops[1]) if self.cond(ops[2]) else self.val(ops[1]))
+        elif mn == 'cinc': self.setreg(ops[0], self.val(ops[1]) + 1 if self.cond(ops[2]) else self.val(ops[1]))
+        elif mn == 'adrp':
+            self.setreg(ops[0], self.addr_of(ops[1]) & ~0xfff)
+        elif mn == 'adr':
+            self.setreg(ops[0], self.addr_of(ops[1]))
+        elif mn in ('ldr', 'str', 'ldrb', 'strb', 'ldrsw', 'ldur', 'stur'):
+            if ops[0].startswith(('q', 'd')) or ops[0].startswith('v'):
+                return self.vec(mn, ops, npc)
+            if mn == 'ldr' and ops[1].startswith('='):
+                self.setreg(ops[0], int(ops[1][1:], 0)); return npc
+            if mn == 'ldr' and not ops[1].startswith('['):
+                self.setreg(ops[0], self.load(self.addr_of(ops[1]), 8)); return npc
+            addr, wb = self.memop(ops, 1)
+            n = 1 if mn.endswith('b') else (4 if (ops[0].startswith('w') or mn == 'ldrsw') else 8)
+            if mn.startswith('ld'): self.setreg(ops[0], self.load(addr, n, mn == 'ldrsw'))
+            else: self.store(addr, n, self.reg(ops[0]))
+            if wb: wb()
+        elif mn in ('ldp', 'stp'):
+            if ops[0].startswith('q'): return self.vec(mn, ops, npc)
+            addr, wb = self.memop(ops, 2)
+            if mn == 'ldp':
+                self.setreg(ops[0], self.load(addr, 8)); self.setreg(ops[1], self.load(addr + 8, 8))
+            else:
+                self.store(addr, 8, self.reg(ops[0])); self.store(addr + 8, 8, self.reg(ops[1]))
+            if wb: wb()
+        elif mn == 'b':
+            if ops[0] in self.labels or ops[0].startswith('.'):
+                return self.target(ops[0])
+            # tail call into a native: run it and return to x30
+            self.call_native(ops[0])
+            return (x[30] - 0x40000000) // 4
+        elif mn.startswith('b.'):
+            return self.target(ops[0]) if self.cond(mn[2:]) else npc
+        elif mn in ('beq', 'bne', 'blt', 'bgt', 'ble', 'bge'):
+            return self.target(ops[0]) if self.cond(mn[1:]) else npc
+        elif mn in ('cbz', 'cbnz'):
+            z = self.val(ops[0]) == 0
+            return self.target(ops[1]) if (z if mn == 'cbz' else not z) else npc
+        elif mn == 'bl':
+            if ops[0] in self.labels:
+                x[30] = 0x40000000 + npc * 4
+                return self.target(ops[0])
+            self.call_native(ops[0])
+        elif mn == 'blr':
+            a = self.reg(ops[0]); x[30] = 0x40000000 + npc * 4
+            return (a - 0x40000000) // 4
+        elif mn == 'br':
+            return (self.reg(ops[0]) - 0x40000000) // 4
+        elif mn == 'ret':
+            r = x[30]
+            if r == 0xffffffff: return None
+            return (r - 0x40000000) // 4
+        elif mn == 'nop': pass
+        elif mn == 'svc':
+            return self.svc(npc)
+        else:
+            return self.vec(mn, ops, npc)
+        return npc
+
+    def svc(self, npc):
+        nr = self.x[8]
+        if nr == 64:  # write
+            self.out.append(bytes(self.mem[self.x[1]:self.x[1] + self.x[2]])); self.x[0] = self.x[2]
+        elif nr in (93, 94):
+            self.exit_code = self.x[0]; return None
+        else: raise Exception('syscall %d' % nr)
+        return npc
+
+    # minimal Advanced SIMD support for 2d integer lanes
+    def vreg(self, s):
+        m = re.match(r'v(\d+)', s.strip()); return int(m.group(1))
+    def vec(self, mn, ops, npc):
+        if mn in ('ld1', 'st1'):
+            regs = [self.vreg(r) for r in ops[0].strip('{}').split(',')]
+            addr, wb = self.memop(ops, 1)
+            for i, r in enumerate(regs):
+                for l in range(2):
+                    a = addr + 16 * i + 8 * l
+                    if mn == 'ld1': self.v[r][l] = self.load(a, 8)
+                    else: self.store(a, 8, self.v[r][l])
+            if wb: wb()
+        elif mn in ('neg', 'mvn'):
+            d, a = self.vreg(ops[0]), self.vreg(ops[1])
+            self.v[d] = [(-p if mn == 'neg' else ~p) & M64 for p in self.v[a]]
+        elif mn in ('ldr', 'str', 'ldur', 'stur') and ops[0].startswith('q'):
+            mn = mn.replace('u', '')
+            r = int(ops[0][1:]); addr, wb = self.memop(ops, 1)
+            for l in range(2):
+                if mn == 'ldr': self.v[r][l] = self.load(addr + 8 * l, 8)
+                else: self.store(addr + 8 * l, 8, self.v[r][l])
+            if wb: wb()
+        elif mn in ('add', 'sub', 'mul', 'cmeq', 'cmgt', 'cmge', 'and', 'orr', 'eor'):
+            d, a, b = self.vreg(ops[0]), self.vreg(ops[1]), self.vreg(ops[2])
+            for l in range(2):
+                p, q = self.v[a][l], self.v[b][l]
+                if mn == 'add': r = p + q
+                elif mn == 'sub': r = p - q
+                elif mn == 'mul': r = p * q
+                elif mn == 'cmeq': r = M64 if p == q else 0
+                elif mn == 'cmgt': r = M64 if s64(p) > s64(q) else 0
+                elif mn == 'cmge': r = M64 if s64(p) >= s64(q) else 0
+                elif mn == 'and': r = p & q
+                elif mn == 'orr': r = p | q
+                else: r = p ^ q
+                self.v[d][l] = r & M64
+        elif mn == 'movi':
+            d = self.vreg(ops[0]); self.v[d] = [self.imm(ops[1]) & M64] * 2
+        elif mn == 'dup':
+            d = self.vreg(ops[0]); val = self.reg(ops[1]); self.v[d] = [val, val]
+        elif mn == 'addp':
+            # addp d0, v0.2d
+            d = int(ops[0].strip()[1:]); a = self.vreg(ops[1])
+            self.v[d] = [(self.v[a][0] + self.v[a][1]) & M64, 0]
+        elif mn == 'fmov' or (mn == 'mov' and ops[1].startswith('v')):
+            # fmov x0, d0  /  mov x0, v0.d[0]
+            src = ops[1]
+            if src.startswith('d'): self.setreg(ops[0], self.v[int(src[1:])][0])
+            else:
+                m = re.match(r'v(\d+)\.d\[(\d)\]', src); self.setreg(ops[0], self.v[int(m.group(1))][int(m.group(2))])
+        elif mn == 'umov':
+            m = re.match(r'v(\d+)\.d\[(\d)\]', ops[1]); self.setreg(ops[0], self.v[int(m.group(1))][int(m.group(2))])
+        else:
+            raise Exception('unsupported instruction ' + mn)
+        return npc
+
+if __name__ == '__main__':
+    sim = Sim(open(sys.argv[1]).read())
+    rc = sim.run()
+    sys.stdout.buffer.write(b''.join(sim.out))
+    sys.stdout.flush()
+    sys.stdout.write('\n[exit %s]\n' % (rc if -4096 < rc < 4096 else 'junk'))
+    sys.stderr.write('[%d insts]\n' % sim.icount)
@@ -0,0 +1,74 @@
+#!/bin/sh
+
+# How to use this benchmark script:
+
+# Compiles every codegen test with the given flags and runs the assembly
+# in bench/armsim.py, a small AArch64 simulator, so no ARM machine is
+# needed. Each program's output and exit code are compared with what the
+# same program gives when compiled at -O1, the IR path with no
+# optimization, which serves as the reference. Reports the instructions
+# each test executed and its lines of assembly, then the totals over
+# every test that runs. These are the simulated instruction counts the
+# optimization passes are measured by. Tests the simulator can't run
+# (ones that don't compile, or that don't finish within its instruction
+# limit) are listed and left out of the totals. Run it from the top of
+# the repository after building the compiler with make; it needs
+# python3.
+
+# For example:
+#     bench/sim.sh ./bminor -O2
+#     bench/sim.sh ./bminor -O2 -inline-threshold=0
+
+if [ $# -lt 1 ]
+then
+	echo "Usage: $0 <compiler> [flags]"
+	exit 1
+fi
+
+COMPILER=$1
+shift
+
+WORKDIR=${TMPDIR:-/tmp}/bminor-sim.$$
+mkdir -p ${WORKDIR}
+
+TOTAL_INSTS=0
+TOTAL_LINES=0
+
+for testfile in tests/*/codegen/good*.bminor
+do
+	if ! ${COMPILER} -O1 -codegen $testfile ${WORKDIR}/ref.s > /dev/null 2>&1 ||
+	   ! python3 bench/armsim.py ${WORKDIR}/ref.s > ${WORKDIR}/ref.out 2> /dev/null
+	then
+		echo "$testfile skipped (doesn't run at -O1)"
+		continue
+	fi
+
+	if ! ${COMPILER} "$@" -codegen $testfile ${WORKDIR}/test.s > /dev/null 2>&1
+	then
+		echo "$testfile failure (doesn't compile)"
+		continue
+	fi
+
+	if ! python3 bench/armsim.py ${WORKDIR}/test.s > ${WORKDIR}/test.out 2> ${WORKDIR}/test.err
+	then
+		echo "$testfile failure ($(tail -1 ${WORKDIR}/test.err))"
+		continue
+	fi
+
+	if ! cmp -s ${WORKDIR}/ref.out ${WORKDIR}/test.out
+	then
+		echo "$testfile failure (output differs from -O1)"
+		diff ${WORKDIR}/ref.out ${WORKDIR}/test.out | head -6
+		continue
+	fi
+
+	INSTS=$(sed -n 's/^\[\([0-9]*\) insts\]$/\1/p' ${WORKDIR}/test.err)
+	LINES=$(grep -c "^[[:space:]]" ${WORKDIR}/test.s)
+	echo "$testfile ${INSTS} instructions, ${LINES} lines"
+	TOTAL_INSTS=$((TOTAL_INSTS + INSTS))
+	TOTAL_LINES=$((TOTAL_LINES + LINES))
+done
+
+echo "total: ${TOTAL_INSTS} simulated instructions, ${TOTAL_LINES} lines of assembly"
+
+rm -rf ${WORKDIR}
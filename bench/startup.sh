@@ -0,0 +1,52 @@
+#!/bin/sh
+
+# How to use this benchmark script:
+
+# Compiles bench/startup.bminor once, links it twice (against the regular
+# libc runtime and against the freestanding runtime as a static binary),
+# then runs each binary RUNS times and reports the average wall time
+# per run. Run it from the top of the repository on the target machine
+# after building the compiler with make.
+
+# For example:
+#     bench/startup.sh ./bminor 2000
+
+if [ $# -lt 1 ]
+then
+	echo "Usage: $0 <compiler> [runs]"
+	exit 1
+fi
+
+COMPILER=$1
+RUNS=${2:-1000}
+WORKDIR=${TMPDIR:-/tmp}/bminor-startup.$$
+
+mkdir -p ${WORKDIR}
+
+${COMPILER} -codegen bench/startup.bminor ${WORKDIR}/startup.s > /dev/null || exit 1
+
+gcc -O2 ${WORKDIR}/startup.s library.c -o ${WORKDIR}/startup_libc || exit 1
+gcc -static -nostdlib -no-pie -ffreestanding -fno-stack-protector -O2 -DBMINOR_FREESTANDING ${WORKDIR}/startup.s library.c -o ${WORKDIR}/startup_static || exit 1
+
+# run one binary RUNS times, print the average microseconds per run
+time_runs()
+{
+	START=$(date +%s%N)
+	i=0
+	while [ $i -lt ${RUNS} ]
+	do
+		$1 > /dev/null
+		i=$((i+1))
+	done
+	END=$(date +%s%N)
+	echo $(( (END - START) / RUNS / 1000 ))
+}
+
+LIBC_US=$(time_runs ${WORKDIR}/startup_libc)
+STATIC_US=$(time_runs ${WORKDIR}/startup_static)
+
+echo "runs:                 ${RUNS}"
+echo "libc runtime:         ${LIBC_US} us/run ($(wc -c < ${WORKDIR}/startup_libc) bytes)"
+echo "freestanding runtime: ${STATIC_US} us/run ($(wc -c < ${WORKDIR}/startup_static) bytes)"
+
+rm -rf ${WORKDIR}
@@ -0,0 +1,33 @@
+#!/bin/sh
+
+# How to use this benchmark script:
+
+# Runs each VM benchmark (fib, sieve, loops) in the bytecode VM with
+# -vm-stats and reports how many bytecode instructions it executed and
+# how many it got through per second, first compiled without
+# superinstructions (-vm-super=0) and then with them, so the dispatches
+# they save show up side by side. Run it from the top of the repository
+# after building the compiler with make. Any flags after the compiler
+# (an -O level, say) are passed on to it.
+
+# For example:
+#     bench/vm.sh ./bminor
+#     bench/vm.sh ./bminor -O1
+
+if [ $# -lt 1 ]
+then
+	echo "Usage: $0 <compiler> [flags]"
+	exit 1
+fi
+
+COMPILER=$1
+shift
+
+for BENCH in fib sieve loops
+do
+	for SUPER in 0 1
+	do
+		STATS=$(${COMPILER} "$@" -vm-super=${SUPER} -vm-stats -run bench/${BENCH}.bminor 2>&1 > /dev/null | grep "^vm:") || exit 1
+		echo "${BENCH} (super ${SUPER}): ${STATS#vm: }"
+	done
+done
@@ -0,0 +1,619 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+- burg: turns a table of tree rewrite rules into the C that labels trees with them, run at build time
+  - ./burg RULES.brg OUT.c OUT.h
+
+- the rules file, one declaration per line, # starts a comment line:
+    %include "file.h"          included by the generated code
+    %term NAME=VALUE ...       operators the trees are made of, VALUE is what burs_node.op holds for them
+    %inst name OP field ...    a machine instruction templates can use, OP its a64_op_t and the fields its
+                               operands fill, in order (rd rn rm ra imm shift cond)
+    %base nt                   the nonterminal for a value in a register, see base rules below
+    nt: pattern cost [@pred] = template
+- a pattern is a nonterminal (a chain rule) or an operator with patterns for its operands, OP(p, p), up to
+  three operands and four leaves, at most three of them %base
+- @pred names a C function int pred( struct burs_node *n ) that has to accept the root node too, the way
+  constants are sorted into immediates that fit an instruction and those that don't
+- the template is the instructions the rule emits, separated by ;, each a name from %inst and its operands:
+    %d            the register the result goes in
+    %N            register of leaf N (the nonterminals of the pattern, numbered left to right from 0),
+                  or in a cond field the condition leaf N compares with, !%N for the opposite one
+    NAME          in a cond field, a condition constant from the included headers
+    #%N  #log%N   the constant at leaf N, or its log2
+    #K            the number K
+    %t  xzr       scratch register, zero register
+- a rule is a base rule if it covers a single operator and every operand is the %base nonterminal (chain and
+  leaf rules count too), those alone are what selecting one IR operation at a time can do
+
+- the generated .c has the rule table and the templates, plus
+    void burs_label( struct burs_node *n );
+    int burs_leaves( int rule, struct burs_node *n, struct burs_node **leaves );
+  the .h numbers the nonterminals BURS_NT_name and declares the predicates
+*/
+
+#define BURG_MAX      256
+#define BURG_NAME     64
+#define BURG_NFIELDS  7
+
+const char *burg_fields[BURG_NFIELDS]      = { "rd", "rn", "rm", "ra", "imm", "shift", "cond" };
+const char *burg_field_enums[BURG_NFIELDS] = { "BURS_RD", "BURS_RN", "BURS_RM", "BURS_RA", "BURS_IMM", "BURS_SHIFT", "BURS_COND" };
+
+struct burg_pat {
+	int term;					// index in burg_terms, -1 for a nonterminal
+	int nt;
+	int nkids;
+	struct burg_pat *kids[3];
+};
+
+struct burg_term {
+	char name[BURG_NAME];
+	char value[BURG_NAME];
+	int arity;					// -1 until a pattern uses it
+};
+
+struct burg_inst {
+	char name[BURG_NAME];
+	char op[BURG_NAME];
+	int fields[BURG_NFIELDS];
+	int nfields;
+};
+
+struct burg_operand {
+	char kind;
+	int leaf;
+	long value;
+	char sym[BURG_NAME];		// a named constant instead of value
+};
+
+struct burg_tmpl {
+	int inst;
+	struct burg_operand f[BURG_NFIELDS];
+};
+
+struct burg_rule {
+	int nt;
+	struct burg_pat *pat;
+	int cost;
+	char pred[BURG_NAME];
+	int base;
+	int nleaves;
+	int leaf_nt[4];
+	char leaf_path[4][BURG_MAX];
+	struct burg_tmpl tmpl[4];
+	int len;
+	char text[BURG_MAX];
+	int line;
+};
+
+struct burg_term burg_terms[64];
+int              burg_nterms = 0;
+struct burg_inst burg_insts[64];
+int              burg_ninsts = 0;
+char             burg_nts[16][BURG_NAME];	// 0 isn't a nonterminal
+int              burg_nnts = 1;
+int              burg_nt_defined[16];
+struct burg_rule burg_rules[BURG_MAX];
+int              burg_nrules = 1;			// 0 isn't a rule either
+char             burg_includes[8][BURG_MAX];
+int              burg_nincludes = 0;
+char             burg_preds[32][BURG_NAME];
+int              burg_npreds = 0;
+int              burg_base_nt = 0;
+
+const char *burg_file = 0;
+int         burg_line = 0;
+
+/* stop with an error about the current line */
+void burg_error(const char *msg, const char *what)
+{
+	fprintf(stderr, "burg: %s:%i: %s%s%s\n", burg_file, burg_line, msg, what ? ": " : "", what ? what : "");
+	exit(1);
+}
+
+/* skip spaces */
+const char * burg_skip(const char *s)
+{
+	while (*s && isspace((unsigned char) *s)) s++;
+	return s;
+}
+
+/* read an identifier into name, returns where it ends */
+const char * burg_ident(const char *s, char *name)
+{
+	int n = 0;
+	s = burg_skip(s);
+	while (*s && (isalnum((unsigned char) *s) || *s == '_' || *s == '.'))
+	{
+		if (n == BURG_NAME - 1) burg_error("name too long", 0);
+		name[n++] = *s++;
+	}
+	name[n] = 0;
+	if (!n) burg_error("expected a name", s);
+	return s;
+}
+
+/* index of a nonterminal, added the first time it's seen */
+int burg_nt(const char *name)
+{
+	for (int k=1;k<burg_nnts;k++) if (!strcmp(burg_nts[k], name)) return k;
+	if (burg_nnts == 16) burg_error("too many nonterminals", name);
+	strcpy(burg_nts[burg_nnts], name);
+	return burg_nnts++;
+}
+
+/* index of a terminal, -1 if name isn't one */
+int burg_term(const char *name)
+{
+	for (int k=0;k<burg_nterms;k++) if (!strcmp(burg_terms[k].name, name)) return k;
+	return -1;
+}
+
+/* parse a pattern */
+const char * burg_pattern(const char *s, struct burg_pat **out)
+{
+	char name[BURG_NAME];
+	struct burg_pat *p = calloc(1, sizeof(*p));
+	s = burg_ident(s, name);
+	p->term = burg_term(name);
+	p->nt   = p->term < 0 ? burg_nt(name) : 0;
+
+	s = burg_skip(s);
+	if (*s == '(')
+	{
+		if (p->term < 0) burg_error("a nonterminal can't have operands", name);
+		s++;
+		for (;;)
+		{
+			if (p->nkids == 3) burg_error("more than three operands", name);
+			s = burg_pattern(s, &p->kids[p->nkids++]);
+			s = burg_skip(s);
+			if (*s == ',') { s++; continue; }
+			if (*s == ')') { s++; break; }
+			burg_error("expected , or ) in the pattern", s);
+		}
+	}
+
+	if (p->term >= 0)
+	{
+		struct burg_term *t = &burg_terms[p->term];
+		if (t->arity < 0) t->arity = p->nkids;
+		if (t->arity != p->nkids) burg_error("operator used with a different number of operands", name);
+	}
+
+	*out = p;
+	return s;
+}
+
+/* collect the leaves of a pattern, the nonterminals in it, with the path to each from the root */
+void burg_leaves(struct burg_rule *r, struct burg_pat *p, const char *path)
+{
+	if (p->term < 0)
+	{
+		if (r->nleaves == 4) burg_error("more than four leaves in one pattern", 0);
+		r->leaf_nt[r->nleaves] = p->nt;
+		strcpy(r->leaf_path[r->nleaves], path);
+		r->nleaves++;
+		return;
+	}
+	for (int k=0;k<p->nkids;k++)
+	{
+		char sub[BURG_MAX];
+		snprintf(sub, sizeof(sub), "%s->kids[%i]", path, k);
+		burg_leaves(r, p->kids[k], sub);
+	}
+}
+
+/* parse one operand of a template instruction for the given field */
+void burg_operand(struct burg_rule *r, const char *text, int field, struct burg_operand *o)
+{
+	int is_reg  = field <= 3;
+	int is_cond = field == 6;
+
+	if (is_reg && !strcmp(text, "%d")) { o->kind = 'd'; return; }
+	if (is_reg && !strcmp(text, "%t")) { o->kind = 't'; return; }
+	if (is_reg && !strcmp(text, "xzr")) { o->kind = 'z'; return; }
+
+	const char *s = text;
+	char kind = 0;
+	if (is_reg && s[0] == '%')                         { kind = 'r'; s += 1; }
+	else if (is_cond && s[0] == '%')                   { kind = 'c'; s += 1; }
+	else if (is_cond && !strncmp(s, "!%", 2))          { kind = 'n'; s += 2; }
+	else if (is_cond && (isalpha((unsigned char) s[0]) || s[0] == '_'))
+	{
+		o->kind = 'k';
+		burg_ident(s, o->sym);
+		return;
+	}
+	else if (!is_reg && !is_cond && !strncmp(s, "#log%", 5)) { kind = 'l'; s += 5; }
+	else if (!is_reg && !is_cond && !strncmp(s, "#%", 2))    { kind = 'i'; s += 2; }
+	else if (!is_reg && !is_cond && s[0] == '#')
+	{
+		char *end;
+		o->kind  = 'k';
+		o->value = strtol(s + 1, &end, 0);
+		if (*end || end == s + 1) burg_error("bad number in the template", text);
+		return;
+	}
+	else burg_error("operand doesn't fit its field", text);
+
+	char *end;
+	o->kind = kind;
+	o->leaf = strtol(s, &end, 10);
+	if (*end || end == s) burg_error("bad leaf number in the template", text);
+	if (o->leaf >= r->nleaves) burg_error("the pattern has no such leaf", text);
+}
+
+/* parse the template of a rule */
+void burg_template(struct burg_rule *r, const char *s)
+{
+	char buf[BURG_MAX];
+	strncpy(buf, s, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = 0;
+
+	for (char *inst = strtok(buf, ";"); inst; inst = strtok(0, ";"))
+	{
+		char name[BURG_NAME];
+		const char *p = burg_skip(inst);
+		if (!*p) continue;
+		p = burg_ident(p, name);
+
+		int k;
+		for (k=0;k<burg_ninsts;k++) if (!strcmp(burg_insts[k].name, name)) break;
+		if (k == burg_ninsts) burg_error("no such instruction, declare it with %inst", name);
+		if (r->len == 4) burg_error("more than four instructions in one template", 0);
+
+		struct burg_tmpl *t = &r->tmpl[r->len++];
+		t->inst = k;
+
+		// operands, comma separated, fill the fields of the instruction in order
+		int n = 0;
+		p = burg_skip(p);
+		while (*p)
+		{
+			char text[BURG_NAME];
+			int len = 0;
+			while (*p && *p != ',' && !isspace((unsigned char) *p) && len < BURG_NAME - 1) text[len++] = *p++;
+			text[len] = 0;
+			if (n == burg_insts[k].nfields) burg_error("too many operands", name);
+			burg_operand(r, text, burg_insts[k].fields[n], &t->f[burg_insts[k].fields[n]]);
+			n++;
+			p = burg_skip(p);
+			if (*p == ',') p = burg_skip(p + 1);
+		}
+	}
+}
+
+/* is a pattern a base rule: one operator, every operand the base nonterminal */
+int burg_is_base(struct burg_pat *p)
+{
+	if (p->term < 0) return 1;
+	for (int k=0;k<p->nkids;k++)
+	{
+		if (p->kids[k]->term >= 0 || p->kids[k]->nt != burg_base_nt) return 0;
+	}
+	return 1;
+}
+
+/* parse a rule line */
+void burg_rule(const char *line)
+{
+	if (burg_nrules == BURG_MAX) burg_error("too many rules", 0);
+	struct burg_rule *r = &burg_rules[burg_nrules++];
+	r->line = burg_line;
+
+	const char *eq = strchr(line, '=');
+	if (!eq) burg_error("rule without = template", 0);
+
+	char name[BURG_NAME];
+	const char *s = burg_ident(line, name);
+	if (burg_term(name) >= 0) burg_error("a rule has to derive a nonterminal", name);
+	r->nt = burg_nt(name);
+	burg_nt_defined[r->nt] = 1;
+	s = burg_skip(s);
+	if (*s != ':') burg_error("expected :", s);
+
+	s = burg_pattern(s + 1, &r->pat);
+	if (r->pat->term < 0 && r->pat->nt == r->nt) burg_error("a chain rule can't derive itself", name);
+
+	// the rule as written, spaces squeezed, for the table
+	int n = 0;
+	for (const char *c = burg_skip(line); c < s && n < BURG_MAX - 1; c++)
+	{
+		if (isspace((unsigned char) *c) && (n == 0 || r->text[n-1] == ' ')) continue;
+		r->text[n++] = isspace((unsigned char) *c) ? ' ' : *c;
+	}
+	while (n && r->text[n-1] == ' ') n--;
+	r->text[n] = 0;
+
+	char *end;
+	r->cost = strtol(s, &end, 10);
+	if (end == s) burg_error("expected the cost", s);
+	s = burg_skip(end);
+
+	if (*s == '@')
+	{
+		s = burg_ident(s + 1, r->pred);
+		if (r->pat->term < 0) burg_error("a chain rule can't have a predicate", r->pred);
+		int k;
+		for (k=0;k<burg_npreds;k++) if (!strcmp(burg_preds[k], r->pred)) break;
+		if (k == burg_npreds) strcpy(burg_preds[burg_npreds++], r->pred);
+		s = burg_skip(s);
+	}
+	if (s != eq) burg_error("expected = before the template", s);
+
+	burg_leaves(r, r->pat, "n");
+	int regs = 0;
+	for (int k=0;k<r->nleaves;k++) if (r->leaf_nt[k] == burg_base_nt) regs++;
+	if (regs > 3) burg_error("more than three register leaves in one pattern", 0);
+	r->base = burg_is_base(r->pat);
+	burg_template(r, eq + 1);
+}
+
+/* parse the rules file */
+void burg_read(FILE *in)
+{
+	char line[1024];
+	while (fgets(line, sizeof(line), in))
+	{
+		burg_line++;
+		line[strcspn(line, "\r\n")] = 0;
+		const char *s = burg_skip(line);
+		if (!*s || *s == '#') continue;
+
+		if (!strncmp(s, "%include", 8))
+		{
+			strcpy(burg_includes[burg_nincludes++], burg_skip(s + 8));
+		}
+		else if (!strncmp(s, "%term", 5))
+		{
+			s += 5;
+			while (*(s = burg_skip(s)))
+			{
+				struct burg_term *t = &burg_terms[burg_nterms++];
+				s = burg_ident(s, t->name);
+				if (*s != '=') burg_error("expected NAME=VALUE", t->name);
+				s = burg_ident(s + 1, t->value);
+				t->arity = -1;
+			}
+		}
+		else if (!strncmp(s, "%inst", 5))
+		{
+			struct burg_inst *i = &burg_insts[burg_ninsts++];
+			s = burg_ident(s + 5, i->name);
+			s = burg_ident(s, i->op);
+			while (*(s = burg_skip(s)))
+			{
+				char field[BURG_NAME];
+				s = burg_ident(s, field);
+				int k;
+				for (k=0;k<BURG_NFIELDS;k++) if (!strcmp(burg_fields[k], field)) break;
+				if (k == BURG_NFIELDS) burg_error("no such field", field);
+				i->fields[i->nfields++] = k;
+			}
+		}
+		else if (!strncmp(s, "%base", 5))
+		{
+			char name[BURG_NAME];
+			burg_ident(s + 5, name);
+			burg_base_nt = burg_nt(name);
+		}
+		else if (*s == '%')
+		{
+			burg_error("unknown declaration", s);
+		}
+		else
+		{
+			burg_rule(s);
+		}
+	}
+
+	burg_line = 0;
+	for (int k=1;k<burg_nnts;k++) if (!burg_nt_defined[k]) burg_error("no rule derives nonterminal", burg_nts[k]);
+	if (!burg_base_nt) burg_error("no %base nonterminal", 0);
+}
+
+/* conditions for the operators below the root of a pattern */
+void burg_conditions(FILE *out, struct burg_pat *p, const char *path, int *first)
+{
+	for (int k=0;k<p->nkids;k++)
+	{
+		struct burg_pat *kid = p->kids[k];
+		if (kid->term < 0) continue;
+		char sub[BURG_MAX];
+		snprintf(sub, sizeof(sub), "%s->kids[%i]", path, k);
+		fprintf(out, "%s%s->op == %s", *first ? "" : " && ", sub, burg_terms[kid->term].value);
+		*first = 0;
+		burg_conditions(out, kid, sub, first);
+	}
+}
+
+/* the cost of a rule at node n, from what its leaves cost */
+void burg_cost(FILE *out, struct burg_rule *r, const char *which, int base)
+{
+	fprintf(out, "%i", base);
+	for (int k=0;k<r->nleaves;k++) fprintf(out, " + %s->%s[BURS_NT_%s]", r->leaf_path[k], which, burg_nts[r->leaf_nt[k]]);
+}
+
+/* write the generated header */
+void burg_write_h(FILE *out, const char *guard)
+{
+	fprintf(out, "/* generated by burg from %s, change the rules there instead */\n\n", burg_file);
+	fprintf(out, "#ifndef %s\n#define %s\n\n#include \"burs.h\"\n\n", guard, guard);
+	for (int k=1;k<burg_nnts;k++) fprintf(out, "#define BURS_NT_%s %i\n", burg_nts[k], k);
+	fprintf(out, "#define BURS_NNT %i\n", burg_nnts);
+	fprintf(out, "#define BURS_NRULES %i\n\n", burg_nrules);
+	fprintf(out, "#if BURS_NNT > BURS_MAX_NT\n#error \"more nonterminals than struct burs_node has room for\"\n#endif\n\n");
+	fprintf(out, "extern const struct burs_rule burs_rules[BURS_NRULES];\n");
+	fprintf(out, "extern const char *burs_nt_names[BURS_NNT];\n\n");
+	fprintf(out, "void burs_label( struct burs_node *n );\n");
+	fprintf(out, "int burs_leaves( int rule, struct burs_node *n, struct burs_node **leaves );\n\n");
+	for (int k=0;k<burg_npreds;k++) fprintf(out, "int %s( struct burs_node *n );\n", burg_preds[k]);
+	fprintf(out, "\n#endif\n");
+}
+
+/* write the generated code */
+void burg_write_c(FILE *out, const char *header)
+{
+	fprintf(out, "/* generated by burg from %s, change the rules there instead */\n\n", burg_file);
+	fprintf(out, "#include \"%s\"\n", header);
+	for (int k=0;k<burg_nincludes;k++) fprintf(out, "#include %s\n", burg_includes[k]);
+	fprintf(out, "\nconst char *burs_nt_names[BURS_NNT] = { 0");
+	for (int k=1;k<burg_nnts;k++) fprintf(out, ", \"%s\"", burg_nts[k]);
+	fprintf(out, " };\n\n");
+
+	// templates
+	for (int r=1;r<burg_nrules;r++)
+	{
+		struct burg_rule *rule = &burg_rules[r];
+		if (!rule->len) continue;
+		fprintf(out, "static const struct burs_tmpl burs_tmpl_%i[] = {\n", r);
+		for (int t=0;t<rule->len;t++)
+		{
+			fprintf(out, "\t{ %s, {", burg_insts[rule->tmpl[t].inst].op);
+			int first = 1;
+			for (int f=0;f<BURG_NFIELDS;f++)
+			{
+				struct burg_operand *o = &rule->tmpl[t].f[f];
+				if (!o->kind) continue;
+				if (o->sym[0]) fprintf(out, "%s [%s] = { '%c', %i, %s }", first ? "" : ",", burg_field_enums[f], o->kind, o->leaf, o->sym);
+				else           fprintf(out, "%s [%s] = { '%c', %i, %li }", first ? "" : ",", burg_field_enums[f], o->kind, o->leaf, o->value);
+				first = 0;
+			}
+			fprintf(out, " } },\n");
+		}
+		fprintf(out, "};\n");
+	}
+
+	// rule table
+	fprintf(out, "\nconst struct burs_rule burs_rules[BURS_NRULES] = {\n\t{ 0 },\n");
+	for (int r=1;r<burg_nrules;r++)
+	{
+		struct burg_rule *rule = &burg_rules[r];
+		fprintf(out, "\t{ BURS_NT_%s, %i, %i, %i, %i, {", burg_nts[rule->nt], rule->cost, rule->len, rule->base, rule->nleaves);
+		for (int k=0;k<rule->nleaves;k++) fprintf(out, "%s BURS_NT_%s", k ? "," : "", burg_nts[rule->leaf_nt[k]]);
+		if (rule->len) fprintf(out, " }, burs_tmpl_%i, \"%s\" },\n", r, rule->text);
+		else           fprintf(out, " }, 0, \"%s\" },\n", rule->text);
+	}
+	fprintf(out, "};\n\n");
+
+	// chain rules, applied until nothing gets cheaper
+	fprintf(out, "/* derive nonterminals from the ones already derived at n */\n");
+	fprintf(out, "static void burs_closure(struct burs_node *n)\n{\n\tint c;\n\tint changed = 1;\n\twhile (changed)\n\t{\n\t\tchanged = 0;\n");
+	for (int r=1;r<burg_nrules;r++)
+	{
+		struct burg_rule *rule = &burg_rules[r];
+		if (rule->pat->term >= 0) continue;
+		const char *to = burg_nts[rule->nt], *from = burg_nts[rule->pat->nt];
+		fprintf(out, "\t\t// %s\n", rule->text);
+		fprintf(out, "\t\tc = n->cost[BURS_NT_%s] + %i;\n", from, rule->cost);
+		fprintf(out, "\t\tif (c < n->cost[BURS_NT_%s]) { n->cost[BURS_NT_%s] = c; n->rule[BURS_NT_%s] = %i; changed = 1; }\n", to, to, to, r);
+		fprintf(out, "\t\tc = n->naive[BURS_NT_%s] + %i;\n", from, rule->len);
+		fprintf(out, "\t\tif (c < n->naive[BURS_NT_%s]) { n->naive[BURS_NT_%s] = c; changed = 1; }\n", to, to);
+	}
+	fprintf(out, "\t}\n}\n\n");
+
+	// labeller, one case per operator with the rules rooted at it
+	fprintf(out, "/* burs_label: the cheapest rule deriving each nonterminal at every node of a tree */\n");
+	fprintf(out, "void burs_label(struct burs_node *n)\n{\n\tint c;\n");
+	fprintf(out, "\tfor (int k=0;k<BURS_MAX_KIDS;k++) if (n->kids[k]) burs_label(n->kids[k]);\n");
+	fprintf(out, "\tfor (int k=0;k<BURS_MAX_NT;k++)\n\t{\n\t\tn->cost[k]  = BURS_INF;\n\t\tn->naive[k] = BURS_INF;\n\t\tn->rule[k]  = 0;\n\t}\n\n");
+	fprintf(out, "\tswitch (n->op)\n\t{\n");
+	for (int t=0;t<burg_nterms;t++)
+	{
+		int any = 0;
+		for (int r=1;r<burg_nrules;r++) if (burg_rules[r].pat->term == t) any = 1;
+		if (!any) continue;
+
+		fprintf(out, "\t\tcase %s:\n", burg_terms[t].value);
+		for (int r=1;r<burg_nrules;r++)
+		{
+			struct burg_rule *rule = &burg_rules[r];
+			if (rule->pat->term != t) continue;
+			const char *nt = burg_nts[rule->nt];
+
+			fprintf(out, "\t\t\t// %s\n", rule->text);
+			int first = 1;
+			int has_cond = 0;
+			{
+				// the operators below the root, then the predicate
+				char cond[2048] = "";
+				FILE *mem = fmemopen(cond, sizeof(cond), "w");
+				burg_conditions(mem, rule->pat, "n", &first);
+				if (rule->pred[0]) fprintf(mem, "%s%s(n)", first ? "" : " && ", rule->pred);
+				fclose(mem);
+				has_cond = cond[0] != 0;
+				if (has_cond) fprintf(out, "\t\t\tif (%s)\n", cond);
+			}
+			const char *in = has_cond ? "\t\t\t\t" : "\t\t\t";
+			if (has_cond) fprintf(out, "\t\t\t{\n");
+			fprintf(out, "%sc = ", in);
+			burg_cost(out, rule, "cost", rule->cost);
+			fprintf(out, ";\n%sif (c < n->cost[BURS_NT_%s]) { n->cost[BURS_NT_%s] = c; n->rule[BURS_NT_%s] = %i; }\n", in, nt, nt, nt, r);
+			if (rule->base)
+			{
+				fprintf(out, "%sc = ", in);
+				burg_cost(out, rule, "naive", rule->len);
+				fprintf(out, ";\n%sif (c < n->naive[BURS_NT_%s]) n->naive[BURS_NT_%s] = c;\n", in, nt, nt);
+			}
+			if (has_cond) fprintf(out, "\t\t\t}\n");
+		}
+		fprintf(out, "\t\t\tbreak;\n");
+	}
+	fprintf(out, "\t}\n\n\tburs_closure(n);\n}\n\n");
+
+	// leaves of each rule's pattern
+	fprintf(out, "/* burs_leaves: the nodes under the leaves of a rule's pattern matched at n, left to right */\n");
+	fprintf(out, "int burs_leaves(int rule, struct burs_node *n, struct burs_node **leaves)\n{\n\tswitch (rule)\n\t{\n");
+	for (int r=1;r<burg_nrules;r++)
+	{
+		struct burg_rule *rule = &burg_rules[r];
+		fprintf(out, "\t\tcase %i: // %s\n", r, rule->text);
+		for (int k=0;k<rule->nleaves;k++) fprintf(out, "\t\t\tleaves[%i] = %s;\n", k, rule->leaf_path[k]);
+		fprintf(out, "\t\t\treturn %i;\n", rule->nleaves);
+	}
+	fprintf(out, "\t}\n\treturn 0;\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 4)
+	{
+		fprintf(stderr, "usage: burg RULES.brg OUT.c OUT.h\n");
+		return 1;
+	}
+
+	burg_file = argv[1];
+	FILE *in = fopen(argv[1], "r");
+	if (!in)
+	{
+		fprintf(stderr, "burg: can't read %s\n", argv[1]);
+		return 1;
+	}
+	burg_read(in);
+	fclose(in);
+
+	// header guard from the header's file name
+	const char *base = strrchr(argv[3], '/');
+	base = base ? base + 1 : argv[3];
+	char guard[BURG_MAX];
+	int n = 0;
+	for (const char *s = base; *s && n < BURG_MAX - 1; s++) guard[n++] = isalnum((unsigned char) *s) ? toupper((unsigned char) *s) : '_';
+	guard[n] = 0;
+
+	FILE *c = fopen(argv[2], "w");
+	FILE *h = fopen(argv[3], "w");
+	if (!c || !h)
+	{
+		fprintf(stderr, "burg: can't write %s and %s\n", argv[2], argv[3]);
+		return 1;
+	}
+	burg_write_h(h, guard);
+	burg_write_c(c, base);
+	fclose(h);
+	fclose(c);
+	return 0;
+}
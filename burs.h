@@ -0,0 +1,62 @@
+#ifndef BURS_H
+#define BURS_H
+
+#include "ir.h"
+
+/*
+- bottom-up rewrite (BURS) instruction selection, the part shared by the rule tables burg generates and the
+  backend that reduces with them
+- a tree is one IR instruction with the instructions it reads folded in as subtrees, every operand that isn't
+  folded is a leaf: a constant (CONST) or a value that's already in a register (REG)
+- burs_label works out, bottom up, the cheapest way to derive every nonterminal at every node (dynamic
+  programming over the rules), so the tiling picked for the root is the cheapest the rules allow
+- naive[] is the same thing using only the rules that cover a single IR operation with register operands,
+  what selecting one IR instruction at a time would have cost, kept for the statistics
+*/
+
+#define BURS_MAX_NT     12			// nonterminals a rule table can have, 0 isn't one
+#define BURS_MAX_KIDS   3			// operands of a node
+#define BURS_MAX_LEAVES 4			// leaves of a pattern, at most three of them registers
+#define BURS_INF        0x1000000	// cost of a nonterminal that can't be derived at a node
+#define BURS_REG        (-1)		// op of a leaf whose value is in a register
+
+struct burs_node {
+	int op;						// ir_op_t, or BURS_REG
+	struct ir_inst *inst;		// the IR instruction, 0 for a leaf
+	int vreg;					// leaves: the vreg read
+	long imm;					// CONST leaves: the value
+	struct burs_node *kids[BURS_MAX_KIDS];
+	int cost[BURS_MAX_NT];
+	int rule[BURS_MAX_NT];		// rule the cheapest derivation starts with
+	int naive[BURS_MAX_NT];
+};
+
+// fields of a template instruction, the a64_inst fields they fill
+enum { BURS_RD, BURS_RN, BURS_RM, BURS_RA, BURS_IMM, BURS_SHIFT, BURS_COND, BURS_NFIELDS };
+
+struct burs_operand {
+	char kind;					// 0 unused, 'd' the result register, 'r' a leaf's register, 'i' a leaf's constant,
+								// 'l' log2 of a leaf's constant, 'k' value (a number or a condition), 't' scratch
+								// register, 'z' zero register, 'c' the condition a leaf compares with, 'n' the
+								// opposite condition
+	char leaf;
+	long value;
+};
+
+struct burs_tmpl {
+	int op;						// a64_op_t
+	struct burs_operand f[BURS_NFIELDS];
+};
+
+struct burs_rule {
+	int nt;						// nonterminal the rule derives
+	int cost;
+	int len;					// instructions in the template
+	int base;					// one IR operation with register operands, counts towards naive
+	int nleaves;
+	int leaf_nt[BURS_MAX_LEAVES];	// nonterminal each leaf of the pattern has to derive, left to right
+	const struct burs_tmpl *tmpl;
+	const char *text;			// the rule as written
+};
+
+#endif
@@ -0,0 +1,422 @@
+#include "cfg.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+- builds the control-flow graph of IR functions
+  - void cfg_build( struct ir_func *f );
+  - void cfg_print_dot_program( struct ir_program *p, FILE *out );
+
+- successors come straight from each block's terminator, predecessors are collected from those
+- blocks that can't be reached from the entry (code after a return, a loop that never falls out, ...) are dropped
+- dominators use the iterative algorithm of Cooper, Harvey and Kennedy over reverse postorder,
+  which settles in two or three passes on the graphs structured code produces, so it's near-linear in practice
+- the dominator tree is numbered pre/post order afterwards, that way "does a dominate b" is two compares
+
+nothing here recurses over the graph, so very long generated functions can't blow the C stack
+*/
+
+/* cfg_succs: successor edges of every block in the layout */
+void cfg_succs(struct ir_func *f)
+{
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		bb->nsuccs = ir_block_succs(bb, bb->succs);
+	}
+}
+
+/* cfg_remove_unreachable: unlink every block the entry can't reach, and number the rest in reverse postorder */
+/*
+inputs
+- f: the function, successor edges get recomputed
+output
+- how many blocks were removed
+*/
+int cfg_remove_unreachable(struct ir_func *f)
+{
+	cfg_succs(f);
+
+	int n = f->nblocks;
+	char *seen = calloc(n + 1, 1);
+	int *next_succ = calloc(n + 1, sizeof(int));
+	struct ir_block **stack = calloc(n + 1, sizeof(*stack));
+	struct ir_block **post  = calloc(n + 1, sizeof(*post));
+	int sp = 0;
+	int npost = 0;
+
+	// depth-first from the entry, a block is finished once all its successors are
+	if (f->blocks)
+	{
+		stack[sp++] = f->blocks;
+		seen[f->blocks->id] = 1;
+	}
+	while (sp)
+	{
+		struct ir_block *bb = stack[sp - 1];
+		if (next_succ[bb->id] < bb->nsuccs)
+		{
+			struct ir_block *s = bb->succs[next_succ[bb->id]++];
+			if (!seen[s->id])
+			{
+				seen[s->id] = 1;
+				stack[sp++] = s;
+			}
+		}
+		else
+		{
+			post[npost++] = bb;
+			sp--;
+		}
+	}
+
+	// unlink whatever wasn't reached, the entry always was
+	int removed = 0;
+	struct ir_block *prev = f->blocks;
+	while (prev && prev->next)
+	{
+		if (!seen[prev->next->id])
+		{
+			prev->next = prev->next->next;
+			removed++;
+		}
+		else
+		{
+			prev = prev->next;
+		}
+	}
+
+	free(f->rpo);
+	f->rpo  = calloc(npost + 1, sizeof(*f->rpo));
+	f->nrpo = npost;
+	for (int k=0;k<npost;k++)
+	{
+		f->rpo[k] = post[npost - 1 - k];
+		f->rpo[k]->rpo = k;
+	}
+
+	free(seen);
+	free(next_succ);
+	free(stack);
+	free(post);
+	return removed;
+}
+
+/* cfg_merge_blocks: fold a block into the one jumping to it when that jump is its only way in */
+/*
+- straight-line chains are left behind by lowering (a for loop's body and its step are two blocks) and by
+  branches that got resolved, merging them gives the passes that work inside one block more to work with
+- the start block stays apart from the entry, self tail calls jump to it
+- the graph has to be up to date, and is rebuilt when anything was merged
+output
+- how many blocks went away
+*/
+int cfg_merge_blocks(struct ir_func *f)
+{
+	int merged = 0;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		while (bb->last && bb->last->op == IR_JMP)
+		{
+			struct ir_block *s = bb->last->target;
+			if (s == bb || s == f->start || s->npreds != 1) break;
+			if (s->first && s->first->op == IR_PHI) break;
+
+			ir_inst_remove(bb->last);
+			while (s->first)
+			{
+				struct ir_inst *i = s->first;
+				ir_inst_remove(i);
+				ir_inst_append(bb, i);
+			}
+
+			// the successors of s are reached from bb now
+			bb->nsuccs = s->nsuccs;
+			for (int k=0;k<s->nsuccs;k++)
+			{
+				struct ir_block *t = s->succs[k];
+				bb->succs[k] = t;
+				for (int p=0;p<t->npreds;p++) if (t->preds[p] == s) t->preds[p] = bb;
+				for (struct ir_inst *phi = t->first; phi && phi->op == IR_PHI; phi = phi->next)
+				{
+					for (int a=0;a<phi->nargs;a++) if (phi->phi_blocks[a] == s) phi->phi_blocks[a] = bb;
+				}
+			}
+
+			struct ir_block *prev = f->blocks;
+			while (prev->next != s) prev = prev->next;
+			prev->next = s->next;
+			s->npreds = 0;
+			merged++;
+		}
+	}
+
+	if (merged) cfg_build(f);
+	return merged;
+}
+
+/* cfg_preds: predecessor lists of every block, in layout order of the predecessors */
+void cfg_preds(struct ir_func *f)
+{
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		free(bb->preds);
+		bb->preds  = 0;
+		bb->npreds = 0;
+	}
+
+	// count first so every list is allocated once
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (int s=0;s<bb->nsuccs;s++) bb->succs[s]->npreds++;
+	}
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		bb->preds  = calloc(bb->npreds + 1, sizeof(*bb->preds));
+		bb->npreds = 0;
+	}
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (int s=0;s<bb->nsuccs;s++)
+		{
+			struct ir_block *t = bb->succs[s];
+			t->preds[t->npreds++] = bb;
+		}
+	}
+}
+
+/* cfg_phis: put phi arguments back in predecessor order after edges changed */
+/*
+- an argument whose edge disappeared is dropped, it can never be taken anymore
+- passes that add an edge (splitting one, say) update phi_blocks themselves before rebuilding the graph
+*/
+void cfg_phis(struct ir_func *f)
+{
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i && i->op == IR_PHI; i = i->next)
+		{
+			int *args = calloc(bb->npreds + 1, sizeof(int));
+			struct ir_block **blocks = calloc(bb->npreds + 1, sizeof(*blocks));
+			for (int p=0;p<bb->npreds;p++)
+			{
+				args[p]   = IR_NO_REG;
+				blocks[p] = bb->preds[p];
+				for (int k=0;k<i->nargs;k++)
+				{
+					if (i->phi_blocks[k] == bb->preds[p]) args[p] = i->args[k];
+				}
+			}
+			free(i->args);
+			free(i->phi_blocks);
+			i->args       = args;
+			i->phi_blocks = blocks;
+			i->nargs      = bb->npreds;
+		}
+	}
+}
+
+/* walk two blocks up the partial dominator tree until they meet */
+struct ir_block * cfg_intersect(struct ir_block *a, struct ir_block *b)
+{
+	while (a != b)
+	{
+		while (a->rpo > b->rpo) a = a->idom;
+		while (b->rpo > a->rpo) b = b->idom;
+	}
+	return a;
+}
+
+/* cfg_dominators: immediate dominators, then the tree built from them */
+void cfg_dominators(struct ir_func *f)
+{
+	if (!f->nrpo) return;
+	struct ir_block *entry = f->rpo[0];
+
+	for (int k=0;k<f->nrpo;k++) f->rpo[k]->idom = 0;
+	entry->idom = entry;
+
+	int changed = 1;
+	while (changed)
+	{
+		changed = 0;
+		for (int k=1;k<f->nrpo;k++)
+		{
+			struct ir_block *bb = f->rpo[k];
+			struct ir_block *d = 0;
+			for (int p=0;p<bb->npreds;p++)
+			{
+				struct ir_block *pred = bb->preds[p];
+				if (!pred->idom) continue;		// not processed yet, comes around on the next pass
+				d = d ? cfg_intersect(pred, d) : pred;
+			}
+			if (d != bb->idom)
+			{
+				bb->idom = d;
+				changed = 1;
+			}
+		}
+	}
+	entry->idom = 0;
+
+	// children lists, again counted first
+	for (int k=0;k<f->nrpo;k++)
+	{
+		struct ir_block *bb = f->rpo[k];
+		free(bb->dom_children);
+		bb->dom_children  = 0;
+		bb->ndom_children = 0;
+	}
+	for (int k=1;k<f->nrpo;k++) f->rpo[k]->idom->ndom_children++;
+	for (int k=0;k<f->nrpo;k++)
+	{
+		struct ir_block *bb = f->rpo[k];
+		bb->dom_children  = calloc(bb->ndom_children + 1, sizeof(*bb->dom_children));
+		bb->ndom_children = 0;
+	}
+	for (int k=1;k<f->nrpo;k++)
+	{
+		struct ir_block *bb = f->rpo[k];
+		bb->idom->dom_children[bb->idom->ndom_children++] = bb;
+	}
+
+	// pre/post numbering of the tree: a dominates b exactly when b's interval nests inside a's
+	struct ir_block **stack = calloc(f->nrpo + 1, sizeof(*stack));
+	int *next_child = calloc(f->nblocks + 1, sizeof(int));
+	int sp = 0;
+	int clock = 0;
+
+	stack[sp++] = entry;
+	entry->dom_pre   = clock++;
+	entry->dom_depth = 0;
+	while (sp)
+	{
+		struct ir_block *bb = stack[sp - 1];
+		if (next_child[bb->id] < bb->ndom_children)
+		{
+			struct ir_block *c = bb->dom_children[next_child[bb->id]++];
+			c->dom_pre   = clock++;
+			c->dom_depth = bb->dom_depth + 1;
+			stack[sp++] = c;
+		}
+		else
+		{
+			bb->dom_post = clock++;
+			sp--;
+		}
+	}
+
+	free(stack);
+	free(next_child);
+}
+
+/* cfg_build: (re)compute edges, drop unreachable blocks and build the dominator tree of a function */
+/*
+- safe to call again whenever a pass changed a terminator, phis are kept in step with the new edges
+*/
+void cfg_build(struct ir_func *f)
+{
+	cfg_remove_unreachable(f);
+	cfg_preds(f);
+	cfg_phis(f);
+	cfg_dominators(f);
+}
+
+/* cfg_build_program: cfg_build on every function */
+void cfg_build_program(struct ir_program *p)
+{
+	for (struct ir_func *f = p->funcs; f; f = f->next)
+	{
+		cfg_build(f);
+	}
+}
+
+/* cfg_dominates: does a dominate b, every block dominates itself */
+int cfg_dominates(struct ir_block *a, struct ir_block *b)
+{
+	return a->dom_pre <= b->dom_pre && b->dom_post <= a->dom_post;
+}
+
+/* cfg_pred_index: position of pred in bb's predecessor list, which is also its phi argument, -1 if it isn't one */
+int cfg_pred_index(struct ir_block *bb, struct ir_block *pred)
+{
+	for (int p=0;p<bb->npreds;p++)
+	{
+		if (bb->preds[p] == pred) return p;
+	}
+	return -1;
+}
+
+/*
+GRAPHVIZ
+*/
+
+/* print one instruction as part of a dot label, escaped and left-justified */
+void cfg_print_dot_inst(struct ir_inst *i, FILE *out)
+{
+	char *text = 0;
+	size_t len = 0;
+	FILE *mem = open_memstream(&text, &len);
+	ir_print_inst(i, mem);
+	fclose(mem);
+
+	for (char *c = text; *c; c++)
+	{
+		if (*c == '\t') continue;
+		if (*c == '\n')      fprintf(out, "\\l");
+		else if (*c == '"' || *c == '\\') fprintf(out, "\\%c", *c);
+		else                 fputc(*c, out);
+	}
+	free(text);
+}
+
+/* cfg_print_dot: one function as a Graphviz cluster */
+/*
+- solid edges are control flow, true/false labelled on branches
+- dashed edges are the dominator tree, they don't take part in the layout
+*/
+void cfg_print_dot(struct ir_func *f, FILE *out)
+{
+	fprintf(out, "\tsubgraph \"cluster_%s\" {\n", f->name);
+	fprintf(out, "\t\tlabel=\"%s\";\n", f->name);
+
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		fprintf(out, "\t\t\"%s.B%i\" [label=\".B%i:\\l", f->name, bb->id, bb->id);
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			cfg_print_dot_inst(i, out);
+		}
+		fprintf(out, "\"];\n");
+	}
+
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (int s=0;s<bb->nsuccs;s++)
+		{
+			fprintf(out, "\t\t\"%s.B%i\" -> \"%s.B%i\"", f->name, bb->id, f->name, bb->succs[s]->id);
+			if (bb->nsuccs == 2) fprintf(out, " [label=\"%s\"]", s ? "F" : "T");
+			fprintf(out, ";\n");
+		}
+		if (bb->idom)
+		{
+			fprintf(out, "\t\t\"%s.B%i\" -> \"%s.B%i\" [style=dashed, color=blue, constraint=false];\n",
+				f->name, bb->idom->id, f->name, bb->id);
+		}
+	}
+
+	fprintf(out, "\t}\n");
+}
+
+/* cfg_print_dot_program: the whole program as one digraph, used by -emit-cfg */
+void cfg_print_dot_program(struct ir_program *p, FILE *out)
+{
+	fprintf(out, "digraph cfg {\n");
+	fprintf(out, "\tnode [shape=box, fontname=\"monospace\"];\n");
+	for (struct ir_func *f = p->funcs; f; f = f->next)
+	{
+		cfg_print_dot(f, out);
+	}
+	fprintf(out, "}\n");
+}
@@ -0,0 +1,23 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include "ir.h"
+#include <stdio.h>
+
+/*
+- control-flow graph of one IR function: successor and predecessor edges, reverse postorder and the dominator tree
+- everything is stored on the blocks themselves (see struct ir_block), so passes just walk bb->preds, bb->idom, ...
+*/
+
+void cfg_build( struct ir_func *f );
+void cfg_build_program( struct ir_program *p );
+int cfg_remove_unreachable( struct ir_func *f );
+int cfg_merge_blocks( struct ir_func *f );
+
+int cfg_dominates( struct ir_block *a, struct ir_block *b );
+int cfg_pred_index( struct ir_block *bb, struct ir_block *pred );
+
+void cfg_print_dot( struct ir_func *f, FILE *out );
+void cfg_print_dot_program( struct ir_program *p, FILE *out );
+
+#endif
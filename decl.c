@@ -2,6 +2,8 @@
 #include "scope.h"
 #include "label.c"
 #include "scratch.c"
+#include "string_pool.h"
+#include "target.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -14,6 +16,10 @@ extern int yylineno;
 
 extern int func_label;
 
+int decl_codegen_funcs = 1; // cleared when function bodies come from the IR backend instead, decl_codegen then only emits data
+extern int func_entry_label;
+extern const char *func_name;
+
 /* create a declaration */
 /*
 inputs
@@ -36,6 +42,7 @@ struct decl * decl_create( char *name,
 	d->type  = type;
 	d->value = value;
 	d->code  = code;
+	d->unused = 0;
 	d->next  = next;
 
 	return d;
@@ -273,6 +280,13 @@ void decl_codegen(struct decl *d, FILE *outfil)
 	// if no decl exists to generate code for then don't
 	if (!d) return;
 
+	// a global the rest of the program never touches takes no space at all
+	if (d->unused)
+	{
+		decl_codegen(d->next, outfil);
+		return;
+	}
+
 	// looking at declared scope first, types second
 	switch (d->symbol->kind)
 	{
@@ -291,8 +305,8 @@ void decl_codegen(struct decl *d, FILE *outfil)
 					// then we need to store this register of our local variable onto the stack
 					if (d->value) // check if there's a value we need to store
 					{
-						printf("\tstr\t%s, [sp, %s]\n", scratch_name(d->value->reg), symbol_codegen(d->symbol));
-						fprintf(outfil, "\tstr\t%s, [sp, %s]\n", scratch_name(d->value->reg), symbol_codegen(d->symbol));
+						printf("\tstr\t%s, [x29, %s]\n", scratch_name(d->value->reg), symbol_codegen(d->symbol));
+						fprintf(outfil, "\tstr\t%s, [x29, %s]\n", scratch_name(d->value->reg), symbol_codegen(d->symbol));
 						scratch_free(d->value->reg);
 					}
 					else // no expression coupled with variable, allocate a register ourselves
@@ -300,7 +314,7 @@ void decl_codegen(struct decl *d, FILE *outfil)
 						int no_assign_reg = scratch_alloc();
 						printf("\tstr\t%s, [sp, %i]\n", scratch_name(no_assign_reg), symbol_codegen(d->symbol));
 						// fprintf(outfil, "sup\n");
-						fprintf(outfil, "\tstr\t%s, [sp, %s]\n", scratch_name(no_assign_reg), symbol_codegen(d->symbol));
+						fprintf(outfil, "\tstr\t%s, [x29, %s]\n", scratch_name(no_assign_reg), symbol_codegen(d->symbol));
 						scratch_free(no_assign_reg);
 					}
 					break;
@@ -312,13 +326,13 @@ void decl_codegen(struct decl *d, FILE *outfil)
 					// then we need to store this register of our local variable onto the stack
 					if (d->value) // check if there's a value we need to store
 					{
-						fprintf(outfil, "\tstr\t%s, [sp, %s]\n", scratch_name(d->value->reg), symbol_codegen(d->symbol));
+						fprintf(outfil, "\tstr\t%s, [x29, %s]\n", scratch_name(d->value->reg), symbol_codegen(d->symbol));
 						scratch_free(d->value->reg);
 					}
 					else // no expression coupled with variable, allocate a register ourselves
 					{
 						int no_assign_reg = scratch_alloc();
-						fprintf(outfil, "\tstr\t%s, [sp, %s]\n", scratch_name(no_assign_reg), symbol_codegen(d->symbol));
+						fprintf(outfil, "\tstr\t%s, [x29, %s]\n", scratch_name(no_assign_reg), symbol_codegen(d->symbol));
 						scratch_free(no_assign_reg);
 					}
 					break;
@@ -350,7 +364,7 @@ void decl_codegen(struct decl *d, FILE *outfil)
 						// 8 bytes for every allocation
 						fprintf(outfil, "\t.global %s\n", d->name);
 						fprintf(outfil, "\t.data\n"); // is this still necessary after the first global var?
-						fprintf(outfil, "\t.align\t3\n");
+						fputs(target->align8, outfil);
 						fprintf(outfil, "\t.type\t%s, %%object\n",d->name);
 						fprintf(outfil, "\t.size\t%s, 8\n",d->name);
 
@@ -358,7 +372,7 @@ void decl_codegen(struct decl *d, FILE *outfil)
 						fprintf(outfil, "%s:\n",d->name);
 
 						// var value
-						fprintf(outfil, "\t.xword\t%d\n",d->value->literal_value);
+						fprintf(outfil, "\t%s\t%ld\n",target->xword,d->value->literal_value);
 					}
 					else // no initialization
 					{
@@ -371,16 +385,11 @@ void decl_codegen(struct decl *d, FILE *outfil)
 					{
 						// 8 bytes for every allocation
 						fprintf(outfil, "\t.global %s\n", d->name);
-						// fprintf(outfil, "\t.data\n"); // is this still necessary after the first global var?
-						fprintf(outfil, "\t.section\t.rodata\n");
-						fprintf(outfil, "\t.align\t3\n");
-
-						// label creation
-						int str_label = label_create();
-						fprintf(outfil, "%s:\n", label_name(str_label));
-						fprintf(outfil, "\t.string\t%s\n", d->value->string_literal);
+
+						// the characters go in the string pool, the variable itself is just a pointer to them
+						const char *str_label = string_pool_name(string_pool_intern(d->value->string_literal));
 						fprintf(outfil, "\t.section\t.data.rel.local,\"aw\"\n");
-						fprintf(outfil, "\t.align\t3\n");
+						fputs(target->align8, outfil);
 
 						fprintf(outfil, "\t.type\t%s, %%object\n",d->name);
 						fprintf(outfil, "\t.size\t%s, 8\n",d->name);
@@ -389,7 +398,7 @@ void decl_codegen(struct decl *d, FILE *outfil)
 						fprintf(outfil, "%s:\n",d->name);
 
 						// var value
-						fprintf(outfil, "\t.xword\t%s\n", label_name(str_label));
+						fprintf(outfil, "\t%s\t%s\n", target->xword, str_label);
 					}
 					else // no initialization
 					{
@@ -411,7 +420,7 @@ void decl_codegen(struct decl *d, FILE *outfil)
 						// 8 bytes for every allocation
 						fprintf(outfil, "\t.global %s\n", d->name);
 						fprintf(outfil, "\t.data\n"); // is this still necessary after the first global var?
-						fprintf(outfil, "\t.align\t3\n");
+						fputs(target->align8, outfil);
 						fprintf(outfil, "\t.type\t%s, %%object\n",d->name);
 						fprintf(outfil, "\t.size\t%s, %i\n",d->name,d->type->size*8);
 
@@ -421,7 +430,7 @@ void decl_codegen(struct decl *d, FILE *outfil)
 						// element values
 						while (elem_p)
 						{
-							fprintf(outfil, "\t.xword\t%d\n",elem_p->literal_value);
+							fprintf(outfil, "\t%s\t%ld\n",target->xword,elem_p->literal_value);
 							elem_p = elem_p->next;
 						}
 					}
@@ -443,7 +452,7 @@ void decl_codegen(struct decl *d, FILE *outfil)
 					    - should have unique label so that return statements can easily jump there
 					*/
 
-					if (d->code)
+					if (d->code && decl_codegen_funcs)
 					{
 						fprintf(outfil, "\t.text\n"); // no clue if this is right to keep or not
 						fprintf(outfil, "\t.align\t2\n");
@@ -459,6 +468,11 @@ void decl_codegen(struct decl *d, FILE *outfil)
 						// make the value of the frame pointer the same as the value of the stack pointer
 						fprintf(outfil, "\tmov\tx29, sp\n");
 						
+						// a self tail call puts the new arguments in x0-x7 and comes back here
+						func_name = d->name;
+						func_entry_label = label_create();
+						fprintf(outfil, "%s:\n", label_name(func_entry_label));
+
 						// store arguments immediately
 						// these arguments will be loaded into arg registers x0-x7
 						struct param_list *param = d->type->params;
@@ -474,7 +488,17 @@ void decl_codegen(struct decl *d, FILE *outfil)
 							arg_num++; // increase the argument counter
 							*/
 
-							fprintf(outfil, "\tstr\tx%i, [sp, %s]\n", param->symbol->which-1, symbol_codegen(param->symbol));
+							int arg_idx = param->symbol->which-1;
+							if (arg_idx < EXPR_CALL_REG_ARGS)
+							{
+								fprintf(outfil, "\tstr\tx%i, [x29, %s]\n", arg_idx, symbol_codegen(param->symbol));
+							}
+							else
+							{
+								// the caller left this one on the stack, right above our frame
+								fprintf(outfil, "\tldr\tx16, [x29, %i]\n", STACK_SIZE + (arg_idx - EXPR_CALL_REG_ARGS) * 8);
+								fprintf(outfil, "\tstr\tx16, [x29, %s]\n", symbol_codegen(param->symbol));
+							}
 
 							// go to the next parameter
 							param = param->next;
@@ -13,6 +13,7 @@ struct decl {
 	struct expr *value;
 	struct stmt *code;
 	struct symbol *symbol;
+	int unused;		// a global nothing reachable from main refers to, not emitted (see prune.c)
 	struct decl *next;
 };
 
@@ -0,0 +1,484 @@
+#include "encode.h"
+#include "string_pool.h"
+
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+- AArch64 instruction encoding and the -emit-obj object writer
+  - void encode_func( struct a64_func *mf, struct object *o, struct object_section *text );
+  - void encode_program( struct decl *d, struct ir_program *p, FILE *out );
+
+- every instruction is one 32-bit word, so a first pass over a function knows where each label lands and
+  branches within the function are resolved on the spot
+- anything that refers to a symbol is left to the linker with the relocation the assembler would have used:
+    adrp sym                 R_AARCH64_ADR_PREL_PG_HI21
+    add  :lo12:sym           R_AARCH64_ADD_ABS_LO12_NC
+    ldr/str :lo12:sym        R_AARCH64_LDST64_ABS_LO12_NC
+    bl sym / b sym           R_AARCH64_CALL26 / R_AARCH64_JUMP26
+    .xword sym               R_AARCH64_ABS64
+- a function's literal pool follows its code in .text, its loads are resolved like branches
+- pooled strings go in the mergeable .rodata.str1.1 the assembly output uses, so the linker can still fold
+  identical strings across objects, and are referenced through the section symbol plus their offset, the way
+  assemblers do for local labels, functions and globals through their own global symbols
+- an instruction with an operand that has no encoding is a compiler bug the assembler would also reject,
+  it stops the compile the same way
+*/
+
+int encode_insts  = 0;
+int encode_relocs = 0;
+
+// state for the object being written
+struct object         *encode_obj       = 0;
+struct object_section *encode_text      = 0;
+struct object_section *encode_rodata    = 0;
+long                  *encode_string_at = 0;	// offset in .rodata.str1.1 of each pooled string, by label
+int                    encode_nstrings  = 0;
+long                  *encode_label_at  = 0;	// offset in .text of each label of the current function
+int                    encode_nlabels   = 0;
+const char            *encode_func_name = 0;
+int                    encode_in_pool   = 0;	// .text ends in a literal pool, code after it needs its mapping symbol again
+
+/* stop at an instruction that can't be encoded */
+void encode_fail(struct a64_inst *i, const char *why)
+{
+	printf("codegen error: can't encode an instruction of %s, %s:\n", encode_func_name, why);
+	aarch64_print_inst(i, stdout);
+	exit(1);
+}
+
+/* register field, sp and xzr both encode as 31 */
+unsigned int encode_reg(int r)
+{
+	return r == A64_SP || r == A64_XZR ? 31 : r;
+}
+
+/* condition field */
+unsigned int encode_cond(a64_cond_t c)
+{
+	switch (c)
+	{
+		case A64_EQ: return 0x0;
+		case A64_NE: return 0x1;
+		case A64_GE: return 0xa;
+		case A64_LT: return 0xb;
+		case A64_GT: return 0xc;
+		default:     return 0xd;
+	}
+}
+
+/* encode_bitmask: N:immr:imms for a logical immediate, -1 when imm isn't a repeating rotated run of ones */
+/*
+- the element is the smallest power of two size (2 to 64 bits) imm repeats with
+- within the element the ones have to be contiguous once rotated, immr is that rotation and imms the run
+  length, with the element size folded into its high bits
+*/
+long encode_bitmask(unsigned long imm)
+{
+	if (imm == 0 || imm == ~0UL) return -1;
+
+	int size = 64;
+	while (size > 2)
+	{
+		int half = size / 2;
+		unsigned long mask = (1UL << half) - 1;
+		if ((imm & mask) != ((imm >> half) & mask)) break;
+		size = half;
+	}
+
+	unsigned long mask = size == 64 ? ~0UL : (1UL << size) - 1;
+	unsigned long elem = imm & mask;
+	int ones = __builtin_popcountl(elem);
+	unsigned long run = ones == 64 ? ~0UL : (1UL << ones) - 1;
+
+	for (int r=0;r<size;r++)
+	{
+		// rotating run right by r has to give elem
+		unsigned long rot = r ? ((run >> r) | (run << (size - r))) & mask : run;
+		if (rot != elem) continue;
+
+		unsigned long n    = size == 64;
+		unsigned long imms = ((-size << 1) & 0x3f) | (ones - 1);
+		return (n << 12) | ((unsigned long) r << 6) | imms;
+	}
+	return -1;
+}
+
+/* mov rd, #imm: movz, movn or an orr with a bitmask, whichever takes it alone */
+unsigned int encode_mov_imm(struct a64_inst *i, int rd, long imm)
+{
+	unsigned long u = (unsigned long) imm;
+	for (int s=0;s<64;s+=16)
+	{
+		if (!(u & ~(0xffffUL << s))) return 0xd2800000 | (s / 16) << 21 | ((u >> s) & 0xffff) << 5 | rd;
+	}
+	for (int s=0;s<64;s+=16)
+	{
+		if (!(~u & ~(0xffffUL << s))) return 0x92800000 | (s / 16) << 21 | ((~u >> s) & 0xffff) << 5 | rd;
+	}
+	long bits = encode_bitmask(u);
+	if (bits >= 0) return 0xb2000000 | bits << 10 | 31 << 5 | rd;
+	encode_fail(i, "no single instruction builds that constant");
+	return 0;
+}
+
+/* add/sub (or adds/subs when flags is set) rd, rn, #imm, a negative immediate flips between the two */
+unsigned int encode_addsub_imm(struct a64_inst *i, int sub, int flags, int rd, int rn, long imm)
+{
+	if (imm < 0)
+	{
+		sub = !sub;
+		imm = -imm;
+	}
+	unsigned int base = (sub ? 0xd1000000 : 0x91000000) | (flags ? 0x20000000 : 0);
+	if (imm < 4096)                           return base | imm << 10 | rn << 5 | rd;
+	if (!(imm & 0xfff) && imm < (4096L << 12)) return base | 1 << 22 | (imm >> 12) << 10 | rn << 5 | rd;
+	encode_fail(i, "the immediate doesn't fit 12 bits");
+	return 0;
+}
+
+/* ldr/str with an immediate offset, the scaled unsigned form when it fits and the unscaled one otherwise */
+unsigned int encode_ldst_imm(struct a64_inst *i, unsigned int scaled, unsigned int unscaled, int scale, int rt, int rn, long imm)
+{
+	if (imm >= 0 && !(imm % scale) && imm / scale < 4096) return scaled | (imm / scale) << 10 | rn << 5 | rt;
+	if (imm >= -256 && imm < 256)                          return unscaled | (imm & 0x1ff) << 12 | rn << 5 | rt;
+	encode_fail(i, "the offset is out of range");
+	return 0;
+}
+
+/* the 9-bit signed immediate of a post-indexed access */
+unsigned int encode_imm9(struct a64_inst *i, long imm)
+{
+	if (imm < -256 || imm > 255) encode_fail(i, "the post-index is out of range");
+	return (imm & 0x1ff) << 12;
+}
+
+/* the 7-bit scaled immediate of ldp/stp */
+unsigned int encode_imm7(struct a64_inst *i, long imm)
+{
+	if (imm % 8 || imm < -512 || imm > 504) encode_fail(i, "the pair offset is out of range");
+	return ((imm / 8) & 0x7f) << 15;
+}
+
+/* words between the instruction at pc and a label, checked against the bits the branch has */
+unsigned int encode_branch(struct a64_inst *i, long pc, int bits)
+{
+	if (i->label < 0 || i->label >= encode_nlabels || encode_label_at[i->label] < 0) encode_fail(i, "the label isn't in this function");
+	long words = (encode_label_at[i->label] - pc) / 4;
+	if (words < -(1L << (bits - 1)) || words >= (1L << (bits - 1))) encode_fail(i, "the branch is out of range");
+	return words & ((1UL << bits) - 1);
+}
+
+/* leave a symbol reference at pc to the linker */
+void encode_reloc(long pc, int type, const char *sym)
+{
+	int label = string_pool_label(sym);
+	if (label >= 0 && label < encode_nstrings && encode_string_at[label] >= 0)
+	{
+		object_reloc(encode_text, pc, type, encode_rodata->symbol, encode_string_at[label]);
+	}
+	else
+	{
+		object_reloc(encode_text, pc, type, object_symbol(encode_obj, sym), 0);
+	}
+	encode_relocs++;
+}
+
+/* encode_inst: the machine word for one instruction at offset pc of .text */
+unsigned int encode_inst(struct a64_inst *i, long pc)
+{
+	unsigned int rd = encode_reg(i->rd);
+	unsigned int rn = encode_reg(i->rn);
+	unsigned int rm = encode_reg(i->rm);
+	unsigned int ra = encode_reg(i->ra);
+
+	switch (i->op)
+	{
+		case A64_MOV:
+			// to or from sp it's an add of 0, otherwise an orr with xzr
+			if (i->rd == A64_SP || i->rn == A64_SP) return 0x91000000 | rn << 5 | rd;
+			return 0xaa0003e0 | rn << 16 | rd;
+		case A64_MOVI:
+			return encode_mov_imm(i, rd, i->imm);
+		case A64_MOVZ:
+		case A64_MOVN:
+		case A64_MOVK:
+		{
+			unsigned int base = i->op == A64_MOVZ ? 0xd2800000 : i->op == A64_MOVN ? 0x92800000 : 0xf2800000;
+			if (i->imm < 0 || i->imm > 0xffff || i->shift % 16 || i->shift < 0 || i->shift > 48) encode_fail(i, "not a 16-bit chunk");
+			return base | (i->shift / 16) << 21 | i->imm << 5 | rd;
+		}
+		case A64_ADD:
+			if (i->shift < 0 || i->shift > 63) encode_fail(i, "the shift is out of range");
+			return 0x8b000000 | rm << 16 | i->shift << 10 | rn << 5 | rd;
+		case A64_ADDI:
+			return encode_addsub_imm(i, 0, 0, rd, rn, i->imm);
+		case A64_SUB:
+			if (i->shift < 0 || i->shift > 63) encode_fail(i, "the shift is out of range");
+			return 0xcb000000 | rm << 16 | i->shift << 10 | rn << 5 | rd;
+		case A64_SUBI:
+			return encode_addsub_imm(i, 1, 0, rd, rn, i->imm);
+		case A64_MUL:
+			return 0x9b007c00 | rm << 16 | rn << 5 | rd;
+		case A64_SDIV:
+			return 0x9ac00c00 | rm << 16 | rn << 5 | rd;
+		case A64_MADD:
+			return 0x9b000000 | rm << 16 | ra << 10 | rn << 5 | rd;
+		case A64_MSUB:
+			return 0x9b008000 | rm << 16 | ra << 10 | rn << 5 | rd;
+		case A64_LSLI:
+			// ubfm rd, rn, #(-imm mod 64), #(63-imm)
+			if (i->imm < 0 || i->imm > 63) encode_fail(i, "the shift is out of range");
+			return 0xd3400000 | ((-i->imm) & 63) << 16 | (63 - i->imm) << 10 | rn << 5 | rd;
+		case A64_AND:
+			return 0x8a000000 | rm << 16 | rn << 5 | rd;
+		case A64_ORR:
+			return 0xaa000000 | rm << 16 | rn << 5 | rd;
+		case A64_EORI:
+		{
+			long bits = encode_bitmask(i->imm);
+			if (bits < 0) encode_fail(i, "not a bitmask immediate");
+			return 0xd2000000 | bits << 10 | rn << 5 | rd;
+		}
+		case A64_NEG:
+			return 0xcb0003e0 | rm << 16 | rd;
+		case A64_CMP:
+			return 0xeb00001f | rm << 16 | rn << 5;
+		case A64_CMPI:
+			return encode_addsub_imm(i, 1, 1, 31, rn, i->imm);
+		case A64_CSET:
+			// csinc rd, xzr, xzr with the opposite condition
+			return 0x9a9f07e0 | (encode_cond(i->cond) ^ 1) << 12 | rd;
+		case A64_CINC:
+			// csinc rd, rn, rn with the opposite condition
+			return 0x9a800400 | rn << 16 | (encode_cond(i->cond) ^ 1) << 12 | rn << 5 | rd;
+		case A64_CSEL:
+			return 0x9a800000 | rm << 16 | encode_cond(i->cond) << 12 | rn << 5 | rd;
+		case A64_CSINC:
+			return 0x9a800400 | rm << 16 | encode_cond(i->cond) << 12 | rn << 5 | rd;
+		case A64_CSNEG:
+			return 0xda800400 | rm << 16 | encode_cond(i->cond) << 12 | rn << 5 | rd;
+		case A64_LDR:
+			return encode_ldst_imm(i, 0xf9400000, 0xf8400000, 8, rd, rn, i->imm);
+		case A64_STR:
+			return encode_ldst_imm(i, 0xf9000000, 0xf8000000, 8, rd, rn, i->imm);
+		case A64_LDRX:
+			return 0xf8607800 | rm << 16 | rn << 5 | rd;
+		case A64_STRX:
+			return 0xf8207800 | rm << 16 | rn << 5 | rd;
+		case A64_LDR_POST:
+			return 0xf8400400 | encode_imm9(i, i->imm) | rn << 5 | rd;
+		case A64_STR_POST:
+			return 0xf8000400 | encode_imm9(i, i->imm) | rn << 5 | rd;
+		case A64_LDP:
+			return 0xa9400000 | encode_imm7(i, i->imm) | ra << 10 | rn << 5 | rd;
+		case A64_STP:
+			return 0xa9000000 | encode_imm7(i, i->imm) | ra << 10 | rn << 5 | rd;
+		case A64_STP_PRE:
+			return 0xa9800000 | encode_imm7(i, i->imm) | ra << 10 | rn << 5 | rd;
+		case A64_LDP_POST:
+			return 0xa8c00000 | encode_imm7(i, i->imm) | ra << 10 | rn << 5 | rd;
+		case A64_ADRP:
+			encode_reloc(pc, R_AARCH64_ADR_PREL_PG_HI21, i->sym);
+			return 0x90000000 | rd;
+		case A64_ADDLO:
+			encode_reloc(pc, R_AARCH64_ADD_ABS_LO12_NC, i->sym);
+			return 0x91000000 | rn << 5 | rd;
+		case A64_LDRLO:
+			encode_reloc(pc, R_AARCH64_LDST64_ABS_LO12_NC, i->sym);
+			return 0xf9400000 | rn << 5 | rd;
+		case A64_STRLO:
+			encode_reloc(pc, R_AARCH64_LDST64_ABS_LO12_NC, i->sym);
+			return 0xf9000000 | rn << 5 | rd;
+		case A64_LDRLIT:
+			return 0x58000000 | encode_branch(i, pc, 19) << 5 | rd;
+		case A64_B:
+			if (i->label >= 0) return 0x14000000 | encode_branch(i, pc, 26);
+			encode_reloc(pc, R_AARCH64_JUMP26, i->sym);
+			return 0x14000000;
+		case A64_BCOND:
+			return 0x54000000 | encode_branch(i, pc, 19) << 5 | encode_cond(i->cond);
+		case A64_CBZ:
+			return 0xb4000000 | encode_branch(i, pc, 19) << 5 | rn;
+		case A64_CBNZ:
+			return 0xb5000000 | encode_branch(i, pc, 19) << 5 | rn;
+		case A64_BL:
+			encode_reloc(pc, R_AARCH64_CALL26, i->sym);
+			return 0x94000000;
+		case A64_RET:
+			return 0xd65f03c0;
+		case A64_LDRQ:
+			return encode_ldst_imm(i, 0x3dc00000, 0x3cc00000, 16, i->rd, rn, i->imm);
+		case A64_STRQ:
+			return encode_ldst_imm(i, 0x3d800000, 0x3c800000, 16, i->rd, rn, i->imm);
+		case A64_LDRQ_POST:
+			return 0x3cc00400 | encode_imm9(i, i->imm) | rn << 5 | i->rd;
+		case A64_STRQ_POST:
+			return 0x3c800400 | encode_imm9(i, i->imm) | rn << 5 | i->rd;
+		case A64_DUP:
+			return 0x4e080c00 | rn << 5 | i->rd;
+		case A64_VADD:
+			return 0x4ee08400 | i->rm << 16 | i->rn << 5 | i->rd;
+		case A64_VSUB:
+			return 0x6ee08400 | i->rm << 16 | i->rn << 5 | i->rd;
+		case A64_ADDP:
+			return 0x5ef1b800 | i->rn << 5 | i->rd;
+		case A64_FMOV:
+			return 0x9e660000 | i->rn << 5 | rd;
+		case A64_LABEL:
+			break;
+	}
+
+	encode_fail(i, "unknown instruction");
+	return 0;
+}
+
+/* encode_func: append a selected function to .text, labels resolved and symbol references relocated */
+void encode_func(struct a64_func *mf, struct object *o, struct object_section *text)
+{
+	encode_obj       = o;
+	encode_text      = text;
+	encode_func_name = mf->name;
+	if (encode_in_pool) object_local(o, "$x", text, text->size, STT_NOTYPE);
+	encode_in_pool = 0;
+
+	// where every label lands, each instruction is 4 bytes, the literal pool 8-byte aligned after them
+	int max = -1;
+	for (struct a64_inst *i = mf->first; i; i = i->next) if (i->label > max) max = i->label;
+	for (int k=0;k<mf->npool;k++) if (mf->pool_label[k] > max) max = mf->pool_label[k];
+	if (max >= encode_nlabels)
+	{
+		encode_nlabels  = max + 1;
+		encode_label_at = realloc(encode_label_at, encode_nlabels * sizeof(long));
+	}
+	for (int k=0;k<encode_nlabels;k++) encode_label_at[k] = -1;
+
+	long pc = text->size;
+	for (struct a64_inst *i = mf->first; i; i = i->next)
+	{
+		if (i->op == A64_LABEL) encode_label_at[i->label] = pc;
+		else                    pc += 4;
+	}
+	pc = (pc + 7) & ~7L;
+	for (int k=0;k<mf->npool;k++) encode_label_at[mf->pool_label[k]] = pc + 8 * k;
+
+	for (struct a64_inst *i = mf->first; i; i = i->next)
+	{
+		if (i->op == A64_LABEL) continue;
+		object_word32(text, encode_inst(i, text->size));
+		encode_insts++;
+	}
+
+	// padded with nops the way the assembler does in code, the pool is data as far as the mapping symbols go
+	if (!mf->npool) return;
+	while (text->size % 8) object_word32(text, 0xd503201f);
+	if (text->align < 8) text->align = 8;
+	object_local(o, "$d", text, text->size, STT_NOTYPE);
+	for (int k=0;k<mf->npool;k++) object_word64(text, (unsigned long) mf->pool[k]);
+	encode_in_pool = 1;
+}
+
+/* encode_data: globals into .data, or common blocks when they start out zero, like decl_codegen does */
+void encode_data(struct decl *d, struct object *o, struct object_section *data, struct object_section *rel)
+{
+	for (; d; d = d->next)
+	{
+		if (d->unused || d->symbol->kind != SYMBOL_GLOBAL || d->type->kind == TYPE_FUNCTION) continue;
+
+		struct object_symbol *sym = object_symbol(o, d->name);
+		switch (d->type->kind)
+		{
+			case TYPE_BOOLEAN:
+			case TYPE_CHARACTER:
+			case TYPE_INTEGER:
+				if (d->value && d->value->literal_value)
+				{
+					object_align(data, 8);
+					object_define(sym, data, data->size, 8, STT_OBJECT, STB_GLOBAL);
+					object_word64(data, (long) d->value->literal_value);
+				}
+				else object_common(sym, 8, 8);
+				break;
+			case TYPE_STRING:
+				if (d->value && d->value->string_literal)
+				{
+					// a pointer to the characters in .rodata.str1.1, in .data.rel.local like the assembly has it
+					int label = string_pool_intern(d->value->string_literal);
+					object_align(rel, 8);
+					object_define(sym, rel, rel->size, 8, STT_OBJECT, STB_GLOBAL);
+					object_reloc(rel, rel->size, R_AARCH64_ABS64, encode_rodata->symbol, encode_string_at[label]);
+					object_word64(rel, 0);
+					encode_relocs++;
+				}
+				else object_common(sym, 8, 8);
+				break;
+			case TYPE_ARRAY:
+				if (d->type->subtype->kind != TYPE_INTEGER)
+				{
+					printf("codegen error: only 1D arrays of integers are supported.\n");
+					exit(1);
+				}
+				if (d->value)
+				{
+					object_align(data, 8);
+					object_define(sym, data, data->size, d->type->size * 8, STT_OBJECT, STB_GLOBAL);
+					for (struct expr *e = d->value; e; e = e->next) object_word64(data, (long) e->literal_value);
+				}
+				else object_common(sym, d->type->size * 8, 8);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+/* encode_program: write the whole program as an ELF relocatable object */
+void encode_program(struct decl *d, struct ir_program *p, FILE *out)
+{
+	struct object *o = object_create(EM_AARCH64);
+	struct object_section *text = object_section(o, ".text",   SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 4);
+	struct object_section *data = object_section(o, ".data",   SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 8);
+	struct object_section *rel  = object_section(o, ".data.rel.local", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 8);
+	encode_rodata               = object_section(o, ".rodata.str1.1", SHT_PROGBITS, SHF_ALLOC | SHF_MERGE | SHF_STRINGS, 1);
+	encode_rodata->entsize      = 1;
+	object_section(o, ".note.GNU-stack", SHT_PROGBITS, 0, 1);
+
+	// the literals string globals point at join the pool before it's laid out
+	for (struct decl *g = d; g; g = g->next)
+	{
+		if (g->unused || g->symbol->kind != SYMBOL_GLOBAL || g->type->kind != TYPE_STRING) continue;
+		if (g->value && g->value->string_literal) string_pool_intern(g->value->string_literal);
+	}
+	for (int label = string_pool_next(-1); label >= 0; label = string_pool_next(label))
+	{
+		if (label >= encode_nstrings)
+		{
+			encode_string_at = realloc(encode_string_at, (label + 1) * sizeof(long));
+			for (int k=encode_nstrings;k<=label;k++) encode_string_at[k] = -1;
+			encode_nstrings = label + 1;
+		}
+		const char *s = string_pool_text(label);
+		encode_string_at[label] = encode_rodata->size;
+		object_append(encode_rodata, s, strlen(s) + 1);
+	}
+
+	encode_data(d, o, data, rel);
+
+	for (struct ir_func *f = p->funcs; f; f = f->next)
+	{
+		struct a64_func *mf = aarch64_select(f);
+		long start = text->size;
+		encode_func(mf, o, text);
+		object_define(object_symbol(o, f->name), text, start, text->size - start, STT_FUNC, STB_GLOBAL);
+	}
+
+	// mapping symbols, code and data as the ELF for AArch64 ABI has them
+	if (text->size)          object_local(o, "$x", text, 0, STT_NOTYPE);
+	if (data->size)          object_local(o, "$d", data, 0, STT_NOTYPE);
+	if (rel->size)           object_local(o, "$d", rel, 0, STT_NOTYPE);
+	if (encode_rodata->size) object_local(o, "$d", encode_rodata, 0, STT_NOTYPE);
+
+	object_write(o, out);
+}
@@ -0,0 +1,26 @@
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include "aarch64.h"
+#include "object.h"
+#include "decl.h"
+
+#include <stdio.h>
+
+/*
+- integrated assembler for the AArch64 backend: the instructions aarch64_select picks are encoded into machine
+  words here instead of printed, and -emit-obj writes them out as an ELF relocatable object, .text, .data and
+  .rodata with their symbols and relocations, so no assembler has to run at all
+- the object links the same as the assembled .s: same symbols, same sizes, same code
+*/
+
+extern int encode_insts;		// instructions encoded
+extern int encode_relocs;		// relocations left for the linker
+
+long encode_bitmask( unsigned long imm );
+
+void encode_func( struct a64_func *mf, struct object *o, struct object_section *text );
+
+void encode_program( struct decl *d, struct ir_program *p, FILE *out );
+
+#endif
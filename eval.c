@@ -0,0 +1,490 @@
+#include "eval.h"
+#include "hash_table.h"
+#include "param_list.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+- evaluates pure function calls with constant arguments while compiling
+  - void eval_program( struct decl *d, int calls );
+
+- runs on the typechecked AST, before anything is lowered
+- global initializers are always computed here, so a global can be initialized with a call (or any constant
+  expression), an initializer that can't be computed is an error
+- with calls set, every call anywhere in the code whose arguments are constants gets evaluated too, and
+  becomes a literal of the function's return type when that works out
+- purity is worked out per function, and only once: every function in a cycle of calls is assumed pure while
+  the cycle is being checked, and only marked pure for good if the function the check started from is
+- the interpreter runs 64-bit like the generated code, with the same wrapping arithmetic; anything it can't do
+  the same as the hardware would (dividing by zero, an index out of range), or that takes longer than
+  EVAL_BUDGET steps, gives up on the call and leaves it alone
+- a result is folded into a literal, which holds any 64-bit value
+*/
+
+int eval_calls   = 0;
+int eval_globals = 0;
+
+#define EVAL_UNKNOWN  0
+#define EVAL_CHECKING 1
+#define EVAL_MAYBE    2		// pure, if the functions still being checked turn out pure
+#define EVAL_PURE     3
+#define EVAL_IMPURE   4
+
+typedef enum {
+	EVAL_OK,
+	EVAL_FAIL,
+	EVAL_RETURN
+} eval_t;
+
+struct eval_var {
+	struct symbol *sym;
+	long value;
+};
+
+// the locals and parameters of one call, looked up by symbol
+struct eval_frame {
+	struct eval_var *vars;
+	int nvars;
+	int cap;
+};
+
+struct hash_table *eval_funcs   = 0;	// name -> decl of every function with a body
+struct hash_table *eval_vars    = 0;	// name -> decl of every global variable
+struct hash_table *eval_written = 0;	// name -> decl of every global some code assigns
+struct hash_table *eval_state   = 0;	// name -> EVAL_UNKNOWN ... EVAL_IMPURE of every function looked at
+
+struct decl **eval_maybe  = 0;			// functions marked EVAL_MAYBE since the last check started
+int           eval_nmaybe = 0;
+
+long eval_steps  = 0;
+int  eval_depth  = 0;		// calls deep the interpreter is
+int  eval_checks = 0;		// functions deep the purity check is
+
+/* purity state of a function */
+int eval_get_state(struct decl *d)
+{
+	return (int) (long) hash_table_lookup(eval_state, d->name);
+}
+
+void eval_set_state(struct decl *d, int state)
+{
+	hash_table_remove(eval_state, d->name);
+	hash_table_insert(eval_state, d->name, (void *) (long) state);
+}
+
+/* is a value of this type something the interpreter holds in a long */
+int eval_is_scalar(struct type *t)
+{
+	return t && (t->kind == TYPE_INTEGER || t->kind == TYPE_BOOLEAN || t->kind == TYPE_CHARACTER);
+}
+
+/* note the globals an expression assigns */
+void eval_note_expr(struct expr *e)
+{
+	for (; e; e = e->next)
+	{
+		if (e->kind == EXPR_ASSIGN || e->kind == EXPR_INCR || e->kind == EXPR_DECR)
+		{
+			struct expr *t = e->left;
+			if (t && t->kind == EXPR_ARRELEM) t = t->left;
+			if (t && t->kind == EXPR_NAME && t->symbol && t->symbol->kind == SYMBOL_GLOBAL)
+			{
+				hash_table_insert(eval_written, t->name, t);
+			}
+		}
+		eval_note_expr(e->left);
+		eval_note_expr(e->right);
+	}
+}
+
+/* note the globals a statement list assigns */
+void eval_note_stmt(struct stmt *s)
+{
+	for (; s; s = s->next)
+	{
+		if (s->decl) eval_note_expr(s->decl->value);
+		eval_note_expr(s->init_expr);
+		eval_note_expr(s->expr);
+		eval_note_expr(s->next_expr);
+		eval_note_stmt(s->body);
+		eval_note_stmt(s->else_body);
+	}
+}
+
+int eval_pure_func( struct decl *d );
+
+/* does an expression stay within what a pure function may do */
+int eval_pure_expr(struct expr *e)
+{
+	if (!e) return 1;
+	switch (e->kind)
+	{
+		case EXPR_STRING_LITERAL:
+			return 0;
+		case EXPR_NAME:
+			if (!eval_is_scalar(e->symbol->type)) return 0;
+			return e->symbol->kind != SYMBOL_GLOBAL || !hash_table_lookup(eval_written, e->name);
+		case EXPR_ARRELEM:
+		{
+			struct expr *a = e->left;
+			if (a->kind != EXPR_NAME || a->symbol->kind != SYMBOL_GLOBAL || hash_table_lookup(eval_written, a->name)) return 0;
+			return eval_pure_expr(e->right);
+		}
+		case EXPR_ASSIGN:
+		case EXPR_INCR:
+		case EXPR_DECR:
+			if (e->left->kind != EXPR_NAME || e->left->symbol->kind == SYMBOL_GLOBAL) return 0;
+			return eval_pure_expr(e->right);
+		case EXPR_FUNCCALL:
+		{
+			struct decl *g = hash_table_lookup(eval_funcs, e->left->name);
+			if (!g || !eval_pure_func(g)) return 0;
+			for (struct expr *a = e->right; a; a = a->next) if (!eval_pure_expr(a)) return 0;
+			return 1;
+		}
+		default:
+			return eval_pure_expr(e->left) && eval_pure_expr(e->right);
+	}
+}
+
+/* does a statement list stay within what a pure function may do */
+int eval_pure_stmt(struct stmt *s)
+{
+	for (; s; s = s->next)
+	{
+		if (s->kind == STMT_PRINT) return 0;
+		if (s->decl && (!eval_is_scalar(s->decl->type) || !eval_pure_expr(s->decl->value))) return 0;
+		if (!eval_pure_expr(s->init_expr) || !eval_pure_expr(s->expr) || !eval_pure_expr(s->next_expr)) return 0;
+		if (!eval_pure_stmt(s->body) || !eval_pure_stmt(s->else_body)) return 0;
+	}
+	return 1;
+}
+
+/* eval_pure_func: can calls to function d be evaluated, it only computes a value out of its arguments */
+int eval_pure_func(struct decl *d)
+{
+	int state = eval_get_state(d);
+	if (state == EVAL_PURE || state == EVAL_IMPURE) return state == EVAL_PURE;
+	if (state == EVAL_CHECKING || state == EVAL_MAYBE) return 1;
+
+	int root = !eval_checks;
+	eval_checks++;
+	eval_set_state(d, EVAL_CHECKING);
+
+	int pure = eval_is_scalar(d->type->subtype);
+	for (struct param_list *p = d->type->params; p && pure; p = p->next) pure = eval_is_scalar(p->type);
+	pure = pure && eval_pure_stmt(d->code);
+
+	eval_checks--;
+	if (!pure)
+	{
+		eval_set_state(d, EVAL_IMPURE);
+	}
+	else
+	{
+		eval_set_state(d, EVAL_MAYBE);
+		eval_maybe = realloc(eval_maybe, (eval_nmaybe + 1) * sizeof(*eval_maybe));
+		eval_maybe[eval_nmaybe++] = d;
+	}
+
+	// the check that started it all is done: what it assumed either held for everything, or gets looked at again
+	if (root)
+	{
+		for (int k=0;k<eval_nmaybe;k++) eval_set_state(eval_maybe[k], pure ? EVAL_PURE : EVAL_UNKNOWN);
+		if (!pure) eval_set_state(d, EVAL_IMPURE);
+		eval_nmaybe = 0;
+	}
+	return pure;
+}
+
+/* the slot of a local or parameter in a frame, made if it isn't there yet */
+long * eval_slot(struct eval_frame *fr, struct symbol *sym)
+{
+	for (int k=0;k<fr->nvars;k++) if (fr->vars[k].sym == sym) return &fr->vars[k].value;
+	if (fr->nvars == fr->cap)
+	{
+		fr->cap  = fr->cap ? 2 * fr->cap : 8;
+		fr->vars = realloc(fr->vars, fr->cap * sizeof(*fr->vars));
+	}
+	fr->vars[fr->nvars].sym   = sym;
+	fr->vars[fr->nvars].value = 0;
+	return &fr->vars[fr->nvars++].value;
+}
+
+/* the value a global that's never assigned always has */
+eval_t eval_global(struct decl *d, long index, long *v)
+{
+	struct expr *e = d->value;
+	if (d->type->kind == TYPE_ARRAY)
+	{
+		if (index < 0 || index >= d->type->size) return EVAL_FAIL;
+		for (long k=0;e && k<index;k++) e = e->next;
+	}
+	if (!e)
+	{
+		*v = 0;
+		return EVAL_OK;
+	}
+	if (e->kind != EXPR_INT_LITERAL && e->kind != EXPR_BOOLEAN_LITERAL && e->kind != EXPR_CHAR_LITERAL) return EVAL_FAIL;
+	*v = e->literal_value;
+	return EVAL_OK;
+}
+
+eval_t eval_call( struct decl *d, struct expr *args, struct eval_frame *caller, long *result );
+
+/* eval_expr: the value of an expression, fr is 0 where there are no locals (outside any function) */
+eval_t eval_expr(struct eval_frame *fr, struct expr *e, long *v)
+{
+	long a, b;
+	eval_t st;
+	if (++eval_steps > EVAL_BUDGET) return EVAL_FAIL;
+
+	switch (e->kind)
+	{
+		case EXPR_INT_LITERAL:
+		case EXPR_BOOLEAN_LITERAL:
+		case EXPR_CHAR_LITERAL:
+			*v = e->literal_value;
+			return EVAL_OK;
+		case EXPR_NAME:
+			if (e->symbol->kind == SYMBOL_GLOBAL)
+			{
+				struct decl *g = hash_table_lookup(eval_vars, e->name);
+				if (!g || hash_table_lookup(eval_written, e->name)) return EVAL_FAIL;
+				return eval_global(g, 0, v);
+			}
+			if (!fr) return EVAL_FAIL;
+			*v = *eval_slot(fr, e->symbol);
+			return EVAL_OK;
+		case EXPR_ARRELEM:
+		{
+			struct decl *g = hash_table_lookup(eval_vars, e->left->name);
+			if (!g || hash_table_lookup(eval_written, e->left->name)) return EVAL_FAIL;
+			if ((st = eval_expr(fr, e->right, &a)) != EVAL_OK) return st;
+			return eval_global(g, a, v);
+		}
+		case EXPR_ASSIGN:
+			if (!fr || e->left->kind != EXPR_NAME || e->left->symbol->kind == SYMBOL_GLOBAL) return EVAL_FAIL;
+			if ((st = eval_expr(fr, e->right, v)) != EVAL_OK) return st;
+			*eval_slot(fr, e->left->symbol) = *v;
+			return EVAL_OK;
+		case EXPR_INCR:
+		case EXPR_DECR:
+		{
+			if (!fr || e->left->kind != EXPR_NAME || e->left->symbol->kind == SYMBOL_GLOBAL) return EVAL_FAIL;
+			long *slot = eval_slot(fr, e->left->symbol);
+			*v = *slot;
+			*slot = (long) ((unsigned long) *slot + (e->kind == EXPR_INCR ? 1UL : -1UL));
+			return EVAL_OK;
+		}
+		case EXPR_GROUP:
+			return eval_expr(fr, e->right, v);
+		case EXPR_NOT:
+		case EXPR_NEG:
+			if ((st = eval_expr(fr, e->right ? e->right : e->left, &a)) != EVAL_OK) return st;
+			*v = e->kind == EXPR_NOT ? a ^ 1 : (long) (0UL - (unsigned long) a);
+			return EVAL_OK;
+		case EXPR_FUNCCALL:
+		{
+			struct decl *g = hash_table_lookup(eval_funcs, e->left->name);
+			if (!g || !eval_pure_func(g)) return EVAL_FAIL;
+			return eval_call(g, e->right, fr, v);
+		}
+		case EXPR_STRING_LITERAL:
+			return EVAL_FAIL;
+		default:
+			break;
+	}
+
+	// binary operators, both sides are always evaluated like the generated code does
+	if ((st = eval_expr(fr, e->left, &a)) != EVAL_OK) return st;
+	if ((st = eval_expr(fr, e->right, &b)) != EVAL_OK) return st;
+	unsigned long ua = (unsigned long) a, ub = (unsigned long) b;
+	switch (e->kind)
+	{
+		case EXPR_ADD: *v = (long) (ua + ub); return EVAL_OK;
+		case EXPR_SUB: *v = (long) (ua - ub); return EVAL_OK;
+		case EXPR_MUL: *v = (long) (ua * ub); return EVAL_OK;
+		case EXPR_DIV:
+		case EXPR_MOD:
+			if (b == 0 || (b == -1 && a == (long) (1UL << 63))) return EVAL_FAIL;
+			*v = e->kind == EXPR_DIV ? a / b : a % b;
+			return EVAL_OK;
+		case EXPR_EXP:
+		{
+			// same loop as integer_power in the runtime library
+			unsigned long r = 1;
+			if (b > EVAL_BUDGET - eval_steps) return EVAL_FAIL;
+			if (b > 0) eval_steps += b;
+			for (; b > 0; b--) r *= ua;
+			*v = (long) r;
+			return EVAL_OK;
+		}
+		case EXPR_LE:  *v = a <= b; return EVAL_OK;
+		case EXPR_LT:  *v = a < b;  return EVAL_OK;
+		case EXPR_GE:  *v = a >= b; return EVAL_OK;
+		case EXPR_GT:  *v = a > b;  return EVAL_OK;
+		case EXPR_EQ:  *v = a == b; return EVAL_OK;
+		case EXPR_NEQ: *v = a != b; return EVAL_OK;
+		case EXPR_AND: *v = a & b;  return EVAL_OK;
+		case EXPR_OR:  *v = a | b;  return EVAL_OK;
+		default:       return EVAL_FAIL;
+	}
+}
+
+/* run a statement list, *ret set when it returns */
+eval_t eval_stmt(struct eval_frame *fr, struct stmt *s, long *ret)
+{
+	long v;
+	eval_t st;
+	for (; s; s = s->next)
+	{
+		if (++eval_steps > EVAL_BUDGET) return EVAL_FAIL;
+		switch (s->kind)
+		{
+			case STMT_DECL:
+				v = 0;
+				if (s->decl->value && (st = eval_expr(fr, s->decl->value, &v)) != EVAL_OK) return st;
+				*eval_slot(fr, s->decl->symbol) = v;
+				break;
+			case STMT_EXPR:
+				if ((st = eval_expr(fr, s->expr, &v)) != EVAL_OK) return st;
+				break;
+			case STMT_IF_ELSE:
+				if ((st = eval_expr(fr, s->expr, &v)) != EVAL_OK) return st;
+				if ((st = eval_stmt(fr, v ? s->body : s->else_body, ret)) != EVAL_OK) return st;
+				break;
+			case STMT_FOR:
+				if (s->init_expr && (st = eval_expr(fr, s->init_expr, &v)) != EVAL_OK) return st;
+				while (1)
+				{
+					v = 1;
+					if (s->expr && (st = eval_expr(fr, s->expr, &v)) != EVAL_OK) return st;
+					if (!v) break;
+					if ((st = eval_stmt(fr, s->body, ret)) != EVAL_OK) return st;
+					if (s->next_expr && (st = eval_expr(fr, s->next_expr, &v)) != EVAL_OK) return st;
+				}
+				break;
+			case STMT_RETURN:
+				if (!s->expr || (st = eval_expr(fr, s->expr, ret)) != EVAL_OK) return EVAL_FAIL;
+				return EVAL_RETURN;
+			case STMT_BLOCK:
+				if ((st = eval_stmt(fr, s->body, ret)) != EVAL_OK) return st;
+				break;
+			default:
+				return EVAL_FAIL;
+		}
+	}
+	return EVAL_OK;
+}
+
+/* eval_call: run function d on the arguments args, evaluated in the caller's frame */
+eval_t eval_call(struct decl *d, struct expr *args, struct eval_frame *caller, long *result)
+{
+	if (eval_depth == EVAL_DEPTH) return EVAL_FAIL;
+
+	struct eval_frame fr = { 0, 0, 0 };
+	eval_t st = EVAL_OK;
+	struct param_list *p = d->type->params;
+	for (struct expr *a = args; a && p && st == EVAL_OK; a = a->next, p = p->next)
+	{
+		long v;
+		st = eval_expr(caller, a, &v);
+		*eval_slot(&fr, p->symbol) = v;
+	}
+
+	if (st == EVAL_OK)
+	{
+		eval_depth++;
+		st = eval_stmt(&fr, d->code, result);
+		eval_depth--;
+	}
+	free(fr.vars);
+
+	// falling off the end leaves no value to fold to
+	return st == EVAL_RETURN ? EVAL_OK : EVAL_FAIL;
+}
+
+/* turn expression e into a literal of type t holding v */
+int eval_fold(struct expr *e, struct type *t, long v)
+{
+	if      (t->kind == TYPE_BOOLEAN)   e->kind = EXPR_BOOLEAN_LITERAL;
+	else if (t->kind == TYPE_CHARACTER) e->kind = EXPR_CHAR_LITERAL;
+	else                                e->kind = EXPR_INT_LITERAL;
+	e->literal_value = v;
+	e->left   = 0;
+	e->right  = 0;
+	e->symbol = 0;
+	e->name   = 0;
+	return 1;
+}
+
+/* evaluate every call with constant arguments in an expression list */
+void eval_calls_expr(struct expr *e)
+{
+	for (; e; e = e->next)
+	{
+		eval_calls_expr(e->left);
+		eval_calls_expr(e->right);
+		if (e->kind != EXPR_FUNCCALL) continue;
+
+		struct decl *g = hash_table_lookup(eval_funcs, e->left->name);
+		long v;
+		eval_steps = 0;
+		if (!g || !eval_pure_func(g) || eval_call(g, e->right, 0, &v) != EVAL_OK) continue;
+		if (eval_fold(e, g->type->subtype, v)) eval_calls++;
+	}
+}
+
+/* evaluate every call with constant arguments in a statement list */
+void eval_calls_stmt(struct stmt *s)
+{
+	for (; s; s = s->next)
+	{
+		if (s->decl) eval_calls_expr(s->decl->value);
+		eval_calls_expr(s->init_expr);
+		eval_calls_expr(s->expr);
+		eval_calls_expr(s->next_expr);
+		eval_calls_stmt(s->body);
+		eval_calls_stmt(s->else_body);
+	}
+}
+
+/* eval_program: compute the global initializers, and with calls set evaluate every call that can be */
+void eval_program(struct decl *d, int calls)
+{
+	eval_funcs   = hash_table_create(0, 0);
+	eval_vars    = hash_table_create(0, 0);
+	eval_written = hash_table_create(0, 0);
+	eval_state   = hash_table_create(0, 0);
+
+	for (struct decl *g = d; g; g = g->next)
+	{
+		if (g->type->kind == TYPE_FUNCTION && g->code) hash_table_insert(eval_funcs, g->name, g);
+		else if (g->type->kind != TYPE_FUNCTION && g->type->kind != TYPE_PROTO) hash_table_insert(eval_vars, g->name, g);
+		eval_note_stmt(g->code);
+	}
+
+	for (struct decl *g = d; g; g = g->next)
+	{
+		struct expr *e = g->value;
+		if (!eval_is_scalar(g->type) || !e) continue;
+		if (e->kind == EXPR_INT_LITERAL || e->kind == EXPR_BOOLEAN_LITERAL || e->kind == EXPR_CHAR_LITERAL) continue;
+
+		long v;
+		eval_steps = 0;
+		if (eval_expr(0, e, &v) != EVAL_OK || !eval_fold(e, g->type, v))
+		{
+			printf("codegen error: the initializer of global %s can't be computed at compile time\n", g->name);
+			exit(1);
+		}
+		eval_globals++;
+	}
+
+	if (!calls) return;
+	for (struct decl *g = d; g; g = g->next)
+	{
+		if (g->type->kind == TYPE_FUNCTION) eval_calls_stmt(g->code);
+	}
+}
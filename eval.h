@@ -0,0 +1,22 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include "decl.h"
+
+/*
+- compile-time evaluation: an interpreter over the AST that runs calls to pure functions with constant arguments
+  while compiling, so the call turns into its result
+- pure means nothing but arithmetic on its own locals and parameters, reading globals nothing ever assigns, and
+  calling other pure functions: no printing, no stores outside itself
+- every evaluation gets EVAL_BUDGET steps, a function that doesn't finish in time (or at all) is left as a call
+*/
+
+#define EVAL_BUDGET 1000000		// expressions and statements one evaluation may go through
+#define EVAL_DEPTH  1000		// calls deep
+
+extern int eval_calls;			// calls replaced by their result
+extern int eval_globals;		// global initializers computed
+
+void eval_program( struct decl *d, int calls );
+
+#endif
@@ -3,6 +3,8 @@
 #include "scratch.h"
 #include "label.h"
 #include "library.h"
+#include "string_pool.h"
+#include "aarch64.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -12,7 +14,7 @@ extern int type_val;
 extern int resolve_val;
 extern int yylineno;
 
-extern int reg_table[6];
+extern int reg_table[SCRATCH_COUNT];
 
 /* create an expression*/
 /*
@@ -46,7 +48,7 @@ struct expr * expr_create_name(const char *name)
 }
 
 /* create an integer literal for an expression */
-struct expr * expr_create_integer_literal(int int_val)
+struct expr * expr_create_integer_literal(long int_val)
 {
 	struct expr *e = expr_create(EXPR_INT_LITERAL, 0, 0);
 
@@ -509,11 +511,11 @@ void expr_codegen(struct expr *e, FILE *outfil)
 				fprintf(outfil, "\tadd\t%s, %s, :lo12:%s\n", scratch_name(e->left->reg), scratch_name(e->left->reg), e->left->left->name);
 				fprintf(outfil, "\tstr\t%s, [%s, %i]\n", scratch_name(e->right->reg), scratch_name(e->left->reg), idx*8);
 			}
-			else if (e->left->symbol->kind == SYMBOL_LOCAL)
+			else if (e->left->symbol->kind != SYMBOL_GLOBAL)
 			{
 				printf("not an array element\n");
 				// fprintf(outfil, "\tmov\t%s, %s\n", scratch_name(e->left->reg), symbol_codegen(e->right->symbol));
-				fprintf(outfil, "\tstr\t%s, [sp, %s]\n", scratch_name(e->right->reg), symbol_codegen(e->left->symbol));
+				fprintf(outfil, "\tstr\t%s, [x29, %s]\n", scratch_name(e->right->reg), symbol_codegen(e->left->symbol));
 			}
 			else // TODO check to see if global variable editing even works
 			{
@@ -522,7 +524,9 @@ void expr_codegen(struct expr *e, FILE *outfil)
 				fprintf(outfil, "\tadd\t%s, %s, :lo12:%s\n", scratch_name(e->left->reg), scratch_name(e->left->reg), symbol_codegen(e->left->symbol));
 				fprintf(outfil, "\tstr\t%s, [%s]\n", scratch_name(e->right->reg), scratch_name(e->left->reg));
 			}
-			e->reg = e->left->reg;
+			// the value of an assignment is the value that was assigned
+			e->reg = e->right->reg;
+			scratch_free(e->left->reg);
 			break;
 		case EXPR_ADD:				// 1
 			expr_codegen(e->left, outfil);
@@ -533,22 +537,8 @@ void expr_codegen(struct expr *e, FILE *outfil)
 			break;
 		case EXPR_SUB:				// 2
 			expr_codegen(e->left, outfil);
-			/*
-			int leftreg_ptr = e->left->reg;
-			if (e->right->kind == EXPR_FUNCCALL)
-			{
-				e->left->reg = 19;
-			}
-			*/
 			expr_codegen(e->right, outfil);
 			fprintf(outfil, "\tsub\t%s, %s, %s\n", scratch_name(e->left->reg), scratch_name(e->left->reg), scratch_name(e->right->reg));
-			/*
-			if (e->right->kind == EXPR_FUNCCALL)
-			{
-				fprintf(outfil, "\tmov\t%s, %s\n", scratch_name(leftreg_ptr), scratch_name(e->left->reg));
-				e->left->reg = leftreg_ptr;
-			}
-			*/
 			e->reg = e->left->reg;
 			scratch_free(e->right->reg);
 			break;
@@ -581,27 +571,12 @@ void expr_codegen(struct expr *e, FILE *outfil)
 			scratch_free(e->right->reg);
 			break;
 		case EXPR_EXP:				// 6
-			expr_codegen(e->left, outfil);  // base
-			expr_codegen(e->right, outfil); // exponent
-
-			// let's just hope these registers are in x0 and x1 lol
-			int base_reg = 0;
-			int expo_reg = 1;
-			if (e->left->reg != base_reg)
-			{
-				fprintf(outfil, "\tmov\t%s, %s\n", scratch_name(base_reg), scratch_name(e->left->reg));
-			}
-			if (e->right->reg != expo_reg)
-			{
-				fprintf(outfil, "\tmov\t%s, %s\n", scratch_name(expo_reg), scratch_name(e->right->reg));
-			}
-			// branch to our integer power function
-			fprintf(outfil, "\tbl\tinteger_power\n");
-
-			e->reg = e->left->reg;
-			scratch_free(e->left->reg);
-			scratch_free(e->right->reg);
+		{
+			// exponents are a call to integer_power(base, exponent) in the library
+			struct expr *exp_args[2] = { e->left, e->right };
+			e->reg = expr_codegen_call("integer_power", exp_args, 2, outfil);
 			break;
+		}
 		case EXPR_LE:				// 7
 		case EXPR_LT:				// 8
 		case EXPR_GE:				// 9
@@ -709,10 +684,10 @@ void expr_codegen(struct expr *e, FILE *outfil)
 				fprintf(outfil, "\tadd\t%s, %s, :lo12:%s\n", scratch_name(e->left->reg), scratch_name(e->left->reg), e->left->left->name);
 				fprintf(outfil, "\tstr\t%s, [%s, %i]\n", scratch_name(temp_reg), scratch_name(e->left->reg), idx*8);
 			}
-			else if (e->left->symbol->kind == SYMBOL_LOCAL)
+			else if (e->left->symbol->kind != SYMBOL_GLOBAL)
 			{
 				printf("not an array element\n");
-				fprintf(outfil, "\tstr\t%s, [sp, %s]\n", scratch_name(temp_reg), symbol_codegen(e->left->symbol));
+				fprintf(outfil, "\tstr\t%s, [x29, %s]\n", scratch_name(temp_reg), symbol_codegen(e->left->symbol));
 			}
 			else
 			{
@@ -725,9 +700,8 @@ void expr_codegen(struct expr *e, FILE *outfil)
 				fprintf(outfil, "\tldr\t%s, [%s]\n", scratch_name(e->left->reg), scratch_name(e->left->reg));
 			}
 
-			// free the registers afterward
+			// free the temporary afterward, the old value stays in e->reg for whoever uses it
 			scratch_free(temp_reg);
-			scratch_free(e->left->reg);
 			
 			break;
 		case EXPR_GROUP:			// 19
@@ -740,7 +714,7 @@ void expr_codegen(struct expr *e, FILE *outfil)
 			// TODO also assignment of new values to already declared arrays
 			printf("ARRAY ELEM INDEXING\n");
 			if (e->left) printf("name: %s\n",e->left->name);
-			if (e->right) printf("idx: %i\n",e->right->literal_value);
+			if (e->right) printf("idx: %li\n",e->right->literal_value);
 			e->reg = scratch_alloc();
 			// instructions to deal with loading the array up
 			fprintf(outfil, "\tadrp\t%s, %s\n", scratch_name(e->reg), e->left->name);
@@ -767,30 +741,17 @@ void expr_codegen(struct expr *e, FILE *outfil)
 		case EXPR_BOOLEAN_LITERAL: 	// 22
 		case EXPR_CHAR_LITERAL:		// 23
 			e->reg = scratch_alloc();
-			fprintf(outfil, "\tmov\t%s, %d\n", scratch_name(e->reg), e->literal_value);
+			// a plain mov only takes what one instruction can build
+			aarch64_print_const(scratch_name(e->reg), e->literal_value, outfil);
 			break;
 		case EXPR_STRING_LITERAL:	// 24
 			e->reg = scratch_alloc();
-			// string label stuff here
-			int str_label = label_create();
-
-			// start up the data section once more
-			fprintf(outfil, "\t.data\n");
-
-			fprintf(outfil, "\t.section\t.rodata\n");
-			// allocate 2^3 = 8 bytes
-			fprintf(outfil, "\t.align\t3\n");
-			// string label
-			fprintf(outfil, "%s:\n", label_name(str_label));
-			// string value
-			fprintf(outfil, "\t.string\t%s\n", e->string_literal);
-
-			// go back to the text section
-			fprintf(outfil, "\t.text\n");
+			// the string itself lives in the string pool, which is emitted once at the end of the file
+			const char *str_label = string_pool_name(string_pool_intern(e->string_literal));
 
 			// now we need instructions to deal with this string
-			fprintf(outfil, "\tadrp\t%s, %s\n", scratch_name(e->reg), label_name(str_label));
-			fprintf(outfil, "\tadd\t%s, %s, :lo12:%s\n", scratch_name(e->reg), scratch_name(e->reg), label_name(str_label));
+			fprintf(outfil, "\tadrp\t%s, %s\n", scratch_name(e->reg), str_label);
+			fprintf(outfil, "\tadd\t%s, %s, :lo12:%s\n", scratch_name(e->reg), scratch_name(e->reg), str_label);
 			break;
 		case EXPR_NAME:				// 25
 			e->reg = scratch_alloc();
@@ -798,7 +759,7 @@ void expr_codegen(struct expr *e, FILE *outfil)
 			{
 				printf("loading local variable/parameter %s\n",e->name);
 				// code to reference any parameter or local variable for anything
-				fprintf(outfil, "\tldr\t%s, [sp, %s]\n", scratch_name(e->reg), symbol_codegen(e->symbol));
+				fprintf(outfil, "\tldr\t%s, [x29, %s]\n", scratch_name(e->reg), symbol_codegen(e->symbol));
 				// TODO maybe remove this line cause it might not be necessary (i think this is only for global vars)
 				// fprintf(outfil, "\tmov\t%s, %s\n", scratch_name(e->reg), symbol_codegen(e->symbol));
 			}
@@ -816,99 +777,132 @@ void expr_codegen(struct expr *e, FILE *outfil)
 			break;
 		case EXPR_FUNCCALL:			// 26
 		{
-			struct expr *er = e->right; // parameters
-			struct expr *er_copy = e->right; // parameters copy
 			struct expr *el = e->left;  // function identifier
-			
-			// int i = 0;
-
-			// printf("funccall start\n");
+			struct expr *args[EXPR_CALL_MAX_ARGS];
+			int nargs = 0;
 
-			// TODO somehow move other IR values into other registers before calling this
-			// let's try to at least
-			/*
-			int reg_move = 19;
-			for (int i=0;i<6;i++)
+			// flatten the argument list so the call lowering can look ahead at it
+			for (struct expr *er = e->right; er; er = er->next)
 			{
-				if (reg_table[i])
+				if (nargs == EXPR_CALL_MAX_ARGS)
 				{
-
+					printf("codegen error: too many arguments in call to %s\n", el->name);
+					exit(1);
 				}
+				args[nargs++] = er;
 			}
-			*/
-
-			// generate code for loading in those parameters
-			while (er)
-			{
-				// TODO fix this up, we gotta load the parameters into argument registers then branch to the function
-				// If i hardcode the parameters, have this loop a "mov" command 
-
-				// generate code for parameter
-				expr_codegen(er, outfil);
-
-				// free register if possible
-				// scratch_free(er->reg);
-
-				// move to next pointer
-				er = er->next;
-			}
-
-			// scratch_print();
-
-			// printf("now we free\n");
 
-			// free up the registers we just used
-			while (er_copy)
-			{
-				scratch_free(er_copy->reg);
+			e->reg = expr_codegen_call(el->name, args, nargs, outfil);
+			break;
+		}
+	}
+}
 
-				er_copy = er_copy->next;
-			}
+/* generate code for a call to the function "name" */
+/*
+inputs
+- name: the function being called
+- args: the argument expressions, in order
+- nargs: number of arguments
+- outfil: output assembly file
+output
+- scratch register holding the return value
+notes
+- every scratch register that is holding a value is pushed before the call and popped after it
+*/
+int expr_codegen_call(const char *name, struct expr **args, int nargs, FILE *outfil)
+{
+	int saved[SCRATCH_COUNT];
+	int nsaved = scratch_save(saved, outfil);
 
-			// scratch_print();
+	int stack_bytes = expr_codegen_args(args, nargs, outfil);
 
-			// printf("argument end\n");
+	fprintf(outfil, "\tbl\t%s\n", name);
 
-			// branch to the function
-			fprintf(outfil, "\tbl\t%s\n",el->name);
+	if (stack_bytes)
+	{
+		fprintf(outfil, "\tadd\tsp, sp, %i\n", stack_bytes);
+	}
 
-			/*
-			// TODO needs local variable storage for any return parameters, probably also needs a lot of fixes
-			if (expr_typecheck(el) != TYPE_VOID)
-			{
-				printf("returning for function %s\n", el->name);
+	// grab the return value before the saved registers come back
+	int result = scratch_alloc();
+	fprintf(outfil, "\tmov\t%s, x0\n", scratch_name(result));
 
-				e->reg = scratch_alloc();
-				fprintf(outfil, "\tstr\t%s, [sp, %i]\n", scratch_name(e->reg), STACK_SIZE-(el->symbol->which*8));
-			}
-			*/
+	scratch_restore(saved, nsaved, outfil);
 
-			// printf("done with return type\n");
+	return result;
+}
 
-			/*
-			int funccall_result = scratch_alloc();
-			e->reg = funccall_result;
-			*/
+/* evaluate call arguments into x0-x7 and the outgoing stack area */
+/*
+inputs
+- args: the argument expressions, in order
+- nargs: number of arguments
+- outfil: output assembly file
+output
+- bytes reserved below sp, which the caller has to give back after the call
+notes
+- arguments past the 8th go in a 16-byte aligned area at the bottom of the stack, 8 bytes each
+- an argument register can only be written once no other argument still needs to make a call,
+  so register arguments up to the last one containing a call are parked right above the stack arguments
+*/
+int expr_codegen_args(struct expr **args, int nargs, FILE *outfil)
+{
+	// find the last argument that makes a call of its own
+	int last_call = -1;
+	for (int i=0;i<nargs;i++)
+	{
+		if (expr_has_call(args[i])) last_call = i;
+	}
 
-			break;
-		}
+	// make room for the stack arguments and the parked ones
+	int nstack  = nargs > EXPR_CALL_REG_ARGS ? nargs - EXPR_CALL_REG_ARGS : 0;
+	int nparked = last_call + 1 < EXPR_CALL_REG_ARGS ? last_call + 1 : EXPR_CALL_REG_ARGS;
+	int stack_bytes = ((nstack + nparked) * 8 + 15) & ~15;
+	if (stack_bytes)
+	{
+		fprintf(outfil, "\tsub\tsp, sp, %i\n", stack_bytes);
 	}
 
-	/*
-	// I'm just gonna try something
-	if (e->right)
+	for (int i=0;i<nargs;i++)
 	{
-		if (e->right->kind == EXPR_FUNCCALL)
-		{
-			// save registers
+		expr_codegen(args[i], outfil);
 
-			// new register time
-			e->reg = 19;
+		if (i >= EXPR_CALL_REG_ARGS)
+		{
+			// stack argument, nothing can overwrite it before the bl
+			fprintf(outfil, "\tstr\t%s, [sp, %i]\n", scratch_name(args[i]->reg), (i - EXPR_CALL_REG_ARGS) * 8);
+		}
+		else if (i < nparked)
+		{
+			// a later argument still makes a call, which would wipe out x0-x7
+			fprintf(outfil, "\tstr\t%s, [sp, %i]\n", scratch_name(args[i]->reg), (nstack + i) * 8);
+		}
+		else
+		{
+			fprintf(outfil, "\tmov\tx%i, %s\n", i, scratch_name(args[i]->reg));
+		}
+		scratch_free(args[i]->reg);
 
+		// once the last call is done, the parked arguments can go to their registers
+		if (i == last_call)
+		{
+			for (int j=0;j<nparked;j++)
+			{
+				fprintf(outfil, "\tldr\tx%i, [sp, %i]\n", j, (nstack + j) * 8);
+			}
 		}
 	}
-	*/
 
+	return stack_bytes;
+}
+
+/* does evaluating this expression involve a call (which clobbers every caller-saved register) */
+int expr_has_call(struct expr *e)
+{
+	if (!e) return 0;
+	if (e->kind == EXPR_FUNCCALL || e->kind == EXPR_EXP) return 1;
+	return expr_has_call(e->left) || expr_has_call(e->right);
 }
 
 /* print an expression */
@@ -1041,14 +1035,15 @@ void expr_print(struct expr *e)
 
 			break;
 		case EXPR_INT_LITERAL:
-			printf("%d",e->literal_value);
+			// literals are never negative as written, the smallest integer is a minus in front of 9223372036854775808
+			printf("%lu",(unsigned long) e->literal_value);
 			break;
 		case EXPR_BOOLEAN_LITERAL:
 			if (e->literal_value) printf("true");
 			else                  printf("false");
 			break;
 		case EXPR_CHAR_LITERAL:
-			printf("'%c'",e->literal_value);
+			printf("'%c'",(int) e->literal_value);
 			break;
 		case EXPR_STRING_LITERAL:
 			printf("%s",  e->string_literal);
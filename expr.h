@@ -44,7 +44,7 @@ struct expr {
 
 	/* used by various leaf exprs */
 	const char *name;
-	int literal_value;
+	long literal_value;		// integers are 64 bits, booleans and characters fit too
 	const char * string_literal;
 	struct symbol *symbol;
 
@@ -56,7 +56,7 @@ struct expr {
 struct expr * expr_create( expr_t kind, struct expr *left, struct expr *right );
 
 struct expr * expr_create_name( const char *n );
-struct expr * expr_create_integer_literal( int c );
+struct expr * expr_create_integer_literal( long c );
 struct expr * expr_create_boolean_literal( int c );
 struct expr * expr_create_char_literal( char c );
 struct expr * expr_create_string_literal( const char *str );
@@ -66,7 +66,14 @@ void exprs_resolve( struct expr *e );
 
 struct type * expr_typecheck( struct expr *e );
 
+// AAPCS64: the first 8 arguments go in x0-x7, the rest are passed on the stack
+#define EXPR_CALL_REG_ARGS (8)
+#define EXPR_CALL_MAX_ARGS (32)
+
 void expr_codegen( struct expr *e, FILE *outfil );
+int  expr_codegen_call( const char *name, struct expr **args, int nargs, FILE *outfil );
+int  expr_codegen_args( struct expr **args, int nargs, FILE *outfil );
+int  expr_has_call( struct expr *e );
 
 void expr_print( struct expr *e );
 void exprs_print( struct expr *e );
@@ -0,0 +1,500 @@
+#include "gvn.h"
+#include "cfg.h"
+#include "ssa.h"
+#include "hash_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+- dominator-based value numbering (Briggs, Cooper and Simpson)
+  - void gvn_purity( struct ir_program *p );
+  - int gvn_run( struct ir_func *f );
+
+- the value number of a vreg is the vreg that first computed the same value, vn[v] == v for a leader
+- the dominator tree is walked with a scoped table of expressions: whatever a block adds is gone again once its
+  subtree is done, so an expression is only ever matched against instructions that dominate it
+  - within a block that's plain local value numbering, the tree walk just carries it on into the dominated blocks
+- expressions are keyed on the value numbers of their operands, commutative ones with those sorted and
+  a > b turned into b < a, so "a*k + k*a" sees the same product twice
+- copies and phis whose arguments all agree take the number of their source
+- constants and addresses only match inside one block, reusing them across blocks just ties up a register
+  for longer than rebuilding them would take
+
+memory is tracked with epochs instead of alias analysis:
+- a load is keyed on the epoch it happens in, so it only matches a load from the same epoch
+- scalar globals and array elements are separate memory, a store to one can't change the other
+  - global loads also carry a version per name that a store to that name bumps, so "x = 1" doesn't
+    forget what y was
+  - array stores start a new epoch, since any two arrays passed in as parameters could be the same one
+  - a call that may write memory starts new epochs for both, printing doesn't count
+- a block with one predecessor starts in the epoch its predecessor ended in; a merge point keeps its immediate
+  dominator's epoch only when no block on the way from there writes that kind of memory
+- after a store the stored value is recorded as what the next load from there reads
+
+purity: a B-minor function is pure when it never stores to memory and only calls pure functions, found by assuming
+everything is and knocking functions out until nothing changes; integer_power is pure, every other library
+function prints. Whether a function can write memory at all is worked out the same way alongside.
+*/
+
+int gvn_exprs = 0;
+int gvn_loads = 0;
+int gvn_calls = 0;
+
+struct hash_table *gvn_funcs = 0;	// name -> ir_func of every function in the program
+
+struct gvn_entry {
+	ir_op_t op;
+	const char *name;
+	long imm;
+	int nops;
+	int *ops;
+	long epoch;
+	int leader;
+	unsigned hash;
+	struct gvn_entry *next;		// bucket chain, newest first
+	struct gvn_entry *undo;		// previously added entry, for popping a block's entries
+};
+
+#define GVN_BUCKETS (1024)
+#define GVN_MAX_OPS (40)		// operands in a key: enough for a call with every argument plus the memory epoch
+
+struct gvn_state {
+	struct ir_func *f;
+	int *vn;
+	struct gvn_entry *buckets[GVN_BUCKETS];
+	struct gvn_entry *added;	// every live entry, newest first
+	long next_epoch;
+	long gepoch;				// epoch of scalar globals
+	long aepoch;				// epoch of array memory
+	struct hash_table *names;	// global name -> 1 + its index in version
+	int *version;
+	int nnames;
+};
+
+// the runtime in library.c: only integer_power is pure, the rest print but never touch the program's memory
+const char *gvn_library[] = { "integer_power", "print_integer", "print_string", "print_boolean", "print_character",
+	"print_values", "print_flush", 0 };
+
+/* is this one of the runtime's functions */
+int gvn_library_call(const char *name)
+{
+	for (int k=0;gvn_library[k];k++) if (!strcmp(gvn_library[k], name)) return 1;
+	return 0;
+}
+
+/* is a call free of side effects, so two of them with the same arguments return the same thing */
+int gvn_call_pure(struct ir_inst *i)
+{
+	if (!strcmp(i->name, "integer_power")) return 1;
+	struct ir_func *f = gvn_funcs ? hash_table_lookup(gvn_funcs, i->name) : 0;
+	return f && f->pure;
+}
+
+/* can a call change a global or an array element */
+int gvn_call_writes(struct ir_inst *i)
+{
+	if (gvn_library_call(i->name)) return 0;
+	struct ir_func *f = gvn_funcs ? hash_table_lookup(gvn_funcs, i->name) : 0;
+	return !f || f->writes_memory;	// anything not defined here could do anything
+}
+
+/* gvn_purity: work out which functions are pure, and which can write memory */
+void gvn_purity(struct ir_program *p)
+{
+	if (gvn_funcs) hash_table_delete(gvn_funcs);
+	gvn_funcs = hash_table_create(0, 0);
+	for (struct ir_func *f = p->funcs; f; f = f->next)
+	{
+		f->pure = 1;
+		f->writes_memory = 0;
+		hash_table_insert(gvn_funcs, f->name, f);
+	}
+
+	// both start optimistic and only ever get worse, so this settles
+	int changed = 1;
+	while (changed)
+	{
+		changed = 0;
+		for (struct ir_func *f = p->funcs; f; f = f->next)
+		{
+			for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+			{
+				for (struct ir_inst *i = bb->first; i; i = i->next)
+				{
+					int writes = i->op == IR_STOREG || i->op == IR_STORE || i->op == IR_VSTORE || (i->op == IR_CALL && gvn_call_writes(i));
+					int impure = writes || (i->op == IR_CALL && !gvn_call_pure(i));
+					if (writes && !f->writes_memory)
+					{
+						f->writes_memory = 1;
+						changed = 1;
+					}
+					if (impure && f->pure)
+					{
+						f->pure = 0;
+						changed = 1;
+					}
+				}
+			}
+		}
+	}
+}
+
+/* value number of a vreg */
+int gvn_vn(struct gvn_state *st, int v)
+{
+	if (v < 0) return v;
+	while (st->vn[v] != v) v = st->vn[v];
+	return v;
+}
+
+/* hash and compare keys */
+unsigned gvn_hash(ir_op_t op, const char *name, long imm, int *ops, int nops, long epoch)
+{
+	unsigned h = op * 31u + (unsigned) imm * 17u + (unsigned) epoch * 13u;
+	if (name) for (const char *c = name; *c; c++) h = h * 33u + (unsigned char) *c;
+	for (int k=0;k<nops;k++) h = h * 7919u + (unsigned) ops[k];
+	return h;
+}
+
+/* look up an expression, returns its leader or -1 */
+int gvn_lookup(struct gvn_state *st, ir_op_t op, const char *name, long imm, int *ops, int nops, long epoch)
+{
+	unsigned h = gvn_hash(op, name, imm, ops, nops, epoch);
+	for (struct gvn_entry *e = st->buckets[h % GVN_BUCKETS]; e; e = e->next)
+	{
+		if (e->hash != h || e->op != op || e->imm != imm || e->epoch != epoch || e->nops != nops) continue;
+		if ((e->name == 0) != (name == 0) || (name && strcmp(e->name, name))) continue;
+		if (nops && memcmp(e->ops, ops, nops * sizeof(int))) continue;
+		return e->leader;
+	}
+	return -1;
+}
+
+/* add an expression with its leader, it stays until the block that added it is left */
+void gvn_insert(struct gvn_state *st, ir_op_t op, const char *name, long imm, int *ops, int nops, long epoch, int leader)
+{
+	struct gvn_entry *e = calloc(1, sizeof(*e));
+	e->op     = op;
+	e->name   = name;
+	e->imm    = imm;
+	e->nops   = nops;
+	e->ops    = malloc((nops + 1) * sizeof(int));
+	if (nops) memcpy(e->ops, ops, nops * sizeof(int));
+	e->epoch  = epoch;
+	e->leader = leader;
+	e->hash   = gvn_hash(op, name, imm, ops, nops, epoch);
+
+	e->next = st->buckets[e->hash % GVN_BUCKETS];
+	st->buckets[e->hash % GVN_BUCKETS] = e;
+	e->undo   = st->added;
+	st->added = e;
+}
+
+/* drop entries until the table is back to how it was when mark was the newest one */
+void gvn_pop(struct gvn_state *st, struct gvn_entry *mark)
+{
+	while (st->added != mark)
+	{
+		struct gvn_entry *e = st->added;
+		st->buckets[e->hash % GVN_BUCKETS] = e->next;	// always at the front of its bucket, nothing newer is left
+		st->added = e->undo;
+		free(e->ops);
+		free(e);
+	}
+}
+
+/* version slot of a global name */
+int * gvn_version(struct gvn_state *st, const char *name)
+{
+	long id = (long) hash_table_lookup(st->names, name);
+	if (!id)
+	{
+		st->version = realloc(st->version, (st->nnames + 1) * sizeof(int));
+		st->version[st->nnames] = 0;
+		id = ++st->nnames;
+		hash_table_insert(st->names, name, (void *) id);
+	}
+	return &st->version[id - 1];
+}
+
+/* does an instruction write scalar globals / array memory */
+int gvn_writes_globals(struct ir_inst *i)
+{
+	return i->op == IR_STOREG || (i->op == IR_CALL && gvn_call_writes(i));
+}
+int gvn_writes_arrays(struct ir_inst *i)
+{
+	return i->op == IR_STORE || i->op == IR_VSTORE || (i->op == IR_CALL && gvn_call_writes(i));
+}
+
+/* can anything on the way from bb's immediate dominator into bb write memory, per kind */
+/*
+- walks backwards from the predecessors, stopping at the immediate dominator, so it sees exactly the blocks
+  that can run between the two, bb itself included when it's in a loop
+*/
+void gvn_region_writes(struct gvn_state *st, struct ir_block *bb, char *wg, char *wa, int *seen, int stamp,
+	struct ir_block **work, int *writes_g, int *writes_a)
+{
+	int nw = 0;
+	*writes_g = *writes_a = 0;
+	for (int p=0;p<bb->npreds;p++)
+	{
+		struct ir_block *b = bb->preds[p];
+		if (b == bb->idom || seen[b->id] == stamp) continue;
+		seen[b->id] = stamp;
+		work[nw++] = b;
+	}
+	while (nw && !(*writes_g && *writes_a))
+	{
+		struct ir_block *b = work[--nw];
+		*writes_g |= wg[b->id];
+		*writes_a |= wa[b->id];
+		for (int p=0;p<b->npreds;p++)
+		{
+			struct ir_block *c = b->preds[p];
+			if (c == bb->idom || seen[c->id] == stamp) continue;
+			seen[c->id] = stamp;
+			work[nw++] = c;
+		}
+	}
+}
+
+/* value number one instruction, returns 1 when it turned out to be redundant */
+int gvn_inst(struct gvn_state *st, struct ir_inst *i)
+{
+	int ops[GVN_MAX_OPS];
+	int nops = 0;
+	long epoch = 0;
+	long imm = i->imm;
+	const char *name = i->name;
+	ir_op_t op = i->op;
+
+	switch (i->op)
+	{
+		case IR_MOV:
+			st->vn[i->dst] = gvn_vn(st, i->src[0]);
+			return 1;
+		case IR_PHI:
+		{
+			// all arguments the same value (or the phi itself, round a loop): it's just that value
+			int same = -1;
+			int trivial = 1;
+			for (int k=0;k<i->nargs;k++)
+			{
+				int a = gvn_vn(st, i->args[k]);
+				if (a == i->dst) continue;
+				if (same >= 0 && a != same) trivial = 0;
+				same = a;
+			}
+			if (trivial && same >= 0)
+			{
+				st->vn[i->dst] = same;
+				return 1;
+			}
+			if (i->nargs > GVN_MAX_OPS) return 0;
+			for (int k=0;k<i->nargs;k++) ops[nops++] = gvn_vn(st, i->args[k]);
+			epoch = i->block->id;
+			break;
+		}
+		case IR_CONST:
+		case IR_ADDR:
+			epoch = i->block->id;
+			break;
+		case IR_LOADG:
+			ops[nops++] = *gvn_version(st, i->name);
+			epoch = st->gepoch;
+			break;
+		case IR_LOAD:
+			ops[nops++] = gvn_vn(st, i->src[0]);
+			ops[nops++] = gvn_vn(st, i->src[1]);
+			epoch = st->aepoch;
+			break;
+		case IR_STOREG:
+			(*gvn_version(st, i->name))++;
+			ops[nops++] = *gvn_version(st, i->name);
+			gvn_insert(st, IR_LOADG, name, imm, ops, nops, st->gepoch, gvn_vn(st, i->src[0]));
+			return 0;
+		case IR_STORE:
+			st->aepoch = st->next_epoch++;
+			ops[nops++] = gvn_vn(st, i->src[0]);
+			ops[nops++] = gvn_vn(st, i->src[1]);
+			gvn_insert(st, IR_LOAD, 0, imm, ops, nops, st->aepoch, gvn_vn(st, i->src[2]));
+			return 0;
+		case IR_VSTORE:
+			st->aepoch = st->next_epoch++;
+			return 0;
+		case IR_VSUM:
+			// reads a SIMD register, which isn't a value GVN knows
+			return 0;
+		case IR_CALL:
+			if (gvn_call_writes(i))
+			{
+				st->gepoch = st->next_epoch++;
+				st->aepoch = st->next_epoch++;
+			}
+			if (!gvn_call_pure(i)) return 0;
+			if (i->dst < 0 || i->nargs + 1 > GVN_MAX_OPS) return 0;
+			for (int k=0;k<i->nargs;k++) ops[nops++] = gvn_vn(st, i->args[k]);
+			// a pure function can still read memory
+			ops[nops++] = (int) st->aepoch;
+			epoch = st->gepoch;
+			imm = 0;
+			break;
+		default:
+			if (i->dst < 0) return 0;
+			ops[nops++] = gvn_vn(st, i->src[0]);
+			if (ir_is_binary(i->op))
+			{
+				ops[nops++] = gvn_vn(st, i->src[1]);
+				// one spelling for commutative operations and mirrored comparisons
+				if (op == IR_GT || op == IR_GE)
+				{
+					int t = ops[0]; ops[0] = ops[1]; ops[1] = t;
+					op = op == IR_GT ? IR_LT : IR_LE;
+				}
+				else if ((op == IR_ADD || op == IR_MUL || op == IR_AND || op == IR_OR || op == IR_EQ || op == IR_NE)
+					&& ops[0] > ops[1])
+				{
+					int t = ops[0]; ops[0] = ops[1]; ops[1] = t;
+				}
+			}
+			imm = 0;
+			name = 0;
+			break;
+	}
+
+	int leader = gvn_lookup(st, op, name, imm, ops, nops, epoch);
+	if (leader >= 0 && leader != i->dst)
+	{
+		st->vn[i->dst] = leader;
+		return 1;
+	}
+	gvn_insert(st, op, name, imm, ops, nops, epoch, i->dst);
+	return 0;
+}
+
+/* gvn_run: value number one function in SSA form */
+/*
+output
+- how many instructions were found redundant, they're left for ssa_dce to delete once nothing reads them
+*/
+int gvn_run(struct ir_func *f)
+{
+	struct gvn_state st;
+	memset(&st, 0, sizeof(st));
+	st.f     = f;
+	st.vn    = calloc(f->nvregs + 1, sizeof(int));
+	st.names = hash_table_create(0, 0);
+	for (int v=0;v<f->nvregs;v++) st.vn[v] = v;
+	st.next_epoch = 1;
+
+	// which blocks write each kind of memory
+	int nb = f->nblocks;
+	char *wg = calloc(nb + 1, 1);
+	char *wa = calloc(nb + 1, 1);
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			wg[bb->id] |= gvn_writes_globals(i);
+			wa[bb->id] |= gvn_writes_arrays(i);
+		}
+	}
+
+	long *end_g = calloc(nb + 1, sizeof(long));
+	long *end_a = calloc(nb + 1, sizeof(long));
+	int *seen   = calloc(nb + 1, sizeof(int));
+	struct ir_block **work  = calloc(nb + 1, sizeof(*work));
+	struct ir_block **stack = calloc(f->nrpo + 1, sizeof(*stack));
+	struct gvn_entry **mark = calloc(f->nrpo + 1, sizeof(*mark));
+	int *next_kid = calloc(nb + 1, sizeof(int));
+	int sp = 0;
+	int found = 0;
+
+	stack[sp++] = f->blocks;
+	int entered = 0;
+	while (sp)
+	{
+		struct ir_block *bb = stack[sp - 1];
+
+		if (!entered)
+		{
+			mark[sp - 1] = st.added;
+
+			// memory epoch on entry
+			if (!bb->idom)
+			{
+				st.gepoch = st.next_epoch++;
+				st.aepoch = st.next_epoch++;
+			}
+			else
+			{
+				int writes_g, writes_a;
+				gvn_region_writes(&st, bb, wg, wa, seen, bb->id + 1, work, &writes_g, &writes_a);
+				st.gepoch = writes_g ? st.next_epoch++ : end_g[bb->idom->id];
+				st.aepoch = writes_a ? st.next_epoch++ : end_a[bb->idom->id];
+			}
+
+			for (struct ir_inst *i = bb->first; i; i = i->next)
+			{
+				if (!gvn_inst(&st, i)) continue;
+				if (i->op == IR_MOV) continue;		// copies were never real work
+				found++;
+				if (i->op == IR_LOADG || i->op == IR_LOAD) gvn_loads++;
+				else if (i->op == IR_CALL)                 gvn_calls++;
+				else if (i->op != IR_PHI)                  gvn_exprs++;
+			}
+			end_g[bb->id] = st.gepoch;
+			end_a[bb->id] = st.aepoch;
+		}
+
+		if (next_kid[bb->id] < bb->ndom_children)
+		{
+			stack[sp++] = bb->dom_children[next_kid[bb->id]++];
+			entered = 0;
+			continue;
+		}
+
+		gvn_pop(&st, mark[sp - 1]);
+		sp--;
+		entered = 1;
+	}
+
+	// every read goes to the leader now, the redundant definitions are dead
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			int *slot;
+			for (int k=0;(slot = ir_inst_use(i, k));k++) *slot = gvn_vn(&st, *slot);
+		}
+	}
+
+	// a redundant call still has to go, dead code elimination keeps every call
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		struct ir_inst *next;
+		for (struct ir_inst *i = bb->first; i; i = next)
+		{
+			next = i->next;
+			if (i->op == IR_CALL && i->dst >= 0 && st.vn[i->dst] != i->dst) ir_inst_remove(i);
+		}
+	}
+
+	hash_table_delete(st.names);
+	free(st.version);
+	free(st.vn);
+	free(wg);
+	free(wa);
+	free(end_g);
+	free(end_a);
+	free(seen);
+	free(work);
+	free(stack);
+	free(mark);
+	free(next_kid);
+
+	return found;
+}
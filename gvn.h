@@ -0,0 +1,22 @@
+#ifndef GVN_H
+#define GVN_H
+
+#include "ir.h"
+
+/*
+- global value numbering over a function in SSA form: every instruction that computes a value some dominating
+  instruction already computed is replaced by that earlier value
+- covers arithmetic, loads of globals and array elements nothing could have written in between,
+  and calls to B-minor functions that don't write memory or print
+*/
+
+extern int gvn_exprs;	// redundant arithmetic removed, summed over every run
+extern int gvn_loads;	// redundant loads removed
+extern int gvn_calls;	// redundant calls removed
+
+void gvn_purity( struct ir_program *p );
+int gvn_call_pure( struct ir_inst *i );
+int gvn_call_writes( struct ir_inst *i );
+int gvn_run( struct ir_func *f );
+
+#endif
@@ -0,0 +1,207 @@
+#include "ifconv.h"
+#include "cfg.h"
+#include "ssa.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+- if-conversion over a function in SSA form
+  - int ifconv_run( struct ir_func *f );
+
+- the shapes taken, a block ending in a branch on c and a join block with a phi per value the sides differ in:
+  - a diamond: each side is an arm, a block only the branch leads to that ends in a jump to the join
+  - a triangle: one side is an arm, the other goes to the join directly
+- an arm may only compute: arithmetic, comparisons, copies, constants, addresses and global loads, and
+  division by a constant that can't trap, nothing that stores, calls, or could fault on an array index the
+  branch was there to keep in range
+- the arms move up in front of the branch, the branch becomes a jump to the join and every phi there a
+  select between its two arguments by c, the merge afterwards leaves one straight block
+- the arms go in ahead of the comparison the branch tests when that's right before it, so the selects come
+  right after it and the backends can use its flags directly (csel on AArch64, cmov on x86-64)
+- an inner if that becomes straight code can turn the one around it into a diamond, so it goes round again
+  until nothing changes
+*/
+
+int ifconv_branches = 0;
+int ifconv_selects  = 0;
+
+/* can i run on a path that didn't run it before: it can't fail and has no effect besides its result */
+int ifconv_speculable(struct ir_inst *i, struct ir_inst **defs)
+{
+	switch (i->op)
+	{
+		case IR_CONST:
+		case IR_MOV:
+		case IR_ADD:
+		case IR_SUB:
+		case IR_MUL:
+		case IR_AND:
+		case IR_OR:
+		case IR_EQ:
+		case IR_NE:
+		case IR_LT:
+		case IR_LE:
+		case IR_GT:
+		case IR_GE:
+		case IR_NEG:
+		case IR_NOT:
+		case IR_SEL:
+		case IR_ADDR:
+		case IR_LOADG:
+			return 1;
+		case IR_DIV:
+		case IR_MOD:
+		{
+			struct ir_inst *d = defs[i->src[1]];
+			return d && d->op == IR_CONST && d->imm != 0 && d->imm != -1;
+		}
+		default:
+			return 0;
+	}
+}
+
+/* is bb an arm of the branch ending head, returns its size and where it jumps to */
+/*
+output
+- instructions in the arm, its jump left out, or -1 when it isn't one
+*/
+int ifconv_arm(struct ir_block *bb, struct ir_block *head, struct ir_inst **defs, struct ir_block **join)
+{
+	if (bb == head || bb->npreds != 1 || !bb->last || bb->last->op != IR_JMP) return -1;
+
+	int n = 0;
+	for (struct ir_inst *i = bb->first; i != bb->last; i = i->next)
+	{
+		if (i->op == IR_PHI || !ifconv_speculable(i, defs)) return -1;
+		n++;
+	}
+	*join = bb->last->target;
+	return n;
+}
+
+/* does any instruction of bb read v */
+int ifconv_reads(struct ir_block *bb, int v)
+{
+	if (!bb) return 0;
+	for (struct ir_inst *i = bb->first; i; i = i->next)
+	{
+		int *slot;
+		for (int k=0;(slot = ir_inst_use(i, k));k++) if (*slot == v) return 1;
+	}
+	return 0;
+}
+
+/* move the instructions of an arm in front of pos, all but its jump */
+void ifconv_hoist(struct ir_block *arm, struct ir_inst *pos)
+{
+	while (arm->first != arm->last)
+	{
+		struct ir_inst *i = arm->first;
+		ir_inst_remove(i);
+		ir_inst_insert_before(pos, i);
+	}
+}
+
+/* ifconv_convert: turn the branch ending bb into selects, if it has one of the shapes above */
+/*
+output
+- 1 when it was converted
+*/
+int ifconv_convert(struct ir_block *bb, struct ir_inst **defs)
+{
+	struct ir_inst *br = bb->last;
+	if (!br || br->op != IR_BR || br->target == br->target_false) return 0;
+
+	// the arm each side of the join is reached from, bb itself for the side that goes there directly
+	struct ir_block *t = br->target;
+	struct ir_block *e = br->target_false;
+	struct ir_block *tj = 0;
+	struct ir_block *ej = 0;
+	int tn = ifconv_arm(t, bb, defs, &tj);
+	int en = ifconv_arm(e, bb, defs, &ej);
+
+	struct ir_block *join, *from_t, *from_e;
+	int size;
+	if (tn >= 0 && en >= 0 && tj == ej) { join = tj; from_t = t;  from_e = e;  size = tn + en; }
+	else if (tn >= 0 && tj == e)        { join = e;  from_t = t;  from_e = bb; size = tn; }
+	else if (en >= 0 && ej == t)        { join = t;  from_t = bb; from_e = e;  size = en; }
+	else return 0;
+	if (join == bb || join->npreds != 2 || size > IFCONV_MAX_INSTS) return 0;
+
+	int nphis = 0;
+	for (struct ir_inst *phi = join->first; phi && phi->op == IR_PHI; phi = phi->next)
+	{
+		for (int k=0;k<phi->nargs;k++) if (phi->args[k] == IR_NO_REG) return 0;
+		nphis++;
+	}
+	if (nphis > IFCONV_MAX_SELECTS) return 0;
+
+	// the arms go before the comparison, unless they read what it computes
+	int c = br->src[0];
+	struct ir_inst *pos = br;
+	struct ir_inst *cmp = br->prev;
+	if (cmp && cmp->dst == c && ir_is_binary(cmp->op) && cmp->op >= IR_EQ &&
+		!ifconv_reads(from_t == bb ? 0 : from_t, c) && !ifconv_reads(from_e == bb ? 0 : from_e, c))
+	{
+		pos = cmp;
+	}
+	if (from_t != bb) ifconv_hoist(from_t, pos);
+	if (from_e != bb) ifconv_hoist(from_e, pos);
+
+	// every phi picks by the condition now
+	for (struct ir_inst *phi = join->first; phi && phi->op == IR_PHI; phi = phi->next)
+	{
+		int vt = IR_NO_REG;
+		int ve = IR_NO_REG;
+		for (int k=0;k<phi->nargs;k++)
+		{
+			if (phi->phi_blocks[k] == from_t) vt = phi->args[k];
+			if (phi->phi_blocks[k] == from_e) ve = phi->args[k];
+		}
+		phi->op     = IR_SEL;
+		phi->src[0] = c;
+		phi->src[1] = vt;
+		phi->src[2] = ve;
+		free(phi->args);
+		free(phi->phi_blocks);
+		phi->args       = 0;
+		phi->phi_blocks = 0;
+		phi->nargs      = 0;
+		ifconv_selects++;
+	}
+
+	br->op           = IR_JMP;
+	br->src[0]       = IR_NO_REG;
+	br->target       = join;
+	br->target_false = 0;
+	ifconv_branches++;
+	return 1;
+}
+
+/* ifconv_run: if-convert every branch of a function in SSA form that's worth it */
+/*
+- the graph has to be up to date, and is rebuilt whenever anything changed
+output
+- how many branches went away
+*/
+int ifconv_run(struct ir_func *f)
+{
+	int total = 0;
+	for (;;)
+	{
+		struct ir_inst **defs = ssa_defs(f);
+		int n = 0;
+
+		// a converted block's join has one way in left, but still counts two until the graph is rebuilt,
+		// so it can't be taken for an arm of another branch before then
+		for (struct ir_block *bb = f->blocks; bb; bb = bb->next) n += ifconv_convert(bb, defs);
+		free(defs);
+		if (!n) break;
+
+		cfg_build(f);
+		cfg_merge_blocks(f);
+		total += n;
+	}
+	return total;
+}
@@ -0,0 +1,19 @@
+#ifndef IFCONV_H
+#define IFCONV_H
+
+#include "ir.h"
+
+/*
+- if-conversion: a branch whose sides only compute values for the block they meet in again becomes straight
+  code computing both sides, with an IR_SEL picking each value by the condition instead of a phi
+*/
+
+#define IFCONV_MAX_INSTS   4	// instructions both sides together may compute, every one of them runs on every path now
+#define IFCONV_MAX_SELECTS 3	// values the two sides may differ in
+
+extern int ifconv_branches;		// branches removed, summed over every run
+extern int ifconv_selects;		// selects put in their place
+
+int ifconv_run( struct ir_func *f );
+
+#endif
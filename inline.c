@@ -0,0 +1,264 @@
+#include "inline.h"
+#include "hash_table.h"
+#include "stmt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+- inlines calls between the functions of the program
+  - void inline_program( struct ir_program *p );
+
+- the call graph comes from the EXPR_FUNCCALL sites in the AST, one node per function defined in the program
+  - a function that can reach itself through it is recursive and is never inlined, so copying always ends
+  - functions are handled callees first, a callee has had its own calls inlined before it gets copied anywhere
+- cost model, per call site: the callee's size in IR instructions, less what the call itself costs
+  (INLINE_CALL_COST plus a move per argument), less INLINE_CONST_ARG for every constant argument;
+  the call is inlined when that's at most inline_threshold, and the caller is still under INLINE_MAX_SIZE
+- inlining, on the IR before SSA form:
+  - the block is split after the call, the callee's blocks are copied in between with its vregs renumbered
+    past the caller's
+  - the call becomes moves of the arguments into the copied parameters and a jump into the copied entry
+  - every ret becomes a move into the call's result and a jump to the rest of the split block
+  - a tail call inside the copy isn't in tail position anymore
+*/
+
+int inline_threshold = 16;
+int inline_sites     = 0;
+
+struct inline_node {
+	struct decl *decl;
+	struct ir_func *func;
+	struct inline_node **callees;
+	int ncallees;
+	int recursive;
+	int seen;
+};
+
+struct hash_table   *inline_nodes  = 0;	// name -> inline_node of every function defined in the program
+struct inline_node **inline_order  = 0;	// callees before callers
+int                  inline_norder = 0;
+
+/* add an edge of the call graph, once */
+void inline_edge(struct inline_node *n, const char *callee)
+{
+	struct inline_node *c = hash_table_lookup(inline_nodes, callee);
+	if (!c) return;
+	for (int k=0;k<n->ncallees;k++) if (n->callees[k] == c) return;
+	n->callees = realloc(n->callees, (n->ncallees + 1) * sizeof(*n->callees));
+	n->callees[n->ncallees++] = c;
+}
+
+/* the call sites in an expression */
+void inline_expr_calls(struct inline_node *n, struct expr *e)
+{
+	for (; e; e = e->next)
+	{
+		if (e->kind == EXPR_FUNCCALL) inline_edge(n, e->left->name);
+		inline_expr_calls(n, e->left);
+		inline_expr_calls(n, e->right);
+	}
+}
+
+/* the call sites in a statement list */
+void inline_stmt_calls(struct inline_node *n, struct stmt *s)
+{
+	for (; s; s = s->next)
+	{
+		if (s->decl) inline_expr_calls(n, s->decl->value);
+		inline_expr_calls(n, s->init_expr);
+		inline_expr_calls(n, s->expr);
+		inline_expr_calls(n, s->next_expr);
+		inline_stmt_calls(n, s->body);
+		inline_stmt_calls(n, s->else_body);
+	}
+}
+
+/* can the call graph get from n to target */
+int inline_reaches(struct inline_node *n, struct inline_node *target, int stamp)
+{
+	for (int k=0;k<n->ncallees;k++)
+	{
+		struct inline_node *c = n->callees[k];
+		if (c == target) return 1;
+		if (c->seen == stamp) continue;
+		c->seen = stamp;
+		if (inline_reaches(c, target, stamp)) return 1;
+	}
+	return 0;
+}
+
+/* put n in inline_order after everything it calls */
+void inline_postorder(struct inline_node *n)
+{
+	if (n->seen) return;
+	n->seen = 1;
+	for (int k=0;k<n->ncallees;k++) inline_postorder(n->callees[k]);
+	inline_order[inline_norder++] = n;
+}
+
+/* build the call graph of p */
+void inline_graph(struct ir_program *p)
+{
+	if (inline_nodes) hash_table_delete(inline_nodes);
+	inline_nodes = hash_table_create(0, 0);
+
+	int nfuncs = 0;
+	for (struct ir_func *f = p->funcs; f; f = f->next)
+	{
+		struct inline_node *n = calloc(1, sizeof(*n));
+		n->decl = f->decl;
+		n->func = f;
+		hash_table_insert(inline_nodes, f->name, n);
+		nfuncs++;
+	}
+
+	inline_order  = calloc(nfuncs + 1, sizeof(*inline_order));
+	inline_norder = 0;
+	for (struct ir_func *f = p->funcs; f; f = f->next)
+	{
+		struct inline_node *n = hash_table_lookup(inline_nodes, f->name);
+		inline_stmt_calls(n, f->decl->code);
+	}
+
+	int stamp = 1;
+	for (struct ir_func *f = p->funcs; f; f = f->next)
+	{
+		struct inline_node *n = hash_table_lookup(inline_nodes, f->name);
+		n->recursive = inline_reaches(n, n, ++stamp);
+	}
+
+	for (struct ir_func *f = p->funcs; f; f = f->next) ((struct inline_node *) hash_table_lookup(inline_nodes, f->name))->seen = 0;
+	for (struct ir_func *f = p->funcs; f; f = f->next) inline_postorder(hash_table_lookup(inline_nodes, f->name));
+}
+
+/* instructions in a function */
+int inline_size(struct ir_func *f)
+{
+	int n = 0;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next) n++;
+	}
+	return n;
+}
+
+/* is vreg v a constant where call i reads it: defined by a const earlier in i's block */
+int inline_const_arg(struct ir_inst *i, int v)
+{
+	for (struct ir_inst *d = i->prev; d; d = d->prev)
+	{
+		if (d->dst == v) return d->op == IR_CONST;
+	}
+	return 0;
+}
+
+/* inline_cost: how much bigger than the call it replaces inlining callee g at call i would make the code */
+int inline_cost(struct ir_inst *i, struct ir_func *g)
+{
+	int cost = inline_size(g) - INLINE_CALL_COST - i->nargs;
+	for (int k=0;k<i->nargs;k++) if (inline_const_arg(i, i->args[k])) cost -= INLINE_CONST_ARG;
+	return cost;
+}
+
+/* replace call i in f by a copy of g */
+void inline_call(struct ir_func *f, struct ir_inst *i, struct ir_func *g)
+{
+	struct ir_block *bb = i->block;
+	int base = f->nvregs;
+	f->nvregs += g->nvregs;
+
+	// what comes after the call moves to a block of its own, the copy goes in between
+	struct ir_block *rest = ir_block_create(f);
+	ir_block_place_before(f, bb->next, rest);
+	while (i->next)
+	{
+		struct ir_inst *n = i->next;
+		ir_inst_remove(n);
+		ir_inst_append(rest, n);
+	}
+
+	struct ir_block **copy = calloc(g->nblocks + 1, sizeof(*copy));
+	for (struct ir_block *gb = g->blocks; gb; gb = gb->next)
+	{
+		copy[gb->id] = ir_block_create(f);
+		ir_block_place_before(f, rest, copy[gb->id]);
+	}
+
+	for (struct ir_block *gb = g->blocks; gb; gb = gb->next)
+	{
+		for (struct ir_inst *gi = gb->first; gi; gi = gi->next)
+		{
+			if (gi->op == IR_RET)
+			{
+				if (gi->src[0] != IR_NO_REG && i->dst != IR_NO_REG)
+				{
+					ir_inst_append(copy[gb->id], ir_inst_create(IR_MOV, i->dst, base + gi->src[0], IR_NO_REG));
+				}
+				struct ir_inst *j = ir_inst_create(IR_JMP, IR_NO_REG, IR_NO_REG, IR_NO_REG);
+				j->target = rest;
+				ir_inst_append(copy[gb->id], j);
+				continue;
+			}
+
+			struct ir_inst *n = malloc(sizeof(*n));
+			memcpy(n, gi, sizeof(*n));
+			n->tail = 0;
+			if (gi->nargs)
+			{
+				n->args = malloc(gi->nargs * sizeof(int));
+				memcpy(n->args, gi->args, gi->nargs * sizeof(int));
+			}
+			if (n->dst != IR_NO_REG) n->dst += base;
+			int *slot;
+			for (int k=0;(slot = ir_inst_use(n, k));k++) if (*slot != IR_NO_REG) *slot += base;
+			if (n->target)       n->target       = copy[n->target->id];
+			if (n->target_false) n->target_false = copy[n->target_false->id];
+			ir_inst_append(copy[gb->id], n);
+		}
+	}
+
+	// the arguments go where the copy expects its parameters, then off into it
+	for (int k=0;k<g->nparams;k++)
+	{
+		ir_inst_insert_before(i, ir_inst_create(IR_MOV, base + k, i->args[k], IR_NO_REG));
+	}
+	struct ir_inst *j = ir_inst_create(IR_JMP, IR_NO_REG, IR_NO_REG, IR_NO_REG);
+	j->target = copy[g->blocks->id];
+	ir_inst_insert_before(i, j);
+	ir_inst_remove(i);
+
+	free(copy);
+	inline_sites++;
+}
+
+/* inline whatever is worth it into f */
+void inline_func(struct ir_func *f)
+{
+	int size = inline_size(f);
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			if (i->op != IR_CALL) continue;
+			struct inline_node *c = hash_table_lookup(inline_nodes, i->name);
+			if (!c || c->recursive || c->func == f) continue;
+
+			int grows = inline_size(c->func);
+			if (size + grows > INLINE_MAX_SIZE || inline_cost(i, c->func) > inline_threshold) continue;
+
+			// the rest of bb has moved on, the walk carries on into the copy right after it
+			inline_call(f, i, c->func);
+			size += grows;
+			break;
+		}
+	}
+}
+
+/* inline_program: inline calls throughout the program, callees first */
+void inline_program(struct ir_program *p)
+{
+	inline_graph(p);
+	for (int k=0;k<inline_norder;k++) inline_func(inline_order[k]->func);
+}
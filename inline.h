@@ -0,0 +1,20 @@
+#ifndef INLINE_H
+#define INLINE_H
+
+#include "ir.h"
+
+/*
+- function inlining: a call to a small function that isn't recursive is replaced by a copy of its body
+- runs over the IR before anything else does, so the copies get optimized along with the code around them
+*/
+
+#define INLINE_CALL_COST  5		// what a call costs besides its arguments: bl, ret, the result move, frame setup and teardown
+#define INLINE_CONST_ARG  4		// how much a constant argument is expected to fold away once the body is copied in
+#define INLINE_MAX_SIZE   2000	// callers stop growing at this many instructions
+
+extern int inline_threshold;	// -inline-threshold=N, how much bigger than its call a callee may be
+extern int inline_sites;		// calls inlined
+
+void inline_program( struct ir_program *p );
+
+#endif
@@ -0,0 +1,387 @@
+#include "ipcp.h"
+#include "cfg.h"
+#include "sccp.h"
+#include "hash_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+- propagates constant arguments into the functions they're passed to, and specializes functions for the
+  constant arguments they get most
+  - void ipcp_program( struct ir_program *p );
+
+- every call the program makes has to be in view, so nothing happens to a program without a main (see prune.c)
+- an argument is constant when its vreg is defined exactly once, by a const, or when it's a parameter of the
+  caller that's constant itself and never assigned
+- propagation, repeated until nothing changes: parameter k of g is constant when every call to g passes the
+  same constant for it, a call of g to itself passing its own parameter k along doesn't count
+- specialization: the calls that pass g the same constants for the parameters left over are grouped, weighted by
+  IPCP_LOOP_WEIGHT for a call inside a loop
+  - the benefit of a group is how many fewer instructions g runs with those constants bound, estimated by folding
+    straight through g and leaving out the blocks a folded branch never goes to
+  - a group with enough benefit and weight gets a clone, g.constprop.N, and its calls are sent there
+- a constant parameter becomes a const into its vreg at the top of the entry block, ahead of everything else,
+  sccp takes it from there
+*/
+
+int ipcp_params = 0;
+int ipcp_clones = 0;
+int ipcp_calls  = 0;
+
+struct ipcp_node;
+
+struct ipcp_site {
+	struct ir_inst *call;
+	struct ipcp_node *caller;
+	int weight;
+	struct ipcp_site *next;
+};
+
+struct ipcp_node {
+	struct ir_func *func;
+	int *ndefs;					// definitions of each vreg, a parameter arriving counts as one
+	struct ir_inst **def;		// the definition of each vreg defined once
+	char *known;				// known[k]: parameter k is value[k] on every call
+	long *value;
+	struct ipcp_site *sites;	// calls to this function
+	int nclones;
+	struct ipcp_node *next;
+};
+
+// one group of calls passing the same constants
+struct ipcp_spec {
+	struct ipcp_node *callee;
+	char *known;				// the parameters bound for the group, the ones known for every call included
+	long *value;
+	int weight;
+	struct ipcp_site **sites;
+	int nsites;
+	struct ir_func *clone;
+	struct ipcp_spec *next;
+};
+
+struct hash_table *ipcp_nodes = 0;		// name -> ipcp_node of every function defined
+struct ipcp_node  *ipcp_first = 0;
+
+/* count the definitions of every vreg of a node's function */
+void ipcp_defs(struct ipcp_node *n)
+{
+	struct ir_func *f = n->func;
+	n->ndefs = calloc(f->nvregs + 1, sizeof(int));
+	n->def   = calloc(f->nvregs + 1, sizeof(*n->def));
+	for (int p=0;p<f->nparams;p++) n->ndefs[p]++;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			if (i->dst < 0) continue;
+			n->ndefs[i->dst]++;
+			n->def[i->dst] = i;
+		}
+	}
+}
+
+/* is vreg v of the caller a constant, *c set to it when it is */
+int ipcp_arg(struct ipcp_node *caller, int v, long *c)
+{
+	if (v < 0 || caller->ndefs[v] != 1) return 0;
+	if (v < caller->func->nparams)
+	{
+		*c = caller->value[v];
+		return caller->known[v];
+	}
+	if (caller->def[v]->op != IR_CONST) return 0;
+	*c = caller->def[v]->imm;
+	return 1;
+}
+
+/* mark the blocks of f that are inside a loop, from the back edges of the control-flow graph */
+char * ipcp_in_loop(struct ir_func *f)
+{
+	char *in = calloc(f->nblocks + 1, 1);
+	struct ir_block **stack = calloc(f->nblocks + 1, sizeof(*stack));
+	for (int r=0;r<f->nrpo;r++)
+	{
+		struct ir_block *bb = f->rpo[r];
+		for (int s=0;s<bb->nsuccs;s++)
+		{
+			struct ir_block *h = bb->succs[s];
+			if (!cfg_dominates(h, bb)) continue;
+
+			// the body of the loop closed by this back edge: what reaches bb going backwards without passing h
+			char *seen = calloc(f->nblocks + 1, 1);
+			int top = 0;
+			seen[h->id] = in[h->id] = 1;
+			if (!seen[bb->id]) stack[top++] = bb;
+			seen[bb->id] = 1;
+			while (top)
+			{
+				struct ir_block *b = stack[--top];
+				in[b->id] = 1;
+				for (int p=0;p<b->npreds;p++)
+				{
+					if (seen[b->preds[p]->id]) continue;
+					seen[b->preds[p]->id] = 1;
+					stack[top++] = b->preds[p];
+				}
+			}
+			free(seen);
+		}
+	}
+	free(stack);
+	return in;
+}
+
+/* ipcp_remaining: about how many instructions of g are left once the parameters in known are bound and folded */
+int ipcp_remaining(struct ipcp_node *g, char *known, long *value)
+{
+	struct ir_func *f = g->func;
+	char *kn   = calloc(f->nvregs + 1, 1);
+	long *kv   = calloc(f->nvregs + 1, sizeof(long));
+	char *live = calloc(f->nblocks + 1, 1);
+	for (int p=0;p<f->nparams;p++)
+	{
+		if (!known[p] || g->ndefs[p] != 1) continue;
+		kn[p] = 1;
+		kv[p] = value[p];
+	}
+
+	int n = 0;
+	if (f->nrpo) live[f->rpo[0]->id] = 1;
+	for (int r=0;r<f->nrpo;r++)
+	{
+		struct ir_block *bb = f->rpo[r];
+		if (!live[bb->id]) continue;
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			int single = i->dst >= 0 && g->ndefs[i->dst] == 1;
+			int fold = 0;
+			long res = 0;
+
+			if (i->op == IR_CONST && single)
+			{
+				kn[i->dst] = 1;
+				kv[i->dst] = i->imm;
+			}
+			else if (i->op == IR_MOV && single && kn[i->src[0]])
+			{
+				fold = 1;
+				res  = kv[i->src[0]];
+			}
+			else if ((ir_is_binary(i->op) || i->op == IR_NEG || i->op == IR_NOT) && single && kn[i->src[0]] && (i->src[1] < 0 || kn[i->src[1]]))
+			{
+				fold = sccp_fold(i->op, kv[i->src[0]], i->src[1] < 0 ? 0 : kv[i->src[1]], &res);
+			}
+			else if (i->op == IR_BR && kn[i->src[0]])
+			{
+				live[(kv[i->src[0]] ? i->target : i->target_false)->id] = 1;
+				continue;
+			}
+
+			if (fold)
+			{
+				kn[i->dst] = 1;
+				kv[i->dst] = res;
+				continue;
+			}
+			if (i->target)       live[i->target->id] = 1;
+			if (i->target_false) live[i->target_false->id] = 1;
+			n++;
+		}
+	}
+
+	free(kn);
+	free(kv);
+	free(live);
+	return n;
+}
+
+/* parameter k of g is constant, on every call */
+void ipcp_propagate(struct ipcp_node *g, int k, int *changed)
+{
+	long c = 0, a;
+	int have = 0;
+	for (struct ipcp_site *s = g->sites; s; s = s->next)
+	{
+		int v = s->call->args[k];
+		if (s->caller == g && v == k && g->ndefs[k] == 1) continue;
+		if (!ipcp_arg(s->caller, v, &a) || (have && a != c)) return;
+		c    = a;
+		have = 1;
+	}
+	if (!have) return;
+
+	g->known[k] = 1;
+	g->value[k] = c;
+	*changed = 1;
+}
+
+/* put the constant parameters of f into their vregs on entry */
+void ipcp_bind(struct ir_func *f, char *known, long *value)
+{
+	for (int k=0;k<f->nparams;k++)
+	{
+		if (!known[k]) continue;
+		struct ir_inst *i = ir_inst_create(IR_CONST, k, IR_NO_REG, IR_NO_REG);
+		i->imm = value[k];
+		ir_inst_insert_before(f->blocks->first, i);
+		ipcp_params++;
+	}
+}
+
+/* the group of calls site belongs to, 0 when it passes no constants beyond the ones every call passes */
+struct ipcp_spec * ipcp_group(struct hash_table *specs, struct ipcp_spec ***end, struct ipcp_node *g, struct ipcp_site *site)
+{
+	int np = g->func->nparams;
+	char *known = calloc(np + 1, 1);
+	long *value = calloc(np + 1, sizeof(long));
+	char *key   = malloc(strlen(g->func->name) + 24 * (np + 1));
+	char *k     = key + sprintf(key, "%s", g->func->name);
+	int extra = 0;
+
+	for (int p=0;p<np;p++)
+	{
+		known[p] = g->known[p];
+		value[p] = g->value[p];
+		if (!g->known[p] && ipcp_arg(site->caller, site->call->args[p], &value[p]))
+		{
+			known[p] = 1;
+			extra++;
+		}
+		if (known[p]) k += sprintf(k, "|%li", value[p]);
+		else          k += sprintf(k, "|*");
+	}
+
+	struct ipcp_spec *s = extra ? hash_table_lookup(specs, key) : 0;
+	if (extra && !s)
+	{
+		s = calloc(1, sizeof(*s));
+		s->callee = g;
+		s->known  = known;
+		s->value  = value;
+		s->sites  = calloc(1, sizeof(*s->sites));
+		hash_table_insert(specs, key, s);
+		**end = s;
+		*end  = &s->next;
+	}
+	else
+	{
+		free(known);
+		free(value);
+	}
+	free(key);
+	return s;
+}
+
+/* instructions in a function */
+int ipcp_size(struct ir_func *f)
+{
+	int n = 0;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next) n++;
+	}
+	return n;
+}
+
+/* clone g for the calls of one group if that looks worth it */
+void ipcp_specialize(struct ipcp_spec *s)
+{
+	struct ipcp_node *g = s->callee;
+	if (g->nclones == IPCP_MAX_CLONES || ipcp_size(g->func) > IPCP_MAX_SIZE) return;
+
+	int benefit = ipcp_remaining(g, g->known, g->value) - ipcp_remaining(g, s->known, s->value);
+	if (benefit < IPCP_MIN_BENEFIT || benefit * s->weight < IPCP_THRESHOLD) return;
+
+	char *name = malloc(strlen(g->func->name) + 24);
+	sprintf(name, "%s.constprop.%i", g->func->name, g->nclones++);
+	s->clone = ir_func_clone(g->func, name);
+	s->clone->next = g->func->next;
+	g->func->next  = s->clone;
+	cfg_build(s->clone);
+	ipcp_clones++;
+
+	for (int k=0;k<s->nsites;k++)
+	{
+		s->sites[k]->call->name = name;
+		ipcp_calls++;
+	}
+}
+
+/* ipcp_program: propagate constant arguments through the program and specialize where it pays */
+void ipcp_program(struct ir_program *p)
+{
+	if (ipcp_nodes) hash_table_delete(ipcp_nodes);
+	ipcp_nodes = hash_table_create(0, 0);
+	ipcp_first = 0;
+
+	struct ipcp_node **end = &ipcp_first;
+	for (struct ir_func *f = p->funcs; f; f = f->next)
+	{
+		struct ipcp_node *n = calloc(1, sizeof(*n));
+		n->func  = f;
+		n->known = calloc(f->nparams + 1, 1);
+		n->value = calloc(f->nparams + 1, sizeof(long));
+		ipcp_defs(n);
+		hash_table_insert(ipcp_nodes, f->name, n);
+		*end = n;
+		end  = &n->next;
+	}
+	if (!hash_table_lookup(ipcp_nodes, "main")) return;
+
+	// every call to a function of the program, weighted by whether it's in a loop
+	for (struct ipcp_node *n = ipcp_first; n; n = n->next)
+	{
+		char *in_loop = ipcp_in_loop(n->func);
+		for (struct ir_block *bb = n->func->blocks; bb; bb = bb->next)
+		{
+			for (struct ir_inst *i = bb->first; i; i = i->next)
+			{
+				if (i->op != IR_CALL) continue;
+				struct ipcp_node *g = hash_table_lookup(ipcp_nodes, i->name);
+				if (!g || i->nargs != g->func->nparams) continue;
+
+				struct ipcp_site *s = calloc(1, sizeof(*s));
+				s->call   = i;
+				s->caller = n;
+				s->weight = in_loop[bb->id] ? IPCP_LOOP_WEIGHT : 1;
+				s->next   = g->sites;
+				g->sites  = s;
+			}
+		}
+		free(in_loop);
+	}
+
+	int changed = 1;
+	while (changed)
+	{
+		changed = 0;
+		for (struct ipcp_node *g = ipcp_first; g; g = g->next)
+		{
+			for (int k=0;k<g->func->nparams;k++) if (!g->known[k]) ipcp_propagate(g, k, &changed);
+		}
+	}
+
+	struct hash_table *specs = hash_table_create(0, 0);
+	struct ipcp_spec *first = 0;
+	struct ipcp_spec **send = &first;
+	for (struct ipcp_node *g = ipcp_first; g; g = g->next)
+	{
+		for (struct ipcp_site *site = g->sites; site; site = site->next)
+		{
+			struct ipcp_spec *s = ipcp_group(specs, &send, g, site);
+			if (!s) continue;
+			s->weight += site->weight;
+			s->sites = realloc(s->sites, (s->nsites + 1) * sizeof(*s->sites));
+			s->sites[s->nsites++] = site;
+		}
+	}
+	for (struct ipcp_spec *s = first; s; s = s->next) ipcp_specialize(s);
+
+	// the consts only go in once every clone has been copied from a function without them
+	for (struct ipcp_node *g = ipcp_first; g; g = g->next) ipcp_bind(g->func, g->known, g->value);
+	for (struct ipcp_spec *s = first; s; s = s->next) if (s->clone) ipcp_bind(s->clone, s->known, s->value);
+	hash_table_delete(specs);
+}
@@ -0,0 +1,26 @@
+#ifndef IPCP_H
+#define IPCP_H
+
+#include "ir.h"
+
+/*
+- interprocedural constant propagation: a parameter every call passes the same constant becomes that constant
+  inside the function
+- function specialization: a set of constant arguments that's passed often (from inside loops, mostly) gets a
+  clone of the function of its own with those constants in place, when enough of the clone folds away
+- runs on the whole program after inlining, before SSA, so sccp and the passes after it do the folding
+*/
+
+#define IPCP_LOOP_WEIGHT 10		// a call inside a loop counts as this many calls
+#define IPCP_MIN_BENEFIT 3		// a clone has to lose at least this many instructions
+#define IPCP_THRESHOLD   30		// and instructions saved times calls has to come to this much
+#define IPCP_MAX_SIZE    300	// bigger functions aren't cloned
+#define IPCP_MAX_CLONES  4		// clones per function
+
+extern int ipcp_params;			// parameters turned into constants, clones included
+extern int ipcp_clones;			// specialized clones made
+extern int ipcp_calls;			// calls sent to a clone
+
+void ipcp_program( struct ir_program *p );
+
+#endif
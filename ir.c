@@ -0,0 +1,1263 @@
+#include "ir.h"
+#include "library.h"
+#include "string_pool.h"
+#include "unroll.h"
+#include "vector.h"
+#include "opt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+/*
+- ir_lower turns every function of the AST into a list of basic blocks of three-address instructions
+  - struct ir_program * ir_lower( struct decl *d );
+  - void ir_print( struct ir_program *p, FILE *out );
+
+- expressions are lowered post-order just like expr_codegen, but into fresh virtual registers instead of scratch registers,
+  so nothing ever runs out and the backends decide what actually lives in a machine register
+- locals and parameters are variables: one vreg each, assigned with IR_MOV
+- globals are accessed by name (IR_LOADG/IR_STOREG), global arrays through their address (IR_ADDR + IR_LOAD/IR_STORE)
+- control flow only ever happens at the end of a block, so every if/for turns into a handful of blocks
+
+the lowering state is kept in globals while one function is being built
+*/
+
+struct ir_var {
+	struct symbol *symbol;
+	int vreg;
+	struct ir_var *next;
+};
+
+struct ir_func  *ir_func_cur  = 0;	// function being lowered
+struct ir_block *ir_block_cur = 0;	// block new instructions get appended to
+struct ir_var   *ir_vars      = 0;	// locals and parameters of the current function
+char            *ir_is_var    = 0;	// ir_is_var[v] is set when vreg v is a variable rather than a temporary
+int              ir_is_var_cap = 0;
+
+/* ir_vreg_new: hand out the next virtual register of a function */
+int ir_vreg_new(struct ir_func *f)
+{
+	return f->nvregs++;
+}
+
+/* ir_block_create: create an empty block that isn't part of the layout yet */
+struct ir_block * ir_block_create(struct ir_func *f)
+{
+	struct ir_block *bb = calloc(1, sizeof(*bb));
+	bb->id = f->nblocks++;
+	return bb;
+}
+
+/* ir_block_place: append a block to the end of the function's layout */
+void ir_block_place(struct ir_func *f, struct ir_block *bb)
+{
+	if (!f->blocks)
+	{
+		f->blocks = bb;
+	}
+	else
+	{
+		struct ir_block *p = f->blocks;
+		while (p->next) p = p->next;
+		p->next = bb;
+	}
+}
+
+/* ir_block_place_before: put a block into the layout right in front of pos */
+void ir_block_place_before(struct ir_func *f, struct ir_block *pos, struct ir_block *bb)
+{
+	if (f->blocks == pos)
+	{
+		bb->next  = pos;
+		f->blocks = bb;
+		return;
+	}
+
+	struct ir_block *p = f->blocks;
+	while (p->next != pos) p = p->next;
+	bb->next = pos;
+	p->next  = bb;
+}
+
+/* ir_block_new: create an empty block and append it to the function's layout */
+struct ir_block * ir_block_new(struct ir_func *f)
+{
+	struct ir_block *bb = ir_block_create(f);
+	ir_block_place(f, bb);
+	return bb;
+}
+
+/* ir_inst_create: create an instruction that isn't part of any block yet */
+struct ir_inst * ir_inst_create(ir_op_t op, int dst, int a, int b)
+{
+	struct ir_inst *i = calloc(1, sizeof(*i));
+	i->op     = op;
+	i->dst    = dst;
+	i->src[0] = a;
+	i->src[1] = b;
+	i->src[2] = IR_NO_REG;
+	return i;
+}
+
+/* ir_inst_append: add an instruction to the end of a block */
+void ir_inst_append(struct ir_block *bb, struct ir_inst *i)
+{
+	i->block = bb;
+	i->prev  = bb->last;
+	i->next  = 0;
+	if (bb->last) bb->last->next = i;
+	else          bb->first      = i;
+	bb->last = i;
+}
+
+/* ir_inst_insert_before: put an instruction right in front of another one */
+void ir_inst_insert_before(struct ir_inst *pos, struct ir_inst *i)
+{
+	struct ir_block *bb = pos->block;
+	i->block = bb;
+	i->next  = pos;
+	i->prev  = pos->prev;
+	if (pos->prev) pos->prev->next = i;
+	else           bb->first       = i;
+	pos->prev = i;
+}
+
+/* ir_inst_remove: unlink an instruction from its block */
+void ir_inst_remove(struct ir_inst *i)
+{
+	struct ir_block *bb = i->block;
+	if (i->prev) i->prev->next = i->next;
+	else         bb->first     = i->next;
+	if (i->next) i->next->prev = i->prev;
+	else         bb->last      = i->prev;
+	i->prev = i->next = 0;
+	i->block = 0;
+}
+
+/* ir_func_clone: a copy of function g under another name, block for block and vreg for vreg */
+/*
+- the copy isn't in any program yet and has no control-flow graph, cfg_build it once it's placed
+*/
+struct ir_func * ir_func_clone(struct ir_func *g, const char *name)
+{
+	struct ir_func *f = malloc(sizeof(*f));
+	memcpy(f, g, sizeof(*f));
+	f->name    = name;
+	f->nblocks = 0;
+	f->blocks  = 0;
+	f->rpo     = 0;
+	f->nrpo    = 0;
+	f->next    = 0;
+
+	struct ir_block **copy = calloc(g->nblocks + 1, sizeof(*copy));
+	for (struct ir_block *gb = g->blocks; gb; gb = gb->next)
+	{
+		copy[gb->id] = ir_block_create(f);
+		ir_block_place(f, copy[gb->id]);
+	}
+	f->start = copy[g->start->id];
+
+	for (struct ir_block *gb = g->blocks; gb; gb = gb->next)
+	{
+		for (struct ir_inst *gi = gb->first; gi; gi = gi->next)
+		{
+			struct ir_inst *i = malloc(sizeof(*i));
+			memcpy(i, gi, sizeof(*i));
+			if (gi->nargs)
+			{
+				i->args = malloc(gi->nargs * sizeof(int));
+				memcpy(i->args, gi->args, gi->nargs * sizeof(int));
+			}
+			if (gi->phi_blocks)
+			{
+				i->phi_blocks = malloc(gi->nargs * sizeof(*i->phi_blocks));
+				for (int k=0;k<gi->nargs;k++) i->phi_blocks[k] = copy[gi->phi_blocks[k]->id];
+			}
+			if (i->target)       i->target       = copy[i->target->id];
+			if (i->target_false) i->target_false = copy[i->target_false->id];
+			ir_inst_append(copy[gb->id], i);
+		}
+	}
+
+	free(copy);
+	return f;
+}
+
+/* ir_is_terminator: does this instruction end a block */
+int ir_is_terminator(ir_op_t op)
+{
+	return op == IR_JMP || op == IR_BR || op == IR_RET;
+}
+
+/* ir_is_binary: is this a plain dst = src0 op src1 instruction */
+int ir_is_binary(ir_op_t op)
+{
+	return op >= IR_ADD && op <= IR_GE;
+}
+
+/* ir_has_side_effects: can this instruction not be deleted even when its result is unused */
+int ir_has_side_effects(struct ir_inst *i)
+{
+	switch (i->op)
+	{
+		case IR_STOREG:
+		case IR_STORE:
+		case IR_CALL:
+		case IR_JMP:
+		case IR_BR:
+		case IR_RET:
+		case IR_VLOAD:
+		case IR_VSTORE:
+		case IR_VDUP:
+		case IR_VBIN:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+/* ir_inst_use: pointer to the k-th vreg operand slot of an instruction, 0 once k runs past the end */
+/*
+- slots that hold IR_NO_REG are still returned, so callers skip those
+- the pointer lets passes rewrite operands in place
+*/
+int * ir_inst_use(struct ir_inst *i, int k)
+{
+	if (k < 3) return &i->src[k];
+	k -= 3;
+	if (k < i->nargs) return &i->args[k];
+	return 0;
+}
+
+/* ir_block_succs: fill in the successors of a block from its terminator, returns how many there are */
+int ir_block_succs(struct ir_block *bb, struct ir_block **succs)
+{
+	struct ir_inst *t = bb->last;
+	if (!t) return 0;
+
+	switch (t->op)
+	{
+		case IR_JMP:
+			succs[0] = t->target;
+			return 1;
+		case IR_BR:
+			succs[0] = t->target;
+			if (t->target_false == t->target) return 1;
+			succs[1] = t->target_false;
+			return 2;
+		default:
+			return 0;
+	}
+}
+
+/* ir_op_name: mnemonic used by the textual dump */
+const char * ir_op_name(ir_op_t op)
+{
+	switch (op)
+	{
+		case IR_CONST:  return "const";
+		case IR_MOV:    return "mov";
+		case IR_ADD:    return "add";
+		case IR_SUB:    return "sub";
+		case IR_MUL:    return "mul";
+		case IR_DIV:    return "div";
+		case IR_MOD:    return "mod";
+		case IR_AND:    return "and";
+		case IR_OR:     return "or";
+		case IR_EQ:     return "eq";
+		case IR_NE:     return "ne";
+		case IR_LT:     return "lt";
+		case IR_LE:     return "le";
+		case IR_GT:     return "gt";
+		case IR_GE:     return "ge";
+		case IR_NEG:    return "neg";
+		case IR_NOT:    return "not";
+		case IR_ADDR:   return "addr";
+		case IR_LOADG:  return "loadg";
+		case IR_STOREG: return "storeg";
+		case IR_LOAD:   return "load";
+		case IR_STORE:  return "store";
+		case IR_CALL:   return "call";
+		case IR_JMP:    return "jmp";
+		case IR_BR:     return "br";
+		case IR_RET:    return "ret";
+		case IR_PHI:    return "phi";
+		case IR_VLOAD:  return "vload";
+		case IR_VSTORE: return "vstore";
+		case IR_VDUP:   return "vdup";
+		case IR_VBIN:   return "vbin";
+		case IR_VSUM:   return "vsum";
+		case IR_SEL:    return "sel";
+	}
+	return "?";
+}
+
+/*
+LOWERING
+*/
+
+/* add an instruction to the block we're currently filling */
+struct ir_inst * ir_emit(ir_op_t op, int dst, int a, int b)
+{
+	struct ir_inst *i = ir_inst_create(op, dst, a, b);
+	ir_inst_append(ir_block_cur, i);
+	return i;
+}
+
+/* is the current block already closed off by a jump, branch or return */
+int ir_block_cur_done()
+{
+	return ir_block_cur->last && ir_is_terminator(ir_block_cur->last->op);
+}
+
+/* start emitting into bb, placing it after everything emitted so far */
+/*
+- blocks are created as soon as something needs to branch to them, but only placed once code goes into them,
+  so the layout ends up in source order
+- if the current block is still open it falls through into bb
+*/
+void ir_block_begin(struct ir_block *bb)
+{
+	if (!ir_block_cur_done())
+	{
+		ir_emit(IR_JMP, IR_NO_REG, IR_NO_REG, IR_NO_REG)->target = bb;
+	}
+	ir_block_place(ir_func_cur, bb);
+	ir_block_cur = bb;
+}
+
+/* create a variable vreg for a local or parameter */
+int ir_var_new(struct symbol *s)
+{
+	struct ir_var *v = calloc(1, sizeof(*v));
+	v->symbol = s;
+	v->vreg   = ir_vreg_new(ir_func_cur);
+	v->next   = ir_vars;
+	ir_vars   = v;
+
+	if (v->vreg >= ir_is_var_cap)
+	{
+		int cap = ir_is_var_cap ? ir_is_var_cap * 2 : 64;
+		while (cap <= v->vreg) cap *= 2;
+		ir_is_var = realloc(ir_is_var, cap);
+		memset(ir_is_var + ir_is_var_cap, 0, cap - ir_is_var_cap);
+		ir_is_var_cap = cap;
+	}
+	ir_is_var[v->vreg] = 1;
+
+	return v->vreg;
+}
+
+/* find the variable vreg of a local or parameter */
+int ir_var_lookup(struct symbol *s)
+{
+	for (struct ir_var *v = ir_vars; v; v = v->next)
+	{
+		if (v->symbol == s) return v->vreg;
+	}
+
+	printf("ir error: no variable for %s\n", s->name);
+	exit(1);
+}
+
+/* is vreg v a local or parameter */
+int ir_vreg_is_var(int v)
+{
+	return v >= 0 && v < ir_is_var_cap && ir_is_var[v];
+}
+
+/* does evaluating this expression write to a local, which would change a variable vreg read earlier */
+int ir_expr_writes(struct expr *e)
+{
+	if (!e) return 0;
+	if (e->kind == EXPR_ASSIGN || e->kind == EXPR_INCR || e->kind == EXPR_DECR) return 1;
+	if (e->kind == EXPR_FUNCCALL)
+	{
+		for (struct expr *a = e->right; a; a = a->next)
+		{
+			if (ir_expr_writes(a)) return 1;
+		}
+		return 0;
+	}
+	return ir_expr_writes(e->left) || ir_expr_writes(e->right);
+}
+
+/* take a snapshot of v if it's a variable that "later" is about to overwrite */
+int ir_snapshot(int v, struct expr *later)
+{
+	if (!ir_vreg_is_var(v) || !ir_expr_writes(later)) return v;
+
+	int t = ir_vreg_new(ir_func_cur);
+	ir_emit(IR_MOV, t, v, IR_NO_REG);
+	return t;
+}
+
+int ir_lower_expr( struct expr *e );
+
+/* emit dst = name(args), returns dst */
+int ir_lower_call(const char *name, struct expr *args, int returns_value)
+{
+	int nargs = 0;
+	for (struct expr *a = args; a; a = a->next) nargs++;
+
+	int *regs = calloc(nargs ? nargs : 1, sizeof(int));
+	int k = 0;
+	for (struct expr *a = args; a; a = a->next, k++)
+	{
+		regs[k] = ir_snapshot(ir_lower_expr(a), a->next);
+	}
+
+	int dst = returns_value ? ir_vreg_new(ir_func_cur) : IR_NO_REG;
+	struct ir_inst *i = ir_emit(IR_CALL, dst, IR_NO_REG, IR_NO_REG);
+	i->name  = name;
+	i->args  = regs;
+	i->nargs = nargs;
+	return dst;
+}
+
+/* emit the address of a global array */
+int ir_lower_array_base(struct expr *name)
+{
+	int base = ir_vreg_new(ir_func_cur);
+	ir_emit(IR_ADDR, base, IR_NO_REG, IR_NO_REG)->name = name->name;
+	return base;
+}
+
+/* store value v into the location named by lvalue "e" (a name or an array element) */
+void ir_lower_store(struct expr *e, int base, int idx, int v)
+{
+	if (e->kind == EXPR_ARRELEM)
+	{
+		struct ir_inst *i = ir_emit(IR_STORE, IR_NO_REG, base, idx);
+		i->src[2] = v;
+	}
+	else if (e->symbol->kind != SYMBOL_GLOBAL)
+	{
+		int var = ir_var_lookup(e->symbol);
+
+		// if v was computed by the instruction we just emitted, just make that instruction write the variable
+		struct ir_inst *last = ir_block_cur->last;
+		if (last && last->dst == v && !ir_vreg_is_var(v) && last->op != IR_CALL)
+		{
+			last->dst = var;
+		}
+		else
+		{
+			ir_emit(IR_MOV, var, v, IR_NO_REG);
+		}
+	}
+	else
+	{
+		ir_emit(IR_STOREG, IR_NO_REG, v, IR_NO_REG)->name = e->symbol->name;
+	}
+}
+
+/* the IR operation of a binary expression */
+ir_op_t ir_binary_op(expr_t kind)
+{
+	switch (kind)
+	{
+		case EXPR_ADD: return IR_ADD;
+		case EXPR_SUB: return IR_SUB;
+		case EXPR_MUL: return IR_MUL;
+		case EXPR_DIV: return IR_DIV;
+		case EXPR_MOD: return IR_MOD;
+		case EXPR_LE:  return IR_LE;
+		case EXPR_LT:  return IR_LT;
+		case EXPR_GE:  return IR_GE;
+		case EXPR_GT:  return IR_GT;
+		case EXPR_EQ:  return IR_EQ;
+		case EXPR_NEQ: return IR_NE;
+		case EXPR_AND: return IR_AND;
+		default:       return IR_OR;
+	}
+}
+
+/* ir_lower_expr: lower an expression, returns the vreg holding its value */
+int ir_lower_expr(struct expr *e)
+{
+	struct ir_func *f = ir_func_cur;
+	int dst, a, b;
+
+	switch (e->kind)
+	{
+		case EXPR_ASSIGN:			// 0
+		{
+			// the array index is evaluated before the value, left to right like everything else
+			int base = IR_NO_REG, idx = IR_NO_REG;
+			if (e->left->kind == EXPR_ARRELEM)
+			{
+				base = ir_lower_array_base(e->left->left);
+				idx  = ir_snapshot(ir_lower_expr(e->left->right), e->right);
+			}
+			int v = ir_lower_expr(e->right);
+			ir_lower_store(e->left, base, idx, v);
+			// the value of an assignment is what got stored, which now lives in the variable itself
+			if (e->left->kind == EXPR_NAME && e->left->symbol->kind != SYMBOL_GLOBAL)
+			{
+				return ir_var_lookup(e->left->symbol);
+			}
+			return v;
+		}
+		case EXPR_ADD:				// 1
+		case EXPR_SUB:				// 2
+		case EXPR_MUL:				// 3
+		case EXPR_DIV:				// 4
+		case EXPR_MOD:				// 5
+		case EXPR_LE:				// 7
+		case EXPR_LT:				// 8
+		case EXPR_GE:				// 9
+		case EXPR_GT:				// 10
+		case EXPR_EQ:				// 11
+		case EXPR_NEQ:				// 12
+		case EXPR_AND:				// 13
+		case EXPR_OR:				// 14
+		{
+			ir_op_t op = ir_binary_op(e->kind);
+			// both sides are always evaluated, same as the direct emitter
+			a = ir_snapshot(ir_lower_expr(e->left), e->right);
+			b = ir_lower_expr(e->right);
+			dst = ir_vreg_new(f);
+			ir_emit(op, dst, a, b);
+			return dst;
+		}
+		case EXPR_EXP:				// 6
+		{
+			// integer_power(base, exponent) from the runtime library
+			e->left->next = e->right;
+			dst = ir_lower_call("integer_power", e->left, 1);
+			e->left->next = 0;
+			return dst;
+		}
+		case EXPR_NOT:				// 15
+		case EXPR_NEG:				// 16
+			a = ir_lower_expr(e->right);
+			dst = ir_vreg_new(f);
+			ir_emit(e->kind == EXPR_NOT ? IR_NOT : IR_NEG, dst, a, IR_NO_REG);
+			return dst;
+		case EXPR_INCR:				// 17
+		case EXPR_DECR:				// 18
+		{
+			// postfix: the value of the expression is the old value
+			struct expr *lv = e->left;
+			int base = IR_NO_REG, idx = IR_NO_REG, old;
+			if (lv->kind == EXPR_ARRELEM)
+			{
+				base = ir_lower_array_base(lv->left);
+				idx  = ir_lower_expr(lv->right);
+				old  = ir_vreg_new(f);
+				ir_emit(IR_LOAD, old, base, idx);
+			}
+			else if (lv->symbol->kind != SYMBOL_GLOBAL)
+			{
+				old = ir_vreg_new(f);
+				ir_emit(IR_MOV, old, ir_var_lookup(lv->symbol), IR_NO_REG);
+			}
+			else
+			{
+				old = ir_vreg_new(f);
+				ir_emit(IR_LOADG, old, IR_NO_REG, IR_NO_REG)->name = lv->symbol->name;
+			}
+
+			int one = ir_vreg_new(f);
+			ir_emit(IR_CONST, one, IR_NO_REG, IR_NO_REG)->imm = 1;
+			int upd = ir_vreg_new(f);
+			ir_emit(e->kind == EXPR_INCR ? IR_ADD : IR_SUB, upd, old, one);
+			ir_lower_store(lv, base, idx, upd);
+			return old;
+		}
+		case EXPR_GROUP:			// 19
+			return ir_lower_expr(e->right);
+		case EXPR_ARRELEM:			// 20
+		{
+			int base = ir_lower_array_base(e->left);
+			int idx  = ir_lower_expr(e->right);
+			dst = ir_vreg_new(f);
+			ir_emit(IR_LOAD, dst, base, idx);
+			return dst;
+		}
+		case EXPR_INT_LITERAL:		// 21
+		case EXPR_BOOLEAN_LITERAL: 	// 22
+		case EXPR_CHAR_LITERAL:		// 23
+			dst = ir_vreg_new(f);
+			ir_emit(IR_CONST, dst, IR_NO_REG, IR_NO_REG)->imm = e->literal_value;
+			return dst;
+		case EXPR_STRING_LITERAL:	// 24
+			dst = ir_vreg_new(f);
+			ir_emit(IR_ADDR, dst, IR_NO_REG, IR_NO_REG)->name = string_pool_name(string_pool_intern(e->string_literal));
+			return dst;
+		case EXPR_NAME:				// 25
+			if (e->symbol->kind != SYMBOL_GLOBAL)
+			{
+				return ir_var_lookup(e->symbol);
+			}
+			dst = ir_vreg_new(f);
+			ir_emit(IR_LOADG, dst, IR_NO_REG, IR_NO_REG)->name = e->symbol->name;
+			return dst;
+		case EXPR_FUNCCALL:			// 26
+		{
+			struct type *ft = e->left->symbol->type;
+			int returns_value = ft->subtype && ft->subtype->kind != TYPE_VOID;
+			return ir_lower_call(e->left->name, e->right, returns_value);
+		}
+	}
+
+	printf("ir error: unknown expression kind %i\n", e->kind);
+	exit(1);
+}
+
+/* lower a print statement into print_values calls, same descriptor scheme as stmt_codegen_print */
+void ir_lower_print(struct expr *e)
+{
+	while (e)
+	{
+		char *desc = 0;
+		int  len   = 0;
+		int  regs[PRINT_VALUES_MAX_ARGS + 1];
+		int  nargs = 1;
+
+		print_desc_append(&desc, &len, "");
+
+		for (; e; e = e->next)
+		{
+			if (print_expr_is_constant(e))
+			{
+				print_desc_constant(&desc, &len, e);
+				continue;
+			}
+			if (nargs == PRINT_VALUES_MAX_ARGS + 1) break;
+
+			regs[nargs++] = ir_snapshot(ir_lower_expr(e), e->next);
+			print_desc_marker(&desc, &len, e);
+		}
+
+		regs[0] = ir_vreg_new(ir_func_cur);
+		ir_emit(IR_ADDR, regs[0], IR_NO_REG, IR_NO_REG)->name = string_pool_name(string_pool_intern_text(desc));
+
+		struct ir_inst *i = ir_emit(IR_CALL, IR_NO_REG, IR_NO_REG, IR_NO_REG);
+		i->name  = "print_values";
+		i->nargs = nargs;
+		i->args  = malloc(nargs * sizeof(int));
+		memcpy(i->args, regs, nargs * sizeof(int));
+
+		free(desc);
+	}
+}
+
+/* lower "return e", handling calls in tail position */
+void ir_lower_return(struct expr *e)
+{
+	struct ir_func *f = ir_func_cur;
+
+	// a bare "return;" is parsed as an empty expression
+	if (!e || (e->kind == EXPR_ASSIGN && !e->left))
+	{
+		ir_emit(IR_RET, IR_NO_REG, IR_NO_REG, IR_NO_REG);
+		return;
+	}
+
+	struct expr *call = e;
+	while (call->kind == EXPR_GROUP) call = call->right;
+
+	// calling ourselves: reassign the parameters and loop back to the top of the body
+	if (call->kind == EXPR_FUNCCALL && !strcmp(call->left->name, f->name))
+	{
+		int regs[EXPR_CALL_MAX_ARGS];
+		int k = 0;
+		for (struct expr *a = call->right; a && k < EXPR_CALL_MAX_ARGS; a = a->next, k++)
+		{
+			regs[k] = ir_lower_expr(a);
+			// every new parameter value has to be read before any parameter is overwritten
+			if (ir_vreg_is_var(regs[k]))
+			{
+				int t = ir_vreg_new(f);
+				ir_emit(IR_MOV, t, regs[k], IR_NO_REG);
+				regs[k] = t;
+			}
+		}
+		for (int p=0;p<k;p++)
+		{
+			ir_emit(IR_MOV, p, regs[p], IR_NO_REG);
+		}
+		ir_emit(IR_JMP, IR_NO_REG, IR_NO_REG, IR_NO_REG)->target = f->start;
+		return;
+	}
+
+	int v = ir_lower_expr(e);
+
+	// anything else returned straight from a call can become a jump in the backend
+	struct ir_inst *last = ir_block_cur->last;
+	if (last && last->op == IR_CALL && last->dst == v && call->kind != EXPR_ASSIGN)
+	{
+		last->tail = 1;
+	}
+
+	ir_emit(IR_RET, IR_NO_REG, v, IR_NO_REG);
+}
+
+void ir_lower_stmt( struct stmt *s );
+
+/* a for loop past its init expression: test, body and next, carrying on in the block after it */
+void ir_lower_for(struct stmt *s)
+{
+	struct ir_func *f = ir_func_cur;
+	struct ir_block *head_bb = ir_block_create(f);
+	struct ir_block *body_bb = ir_block_create(f);
+	struct ir_block *next_bb = ir_block_create(f);
+	struct ir_block *done_bb = ir_block_create(f);
+
+	ir_block_begin(head_bb);
+	if (s->expr)
+	{
+		int c = ir_lower_expr(s->expr);
+		struct ir_inst *br = ir_emit(IR_BR, IR_NO_REG, c, IR_NO_REG);
+		br->target       = body_bb;
+		br->target_false = done_bb;
+	}
+
+	ir_block_begin(body_bb);
+	ir_lower_stmt(s->body);
+
+	ir_block_begin(next_bb);
+	if (s->next_expr) ir_lower_expr(s->next_expr);
+	ir_emit(IR_JMP, IR_NO_REG, IR_NO_REG, IR_NO_REG)->target = head_bb;
+
+	ir_block_begin(done_bb);
+}
+
+/* one trip around a for loop with no test in front of it: the body, then the next expression */
+void ir_lower_trip(struct stmt *s)
+{
+	ir_lower_stmt(s->body);
+	if (ir_block_cur_done()) ir_block_cur = ir_block_new(ir_func_cur);
+	ir_lower_expr(s->next_expr);
+}
+
+/* the head of a loop doing per_trip trips at once: is the counter still in range per_trip - 1 steps ahead */
+/*
+- counter + ahead <op> bound is tested as counter <op> bound - ahead, the counter is never near enough to the end
+  of the integers for the sum to wrap around then
+- bound - ahead is worked out once in front of the loop, it wraps when the bound is within ahead of the end the
+  counter counts away from, and no counter can be that far ahead of it, so the loop is skipped for the trips left
+- unroll_plan only unrolls loops whose ahead fits in a long
+*/
+void ir_lower_ahead(struct unroll *u, int per_trip, struct ir_block *head_bb, struct ir_block *body_bb, struct ir_block *rest_bb)
+{
+	struct ir_func *f = ir_func_cur;
+	long ahead = (per_trip - 1) * u->step;
+	long edge  = u->step > 0 ? LONG_MIN + ahead : LONG_MAX + ahead;	// the furthest bound bound - ahead stays in range for
+
+	long b;
+	int bound = ir_lower_expr(u->bound);
+	int dist  = ir_vreg_new(f);
+	int limit = ir_vreg_new(f);
+	ir_emit(IR_CONST, dist, IR_NO_REG, IR_NO_REG)->imm = ahead;
+	ir_emit(IR_SUB, limit, bound, dist);
+	if (!unroll_literal(u->bound, &b))
+	{
+		int e = ir_vreg_new(f);
+		int clear = ir_vreg_new(f);
+		ir_emit(IR_CONST, e, IR_NO_REG, IR_NO_REG)->imm = edge;
+		ir_emit(u->step > 0 ? IR_GE : IR_LE, clear, bound, e);
+		struct ir_inst *br = ir_emit(IR_BR, IR_NO_REG, clear, IR_NO_REG);
+		br->target       = head_bb;
+		br->target_false = rest_bb;
+	}
+	else if (u->step > 0 ? b < edge : b > edge)
+	{
+		ir_emit(IR_JMP, IR_NO_REG, IR_NO_REG, IR_NO_REG)->target = rest_bb;
+	}
+
+	ir_block_begin(head_bb);
+	int c = ir_vreg_new(f);
+	ir_emit(ir_binary_op(u->cmp), c, ir_var_lookup(u->var), limit);
+	struct ir_inst *br = ir_emit(IR_BR, IR_NO_REG, c, IR_NO_REG);
+	br->target       = body_bb;
+	br->target_false = rest_bb;
+}
+
+/* the trips left after a loop that did per_trip of them at once */
+void ir_lower_leftover(struct stmt *s, struct unroll *u, int per_trip)
+{
+	if (u->trips >= 0)
+	{
+		// the counter's value here is known too, and saying so lets it die with the loop
+		unsigned long done = u->trips - u->trips % per_trip;
+		ir_emit(IR_CONST, ir_var_lookup(u->var), IR_NO_REG, IR_NO_REG)->imm = (long) ((unsigned long) u->start + done * (unsigned long) u->step);
+		for (long k=0;k<u->trips % per_trip;k++) ir_lower_trip(s);
+	}
+	else
+	{
+		ir_lower_for(s);
+	}
+}
+
+/* the SIMD register holding vector expression e, computed into temporary d and up when it isn't a fixed one */
+int ir_lower_vector_expr(struct vector *v, struct expr *e, int d)
+{
+	int r = vector_value_reg(v, e);
+	if (r >= 0) return r;
+
+	e = unroll_strip(e);
+	if (e->kind == EXPR_ARRELEM)
+	{
+		long off;
+		vector_index(e->right, v->u.var, &off);
+		int base = ir_lower_array_base(e->left);
+		struct ir_inst *i = ir_emit(IR_VLOAD, IR_NO_REG, base, ir_var_lookup(v->u.var));
+		i->imm    = 8 * off;
+		i->vec[0] = d;
+		return d;
+	}
+
+	int a = ir_lower_vector_expr(v, e->left, d);
+	int b = ir_lower_vector_expr(v, e->right, d + 1);
+	struct ir_inst *i = ir_emit(IR_VBIN, IR_NO_REG, IR_NO_REG, IR_NO_REG);
+	i->imm    = ir_binary_op(e->kind);
+	i->vec[0] = d;
+	i->vec[1] = a;
+	i->vec[2] = b;
+	return d;
+}
+
+/* lower a for loop unroll_plan agreed to unroll, see unroll.c */
+/*
+- completely: the condition is known to hold exactly u->trips times, so that many trips one after the other
+- by unroll_factor: a loop doing unroll_factor trips per test, for as long as the last of them would still pass
+  the condition, then the trips that are left, as straight copies when their number is known and as the
+  original loop when it isn't
+*/
+void ir_lower_for_unrolled(struct stmt *s, struct unroll *u)
+{
+	struct ir_func *f = ir_func_cur;
+	if (s->init_expr) ir_lower_expr(s->init_expr);
+
+	if (u->full)
+	{
+		for (long k=0;k<u->trips;k++) ir_lower_trip(s);
+		return;
+	}
+
+	struct ir_block *head_bb = ir_block_create(f);
+	struct ir_block *body_bb = ir_block_create(f);
+	struct ir_block *rest_bb = ir_block_create(f);
+
+	ir_lower_ahead(u, unroll_factor, head_bb, body_bb, rest_bb);
+
+	ir_block_begin(body_bb);
+	for (int k=0;k<unroll_factor;k++) ir_lower_trip(s);
+	ir_emit(IR_JMP, IR_NO_REG, IR_NO_REG, IR_NO_REG)->target = head_bb;
+
+	ir_block_begin(rest_bb);
+	ir_lower_leftover(s, u, unroll_factor);
+}
+
+/* lower the statements of a vectorized loop body, VECTOR_LANES elements at once */
+void ir_lower_vector_stmts(struct vector *v, struct stmt *s)
+{
+	for (; s; s = s->next)
+	{
+		if (s->kind == STMT_BLOCK)
+		{
+			ir_lower_vector_stmts(v, s->body);
+			continue;
+		}
+
+		struct expr *e = unroll_strip(s->expr);
+		struct expr *l = unroll_strip(e->left);
+		if (l->kind == EXPR_ARRELEM)
+		{
+			int r = ir_lower_vector_expr(v, e->right, 0);
+			int base = ir_lower_array_base(l->left);
+			ir_emit(IR_VSTORE, IR_NO_REG, base, ir_var_lookup(v->u.var))->vec[0] = r;
+		}
+		else
+		{
+			int acc = vector_sum_reg(v, l->symbol);
+			int r = ir_lower_vector_expr(v, vector_sum_operand(e), 0);
+			struct ir_inst *i = ir_emit(IR_VBIN, IR_NO_REG, IR_NO_REG, IR_NO_REG);
+			i->imm    = IR_ADD;
+			i->vec[0] = acc;
+			i->vec[1] = acc;
+			i->vec[2] = r;
+		}
+	}
+}
+
+/* lower a for loop vector_plan agreed to vectorize, see vector.c */
+/*
+- the values the loop only reads are broadcast, and the sums zeroed, in front of it
+- each copy of the body does VECTOR_LANES elements, the body is unrolled unroll_factor / VECTOR_LANES times,
+  and the loop runs for as long as all of those elements are in range; the ones left go through the
+  ordinary loop
+- the sums are folded into their variables on the way out, before that loop adds the last few elements
+*/
+void ir_lower_for_vector(struct stmt *s, struct vector *v)
+{
+	struct ir_func *f = ir_func_cur;
+	struct unroll *u = &v->u;
+	int copies = unroll_factor / VECTOR_LANES;
+	if (copies < 1) copies = 1;
+
+	if (s->init_expr) ir_lower_expr(s->init_expr);
+	for (int k=0;k<v->nfixed;k++)
+	{
+		int x;
+		if (v->fixed[k].value)
+		{
+			x = ir_lower_expr(v->fixed[k].value);
+		}
+		else
+		{
+			x = ir_vreg_new(f);
+			ir_emit(IR_CONST, x, IR_NO_REG, IR_NO_REG)->imm = 0;
+		}
+		ir_emit(IR_VDUP, IR_NO_REG, x, IR_NO_REG)->vec[0] = VECTOR_FIXED + k;
+	}
+
+	struct ir_block *head_bb = ir_block_create(f);
+	struct ir_block *body_bb = ir_block_create(f);
+	struct ir_block *rest_bb = ir_block_create(f);
+
+	ir_lower_ahead(u, copies * VECTOR_LANES, head_bb, body_bb, rest_bb);
+
+	ir_block_begin(body_bb);
+	int var = ir_var_lookup(u->var);
+	for (int c=0;c<copies;c++)
+	{
+		ir_lower_vector_stmts(v, s->body);
+		int lanes = ir_vreg_new(f);
+		ir_emit(IR_CONST, lanes, IR_NO_REG, IR_NO_REG)->imm = VECTOR_LANES;
+		ir_emit(IR_ADD, var, var, lanes);
+	}
+	ir_emit(IR_JMP, IR_NO_REG, IR_NO_REG, IR_NO_REG)->target = head_bb;
+
+	ir_block_begin(rest_bb);
+	for (int k=0;k<v->nfixed;k++)
+	{
+		if (!v->fixed[k].sum) continue;
+		int t = ir_vreg_new(f);
+		ir_emit(IR_VSUM, t, IR_NO_REG, IR_NO_REG)->vec[1] = VECTOR_FIXED + k;
+		int sum = ir_var_lookup(v->fixed[k].sum);
+		ir_emit(IR_ADD, sum, sum, t);
+	}
+	ir_lower_leftover(s, u, copies * VECTOR_LANES);
+}
+
+/* ir_lower_stmt: lower a statement list into the current function */
+void ir_lower_stmt(struct stmt *s)
+{
+	struct ir_func *f = ir_func_cur;
+
+	for (; s; s = s->next)
+	{
+		// statements after a return are unreachable, they still get a block of their own
+		if (ir_block_cur_done()) ir_block_cur = ir_block_new(f);
+
+		switch (s->kind)
+		{
+			case STMT_DECL:		// 0
+			{
+				struct decl *d = s->decl;
+				int var = ir_var_new(d->symbol);
+				if (d->value)
+				{
+					int v = ir_lower_expr(d->value);
+					struct ir_inst *last = ir_block_cur->last;
+					if (last && last->dst == v && !ir_vreg_is_var(v) && last->op != IR_CALL)
+						last->dst = var;
+					else
+						ir_emit(IR_MOV, var, v, IR_NO_REG);
+				}
+				else
+				{
+					// locals without an initializer start out as zero
+					ir_emit(IR_CONST, var, IR_NO_REG, IR_NO_REG)->imm = 0;
+				}
+				break;
+			}
+			case STMT_EXPR:		// 1
+				ir_lower_expr(s->expr);
+				break;
+			case STMT_IF_ELSE: 	// 2
+			{
+				struct ir_block *then_bb = ir_block_create(f);
+				struct ir_block *else_bb = s->else_body ? ir_block_create(f) : 0;
+				struct ir_block *done_bb = ir_block_create(f);
+
+				int c = ir_lower_expr(s->expr);
+				struct ir_inst *br = ir_emit(IR_BR, IR_NO_REG, c, IR_NO_REG);
+				br->target       = then_bb;
+				br->target_false = else_bb ? else_bb : done_bb;
+
+				ir_block_begin(then_bb);
+				ir_lower_stmt(s->body);
+				if (!ir_block_cur_done())
+				{
+					ir_emit(IR_JMP, IR_NO_REG, IR_NO_REG, IR_NO_REG)->target = done_bb;
+				}
+
+				if (else_bb)
+				{
+					ir_block_begin(else_bb);
+					ir_lower_stmt(s->else_body);
+				}
+				ir_block_begin(done_bb);
+				break;
+			}
+			case STMT_FOR:		// 3
+			{
+				struct vector v;
+				if (opt_level >= 2 && vector_plan(s, f->name, &v))
+				{
+					ir_lower_for_vector(s, &v);
+					break;
+				}
+				struct unroll u;
+				if (opt_level >= 2 && unroll_plan(s, &u))
+				{
+					ir_lower_for_unrolled(s, &u);
+					break;
+				}
+				if (s->init_expr) ir_lower_expr(s->init_expr);
+				ir_lower_for(s);
+				break;
+			}
+			case STMT_PRINT:	// 4
+				ir_lower_print(s->expr);
+				break;
+			case STMT_RETURN:	// 5
+				ir_lower_return(s->expr);
+				break;
+			case STMT_BLOCK:	// 6
+				ir_lower_stmt(s->body);
+				break;
+		}
+	}
+}
+
+/* ir_lower_func: lower one function definition */
+struct ir_func * ir_lower_func(struct decl *d)
+{
+	struct ir_func *f = calloc(1, sizeof(*f));
+	f->name = d->name;
+	f->decl = d;
+	f->returns_value = d->type->subtype && d->type->subtype->kind != TYPE_VOID;
+
+	ir_func_cur = f;
+	ir_vars     = 0;
+	if (ir_is_var) memset(ir_is_var, 0, ir_is_var_cap);
+
+	// parameters are vregs 0..nparams-1, in order
+	for (struct param_list *p = d->type->params; p; p = p->next)
+	{
+		ir_var_new(p->symbol);
+		f->nparams++;
+	}
+
+	// the entry block is where the backend moves arguments into place, the body starts in the block after it
+	ir_block_cur = ir_block_new(f);
+	f->start = ir_block_create(f);
+	ir_block_begin(f->start);
+
+	ir_lower_stmt(d->code);
+
+	// falling off the end of the function
+	if (!ir_block_cur_done())
+	{
+		ir_emit(IR_RET, IR_NO_REG, IR_NO_REG, IR_NO_REG);
+	}
+
+	return f;
+}
+
+/* ir_lower: lower every function definition in the program */
+struct ir_program * ir_lower(struct decl *d)
+{
+	struct ir_program *p = calloc(1, sizeof(*p));
+	struct ir_func *tail = 0;
+
+	p->decls = d;
+	for (; d; d = d->next)
+	{
+		if (d->type->kind != TYPE_FUNCTION || !d->code) continue;
+
+		struct ir_func *f = ir_lower_func(d);
+		if (tail) tail->next = f;
+		else      p->funcs   = f;
+		tail = f;
+	}
+
+	return p;
+}
+
+/*
+OUTPUT
+*/
+
+/* print a vreg operand */
+void ir_print_vreg(int v, FILE *out)
+{
+	if (v == IR_NO_REG) fprintf(out, "_");
+	else                fprintf(out, "%%%i", v);
+}
+
+/* ir_print_inst: print a single instruction in the -emit-ir format */
+void ir_print_inst(struct ir_inst *i, FILE *out)
+{
+	fprintf(out, "\t");
+	if (i->dst != IR_NO_REG)
+	{
+		ir_print_vreg(i->dst, out);
+		fprintf(out, " = ");
+	}
+
+	switch (i->op)
+	{
+		case IR_CONST:
+			fprintf(out, "const %li", i->imm);
+			break;
+		case IR_ADDR:
+		case IR_LOADG:
+			fprintf(out, "%s %s", ir_op_name(i->op), i->name);
+			break;
+		case IR_STOREG:
+			fprintf(out, "storeg %s, ", i->name);
+			ir_print_vreg(i->src[0], out);
+			break;
+		case IR_LOAD:
+		case IR_STORE:
+			fprintf(out, "%s [", ir_op_name(i->op));
+			ir_print_vreg(i->src[0], out);
+			if (i->src[1] != IR_NO_REG)
+			{
+				fprintf(out, " + ");
+				ir_print_vreg(i->src[1], out);
+				fprintf(out, "*8");
+			}
+			if (i->imm) fprintf(out, " + %li", i->imm);
+			fprintf(out, "]");
+			if (i->op == IR_STORE)
+			{
+				fprintf(out, ", ");
+				ir_print_vreg(i->src[2], out);
+			}
+			break;
+		case IR_VLOAD:
+		case IR_VSTORE:
+			fprintf(out, "%s v%i, [", ir_op_name(i->op), i->vec[0]);
+			ir_print_vreg(i->src[0], out);
+			if (i->src[1] != IR_NO_REG)
+			{
+				fprintf(out, " + ");
+				ir_print_vreg(i->src[1], out);
+				fprintf(out, "*8");
+			}
+			if (i->imm) fprintf(out, " + %li", i->imm);
+			fprintf(out, "]");
+			break;
+		case IR_VDUP:
+			fprintf(out, "vdup v%i, ", i->vec[0]);
+			ir_print_vreg(i->src[0], out);
+			break;
+		case IR_VBIN:
+			fprintf(out, "vbin v%i = v%i %s v%i", i->vec[0], i->vec[1], ir_op_name(i->imm), i->vec[2]);
+			break;
+		case IR_VSUM:
+			fprintf(out, "vsum v%i", i->vec[1]);
+			break;
+		case IR_CALL:
+			fprintf(out, "%scall %s(", i->tail ? "tail " : "", i->name);
+			for (int k=0;k<i->nargs;k++)
+			{
+				if (k) fprintf(out, ", ");
+				ir_print_vreg(i->args[k], out);
+			}
+			fprintf(out, ")");
+			break;
+		case IR_PHI:
+			fprintf(out, "phi ");
+			for (int k=0;k<i->nargs;k++)
+			{
+				if (k) fprintf(out, ", ");
+				fprintf(out, "[");
+				ir_print_vreg(i->args[k], out);
+				fprintf(out, ", .B%i]", i->phi_blocks[k]->id);
+			}
+			break;
+		case IR_JMP:
+			fprintf(out, "jmp .B%i", i->target->id);
+			break;
+		case IR_BR:
+			fprintf(out, "br ");
+			ir_print_vreg(i->src[0], out);
+			fprintf(out, ", .B%i, .B%i", i->target->id, i->target_false->id);
+			break;
+		case IR_SEL:
+			fprintf(out, "sel ");
+			ir_print_vreg(i->src[0], out);
+			fprintf(out, " ? ");
+			ir_print_vreg(i->src[1], out);
+			fprintf(out, " : ");
+			ir_print_vreg(i->src[2], out);
+			break;
+		case IR_RET:
+			fprintf(out, "ret");
+			if (i->src[0] != IR_NO_REG)
+			{
+				fprintf(out, " ");
+				ir_print_vreg(i->src[0], out);
+			}
+			break;
+		default:
+			fprintf(out, "%s ", ir_op_name(i->op));
+			ir_print_vreg(i->src[0], out);
+			if (i->src[1] != IR_NO_REG)
+			{
+				fprintf(out, ", ");
+				ir_print_vreg(i->src[1], out);
+			}
+			break;
+	}
+	fprintf(out, "\n");
+}
+
+/* ir_print_func: print one function */
+void ir_print_func(struct ir_func *f, FILE *out)
+{
+	fprintf(out, "function %s(", f->name);
+	for (int p=0;p<f->nparams;p++)
+	{
+		if (p) fprintf(out, ", ");
+		ir_print_vreg(p, out);
+	}
+	fprintf(out, ") {\n");
+
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		fprintf(out, ".B%i:", bb->id);
+		for (int p=0;p<bb->npreds;p++)
+		{
+			fprintf(out, "%s.B%i", p ? ", " : "\t\t; preds ", bb->preds[p]->id);
+		}
+		fprintf(out, "\n");
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			ir_print_inst(i, out);
+		}
+	}
+
+	fprintf(out, "}\n");
+}
+
+/* ir_print: textual dump of the whole program, used by -emit-ir */
+void ir_print(struct ir_program *p, FILE *out)
+{
+	for (struct ir_func *f = p->funcs; f; f = f->next)
+	{
+		ir_print_func(f, out);
+		if (f->next) fprintf(out, "\n");
+	}
+}
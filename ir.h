@@ -0,0 +1,145 @@
+#ifndef IR_H
+#define IR_H
+
+#include "decl.h"
+#include <stdio.h>
+
+/*
+- three-address IR that sits between the AST and the target backends
+- every value lives in a virtual register (vreg), numbered from 0 per function
+  - the first nparams vregs are the function parameters
+  - locals get one vreg each and are assigned with IR_MOV, every other vreg is a temporary defined once
+- instructions are grouped into basic blocks, each block ends in exactly one IR_JMP, IR_BR or IR_RET
+- the vector instructions work on SIMD registers of two 64-bit lanes, named directly by number in vec[]
+  - the vectorizer hands those out itself (see vector.c), they never hold a vreg and no pass tracks them,
+    so every vector instruction but IR_VSUM counts as having side effects
+*/
+
+typedef enum {
+	IR_CONST,	// 0  dst = imm
+	IR_MOV,		// 1  dst = src0
+	IR_ADD,		// 2  dst = src0 + src1
+	IR_SUB,		// 3  dst = src0 - src1
+	IR_MUL,		// 4  dst = src0 * src1
+	IR_DIV,		// 5  dst = src0 / src1
+	IR_MOD,		// 6  dst = src0 % src1
+	IR_AND,		// 7  dst = src0 & src1
+	IR_OR,		// 8  dst = src0 | src1
+	IR_EQ,		// 9  dst = src0 == src1
+	IR_NE,		// 10 dst = src0 != src1
+	IR_LT,		// 11 dst = src0 < src1
+	IR_LE,		// 12 dst = src0 <= src1
+	IR_GT,		// 13 dst = src0 > src1
+	IR_GE,		// 14 dst = src0 >= src1
+	IR_NEG,		// 15 dst = -src0
+	IR_NOT,		// 16 dst = !src0
+	IR_ADDR,	// 17 dst = address of the symbol/label "name"
+	IR_LOADG,	// 18 dst = global "name"
+	IR_STOREG,	// 19 global "name" = src0
+	IR_LOAD,	// 20 dst = [src0 + src1*8 + imm], src1 may be -1
+	IR_STORE,	// 21 [src0 + src1*8 + imm] = src2, src1 may be -1
+	IR_CALL,	// 22 dst = name(args...), dst may be -1
+	IR_JMP,		// 23 goto target
+	IR_BR,		// 24 if src0 goto target else target_false
+	IR_RET,		// 25 return src0, src0 may be -1
+	IR_PHI,		// 26 dst = phi(args...), one argument per predecessor
+	IR_VLOAD,	// 27 v[vec0] = the two elements at [src0 + src1*8 + imm], src1 may be -1
+	IR_VSTORE,	// 28 the two elements at [src0 + src1*8 + imm] = v[vec0], src1 may be -1
+	IR_VDUP,	// 29 v[vec0] = src0 in both lanes
+	IR_VBIN,	// 30 v[vec0] = v[vec1] op v[vec2] lane by lane, op (in imm) IR_ADD or IR_SUB
+	IR_VSUM,	// 31 dst = the two lanes of v[vec1] added
+	IR_SEL		// 32 dst = src0 ? src1 : src2, left by if-conversion
+} ir_op_t;
+
+#define IR_NO_REG (-1)
+
+struct ir_block;
+
+struct ir_inst {
+	ir_op_t op;
+	int dst;
+	int src[3];
+	long imm;
+	const char *name;
+	int *args;
+	int nargs;
+	struct ir_block **phi_blocks;	// IR_PHI: the predecessor each argument comes in from
+	int tail;						// IR_CALL: the result is returned straight away, the call can be a jump
+	int vec[3];						// vector instructions: the SIMD registers, vec[0] the one written (or stored)
+	struct ir_block *target;
+	struct ir_block *target_false;
+	struct ir_block *block;			// block this instruction lives in
+	struct ir_inst *prev;
+	struct ir_inst *next;
+};
+
+struct ir_block {
+	int id;
+	struct ir_inst *first;
+	struct ir_inst *last;
+	struct ir_block *next;			// layout order
+
+	// filled in by cfg_build, stale as soon as a pass changes a terminator
+	struct ir_block *succs[2];
+	int nsuccs;
+	struct ir_block **preds;		// in layout order of the predecessors, phi arguments follow this order
+	int npreds;
+	int rpo;						// index in f->rpo
+	struct ir_block *idom;			// immediate dominator, 0 for the entry
+	struct ir_block **dom_children;
+	int ndom_children;
+	int dom_pre;					// preorder/postorder numbers in the dominator tree, see cfg_dominates
+	int dom_post;
+	int dom_depth;
+};
+
+struct ir_func {
+	const char *name;
+	struct decl *decl;
+	int nparams;
+	int nvregs;
+	int returns_value;
+	int pure;						// writes no memory and prints nothing, worked out by gvn_purity
+	int writes_memory;				// may store to a global or an array, directly or through a call
+	int nblocks;					// ids handed out so far, not necessarily how many are left
+	struct ir_block *blocks;		// first block is the entry
+	struct ir_block *start;			// block right after the entry, self tail calls loop back here
+	struct ir_block **rpo;			// reachable blocks in reverse postorder, filled in by cfg_build
+	int nrpo;
+	struct ir_func *next;
+};
+
+struct ir_program {
+	struct decl *decls;				// the whole AST, globals are still emitted from here
+	struct ir_func *funcs;
+};
+
+/* building */
+struct ir_program * ir_lower( struct decl *d );
+struct ir_func  * ir_lower_func( struct decl *d );
+
+int ir_vreg_new( struct ir_func *f );
+struct ir_block * ir_block_new( struct ir_func *f );
+struct ir_block * ir_block_create( struct ir_func *f );
+void ir_block_place( struct ir_func *f, struct ir_block *bb );
+void ir_block_place_before( struct ir_func *f, struct ir_block *pos, struct ir_block *bb );
+struct ir_inst * ir_inst_create( ir_op_t op, int dst, int a, int b );
+void ir_inst_append( struct ir_block *bb, struct ir_inst *i );
+void ir_inst_insert_before( struct ir_inst *pos, struct ir_inst *i );
+void ir_inst_remove( struct ir_inst *i );
+struct ir_func * ir_func_clone( struct ir_func *g, const char *name );
+
+/* queries */
+int ir_is_terminator( ir_op_t op );
+int ir_is_binary( ir_op_t op );
+int ir_has_side_effects( struct ir_inst *i );
+int * ir_inst_use( struct ir_inst *i, int k );
+int ir_block_succs( struct ir_block *bb, struct ir_block **succs );
+const char * ir_op_name( ir_op_t op );
+
+/* output */
+void ir_print_inst( struct ir_inst *i, FILE *out );
+void ir_print_func( struct ir_func *f, FILE *out );
+void ir_print( struct ir_program *p, FILE *out );
+
+#endif
@@ -0,0 +1,380 @@
+#include "iv.h"
+#include "loop.h"
+#include "cfg.h"
+#include "ssa.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+- induction variable strength reduction
+  - int iv_run( struct ir_func *f );
+
+- a basic induction variable is a header phi "i = phi [init, preheader], [i + step, latch]" with a constant step,
+  which is what every counting for loop turns into once it's in SSA form; the step may come through a chain of
+  constant adds, the way an unrolled loop steps its counter once per copy of the body
+- for each one, inside its loop:
+  - a[i + c] (c a constant, 0 included, reached through any chain of adds) on an array base that doesn't change in the loop become [p + 8c], where
+    p = phi [base + 8*init, preheader], [p + 8*step, latch], one pointer per base, vector accesses included
+  - i*k with a constant k becomes its own counter, phi [init*k, preheader], [.. + step*k, latch]
+- the pointer is bumped right after its last access when that access runs exactly once on every trip,
+  which puts "ldr x, [p]" and "add p, p, 8" next to each other for the backend to make "ldr x, [p], 8" of
+- the loop test "i < n" becomes "p < base + 8n" when i has no other use left, after which the counter and
+  its increment are dead and DCE takes them
+- overflow: p is only ever compared or dereferenced, and base + 8i is what the access computed anyway
+*/
+
+#define IV_MAX_CHAIN 64	// longest chain of constant adds followed back to a counter
+
+int iv_reduced  = 0;
+int iv_replaced = 0;
+
+int iv_ndefs = 0;	// vregs the current defs array covers, the ones made since aren't in it
+
+/* the constant vreg v holds, if its definition is a constant */
+int iv_const(struct ir_inst **defs, int v, long *imm)
+{
+	if (v < 0 || v >= iv_ndefs || !defs[v] || defs[v]->op != IR_CONST) return 0;
+	*imm = defs[v]->imm;
+	return 1;
+}
+
+/* is vreg v the counter i plus a constant, through any chain of constant adds and subtracts */
+/*
+- unrolled loops step their counter a little at a time, "i2 = i1 + 1" where "i1 = i + 1", and index with those
+*/
+int iv_offset(struct ir_inst **defs, int i, int v, long *off)
+{
+	long c;
+	*off = 0;
+	for (int n=0;n<IV_MAX_CHAIN;n++)
+	{
+		if (v == i) return 1;
+		if (v < 0 || v >= iv_ndefs || !defs[v]) return 0;
+		struct ir_inst *d = defs[v];
+		if      (d->op == IR_ADD && iv_const(defs, d->src[1], &c)) v = d->src[0];
+		else if (d->op == IR_ADD && iv_const(defs, d->src[0], &c)) v = d->src[1];
+		else if (d->op == IR_SUB && iv_const(defs, d->src[1], &c)) { v = d->src[0]; c = -c; }
+		else return 0;
+		*off += c;
+	}
+	return 0;
+}
+
+/* new instruction dst = a op b in front of pos, returns dst */
+int iv_emit(struct ir_func *f, struct ir_inst *pos, ir_op_t op, int a, int b, long imm)
+{
+	struct ir_inst *i = ir_inst_create(op, ir_vreg_new(f), a, b);
+	i->imm = imm;
+	ir_inst_insert_before(pos, i);
+	return i->dst;
+}
+
+/* a vreg holding constant k in block bb, the one already there if there is one */
+int iv_konst(struct ir_func *f, struct ir_block *bb, long k)
+{
+	for (struct ir_inst *m = bb->first; m; m = m->next)
+	{
+		if (m->op == IR_CONST && m->imm == k) return m->dst;
+	}
+	return iv_emit(f, bb->last, IR_CONST, IR_NO_REG, IR_NO_REG, k);
+}
+
+/* do vregs a and b hold the same array base: the same vreg, or the address of the same symbol */
+int iv_same_base(struct ir_inst **defs, int a, int b)
+{
+	if (a == b) return 1;
+	if (a >= iv_ndefs || b >= iv_ndefs || !defs[a] || !defs[b]) return 0;
+	return defs[a]->op == IR_ADDR && defs[b]->op == IR_ADDR && !strcmp(defs[a]->name, defs[b]->name);
+}
+
+/* v*k + add in front of pos, folded when v is a constant */
+int iv_scale(struct ir_func *f, struct ir_inst **defs, struct ir_inst *pos, int v, long k, int add)
+{
+	long c;
+	int t;
+	if (iv_const(defs, v, &c))
+	{
+		if (c * k == 0 && add >= 0) return add;
+		t = iv_konst(f, pos->block, c * k);
+	}
+	else
+	{
+		t = iv_emit(f, pos, IR_MUL, v, iv_konst(f, pos->block, k), 0);
+	}
+	return add >= 0 ? iv_emit(f, pos, IR_ADD, add, t, 0) : t;
+}
+
+/* a new counter in l stepping alongside basic induction variable phi */
+/*
+inputs
+- start: its value on entry, step: what gets added on every trip, after: the add goes right behind this
+output
+- the new phi, and in *bump the add feeding it back from the latch
+*/
+struct ir_inst * iv_counter(struct ir_func *f, struct ir_loop *l, struct ir_inst *phi, int start, int step, struct ir_inst *after, struct ir_inst **bump)
+{
+	struct ir_inst *q = ir_inst_create(IR_PHI, ir_vreg_new(f), IR_NO_REG, IR_NO_REG);
+	struct ir_inst *next = ir_inst_create(IR_ADD, ir_vreg_new(f), q->dst, step);
+	ir_inst_insert_before(l->header->first, q);
+	ir_inst_insert_before(after->next, next);
+
+	q->nargs      = 2;
+	q->args       = calloc(3, sizeof(int));
+	q->phi_blocks = calloc(3, sizeof(*q->phi_blocks));
+	for (int k=0;k<2;k++)
+	{
+		q->phi_blocks[k] = phi->phi_blocks[k];
+		q->args[k]       = phi->phi_blocks[k] == l->preheader ? start : next->dst;
+	}
+	if (bump) *bump = next;
+	return q;
+}
+
+struct iv_ptr {
+	int base;				// array base, invariant in the loop
+	struct ir_inst *phi;	// the pointer
+	struct ir_inst *bump;	// pointer + 8*step
+	struct ir_inst *last;	// last access through it
+	int spread;				// accesses in more than one block
+};
+
+/* is vreg v defined outside loop l */
+int iv_invariant(struct ir_loop *l, struct ir_inst **defs, int v)
+{
+	if (v >= iv_ndefs) return 0;	// made by this pass, don't know
+	return !defs[v] || !loop_contains(l, defs[v]->block);
+}
+
+/* is bb inside a loop nested in l */
+int iv_in_inner(struct ir_loop *loops, struct ir_loop *l, struct ir_block *bb)
+{
+	for (struct ir_loop *m = loops; m; m = m->next)
+	{
+		if (m != l && m->depth > l->depth && loop_contains(m, bb) && loop_contains(l, m->header)) return 1;
+	}
+	return 0;
+}
+
+/* point every use of vreg from at vreg to */
+void iv_replace_uses(struct ir_func *f, int from, int to)
+{
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			int *slot;
+			for (int k=0;(slot = ir_inst_use(i, k));k++) if (*slot == from) *slot = to;
+		}
+	}
+}
+
+/* strength-reduce what depends on basic induction variable phi in loop l, inc is what comes back around */
+void iv_reduce(struct ir_func *f, struct ir_loop *loops, struct ir_loop *l, struct ir_inst **defs, struct ir_inst *phi, struct ir_inst *inc, long step)
+{
+	int i    = phi->dst;
+	int init = phi->phi_blocks[0] == l->preheader ? phi->args[0] : phi->args[1];
+	struct ir_inst *pos = l->preheader->last;
+
+	// (i + o)*k: i*k gets a counter of its own, shared by every product with k, and adding o*k to it does the rest
+	struct ir_inst **counters = 0;
+	long *factors = 0;
+	int ncounters = 0;
+	for (int b=0;b<l->nblocks;b++)
+	{
+		for (struct ir_inst *m = l->blocks[b]->first; m; m = m->next)
+		{
+			long k, o;
+			if (m->op != IR_MUL) continue;
+			if      (iv_offset(defs, i, m->src[0], &o) && iv_const(defs, m->src[1], &k)) ;
+			else if (iv_offset(defs, i, m->src[1], &o) && iv_const(defs, m->src[0], &k)) ;
+			else continue;
+
+			int c = 0;
+			while (c < ncounters && factors[c] != k) c++;
+			if (c == ncounters)
+			{
+				counters = realloc(counters, (ncounters + 1) * sizeof(*counters));
+				factors  = realloc(factors, (ncounters + 1) * sizeof(*factors));
+				int start = iv_scale(f, defs, pos, init, k, IR_NO_REG);
+				counters[c] = iv_counter(f, l, phi, start, iv_konst(f, l->preheader, step * k), inc, 0);
+				factors[ncounters++] = k;
+			}
+
+			if (o == 0)
+			{
+				iv_replace_uses(f, m->dst, counters[c]->dst);
+			}
+			else
+			{
+				m->op     = IR_ADD;
+				m->src[0] = counters[c]->dst;
+				m->src[1] = iv_konst(f, l->preheader, o * k);
+			}
+			iv_reduced++;
+		}
+	}
+	free(counters);
+	free(factors);
+
+	// array accesses: one pointer per base
+	struct iv_ptr *ptrs = 0;
+	int nptrs = 0;
+	for (int b=0;b<l->nblocks;b++)
+	{
+		for (struct ir_inst *m = l->blocks[b]->first; m; m = m->next)
+		{
+			if (m->op != IR_LOAD && m->op != IR_STORE && m->op != IR_VLOAD && m->op != IR_VSTORE) continue;
+			long off;
+			if (!iv_offset(defs, i, m->src[1], &off) || !iv_invariant(l, defs, m->src[0])) continue;
+
+			int g = 0;
+			while (g < nptrs && !iv_same_base(defs, ptrs[g].base, m->src[0])) g++;
+			if (g == nptrs)
+			{
+				ptrs = realloc(ptrs, (nptrs + 1) * sizeof(*ptrs));
+				memset(&ptrs[g], 0, sizeof(*ptrs));
+				ptrs[g].base = m->src[0];
+				int start = iv_scale(f, defs, pos, init, 8, m->src[0]);
+				ptrs[g].phi = iv_counter(f, l, phi, start, iv_konst(f, l->preheader, step * 8), inc, &ptrs[g].bump);
+				nptrs++;
+			}
+			if (ptrs[g].last && ptrs[g].last->block != m->block) ptrs[g].spread = 1;
+			ptrs[g].last = m;
+
+			m->src[0] = ptrs[g].phi->dst;
+			m->src[1] = IR_NO_REG;
+			m->imm   += 8 * off;
+			iv_reduced++;
+		}
+	}
+
+	// bump each pointer right after its last access when that block runs once per trip
+	struct ir_block *latch = phi->phi_blocks[0] == l->preheader ? phi->phi_blocks[1] : phi->phi_blocks[0];
+	for (int g=0;g<nptrs;g++)
+	{
+		struct ir_block *bb = ptrs[g].last->block;
+		if (ptrs[g].spread || !cfg_dominates(bb, latch) || iv_in_inner(loops, l, bb)) continue;
+		ir_inst_remove(ptrs[g].bump);
+		ir_inst_insert_before(ptrs[g].last->next, ptrs[g].bump);
+	}
+
+	// the loop test moves to the first pointer when nothing else needs i
+	struct ir_inst *br = l->header->last;
+	struct ir_inst *cmp = 0;
+	if (nptrs && br->op == IR_BR)
+	{
+		for (struct ir_inst *m = l->header->first; m != br; m = m->next) if (m->dst == br->src[0]) cmp = m;
+	}
+	long o0, o1, o;
+	int on0 = cmp && iv_offset(defs, i, cmp->src[0], &o0);
+	int on1 = cmp && iv_offset(defs, i, cmp->src[1], &o1);
+	if (cmp && cmp->op >= IR_EQ && cmp->op <= IR_GE && on0 != on1)
+	{
+		// cmp tests i + o against bound
+		int side  = on0 ? 0 : 1;
+		int bound = cmp->src[1 - side];
+		o = on0 ? o0 : o1;
+
+		int *uses = calloc(f->nvregs + 1, sizeof(int));
+		int ok = iv_invariant(l, defs, bound);
+		for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+		{
+			for (struct ir_inst *m = bb->first; m; m = m->next)
+			{
+				int *slot;
+				for (int k=0;(slot = ir_inst_use(m, k));k++) if (*slot >= 0) uses[*slot]++;
+			}
+		}
+
+		// i and the chain stepping it may only feed each other, cmp, the back edge, or things now dead
+		long dummy;
+		for (struct ir_block *bb = f->blocks; bb && ok; bb = bb->next)
+		{
+			for (struct ir_inst *m = bb->first; m && ok; m = m->next)
+			{
+				int *slot;
+				int reads = 0;
+				for (int k=0;(slot = ir_inst_use(m, k));k++) if (iv_offset(defs, i, *slot, &dummy)) reads = 1;
+				if (!reads || m == cmp || m == phi) continue;
+				if (m->dst >= 0 && loop_contains(l, bb) && iv_offset(defs, i, m->dst, &dummy)) continue;
+				if (m->dst < 0 || uses[m->dst] || ir_has_side_effects(m) || m->op == IR_PHI) ok = 0;
+			}
+		}
+		free(uses);
+
+		if (ok)
+		{
+			int limit = iv_scale(f, defs, pos, bound, 8, ptrs[0].base);
+			if (o) limit = iv_emit(f, pos, IR_ADD, limit, iv_konst(f, l->preheader, -8 * o), 0);
+			cmp->src[side]     = ptrs[0].phi->dst;
+			cmp->src[1 - side] = limit;
+			iv_replaced++;
+		}
+	}
+
+	free(ptrs);
+
+	// whatever steps i a bit at a time now starts from i itself, so the links in between can die; every
+	// offset is worked out before any link changes, a rewritten one has a constant defs doesn't know about
+	struct ir_inst **links = 0;
+	long *offs = 0;
+	int nlinks = 0;
+	for (int b=0;b<l->nblocks;b++)
+	{
+		for (struct ir_inst *m = l->blocks[b]->first; m; m = m->next)
+		{
+			long o;
+			if (m->op != IR_ADD && m->op != IR_SUB) continue;
+			if (m->src[0] == i || m->src[1] == i || !iv_offset(defs, i, m->dst, &o)) continue;
+			links = realloc(links, (nlinks + 1) * sizeof(*links));
+			offs  = realloc(offs, (nlinks + 1) * sizeof(*offs));
+			links[nlinks]  = m;
+			offs[nlinks++] = o;
+		}
+	}
+	for (int k=0;k<nlinks;k++)
+	{
+		links[k]->op     = IR_ADD;
+		links[k]->src[0] = i;
+		links[k]->src[1] = iv_konst(f, l->preheader, offs[k]);
+	}
+	free(links);
+	free(offs);
+}
+
+/* iv_run: strength-reduce the induction variables of every loop in f */
+/*
+output
+- how many accesses and multiplications were rewritten
+*/
+int iv_run(struct ir_func *f)
+{
+	struct ir_loop *loops = loop_find(f);
+	int before = iv_reduced;
+
+	for (struct ir_loop *l = loops; l; l = l->next)
+	{
+		// counters made along the way go in front of the header, the walk never gets back to them
+		for (struct ir_inst *phi = l->header->first; phi && phi->op == IR_PHI; phi = phi->next)
+		{
+			if (phi->nargs != 2) continue;
+			int in = phi->phi_blocks[0] == l->preheader ? 1 : 0;
+			if (phi->phi_blocks[1 - in] != l->preheader || phi->args[in] < 0) continue;
+
+			// stepped by a constant inside the loop, possibly a bit at a time
+			struct ir_inst **defs = ssa_defs(f);
+			iv_ndefs = f->nvregs;
+			struct ir_inst *inc = defs[phi->args[in]];
+			long step;
+			int basic = inc && loop_contains(l, inc->block) && iv_offset(defs, phi->dst, inc->dst, &step) && step;
+
+			if (basic) iv_reduce(f, loops, l, defs, phi, inc, step);
+			free(defs);
+		}
+	}
+
+	loop_delete(loops);
+	return iv_reduced - before;
+}
@@ -0,0 +1,18 @@
+#ifndef IV_H
+#define IV_H
+
+#include "ir.h"
+
+/*
+- induction variable strength reduction over a function in SSA form
+- array accesses indexed by a loop counter walk a pointer instead of computing base + i*8 every iteration,
+  multiplications of the counter become a second counter stepping by the product, and when nothing else
+  needs the original counter the loop test moves over to the pointer so the counter can go
+*/
+
+extern int iv_reduced;	// accesses and multiplications rewritten, summed over every run
+extern int iv_replaced;	// loop tests moved off a counter
+
+int iv_run( struct ir_func *f );
+
+#endif
@@ -17,6 +17,8 @@
 int label_count = 0;
 
 int func_label = 0; // label of the function we're currently in
+int func_entry_label = 0; // label right after the prologue, self tail calls loop back to it
+const char *func_name = 0; // name of the function we're currently in
 
 int label_create() 
 {
@@ -33,7 +35,7 @@ int label_create_func()
 const char * label_name(int label)
 {
 	// return that label in a string form
-	char *label_str = malloc(sizeof(char)*5);
+	char *label_str = malloc(sizeof(char)*16);
 
 	sprintf(label_str, ".L%i", label); // I don't think this is right
 
@@ -16,6 +16,17 @@ print_integer(x);
 print_boolean(b);
 print_string(s);
 
+The compiler actually folds a whole print statement into a single call
+to print_values, passing a descriptor string followed by the runtime values.
+Constant arguments are already merged into the descriptor, and every runtime
+argument is marked with one of the PRINT_ARG_* bytes from library.h:
+
+print "x = ", x, " b = ", b, "\n";
+
+Is effectively this C code:
+
+print_values("x = \001 b = \002\n", x, b);
+
 And the following bminor code:
 
 x = a ^ b;
@@ -24,31 +35,252 @@ Is effectively this C code:
 
 x = integer_power(a,b);
 
+All output goes through one large buffer that is only handed to the kernel
+when it fills up or when the program exits, so printing a value never costs
+a stdio lock or a format string parse.
+
+Compiled with -DBMINOR_FREESTANDING this file doesn't need libc at all:
+it talks to the kernel with raw write/exit_group system calls and brings
+its own _start, which calls the bminor main, flushes the output buffer and
+exits with main's return value. That lets a program be linked as a tiny
+static binary with next to no startup cost:
+
+gcc -static -nostdlib -no-pie -ffreestanding -fno-stack-protector -O2 -DBMINOR_FREESTANDING PROGRAM.s library.c -o PROGRAM
+
 */
 
 #include "library.h"
 
-#include <stdio.h>
-#include <stdint.h>
+#ifdef BMINOR_FREESTANDING
+
+#if defined(__aarch64__)
+#define SYS_WRITE      64
+#define SYS_EXIT_GROUP 94
+
+static long runtime_syscall3( long n, long a, long b, long c )
+{
+	register long x8 __asm__("x8") = n;
+	register long x0 __asm__("x0") = a;
+	register long x1 __asm__("x1") = b;
+	register long x2 __asm__("x2") = c;
+	__asm__ volatile ("svc #0" : "+r"(x0) : "r"(x8), "r"(x1), "r"(x2) : "memory");
+	return x0;
+}
+
+/* the kernel enters here with sp 16-byte aligned, clear fp/lr so backtraces stop at us */
+__asm__(
+	"\t.text\n"
+	"\t.global\t_start\n"
+	"\t.type\t_start, %function\n"
+	"_start:\n"
+	"\tmov\tx29, 0\n"
+	"\tmov\tx30, 0\n"
+	"\tbl\truntime_start\n"
+);
+#elif defined(__x86_64__)
+#define SYS_WRITE      1
+#define SYS_EXIT_GROUP 231
+
+static long runtime_syscall3( long n, long a, long b, long c )
+{
+	long ret;
+	__asm__ volatile ("syscall" : "=a"(ret) : "a"(n), "D"(a), "S"(b), "d"(c) : "rcx", "r11", "memory");
+	return ret;
+}
+
+/* realign the stack so runtime_start sees the usual call-site alignment */
+__asm__(
+	"\t.text\n"
+	"\t.global\t_start\n"
+	"\t.type\t_start, @function\n"
+	"_start:\n"
+	"\txor\t%ebp, %ebp\n"
+	"\tand\t$-16, %rsp\n"
+	"\tcall\truntime_start\n"
+);
+#else
+#error "BMINOR_FREESTANDING is only supported on aarch64 and x86_64"
+#endif
+
+static long runtime_write( int fd, const char *buf, long n )
+{
+	return runtime_syscall3(SYS_WRITE, fd, (long) buf, n);
+}
+
+static void runtime_exit( int code )
+{
+	runtime_syscall3(SYS_EXIT_GROUP, code, 0, 0);
+	for (;;) ;
+}
+
+long main();
+
+/* called from _start: run the program, then do what libc's exit would have done for us */
+void runtime_start()
+{
+	long code = main();
+	print_flush();
+	runtime_exit((int) code);
+}
+
+/* the compiler is allowed to turn our copy loops into calls to these even when freestanding */
+void *memcpy( void *dst, const void *src, unsigned long n )
+{
+	char *d = dst;
+	const char *s = src;
+	while (n--) *d++ = *s++;
+	return dst;
+}
+
+void *memset( void *dst, int c, unsigned long n )
+{
+	char *d = dst;
+	while (n--) *d++ = (char) c;
+	return dst;
+}
+
+#else
+
+#include <stdlib.h>
+#include <unistd.h>
+
+static long runtime_write( int fd, const char *buf, long n )
+{
+	return write(fd, buf, n);
+}
+
+#endif
+
+#define PRINT_BUFFER_SIZE (64*1024)
+
+static char print_buffer[PRINT_BUFFER_SIZE];
+static int  print_length = 0;
+#ifndef BMINOR_FREESTANDING
+static int  print_registered = 0;
+#endif
+
+/* hand everything buffered so far to the kernel */
+void print_flush()
+{
+	int done = 0;
+	while (done < print_length)
+	{
+		long n = runtime_write(1, print_buffer + done, print_length - done);
+		if (n <= 0) break;
+		done += n;
+	}
+	print_length = 0;
+}
+
+/* append raw bytes to the output buffer, flushing whenever it fills up */
+static void print_bytes( const char *s, int n )
+{
+#ifndef BMINOR_FREESTANDING
+	// make sure whatever is left in the buffer gets written when the program exits
+	// (freestanding builds flush from runtime_start instead)
+	if (!print_registered)
+	{
+		atexit(print_flush);
+		print_registered = 1;
+	}
+#endif
+
+	while (n > 0)
+	{
+		if (print_length == PRINT_BUFFER_SIZE) print_flush();
+
+		int room  = PRINT_BUFFER_SIZE - print_length;
+		int chunk = n < room ? n : room;
+		for (int i=0;i<chunk;i++) print_buffer[print_length+i] = s[i];
+
+		print_length += chunk;
+		s += chunk;
+		n -= chunk;
+	}
+}
+
+/* format an integer by hand, filling the digits in from the back of a small buffer */
+static void print_decimal( long x )
+{
+	char digits[24];
+	int pos = sizeof(digits);
+
+	// work on the magnitude as unsigned so LONG_MIN doesn't overflow
+	unsigned long u = x < 0 ? 0UL - (unsigned long) x : (unsigned long) x;
+	do
+	{
+		digits[--pos] = '0' + (u % 10);
+		u /= 10;
+	} while (u);
+
+	if (x < 0) digits[--pos] = '-';
+
+	print_bytes(digits + pos, sizeof(digits) - pos);
+}
+
+static void print_cstring( const char *s )
+{
+	int n = 0;
+	while (s[n]) n++;
+	print_bytes(s, n);
+}
 
 void print_integer( long x )
 {
-	printf("%ld",x);
+	print_decimal(x);
 }
 
 void print_string( const char *s )
 {
-	printf("%s",s);
+	print_cstring(s);
 }
 
 void print_boolean( int b )
 {
-	printf("%s",b?"true":"false");
+	print_cstring(b?"true":"false");
 }
 
 void print_character( char c )
 {
-	printf("%c",c);
+	print_bytes(&c, 1);
+}
+
+/* print a whole print statement: literal text from the descriptor, values from the arguments */
+void print_values( const char *desc, long a1, long a2, long a3, long a4, long a5, long a6, long a7 )
+{
+	long args[PRINT_VALUES_MAX_ARGS] = { a1, a2, a3, a4, a5, a6, a7 };
+	int next = 0;
+
+	while (*desc)
+	{
+		// copy the run of literal text up to the next marker in one go
+		const char *run = desc;
+		while (*desc > PRINT_ARG_STRING || *desc < 0) desc++;
+		if (desc != run) print_bytes(run, desc - run);
+
+		if (!*desc) break;
+
+		switch (*desc)
+		{
+			case PRINT_ARG_INTEGER:
+				print_decimal(args[next]);
+				break;
+			case PRINT_ARG_BOOLEAN:
+				print_cstring(args[next]?"true":"false");
+				break;
+			case PRINT_ARG_CHARACTER:
+			{
+				char c = (char) args[next];
+				print_bytes(&c, 1);
+				break;
+			}
+			case PRINT_ARG_STRING:
+				print_cstring((const char *) args[next]);
+				break;
+		}
+		next++;
+		desc++;
+	}
 }
 
 long integer_power( long x, long y )
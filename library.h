@@ -1,10 +1,21 @@
 #ifndef LIBRARY_H
 #define LIBRARY_H
 
+/* markers used inside a print_values descriptor string, one per runtime argument */
+#define PRINT_ARG_INTEGER   1
+#define PRINT_ARG_BOOLEAN   2
+#define PRINT_ARG_CHARACTER 3
+#define PRINT_ARG_STRING    4
+
+/* most runtime arguments a single print_values call can take (x1-x7) */
+#define PRINT_VALUES_MAX_ARGS 7
+
 void print_integer( long x );
 void print_string( const char *s );
 void print_boolean( int b );
 void print_character( char c );
+void print_values( const char *desc, long a1, long a2, long a3, long a4, long a5, long a6, long a7 );
+void print_flush();
 long integer_power( long x, long y );
 
-#endif
\ No newline at end of file
+#endif
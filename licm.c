@@ -0,0 +1,197 @@
+#include "licm.h"
+#include "loop.h"
+#include "cfg.h"
+#include "ssa.h"
+#include "gvn.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+- loop-invariant code motion over a function in SSA form
+  - int licm_run( struct ir_func *f );
+
+- loops are done innermost first, and every block of a loop in reverse postorder, so an instruction's operands
+  have already been looked at (and possibly hoisted) by the time it is
+- an instruction is invariant when everything it reads is defined outside the loop, and it moves to the end of
+  the preheader; from there the next loop out can take it further
+- a constant or address the preheader already holds isn't hoisted a second time, its uses move to that one
+- what can go:
+  - constants, addresses and arithmetic, even from blocks that don't run every iteration, they can't fail
+  - division only by a constant that can't trap, unless its block runs whenever the loop does
+  - loads of a global the loop never stores to, when no call in the loop can write memory
+  - array loads and pure calls, when nothing in the loop writes memory and their block dominates every exit,
+    so they'd have run at least once anyway and a bad index can't fault where it wouldn't have before
+*/
+
+int licm_hoisted = 0;
+
+struct licm_effects {
+	const char **stored;	// scalar globals the loop assigns
+	int nstored;
+	int writes_arrays;
+	int writes_all;			// calls something that could write anything
+};
+
+/* what memory a loop can write */
+void licm_effects(struct ir_loop *l, struct licm_effects *fx)
+{
+	memset(fx, 0, sizeof(*fx));
+	int cap = 0;
+	for (int b=0;b<l->nblocks;b++)
+	{
+		for (struct ir_inst *i = l->blocks[b]->first; i; i = i->next)
+		{
+			if (i->op == IR_STORE || i->op == IR_VSTORE) fx->writes_arrays = 1;
+			if (i->op == IR_CALL && gvn_call_writes(i)) fx->writes_all = 1;
+			if (i->op == IR_STOREG)
+			{
+				if (fx->nstored == cap)
+				{
+					cap = cap ? 2 * cap : 4;
+					fx->stored = realloc(fx->stored, cap * sizeof(*fx->stored));
+				}
+				fx->stored[fx->nstored++] = i->name;
+			}
+		}
+	}
+}
+
+/* can the loop change global name */
+int licm_global_written(struct licm_effects *fx, const char *name)
+{
+	if (fx->writes_all) return 1;
+	for (int k=0;k<fx->nstored;k++) if (!strcmp(fx->stored[k], name)) return 1;
+	return 0;
+}
+
+/* is v defined outside the loop */
+int licm_invariant(struct ir_loop *l, struct ir_inst **defs, int v)
+{
+	if (v < 0 || !defs[v]) return 1;	// not an operand, or a parameter
+	return !loop_contains(l, defs[v]->block);
+}
+
+/* does bb run every time the loop is entered: it dominates every way out */
+int licm_always_runs(struct ir_loop *l, struct ir_block *bb)
+{
+	for (int b=0;b<l->nblocks;b++)
+	{
+		if (loop_is_exit(l, l->blocks[b]) && !cfg_dominates(bb, l->blocks[b])) return 0;
+	}
+	return 1;
+}
+
+/* can instruction i move out of loop l */
+int licm_can_hoist(struct ir_loop *l, struct licm_effects *fx, struct ir_inst **defs, struct ir_inst *i)
+{
+	int *slot;
+	for (int k=0;(slot = ir_inst_use(i, k));k++)
+	{
+		if (!licm_invariant(l, defs, *slot)) return 0;
+	}
+
+	switch (i->op)
+	{
+		case IR_CONST:
+		case IR_ADDR:
+		case IR_MOV:
+		case IR_NEG:
+		case IR_NOT:
+			return 1;
+		case IR_DIV:
+		case IR_MOD:
+		{
+			struct ir_inst *d = defs[i->src[1]];
+			if (d && d->op == IR_CONST && d->imm != 0 && d->imm != -1) return 1;
+			return licm_always_runs(l, i->block);
+		}
+		case IR_LOADG:
+			return !licm_global_written(fx, i->name);
+		case IR_LOAD:
+			return !fx->writes_all && !fx->writes_arrays && licm_always_runs(l, i->block);
+		case IR_CALL:
+			if (i->dst < 0 || !gvn_call_pure(i)) return 0;
+			if (fx->writes_all || fx->writes_arrays || fx->nstored) return 0;
+			return licm_always_runs(l, i->block);
+		default:
+			return ir_is_binary(i->op);
+	}
+}
+
+/* a constant or address in bb computing the same as i */
+struct ir_inst * licm_same(struct ir_block *bb, struct ir_inst *i)
+{
+	if (i->op != IR_CONST && i->op != IR_ADDR) return 0;
+	for (struct ir_inst *m = bb->first; m; m = m->next)
+	{
+		if (m->op != i->op) continue;
+		if (i->op == IR_CONST && m->imm == i->imm) return m;
+		if (i->op == IR_ADDR && !strcmp(m->name, i->name)) return m;
+	}
+	return 0;
+}
+
+/* point every use of vreg from at vreg to */
+void licm_replace_uses(struct ir_func *f, int from, int to)
+{
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			int *slot;
+			for (int k=0;(slot = ir_inst_use(i, k));k++) if (*slot == from) *slot = to;
+		}
+	}
+}
+
+/* licm_run: hoist loop-invariant instructions of one function */
+/*
+output
+- how many instructions moved
+*/
+int licm_run(struct ir_func *f)
+{
+	struct ir_loop *loops = loop_find(f);
+	if (!loops) return 0;
+
+	struct ir_inst **defs = ssa_defs(f);
+	int moved = 0;
+
+	for (struct ir_loop *l = loops; l; l = l->next)
+	{
+		struct licm_effects fx;
+		licm_effects(l, &fx);
+
+		for (int b=0;b<l->nblocks;b++)
+		{
+			struct ir_inst *next;
+			for (struct ir_inst *i = l->blocks[b]->first; i; i = next)
+			{
+				next = i->next;
+				if (i->op == IR_PHI || ir_is_terminator(i->op)) continue;
+				if (!licm_can_hoist(l, &fx, defs, i)) continue;
+
+				ir_inst_remove(i);
+				moved++;
+
+				// a constant or address the preheader already has is used from there instead
+				struct ir_inst *same = licm_same(l->preheader, i);
+				if (same)
+				{
+					licm_replace_uses(f, i->dst, same->dst);
+					continue;
+				}
+				ir_inst_insert_before(l->preheader->last, i);
+				i->tail = 0;
+			}
+		}
+		free(fx.stored);
+	}
+
+	free(defs);
+	loop_delete(loops);
+	licm_hoisted += moved;
+	return moved;
+}
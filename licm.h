@@ -0,0 +1,14 @@
+#ifndef LICM_H
+#define LICM_H
+
+#include "ir.h"
+
+/*
+- loop-invariant code motion: computations whose operands don't change inside a loop move to its preheader
+*/
+
+extern int licm_hoisted;	// instructions moved out of a loop, summed over every run
+
+int licm_run( struct ir_func *f );
+
+#endif
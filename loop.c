@@ -0,0 +1,248 @@
+#include "loop.h"
+#include "cfg.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+- natural loop detection
+  - struct ir_loop * loop_find( struct ir_func *f );
+
+- an edge t -> h is a back edge when h dominates t, the loop of h is h plus every block that reaches one of its
+  back edges without going through h
+- loops sharing a header are one loop
+- nesting falls out of sizes: a loop inside another one is strictly smaller, so after sorting by size the parent of
+  a loop is the first bigger one that contains its header
+- preheaders: when the header already has a single predecessor outside the loop that only leads to the header,
+  that block is the preheader; otherwise a new block is put in front of the header and the outside edges
+  (and their phi arguments) are moved onto it
+the control-flow graph has to be up to date, and is rebuilt when a preheader had to be added
+*/
+
+/* loop_contains: is bb part of loop l */
+int loop_contains(struct ir_loop *l, struct ir_block *bb)
+{
+	return bb->id < l->cap && l->in[bb->id];
+}
+
+/* loop_add_block: make bb part of loop l */
+void loop_add_block(struct ir_loop *l, struct ir_block *bb)
+{
+	if (bb->id >= l->cap)
+	{
+		int cap = 2 * (bb->id + 1);
+		l->in = realloc(l->in, cap);
+		memset(l->in + l->cap, 0, cap - l->cap);
+		l->cap = cap;
+	}
+	l->in[bb->id] = 1;
+}
+
+/* loop_is_exit: is bb a block of the loop that can leave it */
+int loop_is_exit(struct ir_loop *l, struct ir_block *bb)
+{
+	if (!loop_contains(l, bb)) return 0;
+	for (int s=0;s<bb->nsuccs;s++)
+	{
+		if (!loop_contains(l, bb->succs[s])) return 1;
+	}
+	return 0;
+}
+
+/* fill in a loop's block list from its membership, header first and in reverse postorder */
+void loop_blocks(struct ir_func *f, struct ir_loop *l)
+{
+	free(l->blocks);
+	l->blocks  = calloc(f->nrpo + 1, sizeof(*l->blocks));
+	l->nblocks = 0;
+	l->blocks[l->nblocks++] = l->header;
+	for (int k=0;k<f->nrpo;k++)
+	{
+		struct ir_block *bb = f->rpo[k];
+		if (bb != l->header && loop_contains(l, bb)) l->blocks[l->nblocks++] = bb;
+	}
+}
+
+/* give loop l a preheader, returns 1 when a block had to be created for it */
+int loop_make_preheader(struct ir_func *f, struct ir_loop *l)
+{
+	struct ir_block *h = l->header;
+	struct ir_block *outside = 0;
+	int nout = 0;
+	for (int p=0;p<h->npreds;p++)
+	{
+		if (loop_contains(l, h->preds[p])) continue;
+		outside = h->preds[p];
+		nout++;
+	}
+
+	if (nout == 1 && outside->nsuccs == 1)
+	{
+		l->preheader = outside;
+		return 0;
+	}
+
+	struct ir_block *pre = ir_block_create(f);
+	struct ir_inst *j = ir_inst_create(IR_JMP, IR_NO_REG, IR_NO_REG, IR_NO_REG);
+	j->target = h;
+	ir_inst_append(pre, j);
+	ir_block_place_before(f, h, pre);
+
+	for (int p=0;p<h->npreds;p++)
+	{
+		struct ir_block *o = h->preds[p];
+		if (loop_contains(l, o)) continue;
+		if (o->last->target == h)       o->last->target       = pre;
+		if (o->last->target_false == h) o->last->target_false = pre;
+	}
+
+	// header phis: the values coming from outside merge in the preheader now
+	for (struct ir_inst *phi = h->first; phi && phi->op == IR_PHI; phi = phi->next)
+	{
+		int *args = calloc(phi->nargs + 1, sizeof(int));
+		struct ir_block **blocks = calloc(phi->nargs + 1, sizeof(*blocks));
+		int n = 0;
+		int in_val = IR_NO_REG;
+
+		struct ir_inst *merge = 0;
+		if (nout > 1)
+		{
+			merge = ir_inst_create(IR_PHI, ir_vreg_new(f), IR_NO_REG, IR_NO_REG);
+			merge->args       = calloc(nout + 1, sizeof(int));
+			merge->phi_blocks = calloc(nout + 1, sizeof(*merge->phi_blocks));
+			ir_inst_insert_before(pre->last, merge);
+		}
+
+		for (int k=0;k<phi->nargs;k++)
+		{
+			if (loop_contains(l, phi->phi_blocks[k]))
+			{
+				args[n]     = phi->args[k];
+				blocks[n++] = phi->phi_blocks[k];
+			}
+			else if (merge)
+			{
+				merge->args[merge->nargs]         = phi->args[k];
+				merge->phi_blocks[merge->nargs++] = phi->phi_blocks[k];
+			}
+			else
+			{
+				in_val = phi->args[k];
+			}
+		}
+		args[n]     = merge ? merge->dst : in_val;
+		blocks[n++] = pre;
+
+		free(phi->args);
+		free(phi->phi_blocks);
+		phi->args       = args;
+		phi->phi_blocks = blocks;
+		phi->nargs      = n;
+	}
+
+	// the preheader sits inside every loop around this one
+	for (struct ir_loop *m = l->parent; m; m = m->parent) loop_add_block(m, pre);
+	l->preheader = pre;
+	return 1;
+}
+
+/* loop_find: find the natural loops of f, innermost first, each with a preheader */
+struct ir_loop * loop_find(struct ir_func *f)
+{
+	struct ir_loop **all = calloc(f->nrpo + 1, sizeof(*all));
+	int nloops = 0;
+	struct ir_block **work = calloc(f->nblocks + 1, sizeof(*work));
+
+	for (int k=0;k<f->nrpo;k++)
+	{
+		struct ir_block *h = f->rpo[k];
+		struct ir_loop *l = 0;
+
+		for (int p=0;p<h->npreds;p++)
+		{
+			struct ir_block *t = h->preds[p];
+			if (!cfg_dominates(h, t)) continue;
+
+			if (!l)
+			{
+				l = calloc(1, sizeof(*l));
+				l->header = h;
+				loop_add_block(l, h);
+				all[nloops++] = l;
+			}
+
+			// everything that reaches the back edge without passing the header
+			int nw = 0;
+			if (!loop_contains(l, t))
+			{
+				loop_add_block(l, t);
+				work[nw++] = t;
+			}
+			while (nw)
+			{
+				struct ir_block *b = work[--nw];
+				for (int q=0;q<b->npreds;q++)
+				{
+					struct ir_block *c = b->preds[q];
+					if (loop_contains(l, c)) continue;
+					loop_add_block(l, c);
+					work[nw++] = c;
+				}
+			}
+		}
+	}
+	free(work);
+
+	for (int k=0;k<nloops;k++)
+	{
+		struct ir_loop *l = all[k];
+		l->nblocks = 0;
+		for (int b=0;b<l->cap;b++) l->nblocks += l->in[b];
+	}
+
+	// smallest first, so inner loops come before the loops around them
+	for (int a=1;a<nloops;a++)
+	{
+		struct ir_loop *l = all[a];
+		int b = a - 1;
+		for (; b >= 0 && all[b]->nblocks > l->nblocks; b--) all[b + 1] = all[b];
+		all[b + 1] = l;
+	}
+	for (int a=0;a<nloops;a++)
+	{
+		for (int b=a+1;b<nloops && !all[a]->parent;b++)
+		{
+			if (loop_contains(all[b], all[a]->header)) all[a]->parent = all[b];
+		}
+	}
+	for (int a=0;a<nloops;a++)
+	{
+		for (struct ir_loop *m = all[a]; m; m = m->parent) all[a]->depth++;
+		all[a]->next = a + 1 < nloops ? all[a + 1] : 0;
+	}
+
+	// preheaders, outermost first so a new block only ever lands in loops that already have theirs
+	int added = 0;
+	for (int a=nloops-1;a>=0;a--) added |= loop_make_preheader(f, all[a]);
+	if (added) cfg_build(f);
+
+	for (int a=0;a<nloops;a++) loop_blocks(f, all[a]);
+
+	struct ir_loop *first = nloops ? all[0] : 0;
+	free(all);
+	return first;
+}
+
+/* loop_delete: free a list of loops */
+void loop_delete(struct ir_loop *loops)
+{
+	while (loops)
+	{
+		struct ir_loop *next = loops->next;
+		free(loops->blocks);
+		free(loops->in);
+		free(loops);
+		loops = next;
+	}
+}
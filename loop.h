@@ -0,0 +1,31 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include "ir.h"
+
+/*
+- natural loops of an IR function, found from the back edges of the control-flow graph
+- every loop gets a preheader: a block outside the loop whose only successor is the header and that every
+  entry into the loop goes through, so passes have somewhere to put code that should run once before it
+*/
+
+struct ir_loop {
+	struct ir_block *header;
+	struct ir_block *preheader;
+	struct ir_block **blocks;		// header first, the rest in reverse postorder
+	int nblocks;
+	char *in;						// in[b->id] is set for blocks of the loop, ids past cap are outside
+	int cap;
+	struct ir_loop *parent;			// closest loop around this one
+	int depth;						// 1 for an outermost loop
+	struct ir_loop *next;			// innermost loops come first
+};
+
+struct ir_loop * loop_find( struct ir_func *f );
+void loop_delete( struct ir_loop *loops );
+
+int loop_contains( struct ir_loop *l, struct ir_block *bb );
+void loop_add_block( struct ir_loop *l, struct ir_block *bb );
+int loop_is_exit( struct ir_loop *l, struct ir_block *bb );
+
+#endif
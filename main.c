@@ -11,6 +11,17 @@
 #include "type.h"
 #include "param_list.h"
 #include "scope.h"
+#include "string_pool.h"
+#include "ir.h"
+#include "cfg.h"
+#include "opt.h"
+#include "unroll.h"
+#include "inline.h"
+#include "eval.h"
+#include "vm.h"
+#include "target.h"
+#include "encode.h"
+#include "sched.h"
 
 extern FILE *yyin;
 extern int yylex();
@@ -21,6 +32,9 @@ extern struct decl* parser_result;
 
 int type_val    = 0;
 int resolve_val = 0;
+int opt_level   = 2; // -O0 emits straight from the AST, -O1 goes through the IR unoptimized, -O2 runs the IR passes
+
+extern int decl_codegen_funcs;
 
 /* Function that converts token number into string */
 /*
@@ -480,13 +494,34 @@ void codegen(FILE *fil, FILE *outfil)
     */
     typecheck(fil);
 
+    // global initializers are computed here at every level, calls to pure functions only when optimizing
+    eval_program(parser_result, opt_level >= 2);
+
     // codegen
     // boiler plate prologue
-    fprintf(outfil, "\t.arch armv8-a\n");
+    if (target->arch) fputs(target->arch, outfil);
     fprintf(outfil, "\t.text\n");
 
     // codegen the actual bminor code
-    decl_codegen(parser_result, outfil);
+    // only AArch64 can be emitted straight from the AST, -O0 for anything else goes through the IR like -O1
+    if (opt_level == 0 && target->ast_codegen)
+    {
+        decl_codegen(parser_result, outfil);
+    }
+    else
+    {
+        // globals still come straight from the declarations, functions go through the IR and the backend
+        // the optimizer runs first, it decides which globals are left to emit
+        struct ir_program *prog = ir_lower(parser_result);
+        opt_program(prog);
+
+        decl_codegen_funcs = 0;
+        decl_codegen(parser_result, outfil);
+        target->codegen(prog, outfil);
+    }
+
+    // every string literal used above gets emitted exactly once, here
+    string_pool_codegen(outfil);
 
     // boiler plate epilogue
     fprintf(outfil, "\t.text\n"); // unsure if this is okay to have?
@@ -504,6 +539,101 @@ void codegen(FILE *fil, FILE *outfil)
     return;
 }
 
+/* Dump the IR of every function */
+/*
+inputs:
+- fil: main BMinor file which will be scanned and then parsed
+- outfil: file the IR is written to
+- graph: write the control-flow graphs in Graphviz format instead of the text dump
+outputs:
+- N/A
+*/
+void emit_ir(FILE *fil, FILE *outfil, int graph)
+{
+    printf("Lowering to IR...\n");
+
+    typecheck(fil);
+    eval_program(parser_result, opt_level >= 2);
+
+    struct ir_program *prog = ir_lower(parser_result);
+    opt_program(prog);
+    if (graph) cfg_print_dot_program(prog, outfil);
+    else       ir_print(prog, outfil);
+
+    int out_ret = fclose(outfil);
+    if (out_ret)
+    {
+        fprintf(stderr, "file error: file not outputted\n");
+        exit(1);
+    }
+
+    return;
+}
+
+/* Write the program straight to an ELF relocatable object */
+/*
+inputs:
+- fil: main BMinor file which will be scanned and then parsed
+- outfil: the object file
+outputs:
+- N/A
+*/
+void emit_obj(FILE *fil, FILE *outfil)
+{
+    printf("Encoding...\n");
+
+    // only the AArch64 backend has an encoder, and only its IR path, -O0 goes through the IR unoptimized
+    if (target != &target_aarch64)
+    {
+        printf("error: -emit-obj only encodes aarch64, write assembly with -codegen for %s\n", target->name);
+        exit(1);
+    }
+
+    typecheck(fil);
+    eval_program(parser_result, opt_level >= 2);
+
+    struct ir_program *prog = ir_lower(parser_result);
+    opt_program(prog);
+    encode_program(parser_result, prog, outfil);
+    printf("encode: %i instructions, %i relocations\n", encode_insts, encode_relocs);
+
+    int out_ret = fclose(outfil);
+    if (out_ret)
+    {
+        fprintf(stderr, "file error: file not outputted\n");
+        exit(1);
+    }
+
+    return;
+}
+
+/* Run a program in the bytecode VM instead of generating code for it */
+/*
+inputs:
+- fil: main BMinor file which will be scanned and then parsed
+outputs:
+- N/A, exits with the value main returns
+*/
+void run(FILE *fil)
+{
+    // the program's output is what goes to stdout, everything the compiler says on the way goes to stderr
+    fflush(stdout);
+    int saved_stdout = dup(1);
+    dup2(2, 1);
+
+    typecheck(fil);
+    eval_program(parser_result, opt_level >= 2);
+
+    struct ir_program *prog = ir_lower(parser_result);
+    opt_program(prog);
+
+    fflush(stdout);
+    dup2(saved_stdout, 1);
+    close(saved_stdout);
+
+    exit((int) vm_run(prog));
+}
+
 /* Main function for BMinor compiler */
 /*
 inputs: 
@@ -526,15 +656,72 @@ int main(int argc, char *argv[])
             {"resolve",   required_argument, 0,  'r' },
             {"typecheck", required_argument, 0,  'y' },
             {"codegen",   required_argument, 0,  'c' },
+            {"emit-ir",   required_argument, 0,  'i' },
+            {"emit-cfg",  required_argument, 0,  'g' },
+            {"unroll",    required_argument, 0,  'u' },
+            {"inline-threshold", required_argument, 0, 'n' },
+            {"run",       required_argument, 0,  'x' },
+            {"vm-stats",  no_argument,       0,  'v' },
+            {"vm-super",  required_argument, 0,  'w' },
+            {"target",    required_argument, 0,  'a' },
+            {"emit-obj",  required_argument, 0,  'e' },
+            {"mcpu",      required_argument, 0,  'm' },
             {0,                           0, 0,   0  }
         };
         int long_index = 0;
 
         // get arguments from command line, see if they match our options
-        opt = getopt_long_only(argc, argv, "s:p:t:r:y:c:", long_options, &long_index);
+        opt = getopt_long_only(argc, argv, "s:p:t:r:y:c:i:g:O:", long_options, &long_index);
         if (opt == -1)
             break;
 
+        // flags only change how the modes below behave, they have to come first
+        if (opt == 'O')
+        {
+            opt_level = atoi(optarg);
+            continue;
+        }
+        if (opt == 'u')
+        {
+            unroll_factor = atoi(optarg);
+            continue;
+        }
+        if (opt == 'n')
+        {
+            inline_threshold = atoi(optarg);
+            continue;
+        }
+        if (opt == 'v')
+        {
+            vm_stats = 1;
+            continue;
+        }
+        if (opt == 'w')
+        {
+            vm_super = atoi(optarg);
+            continue;
+        }
+        if (opt == 'a')
+        {
+            target = target_lookup(optarg);
+            if (!target)
+            {
+                printf("error: unknown target %s, there is aarch64 and x86_64\n", optarg);
+                exit(1);
+            }
+            continue;
+        }
+        if (opt == 'm')
+        {
+            sched_cpu = sched_cpu_lookup(optarg);
+            if (!sched_cpu)
+            {
+                printf("error: unknown cpu %s, there is cortex-a72 and cortex-a53\n", optarg);
+                exit(1);
+            }
+            continue;
+        }
+
         // Open bminor file
         yyin = fopen(optarg,"r");
         // Handle file's existence
@@ -577,17 +764,28 @@ int main(int argc, char *argv[])
                 // printf("we have exited typechecking.\n");
                 break;
             }
+            case 'x' :
+            {
+                // run the program in the bytecode VM
+                run(yyin);
+                break;
+            }
             case 'c' :
+            case 'i' :
+            case 'g' :
+            case 'e' :
             {
-                // initialize code generator
-                if (!argv[3])
+                // initialize code generator, the output file comes right after the source file
+                if (!argv[optind])
                 {
                     printf("error: please enter an output file name.\n");
                     exit(1);
                 }
                 FILE *outfil;
-                outfil = fopen(argv[3],"w+");
-                codegen(yyin, outfil);
+                outfil = fopen(argv[optind],"w+");
+                if (opt == 'c')      codegen(yyin, outfil);
+                else if (opt == 'e') emit_obj(yyin, outfil);
+                else                 emit_ir(yyin, outfil, opt == 'g');
                 break;
             }
             default:
@@ -0,0 +1,310 @@
+#include "object.h"
+
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+- writer for ELF64 relocatable objects (ET_REL), little endian
+  - struct object * object_create( int machine );
+  - struct object_section * object_section( struct object *o, const char *name, int type, long flags, int align );
+  - struct object_symbol * object_symbol( struct object *o, const char *name );
+  - void object_reloc( struct object_section *s, long offset, int type, struct object_symbol *sym, long addend );
+  - void object_write( struct object *o, FILE *out );
+
+- file layout: the ELF header, the contents of every section in order (each at its alignment), then the
+  section header table
+- section headers: the null one, the sections that were created, a .rela section for each of those that has
+  relocations, then .symtab, .strtab and .shstrtab
+- .symtab has the null symbol, then every local symbol (section symbols first, they're created with their
+  sections), then the globals, ELF wants all the locals before the first global
+*/
+
+/* object_create: an empty object for a machine */
+struct object * object_create(int machine)
+{
+	struct object *o = calloc(1, sizeof(*o));
+	o->machine = machine;
+	o->names   = hash_table_create(0, 0);
+	return o;
+}
+
+/* add a symbol to the list every symbol is written from */
+struct object_symbol * object_new_symbol(struct object *o, const char *name)
+{
+	struct object_symbol *sym = calloc(1, sizeof(*sym));
+	sym->name = name;
+
+	if (o->last) o->last->next = sym;
+	else         o->symbols    = sym;
+	o->last = sym;
+	return sym;
+}
+
+/* object_section: add a section, with the local symbol relocations against its contents go through */
+struct object_section * object_section(struct object *o, const char *name, int type, long flags, int align)
+{
+	if (o->nsections == sizeof(o->sections) / sizeof(o->sections[0]))
+	{
+		printf("codegen error: too many sections in one object\n");
+		exit(1);
+	}
+
+	struct object_section *s = calloc(1, sizeof(*s));
+	s->name  = name;
+	s->type  = type;
+	s->flags = flags;
+	s->align = align;
+	o->sections[o->nsections++] = s;
+
+	s->symbol = object_new_symbol(o, "");
+	s->symbol->section = s;
+	s->symbol->bind    = STB_LOCAL;
+	s->symbol->type    = STT_SECTION;
+	return s;
+}
+
+/* object_append: add bytes to the end of a section */
+void object_append(struct object_section *s, const void *bytes, long n)
+{
+	if (s->size + n > s->cap)
+	{
+		s->cap  = (s->size + n) * 2 + 64;
+		s->data = realloc(s->data, s->cap);
+	}
+	memcpy(s->data + s->size, bytes, n);
+	s->size += n;
+}
+
+/* object_word32: add a 32-bit little endian word, an instruction */
+void object_word32(struct object_section *s, unsigned int w)
+{
+	unsigned char b[4];
+	for (int k=0;k<4;k++) b[k] = (w >> (8 * k)) & 0xff;
+	object_append(s, b, 4);
+}
+
+/* object_word64: add a 64-bit little endian word */
+void object_word64(struct object_section *s, unsigned long w)
+{
+	unsigned char b[8];
+	for (int k=0;k<8;k++) b[k] = (w >> (8 * k)) & 0xff;
+	object_append(s, b, 8);
+}
+
+/* object_align: pad a section with zeros up to a multiple of align */
+void object_align(struct object_section *s, int align)
+{
+	static const unsigned char zero[16] = {0};
+	while (s->size % align) object_append(s, zero, 1);
+}
+
+/* object_symbol: the global symbol called name, an undefined one until object_define says where it is */
+struct object_symbol * object_symbol(struct object *o, const char *name)
+{
+	struct object_symbol *sym = hash_table_lookup(o->names, name);
+	if (sym) return sym;
+
+	sym = object_new_symbol(o, name);
+	sym->bind = STB_GLOBAL;
+	sym->type = STT_NOTYPE;
+	hash_table_insert(o->names, name, sym);
+	return sym;
+}
+
+/* object_define: say where a symbol is */
+void object_define(struct object_symbol *sym, struct object_section *s, long value, long size, int type, int bind)
+{
+	sym->section = s;
+	sym->value   = value;
+	sym->size    = size;
+	sym->type    = type;
+	sym->bind    = bind;
+}
+
+/* object_common: make a symbol a common block, what .comm declares */
+void object_common(struct object_symbol *sym, long size, long align)
+{
+	sym->common = 1;
+	sym->value  = align;
+	sym->size   = size;
+	sym->type   = STT_OBJECT;
+}
+
+/* object_local: add a local symbol nothing refers to by name, like the mapping symbols */
+void object_local(struct object *o, const char *name, struct object_section *s, long value, int type)
+{
+	struct object_symbol *sym = object_new_symbol(o, name);
+	sym->section = s;
+	sym->value   = value;
+	sym->bind    = STB_LOCAL;
+	sym->type    = type;
+}
+
+/* object_reloc: ask the linker to patch offset in section s with the address of sym + addend */
+void object_reloc(struct object_section *s, long offset, int type, struct object_symbol *sym, long addend)
+{
+	if (s->nrelocs == s->cap_relocs)
+	{
+		s->cap_relocs = s->cap_relocs * 2 + 16;
+		s->relocs = realloc(s->relocs, s->cap_relocs * sizeof(*s->relocs));
+	}
+	struct object_reloc *r = &s->relocs[s->nrelocs++];
+	r->offset = offset;
+	r->type   = type;
+	r->symbol = sym;
+	r->addend = addend;
+}
+
+/* add a name to a string table, returns where it starts */
+int object_string(struct object_section *strtab, const char *name)
+{
+	if (!*name) return 0;
+	int at = strtab->size;
+	object_append(strtab, name, strlen(name) + 1);
+	return at;
+}
+
+/* object_write: lay the object out and write it */
+void object_write(struct object *o, FILE *out)
+{
+	// the sections the writer adds itself go after the created ones
+	int nuser = o->nsections;
+	struct object_section *rela[16];
+	int nrela = 0;
+	for (int k=0;k<nuser;k++)
+	{
+		struct object_section *s = o->sections[k];
+		if (!s->nrelocs) continue;
+		char *name = malloc(strlen(s->name) + 6);
+		sprintf(name, ".rela%s", s->name);
+		rela[nrela] = calloc(1, sizeof(struct object_section));
+		rela[nrela]->name  = name;
+		rela[nrela]->type  = SHT_RELA;
+		rela[nrela]->flags = SHF_INFO_LINK;
+		rela[nrela]->align = 8;
+		rela[nrela]->target = s;
+		nrela++;
+	}
+
+	struct object_section symtab   = { ".symtab",   SHT_SYMTAB, 0, 8 };
+	struct object_section strtab   = { ".strtab",   SHT_STRTAB, 0, 1 };
+	struct object_section shstrtab = { ".shstrtab", SHT_STRTAB, 0, 1 };
+
+	struct object_section *all[40];
+	int nall = 0;
+	for (int k=0;k<nuser;k++) all[nall++] = o->sections[k];
+	for (int k=0;k<nrela;k++) all[nall++] = rela[k];
+	all[nall++] = &symtab;
+	all[nall++] = &strtab;
+	all[nall++] = &shstrtab;
+	for (int k=0;k<nall;k++) all[k]->index = k + 1;
+
+	// symbols, locals first
+	object_append(&strtab, "", 1);
+	Elf64_Sym null_sym = {0};
+	object_append(&symtab, &null_sym, sizeof(null_sym));
+	int nsyms = 1;
+	int first_global = 0;
+	for (int pass=0;pass<2;pass++)
+	{
+		if (pass == 1) first_global = nsyms;
+		for (struct object_symbol *sym = o->symbols; sym; sym = sym->next)
+		{
+			if ((sym->bind == STB_LOCAL) != (pass == 0)) continue;
+
+			Elf64_Sym es = {0};
+			es.st_name  = object_string(&strtab, sym->name);
+			es.st_info  = ELF64_ST_INFO(sym->bind, sym->type);
+			es.st_shndx = sym->common ? SHN_COMMON : sym->section ? sym->section->index : SHN_UNDEF;
+			es.st_value = sym->value;
+			es.st_size  = sym->size;
+			object_append(&symtab, &es, sizeof(es));
+			sym->index = nsyms++;
+		}
+	}
+
+	for (int k=0;k<nrela;k++)
+	{
+		struct object_section *s = rela[k]->target;
+		for (int r=0;r<s->nrelocs;r++)
+		{
+			Elf64_Rela er;
+			er.r_offset = s->relocs[r].offset;
+			er.r_info   = ELF64_R_INFO(s->relocs[r].symbol->index, s->relocs[r].type);
+			er.r_addend = s->relocs[r].addend;
+			object_append(rela[k], &er, sizeof(er));
+		}
+	}
+
+	// section names
+	object_append(&shstrtab, "", 1);
+	int names[40];
+	for (int k=0;k<nall;k++) names[k] = object_string(&shstrtab, all[k]->name);
+
+	// file offsets
+	long offsets[40];
+	long at = sizeof(Elf64_Ehdr);
+	for (int k=0;k<nall;k++)
+	{
+		int align = all[k]->align > 1 ? all[k]->align : 1;
+		at = (at + align - 1) / align * align;
+		offsets[k] = at;
+		at += all[k]->size;
+	}
+	long shoff = (at + 7) & ~7L;
+
+	Elf64_Ehdr eh = {0};
+	memcpy(eh.e_ident, ELFMAG, SELFMAG);
+	eh.e_ident[EI_CLASS]   = ELFCLASS64;
+	eh.e_ident[EI_DATA]    = ELFDATA2LSB;
+	eh.e_ident[EI_VERSION] = EV_CURRENT;
+	eh.e_ident[EI_OSABI]   = ELFOSABI_NONE;
+	eh.e_type      = ET_REL;
+	eh.e_machine   = o->machine;
+	eh.e_version   = EV_CURRENT;
+	eh.e_shoff     = shoff;
+	eh.e_ehsize    = sizeof(Elf64_Ehdr);
+	eh.e_shentsize = sizeof(Elf64_Shdr);
+	eh.e_shnum     = nall + 1;
+	eh.e_shstrndx  = shstrtab.index;
+	fwrite(&eh, sizeof(eh), 1, out);
+
+	at = sizeof(Elf64_Ehdr);
+	for (int k=0;k<nall;k++)
+	{
+		for (;at<offsets[k];at++) fputc(0, out);
+		if (all[k]->size) fwrite(all[k]->data, 1, all[k]->size, out);
+		at += all[k]->size;
+	}
+	for (;at<shoff;at++) fputc(0, out);
+
+	Elf64_Shdr null_sh = {0};
+	fwrite(&null_sh, sizeof(null_sh), 1, out);
+	for (int k=0;k<nall;k++)
+	{
+		struct object_section *s = all[k];
+		Elf64_Shdr sh = {0};
+		sh.sh_name      = names[k];
+		sh.sh_type      = s->type;
+		sh.sh_flags     = s->flags;
+		sh.sh_offset    = offsets[k];
+		sh.sh_size      = s->size;
+		sh.sh_addralign = s->align;
+		sh.sh_entsize   = s->entsize;
+		if (s->type == SHT_RELA)
+		{
+			sh.sh_link    = symtab.index;
+			sh.sh_info    = s->target->index;
+			sh.sh_entsize = sizeof(Elf64_Rela);
+		}
+		if (s->type == SHT_SYMTAB)
+		{
+			sh.sh_link    = strtab.index;
+			sh.sh_info    = first_global;
+			sh.sh_entsize = sizeof(Elf64_Sym);
+		}
+		fwrite(&sh, sizeof(sh), 1, out);
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include "hash_table.h"
+
+#include <stdio.h>
+
+/*
+- ELF64 relocatable objects, what an assembler would have written for the same program
+- sections are byte buffers that grow as code and data get appended, each with its own relocations
+- symbols are looked up by name, so a function or global can be referenced before it's defined, whatever is
+  still undefined when the object is written is left for the linker
+*/
+
+struct object_reloc {
+	long offset;				// in the section the relocation applies to
+	int type;					// R_AARCH64_*
+	struct object_symbol *symbol;
+	long addend;
+};
+
+struct object_section {
+	const char *name;
+	int type;					// SHT_*
+	long flags;					// SHF_*
+	int align;
+	int entsize;				// size of each entry of a mergeable section, 0 for the others
+	unsigned char *data;
+	long size;
+	long cap;
+	int index;					// in the section header table
+	struct object_symbol *symbol;	// the section's own symbol, relocations against its contents go through it
+	struct object_section *target;	// a .rela section: the section its relocations apply to
+	struct object_reloc *relocs;
+	int nrelocs;
+	int cap_relocs;
+};
+
+struct object_symbol {
+	const char *name;
+	struct object_section *section;	// 0 for undefined or common
+	int common;
+	long value;					// offset in its section, the alignment for a common block
+	long size;
+	int bind;					// STB_*
+	int type;					// STT_*
+	int index;					// in .symtab, set when the object is written
+	struct object_symbol *next;
+};
+
+struct object {
+	int machine;				// EM_*
+	struct object_section *sections[16];
+	int nsections;
+	struct object_symbol *symbols;	// in the order they were created
+	struct object_symbol *last;
+	struct hash_table *names;
+};
+
+struct object * object_create( int machine );
+
+struct object_section * object_section( struct object *o, const char *name, int type, long flags, int align );
+
+void object_append( struct object_section *s, const void *bytes, long n );
+void object_word32( struct object_section *s, unsigned int w );
+void object_word64( struct object_section *s, unsigned long w );
+void object_align( struct object_section *s, int align );
+
+struct object_symbol * object_symbol( struct object *o, const char *name );
+void object_define( struct object_symbol *sym, struct object_section *s, long value, long size, int type, int bind );
+void object_common( struct object_symbol *sym, long size, long align );
+void object_local( struct object *o, const char *name, struct object_section *s, long value, int type );
+
+void object_reloc( struct object_section *s, long offset, int type, struct object_symbol *sym, long addend );
+
+void object_write( struct object *o, FILE *out );
+
+#endif
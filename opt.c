@@ -0,0 +1,95 @@
+#include "opt.h"
+#include "cfg.h"
+#include "ssa.h"
+#include "sccp.h"
+#include "gvn.h"
+#include "licm.h"
+#include "iv.h"
+#include "ifconv.h"
+#include "unroll.h"
+#include "vector.h"
+#include "inline.h"
+#include "ipcp.h"
+#include "eval.h"
+#include "prune.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+- runs the IR passes in order over every function, and reports what they did
+  - void opt_program( struct ir_program *p );
+
+- -O1 only builds the control-flow graph (that alone drops unreachable code), -O2 and up run everything:
+  - inlining of small functions into their callers, over the whole program first
+  - interprocedural constant propagation, functions get specialized for the constant arguments they're called with
+  - SSA construction
+  - sparse conditional constant propagation, then straight-line blocks are merged
+  - global value numbering, with the purity of every function worked out first so pure calls can be reused
+  - loop-invariant code motion into loop preheaders
+  - induction variable strength reduction, array indexing in loops turns into pointers stepping along
+  - if-conversion, small branches that only pick between two values become selects
+  - dead code elimination
+  - SSA destruction, back to copies the backend can take
+  - then, over the whole program again, removal of the functions, globals and strings main can't reach
+*/
+
+/* opt_count: instructions in a function, for the report */
+int opt_count(struct ir_func *f)
+{
+	int n = 0;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next) n++;
+	}
+	return n;
+}
+
+/* opt_program: optimize every function of the program at the current opt_level */
+void opt_program(struct ir_program *p)
+{
+	if (opt_level >= 2) inline_program(p);
+	cfg_build_program(p);
+	if (opt_level < 2) return;
+	ipcp_program(p);
+
+	int before = 0;
+	int after  = 0;
+	int dead   = 0;
+
+	sccp_globals(p);
+	gvn_purity(p);
+	for (struct ir_func *f = p->funcs; f; f = f->next)
+	{
+		before += opt_count(f);
+
+		ssa_build(f);
+		sccp_run(f);
+		cfg_merge_blocks(f);
+		gvn_run(f);
+		licm_run(f);
+		iv_run(f);
+		ifconv_run(f);
+		dead += ssa_dce(f);
+		ssa_destroy(f);
+
+		after += opt_count(f);
+	}
+	prune_program(p);
+
+	vector_report(stdout);
+	printf("inline: %i calls inlined (threshold %i)\n", inline_sites, inline_threshold);
+	printf("eval: %i calls evaluated at compile time, %i global initializers computed\n", eval_calls, eval_globals);
+	printf("ipcp: %i parameters made constant, %i specialized clones taking %i calls\n", ipcp_params, ipcp_clones, ipcp_calls);
+	printf("vector: %i loops vectorized, %i not\n", vector_loops, vector_rejected);
+	printf("unroll: %i loops unrolled completely, %i by a factor of %i\n", unroll_full, unroll_partial, unroll_factor);
+	printf("sccp: %i values folded to constants, %i branches resolved\n", sccp_constants, sccp_branches);
+	printf("gvn: %i redundant expressions, %i redundant loads, %i redundant calls\n", gvn_exprs, gvn_loads, gvn_calls);
+	printf("licm: %i instructions hoisted out of loops\n", licm_hoisted);
+	printf("iv: %i induction expressions strength-reduced, %i loop tests moved off a counter\n", iv_reduced, iv_replaced);
+	printf("ifconv: %i branches turned into %i selects\n", ifconv_branches, ifconv_selects);
+	printf("dce: %i instructions removed\n", dead);
+	printf("ir: %i instructions before optimization, %i after\n", before, after);
+	printf("prune: %i functions, %i globals and %i strings removed, %i bytes of code and %i bytes of data saved\n",
+		prune_functions, prune_globals, prune_strings, prune_code_bytes, prune_data_bytes);
+}
@@ -0,0 +1,14 @@
+#ifndef OPT_H
+#define OPT_H
+
+#include "ir.h"
+
+/*
+- the optimization pipeline run over the IR between lowering and instruction selection
+*/
+
+extern int opt_level;
+
+void opt_program( struct ir_program *p );
+
+#endif
@@ -0,0 +1,141 @@
+#include "prune.h"
+#include "target.h"
+#include "hash_table.h"
+#include "string_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+- drops the functions, globals and string literals nothing reachable from main refers to
+  - void prune_program( struct ir_program *p );
+
+- a program without a main is a module someone else links against, anything in it may be called from outside,
+  so nothing is dropped then
+- the live functions are found with a worklist starting at main, following IR_CALL
+- IR_ADDR, IR_LOADG and IR_STOREG in a live function keep the global or the pooled string they name
+  - a live global string keeps its initial value too
+- dead functions leave p->funcs, dead globals get decl->unused so decl_codegen skips them, dead strings get
+  dropped from the pool
+- the code bytes saved are what the backend would have selected for the dead functions, the data bytes are
+  8 per scalar global (strings are pointers), 8 per array element, and the strings themselves
+*/
+
+int prune_functions  = 0;
+int prune_globals    = 0;
+int prune_strings    = 0;
+int prune_code_bytes = 0;
+int prune_data_bytes = 0;
+
+struct hash_table *prune_funcs   = 0;	// name -> ir_func of every function defined
+struct hash_table *prune_vars    = 0;	// name -> decl of every global variable
+struct hash_table *prune_live    = 0;	// name -> something, for every live function and global
+
+/* is d a global variable, as opposed to a function or a prototype */
+int prune_is_var(struct decl *d)
+{
+	return d->symbol->kind == SYMBOL_GLOBAL && d->type->kind != TYPE_FUNCTION && d->type->kind != TYPE_PROTO && d->type->kind != TYPE_VOID;
+}
+
+/* bytes a global variable takes */
+int prune_var_size(struct decl *d)
+{
+	if (d->type->kind == TYPE_ARRAY) return d->type->size * 8;
+	return 8;
+}
+
+/* something a live function names: a function, a global or a string */
+void prune_reference(const char *name, struct ir_func **work, int *nwork)
+{
+	int label = string_pool_label(name);
+	if (label >= 0)
+	{
+		string_pool_keep(label);
+		return;
+	}
+	if (!name || hash_table_lookup(prune_live, name)) return;
+
+	struct ir_func *f = hash_table_lookup(prune_funcs, name);
+	if (f)
+	{
+		hash_table_insert(prune_live, name, f);
+		work[(*nwork)++] = f;
+		return;
+	}
+
+	struct decl *d = hash_table_lookup(prune_vars, name);
+	if (!d) return;
+	hash_table_insert(prune_live, name, d);
+	if (d->type->kind == TYPE_STRING && d->value && d->value->string_literal)
+	{
+		string_pool_keep(string_pool_intern(d->value->string_literal));
+	}
+}
+
+/* prune_program: remove everything main can't reach */
+void prune_program(struct ir_program *p)
+{
+	if (prune_funcs) hash_table_delete(prune_funcs);
+	if (prune_vars)  hash_table_delete(prune_vars);
+	if (prune_live)  hash_table_delete(prune_live);
+	prune_funcs = hash_table_create(0, 0);
+	prune_vars  = hash_table_create(0, 0);
+	prune_live  = hash_table_create(0, 0);
+
+	int nfuncs = 0;
+	for (struct ir_func *f = p->funcs; f; f = f->next)
+	{
+		hash_table_insert(prune_funcs, f->name, f);
+		nfuncs++;
+	}
+	struct ir_func *main_func = hash_table_lookup(prune_funcs, "main");
+	if (!main_func) return;
+
+	// every string goes in the pool now, so the ones only dead globals start out with get counted too
+	for (struct decl *d = p->decls; d; d = d->next)
+	{
+		if (!prune_is_var(d)) continue;
+		hash_table_insert(prune_vars, d->name, d);
+		if (d->type->kind == TYPE_STRING && d->value && d->value->string_literal) string_pool_intern(d->value->string_literal);
+	}
+
+	struct ir_func **work = calloc(nfuncs + 1, sizeof(*work));
+	int nwork = 0;
+	prune_reference("main", work, &nwork);
+	while (nwork)
+	{
+		struct ir_func *f = work[--nwork];
+		for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+		{
+			for (struct ir_inst *i = bb->first; i; i = i->next)
+			{
+				if (i->op == IR_CALL || i->op == IR_ADDR || i->op == IR_LOADG || i->op == IR_STOREG) prune_reference(i->name, work, &nwork);
+			}
+		}
+	}
+	free(work);
+
+	struct ir_func **link = &p->funcs;
+	while (*link)
+	{
+		struct ir_func *f = *link;
+		if (hash_table_lookup(prune_live, f->name))
+		{
+			link = &f->next;
+			continue;
+		}
+		*link = f->next;
+		prune_code_bytes += target->size(f);
+		prune_functions++;
+	}
+
+	for (struct decl *d = p->decls; d; d = d->next)
+	{
+		if (!prune_is_var(d) || hash_table_lookup(prune_live, d->name)) continue;
+		d->unused = 1;
+		prune_data_bytes += prune_var_size(d);
+		prune_globals++;
+	}
+
+	prune_strings = string_pool_prune(&prune_data_bytes);
+}
@@ -0,0 +1,20 @@
+#ifndef PRUNE_H
+#define PRUNE_H
+
+#include "ir.h"
+
+/*
+- whole-program dead code elimination: whatever main can't reach, through calls and references to globals and
+  strings, isn't emitted
+- runs last, once inlining and the other passes have taken away every call they could
+*/
+
+extern int prune_functions;		// functions removed
+extern int prune_globals;		// global variables removed
+extern int prune_strings;		// string literals removed
+extern int prune_code_bytes;	// what the removed functions would have taken
+extern int prune_data_bytes;	// and the removed globals and strings
+
+void prune_program( struct ir_program *p );
+
+#endif
@@ -0,0 +1,337 @@
+#include "regalloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+- linear scan register allocation over the IR of one function, shared by every backend
+  - struct regalloc * regalloc_run( struct ir_func *f, const int *caller, int ncaller, const int *callee, int ncallee );
+
+- instructions are numbered in layout order, instruction n reads its operands at 2n and writes its result at 2n+1
+  - so a value whose last use is instruction n and a value defined by instruction n never overlap and can share a register
+- liveness is solved per block, then every vreg gets one interval [start, end] covering all the places it's live
+- a value that is live across a call has to go in a callee-saved register (or memory), everything else tries
+  the caller-saved registers first
+- when there's no register left, whichever interval ends last gets spilled to a stack slot
+- the backend passes in its own register numbers, the allocator never needs to know what they're called
+*/
+
+struct regalloc_state {
+	struct ir_func *f;
+	int nvregs;
+	int nwords;				// words per liveness bitset
+	int *start;
+	int *end;
+	int *crosses;			// live across a call
+	int *hint;				// vreg this one was copied from, try to give it the same register
+};
+
+/* set bit v of a bitset */
+void regalloc_bit_set(unsigned long long *set, int v)
+{
+	set[v / 64] |= 1ULL << (v % 64);
+}
+
+/* is bit v of a bitset set */
+int regalloc_bit_test(unsigned long long *set, int v)
+{
+	return (set[v / 64] >> (v % 64)) & 1;
+}
+
+/* extend the interval of vreg v to cover position pos */
+void regalloc_extend(struct regalloc_state *st, int v, int pos)
+{
+	if (v < 0) return;
+	if (pos < st->start[v]) st->start[v] = pos;
+	if (pos > st->end[v])   st->end[v]   = pos;
+}
+
+/* regalloc_intervals: number the instructions, solve liveness and build one interval per vreg */
+void regalloc_intervals(struct regalloc_state *st, struct regalloc *ra)
+{
+	struct ir_func *f = st->f;
+	int nb = f->nblocks;
+	int nw = st->nwords;
+
+	unsigned long long *use = calloc(nb * nw, sizeof(unsigned long long));
+	unsigned long long *def = calloc(nb * nw, sizeof(unsigned long long));
+	unsigned long long *in  = calloc(nb * nw, sizeof(unsigned long long));
+	unsigned long long *out = calloc(nb * nw, sizeof(unsigned long long));
+	int *first = calloc(nb, sizeof(int));
+	int *last  = calloc(nb, sizeof(int));
+
+	// number instructions and collect what each block reads before writing, and what it writes
+	int n = 0;
+	int nblocks = 0;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		unsigned long long *u = use + bb->id * nw;
+		unsigned long long *d = def + bb->id * nw;
+
+		first[bb->id] = n;
+		for (struct ir_inst *i = bb->first; i; i = i->next, n++)
+		{
+			int *slot;
+			for (int k=0;(slot = ir_inst_use(i, k));k++)
+			{
+				if (*slot >= 0 && !regalloc_bit_test(d, *slot)) regalloc_bit_set(u, *slot);
+			}
+			if (i->dst >= 0) regalloc_bit_set(d, i->dst);
+
+			if (i->op == IR_CALL)
+			{
+				ra->ncalls++;
+				if (i->nargs > ra->max_args) ra->max_args = i->nargs;
+			}
+		}
+		last[bb->id] = n - 1;
+		nblocks++;
+	}
+
+	// blocks in reverse layout order, so information flows backwards quickly
+	struct ir_block **order = calloc(nblocks ? nblocks : 1, sizeof(*order));
+	int k = nblocks;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next) order[--k] = bb;
+
+	// live_out(b) = union of live_in(succ), live_in(b) = use(b) | (live_out(b) & ~def(b))
+	int changed = 1;
+	while (changed)
+	{
+		changed = 0;
+		for (int b=0;b<nblocks;b++)
+		{
+			struct ir_block *bb = order[b];
+			struct ir_block *succs[2];
+			int ns = ir_block_succs(bb, succs);
+			unsigned long long *o = out + bb->id * nw;
+			unsigned long long *iv = in + bb->id * nw;
+			unsigned long long *u = use + bb->id * nw;
+			unsigned long long *d = def + bb->id * nw;
+
+			for (int s=0;s<ns;s++)
+			{
+				unsigned long long *si = in + succs[s]->id * nw;
+				for (int w=0;w<nw;w++) o[w] |= si[w];
+			}
+			for (int w=0;w<nw;w++)
+			{
+				unsigned long long nv = u[w] | (o[w] & ~d[w]);
+				if (nv != iv[w])
+				{
+					iv[w] = nv;
+					changed = 1;
+				}
+			}
+		}
+	}
+
+	// build the intervals
+	for (int v=0;v<st->nvregs;v++)
+	{
+		st->start[v] = 1 << 30;
+		st->end[v]   = -(1 << 30);
+	}
+
+	// parameters arrive before the first instruction
+	for (int p=0;p<f->nparams;p++) regalloc_extend(st, p, -1);
+
+	n = 0;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		unsigned long long *iv = in + bb->id * nw;
+		unsigned long long *o  = out + bb->id * nw;
+		for (int v=0;v<st->nvregs;v++)
+		{
+			if (regalloc_bit_test(iv, v)) regalloc_extend(st, v, 2 * first[bb->id]);
+			if (regalloc_bit_test(o, v))  regalloc_extend(st, v, 2 * last[bb->id] + 1);
+		}
+
+		for (struct ir_inst *i = bb->first; i; i = i->next, n++)
+		{
+			int *slot;
+			for (int k=0;(slot = ir_inst_use(i, k));k++)
+			{
+				regalloc_extend(st, *slot, 2 * n);
+			}
+			regalloc_extend(st, i->dst, 2 * n + 1);
+
+			if (i->op == IR_MOV && i->src[0] >= 0 && i->dst >= 0) st->hint[i->dst] = i->src[0];
+		}
+	}
+
+	// which intervals stay live across a call
+	n = 0;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next, n++)
+		{
+			if (i->op != IR_CALL) continue;
+			for (int v=0;v<st->nvregs;v++)
+			{
+				if (st->start[v] < 2 * n && st->end[v] > 2 * n + 1) st->crosses[v] = 1;
+			}
+		}
+	}
+
+	free(use);
+	free(def);
+	free(in);
+	free(out);
+	free(first);
+	free(last);
+	free(order);
+}
+
+struct regalloc_state *regalloc_sort_state = 0;
+
+/* order intervals by where they start */
+int regalloc_cmp_start(const void *a, const void *b)
+{
+	int va = *(const int *) a;
+	int vb = *(const int *) b;
+	int sa = regalloc_sort_state->start[va];
+	int sb = regalloc_sort_state->start[vb];
+	if (sa != sb) return sa < sb ? -1 : 1;
+	return va - vb;
+}
+
+/* regalloc_run: allocate registers for every vreg of f */
+/*
+inputs
+- f: the function
+- caller/ncaller: caller-saved registers the backend lets us use, in order of preference
+- callee/ncallee: callee-saved registers, the backend has to save the ones that end up used
+output
+- where every vreg lives
+*/
+struct regalloc * regalloc_run(struct ir_func *f, const int *caller, int ncaller, const int *callee, int ncallee)
+{
+	struct regalloc *ra = calloc(1, sizeof(*ra));
+	struct regalloc_state st;
+	int nv = f->nvregs;
+
+	st.f       = f;
+	st.nvregs  = nv;
+	st.nwords  = (nv + 63) / 64 + 1;
+	st.start   = calloc(nv + 1, sizeof(int));
+	st.end     = calloc(nv + 1, sizeof(int));
+	st.crosses = calloc(nv + 1, sizeof(int));
+	st.hint    = calloc(nv + 1, sizeof(int));
+	for (int v=0;v<nv;v++) st.hint[v] = -1;
+
+	ra->nvregs = nv;
+	ra->reg    = calloc(nv + 1, sizeof(int));
+	ra->slot   = calloc(nv + 1, sizeof(int));
+	for (int v=0;v<nv;v++)
+	{
+		ra->reg[v]  = REGALLOC_NONE;
+		ra->slot[v] = -1;
+	}
+
+	regalloc_intervals(&st, ra);
+
+	// only vregs that are actually live somewhere need anything
+	int *order = calloc(nv + 1, sizeof(int));
+	int n = 0;
+	for (int v=0;v<nv;v++)
+	{
+		if (st.start[v] <= st.end[v]) order[n++] = v;
+	}
+	regalloc_sort_state = &st;
+	qsort(order, n, sizeof(int), regalloc_cmp_start);
+
+	int owner[64];
+	for (int r=0;r<64;r++) owner[r] = -1;
+	int *active = calloc(nv + 1, sizeof(int));
+	int nactive = 0;
+
+	for (int k=0;k<n;k++)
+	{
+		int v = order[k];
+
+		// anything that ended before v starts gives its register back
+		for (int a=0;a<nactive;)
+		{
+			int w = active[a];
+			if (st.end[w] < st.start[v])
+			{
+				owner[ra->reg[w]] = -1;
+				active[a] = active[--nactive];
+			}
+			else
+			{
+				a++;
+			}
+		}
+
+		// candidates: callee-saved only if v survives a call
+		int cand[64];
+		int ncand = 0;
+		if (!st.crosses[v])
+		{
+			for (int r=0;r<ncaller;r++) cand[ncand++] = caller[r];
+		}
+		for (int r=0;r<ncallee;r++) cand[ncand++] = callee[r];
+
+		int pick = -1;
+		int h = st.hint[v];
+		if (h >= 0 && ra->reg[h] != REGALLOC_NONE && owner[ra->reg[h]] == -1)
+		{
+			for (int c=0;c<ncand;c++) if (cand[c] == ra->reg[h]) pick = cand[c];
+		}
+		for (int c=0;c<ncand && pick < 0;c++)
+		{
+			if (owner[cand[c]] == -1) pick = cand[c];
+		}
+
+		if (pick < 0)
+		{
+			// no free register: spill whichever candidate-holding interval lives the longest
+			int victim = -1;
+			for (int a=0;a<nactive;a++)
+			{
+				int w = active[a];
+				int ok = 0;
+				for (int c=0;c<ncand;c++) if (cand[c] == ra->reg[w]) ok = 1;
+				if (ok && (victim < 0 || st.end[w] > st.end[victim])) victim = w;
+			}
+
+			if (victim >= 0 && st.end[victim] > st.end[v])
+			{
+				pick = ra->reg[victim];
+				ra->reg[victim]  = REGALLOC_NONE;
+				ra->slot[victim] = ra->nslots++;
+				for (int a=0;a<nactive;a++) if (active[a] == victim) active[a] = active[--nactive];
+			}
+			else
+			{
+				ra->slot[v] = ra->nslots++;
+				continue;
+			}
+		}
+
+		ra->reg[v]  = pick;
+		owner[pick] = v;
+		ra->used   |= 1ULL << pick;
+		active[nactive++] = v;
+	}
+
+	free(order);
+	free(active);
+	free(st.start);
+	free(st.end);
+	free(st.crosses);
+	free(st.hint);
+
+	return ra;
+}
+
+/* regalloc_delete: free an allocation */
+void regalloc_delete(struct regalloc *ra)
+{
+	if (!ra) return;
+	free(ra->reg);
+	free(ra->slot);
+	free(ra);
+}
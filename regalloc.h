@@ -0,0 +1,22 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include "ir.h"
+
+#define REGALLOC_NONE (-1)
+
+struct regalloc {
+	int nvregs;
+	int *reg;		// physical register of each vreg, REGALLOC_NONE when spilled or never live
+	int *slot;		// spill slot of each vreg, -1 when it got a register
+	int nslots;
+	unsigned long long used;	// one bit per physical register that was handed out
+	int ncalls;		// calls made by the function, a leaf function makes none
+	int max_args;	// most arguments passed by any one of those calls
+};
+
+struct regalloc * regalloc_run( struct ir_func *f, const int *caller, int ncaller, const int *callee, int ncallee );
+
+void regalloc_delete( struct regalloc *ra );
+
+#endif
@@ -0,0 +1,423 @@
+#include "sccp.h"
+#include "cfg.h"
+#include "ssa.h"
+#include "hash_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+- sparse conditional constant propagation
+  - void sccp_globals( struct ir_program *p );
+  - int sccp_run( struct ir_func *f );
+
+- every vreg sits somewhere on the lattice  TOP (no value seen yet) > constant > BOTTOM (varies),
+  and only ever moves down
+- two worklists drive it: CFG edges that just became executable, and vregs whose lattice value just dropped
+- an instruction is only ever evaluated once its block is known to run, and a phi only looks at arguments
+  coming in over executable edges, so a branch that can't go one way keeps the other side's values out of the merge
+- calls, loads and parameters are BOTTOM, except integer_power which is pure and gets evaluated
+- a scalar global with a literal initializer that no function ever stores to is a constant everywhere,
+  sccp_globals works out which ones those are once for the whole program
+*/
+
+#define SCCP_TOP    (0)
+#define SCCP_CONST  (1)
+#define SCCP_BOTTOM (2)
+
+int sccp_constants = 0;
+int sccp_branches  = 0;
+
+struct hash_table *sccp_const_globals = 0;	// name -> decl of every global that never changes
+
+struct sccp_state {
+	struct ir_func *f;
+	int *state;
+	long *val;
+	char *block_exec;
+	char **edge_exec;				// edge_exec[b->id][k]: the edge from b->preds[k] into b can be taken
+	int *use_start;					// the instructions reading each vreg, packed
+	struct ir_inst **use_list;
+	struct ir_block **flow_to;		// CFG worklist, blocks that just got a new executable edge in
+	int nflow;
+	int *ssa_work;
+	int nssa;
+};
+
+/* sccp_globals: find the scalar globals whose value is fixed for the whole run */
+void sccp_globals(struct ir_program *p)
+{
+	struct hash_table *stored = hash_table_create(0, 0);
+	for (struct ir_func *f = p->funcs; f; f = f->next)
+	{
+		for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+		{
+			for (struct ir_inst *i = bb->first; i; i = i->next)
+			{
+				if (i->op == IR_STOREG && !hash_table_lookup(stored, i->name)) hash_table_insert(stored, i->name, i);
+			}
+		}
+	}
+
+	if (sccp_const_globals) hash_table_delete(sccp_const_globals);
+	sccp_const_globals = hash_table_create(0, 0);
+	for (struct decl *d = p->decls; d; d = d->next)
+	{
+		int kind = d->type->kind;
+		if (kind != TYPE_INTEGER && kind != TYPE_BOOLEAN && kind != TYPE_CHARACTER) continue;
+		if (d->value && d->value->kind != EXPR_INT_LITERAL && d->value->kind != EXPR_BOOLEAN_LITERAL
+			&& d->value->kind != EXPR_CHAR_LITERAL) continue;
+		if (hash_table_lookup(stored, d->name)) continue;
+		hash_table_insert(sccp_const_globals, d->name, d);
+	}
+
+	hash_table_delete(stored);
+}
+
+/* x to the power y the way integer_power computes it, by squaring so a large y doesn't take forever */
+long sccp_power(long x, long y)
+{
+	unsigned long r = 1;
+	unsigned long b = (unsigned long) x;
+	while (y > 0)
+	{
+		if (y & 1) r *= b;
+		b *= b;
+		y >>= 1;
+	}
+	return (long) r;
+}
+
+/* sccp_fold: evaluate a ALU instruction on constants, the way the hardware would */
+/*
+inputs
+- op: an ir_is_binary op, IR_NEG or IR_NOT (b is ignored for those two)
+output
+- 1 with the value in *result, 0 when it can't be folded: division by zero, or the one division that overflows
+*/
+int sccp_fold(ir_op_t op, long a, long b, long *result)
+{
+	unsigned long ua = (unsigned long) a;
+	unsigned long ub = (unsigned long) b;
+
+	switch (op)
+	{
+		case IR_ADD: *result = (long) (ua + ub); return 1;
+		case IR_SUB: *result = (long) (ua - ub); return 1;
+		case IR_MUL: *result = (long) (ua * ub); return 1;
+		case IR_DIV:
+		case IR_MOD:
+			// leave these to run and trap (or not) the same way they always would
+			if (b == 0 || (b == -1 && a == (long) (1UL << 63))) return 0;
+			*result = op == IR_DIV ? a / b : a % b;
+			return 1;
+		case IR_AND: *result = a & b; return 1;
+		case IR_OR:  *result = a | b; return 1;
+		case IR_EQ:  *result = a == b; return 1;
+		case IR_NE:  *result = a != b; return 1;
+		case IR_LT:  *result = a < b;  return 1;
+		case IR_LE:  *result = a <= b; return 1;
+		case IR_GT:  *result = a > b;  return 1;
+		case IR_GE:  *result = a >= b; return 1;
+		case IR_NEG: *result = (long) (0 - ua); return 1;
+		case IR_NOT: *result = a ^ 1; return 1;
+		default:     return 0;
+	}
+}
+
+/* is this a call sccp can evaluate */
+int sccp_pure_call(struct ir_inst *i)
+{
+	return i->op == IR_CALL && i->nargs == 2 && !strcmp(i->name, "integer_power");
+}
+
+/* queue a CFG edge unless it's already known to be executable */
+void sccp_edge(struct sccp_state *st, struct ir_block *from, struct ir_block *to)
+{
+	int k = cfg_pred_index(to, from);
+	if (st->edge_exec[to->id][k]) return;
+	st->edge_exec[to->id][k] = 1;
+	st->flow_to[st->nflow++] = to;
+}
+
+/* lower vreg v to a new lattice value, queueing its users if that changed anything */
+void sccp_set(struct sccp_state *st, int v, int state, long val)
+{
+	if (state == st->state[v] && (state != SCCP_CONST || val == st->val[v])) return;
+	// a second, different constant means it varies
+	if (state == SCCP_CONST && st->state[v] == SCCP_CONST) state = SCCP_BOTTOM;
+	if (state < st->state[v]) return;
+
+	st->state[v] = state;
+	st->val[v]   = val;
+	st->ssa_work[st->nssa++] = v;
+}
+
+/* evaluate one instruction against the current lattice */
+void sccp_eval(struct sccp_state *st, struct ir_inst *i)
+{
+	int *S  = st->state;
+	long *V = st->val;
+
+	switch (i->op)
+	{
+		case IR_JMP:
+			sccp_edge(st, i->block, i->target);
+			return;
+		case IR_BR:
+		{
+			int c = i->src[0];
+			if (S[c] == SCCP_TOP) return;
+			if (S[c] == SCCP_BOTTOM || V[c])  sccp_edge(st, i->block, i->target);
+			if (S[c] == SCCP_BOTTOM || !V[c]) sccp_edge(st, i->block, i->target_false);
+			return;
+		}
+		case IR_PHI:
+		{
+			int state = SCCP_TOP;
+			long val = 0;
+			for (int k=0;k<i->nargs;k++)
+			{
+				int a = i->args[k];
+				if (!st->edge_exec[i->block->id][k] || a < 0 || S[a] == SCCP_TOP) continue;
+				if (S[a] == SCCP_BOTTOM || (state == SCCP_CONST && V[a] != val))
+				{
+					state = SCCP_BOTTOM;
+					break;
+				}
+				state = SCCP_CONST;
+				val   = V[a];
+			}
+			if (state != SCCP_TOP) sccp_set(st, i->dst, state, val);
+			return;
+		}
+		default:
+			break;
+	}
+
+	if (i->dst < 0) return;
+
+	long r = 0;
+	switch (i->op)
+	{
+		case IR_CONST:
+			sccp_set(st, i->dst, SCCP_CONST, i->imm);
+			return;
+		case IR_MOV:
+			if (S[i->src[0]] != SCCP_TOP) sccp_set(st, i->dst, S[i->src[0]], V[i->src[0]]);
+			return;
+		case IR_NEG:
+		case IR_NOT:
+			if (S[i->src[0]] == SCCP_TOP) return;
+			if (S[i->src[0]] == SCCP_CONST && sccp_fold(i->op, V[i->src[0]], 0, &r)) sccp_set(st, i->dst, SCCP_CONST, r);
+			else sccp_set(st, i->dst, SCCP_BOTTOM, 0);
+			return;
+		case IR_LOADG:
+		{
+			struct decl *d = sccp_const_globals ? hash_table_lookup(sccp_const_globals, i->name) : 0;
+			if (d) sccp_set(st, i->dst, SCCP_CONST, d->value ? d->value->literal_value : 0);
+			else   sccp_set(st, i->dst, SCCP_BOTTOM, 0);
+			return;
+		}
+		case IR_CALL:
+		{
+			if (!sccp_pure_call(i))
+			{
+				sccp_set(st, i->dst, SCCP_BOTTOM, 0);
+				return;
+			}
+			int a = i->args[0];
+			int b = i->args[1];
+			if (S[a] == SCCP_BOTTOM || S[b] == SCCP_BOTTOM) sccp_set(st, i->dst, SCCP_BOTTOM, 0);
+			else if (S[a] == SCCP_CONST && S[b] == SCCP_CONST) sccp_set(st, i->dst, SCCP_CONST, sccp_power(V[a], V[b]));
+			return;
+		}
+		default:
+			break;
+	}
+
+	if (!ir_is_binary(i->op))
+	{
+		sccp_set(st, i->dst, SCCP_BOTTOM, 0);
+		return;
+	}
+
+	int a = i->src[0];
+	int b = i->src[1];
+
+	// x * 0 and x & 0 are zero whatever x is
+	if ((i->op == IR_MUL || i->op == IR_AND) &&
+		((S[a] == SCCP_CONST && V[a] == 0) || (S[b] == SCCP_CONST && V[b] == 0)))
+	{
+		sccp_set(st, i->dst, SCCP_CONST, 0);
+		return;
+	}
+
+	if (S[a] == SCCP_BOTTOM || S[b] == SCCP_BOTTOM) sccp_set(st, i->dst, SCCP_BOTTOM, 0);
+	else if (S[a] == SCCP_TOP || S[b] == SCCP_TOP) return;
+	else if (sccp_fold(i->op, V[a], V[b], &r))     sccp_set(st, i->dst, SCCP_CONST, r);
+	else                                           sccp_set(st, i->dst, SCCP_BOTTOM, 0);
+}
+
+/* move a phi that became an ordinary instruction below the phis still left in its block */
+void sccp_unphi(struct ir_inst *i)
+{
+	struct ir_block *bb = i->block;
+	struct ir_inst *pos = i->next;
+	while (pos && pos->op == IR_PHI) pos = pos->next;
+	if (pos == i->next) return;
+	ir_inst_remove(i);
+	if (pos) ir_inst_insert_before(pos, i);
+	else     ir_inst_append(bb, i);
+}
+
+/* sccp_run: propagate constants through one function in SSA form and rewrite it with what was found */
+/*
+output
+- how many instructions and branches changed
+*/
+int sccp_run(struct ir_func *f)
+{
+	struct sccp_state st;
+	int nv = f->nvregs;
+	int nb = f->nblocks;
+	int nedges = 1;
+	int ninsts = 0;
+
+	memset(&st, 0, sizeof(st));
+	st.f     = f;
+	st.state = calloc(nv + 1, sizeof(int));
+	st.val   = calloc(nv + 1, sizeof(long));
+	st.block_exec = calloc(nb + 1, 1);
+	st.edge_exec  = calloc(nb + 1, sizeof(char *));
+	st.use_start  = calloc(nv + 2, sizeof(int));
+
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		st.edge_exec[bb->id] = calloc(bb->npreds + 1, 1);
+		nedges += bb->npreds;
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			ninsts++;
+			int *slot;
+			for (int k=0;(slot = ir_inst_use(i, k));k++) if (*slot >= 0) st.use_start[*slot + 1]++;
+		}
+	}
+	for (int v=0;v<nv;v++) st.use_start[v + 1] += st.use_start[v];
+	st.use_list = calloc(st.use_start[nv] + 1, sizeof(*st.use_list));
+	int *fill = calloc(nv + 1, sizeof(int));
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			int *slot;
+			for (int k=0;(slot = ir_inst_use(i, k));k++)
+			{
+				if (*slot >= 0) st.use_list[st.use_start[*slot] + fill[*slot]++] = i;
+			}
+		}
+	}
+	free(fill);
+
+	st.flow_to   = calloc(nedges + 1, sizeof(*st.flow_to));
+	st.ssa_work  = calloc(2 * nv + 1, sizeof(int));		// a vreg can only drop twice
+
+	// parameters can be anything
+	for (int p=0;p<f->nparams;p++) st.state[p] = SCCP_BOTTOM;
+
+	st.flow_to[0]   = f->blocks;
+	st.nflow = 1;
+
+	int flow_done = 0;
+	int ssa_done = 0;
+	while (flow_done < st.nflow || ssa_done < st.nssa)
+	{
+		if (flow_done < st.nflow)
+		{
+			struct ir_block *bb = st.flow_to[flow_done++];
+			for (struct ir_inst *i = bb->first; i && i->op == IR_PHI; i = i->next) sccp_eval(&st, i);
+
+			if (st.block_exec[bb->id]) continue;
+			st.block_exec[bb->id] = 1;
+			for (struct ir_inst *i = bb->first; i; i = i->next)
+			{
+				if (i->op != IR_PHI) sccp_eval(&st, i);
+			}
+			continue;
+		}
+
+		int v = st.ssa_work[ssa_done++];
+		for (int k=st.use_start[v];k<st.use_start[v + 1];k++)
+		{
+			struct ir_inst *i = st.use_list[k];
+			if (st.block_exec[i->block->id]) sccp_eval(&st, i);
+		}
+	}
+
+	// rewrite
+	int changed = 0;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		if (!st.block_exec[bb->id]) continue;
+
+		struct ir_inst *next;
+		for (struct ir_inst *i = bb->first; i; i = next)
+		{
+			next = i->next;
+
+			if (i->op == IR_BR && st.state[i->src[0]] == SCCP_CONST)
+			{
+				if (!st.val[i->src[0]]) i->target = i->target_false;
+				i->op     = IR_JMP;
+				i->src[0] = IR_NO_REG;
+				i->target_false = 0;
+				sccp_branches++;
+				changed++;
+				continue;
+			}
+
+			if (i->dst < 0 || i->op == IR_CONST || st.state[i->dst] != SCCP_CONST) continue;
+			if (ir_has_side_effects(i) && !sccp_pure_call(i)) continue;
+
+			int was_phi = i->op == IR_PHI;
+			i->op     = IR_CONST;
+			i->imm    = st.val[i->dst];
+			i->src[0] = i->src[1] = i->src[2] = IR_NO_REG;
+			i->nargs  = 0;
+			i->name   = 0;
+			i->tail   = 0;
+			if (was_phi) sccp_unphi(i);
+			sccp_constants++;
+			changed++;
+		}
+	}
+
+	// branches that went away can leave whole regions unreachable, and phis with a single way in
+	cfg_build(f);
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		struct ir_inst *next;
+		for (struct ir_inst *i = bb->first; i && i->op == IR_PHI; i = next)
+		{
+			next = i->next;
+			if (i->nargs != 1) continue;
+			i->op     = IR_MOV;
+			i->src[0] = i->args[0];
+			i->nargs  = 0;
+			sccp_unphi(i);
+		}
+	}
+
+	free(st.state);
+	free(st.val);
+	free(st.block_exec);
+	for (int b=0;b<=nb;b++) free(st.edge_exec[b]);
+	free(st.edge_exec);
+	free(st.use_start);
+	free(st.use_list);
+	free(st.flow_to);
+	free(st.ssa_work);
+
+	return changed;
+}
@@ -0,0 +1,20 @@
+#ifndef SCCP_H
+#define SCCP_H
+
+#include "ir.h"
+
+/*
+- sparse conditional constant propagation (Wegman and Zadeck) over a function in SSA form
+- constants are followed through locals, phis and scalar globals nothing ever assigns, branches on a constant
+  become jumps, and the blocks that leaves unreachable go away
+*/
+
+extern int sccp_constants;	// instructions turned into constants, summed over every run
+extern int sccp_branches;	// branches turned into jumps
+
+void sccp_globals( struct ir_program *p );
+int sccp_run( struct ir_func *f );
+
+int sccp_fold( ir_op_t op, long a, long b, long *result );
+
+#endif
@@ -0,0 +1,683 @@
+#include "sched.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+- instruction scheduling for the AArch64 backend, after selection and register allocation
+  - struct sched_cpu * sched_cpu_lookup( const char *name );
+  - void sched_func( struct a64_func *mf, int reorder );
+
+- a region is a straight run of instructions: it starts after a label or a branch, and ends with the branch,
+  call or return that leaves it (which stays last) or right before the next label
+- dependences in a region, an instruction has to stay after:
+  - the last write of every register it reads, by the latency of that write (the flags count as a register)
+  - every read and the last write of a register it writes
+  - any memory access it could overlap, when either one is a store: stack slots are told apart by offset from
+    the same base, scalar globals by name, and the three never overlap each other (nothing can point into the
+    frame, and a global is only read through a pointer when it's an array); anything through a pointer
+    overlaps any other access through a pointer
+- the list scheduler goes cycle by cycle and issues, of the instructions whose operands are ready and whose
+  pipeline is free, the one with the longest chain of latencies still behind it, ties in the original order
+- cycles are predicted by issuing the instructions in order on the model of the core, waiting for operands
+  and pipelines, which is what the in-order A53 does; the out-of-order A72 finds some of the same overlap by
+  itself, so it gains less than its prediction says
+- a region keeps its original order unless the new one is predicted to be faster
+*/
+
+struct sched_cpu sched_cortex_a72 = {
+	"cortex-a72", 3,
+	{ 2, 1, 1, 1, 2, 1 },
+	{
+		{ SCHED_UNIT_ALU,    1,  1 },	// alu
+		{ SCHED_UNIT_MUL,    2,  1 },	// alu with a shifted operand, down the multi-cycle pipeline
+		{ SCHED_UNIT_MUL,    5,  3 },	// 64-bit mul, madd, msub
+		{ SCHED_UNIT_MUL,    20, 20 },	// 64-bit sdiv, in the middle of its 4 to 36 cycles
+		{ SCHED_UNIT_LOAD,   4,  1 },
+		{ SCHED_UNIT_STORE,  1,  1 },
+		{ SCHED_UNIT_VEC,    3,  1 },	// vector add, sub, addp
+		{ SCHED_UNIT_LOAD,   8,  1 },	// dup and fmov between the register files
+		{ SCHED_UNIT_BRANCH, 1,  1 },
+	}
+};
+
+struct sched_cpu sched_cortex_a53 = {
+	"cortex-a53", 2,
+	{ 2, 1, 1, 0, 1, 1 },
+	{
+		{ SCHED_UNIT_ALU,    1,  1 },
+		{ SCHED_UNIT_ALU,    2,  1 },
+		{ SCHED_UNIT_MUL,    4,  2 },
+		{ SCHED_UNIT_MUL,    12, 12 },
+		{ SCHED_UNIT_LOAD,   3,  1 },
+		{ SCHED_UNIT_LOAD,   1,  1 },	// loads and stores share the one pipeline
+		{ SCHED_UNIT_VEC,    4,  1 },
+		{ SCHED_UNIT_VEC,    4,  1 },
+		{ SCHED_UNIT_BRANCH, 1,  1 },
+	}
+};
+
+struct sched_cpu *sched_cpu = &sched_cortex_a72;
+
+// registers as the dependences see them: x0-x30 and sp as numbered, then the vector registers, then the flags
+#define SCHED_V0     (33)
+#define SCHED_FLAGS  (SCHED_V0 + 32)
+#define SCHED_NREGS  (SCHED_FLAGS + 1)
+
+// memory an instruction accesses
+enum { SCHED_MEM_NONE, SCHED_MEM_STACK, SCHED_MEM_GLOBAL, SCHED_MEM_POINTER };
+
+struct sched_node {
+	struct a64_inst *inst;
+	int cls;
+	int defs[3];
+	int ndefs;
+	int uses[4];
+	int nuses;
+	int mem;
+	int store;
+	int base;			// stack accesses: sp or x29
+	long offset;
+	int size;
+	int height;			// longest chain of latencies from here to the end of the region
+	int npreds;			// dependences not yet issued
+	int earliest;		// cycle its operands are ready
+	int done;
+	int first_succ;		// its dependences in sched_edges, from first_succ up to the next node's
+};
+
+struct sched_edge {
+	int from;
+	int to;
+	int latency;
+};
+
+// the region being scheduled, reused from one region to the next
+struct sched_node *sched_nodes    = 0;
+int                sched_cap      = 0;
+struct sched_edge *sched_edges    = 0;
+int                sched_nedges   = 0;
+int                sched_cap_edge = 0;
+int               *sched_order    = 0;
+
+/* sched_cpu_lookup: the core called name, 0 if there is no model for it */
+struct sched_cpu * sched_cpu_lookup(const char *name)
+{
+	if (!strcmp(name, "cortex-a72") || !strcmp(name, "a72")) return &sched_cortex_a72;
+	if (!strcmp(name, "cortex-a53") || !strcmp(name, "a53")) return &sched_cortex_a53;
+	return 0;
+}
+
+/* does i end a region, it stays last in it */
+int sched_ends_region(struct a64_inst *i)
+{
+	switch (i->op)
+	{
+		case A64_B:
+		case A64_BCOND:
+		case A64_CBZ:
+		case A64_CBNZ:
+		case A64_BL:
+		case A64_RET:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+/* class of a machine instruction */
+int sched_class_of(struct a64_inst *i)
+{
+	switch (i->op)
+	{
+		case A64_ADD:
+		case A64_SUB:
+			return i->shift ? SCHED_SHIFT : SCHED_ALU;
+		case A64_MUL:
+		case A64_MADD:
+		case A64_MSUB:
+			return SCHED_MUL;
+		case A64_SDIV:
+			return SCHED_DIV;
+		case A64_LDR:
+		case A64_LDRX:
+		case A64_LDR_POST:
+		case A64_LDP:
+		case A64_LDP_POST:
+		case A64_LDRLO:
+		case A64_LDRLIT:
+		case A64_LDRQ:
+		case A64_LDRQ_POST:
+			return SCHED_LOAD;
+		case A64_STR:
+		case A64_STRX:
+		case A64_STR_POST:
+		case A64_STP:
+		case A64_STP_PRE:
+		case A64_STRLO:
+		case A64_STRQ:
+		case A64_STRQ_POST:
+			return SCHED_STORE;
+		case A64_VADD:
+		case A64_VSUB:
+		case A64_ADDP:
+			return SCHED_VEC;
+		case A64_DUP:
+		case A64_FMOV:
+			return SCHED_VMOV;
+		case A64_B:
+		case A64_BCOND:
+		case A64_CBZ:
+		case A64_CBNZ:
+		case A64_BL:
+		case A64_RET:
+			return SCHED_BRANCH;
+		default:
+			return SCHED_ALU;
+	}
+}
+
+/* add a register to a node's reads or writes, xzr is neither */
+void sched_reg(int *regs, int *n, int r)
+{
+	if (r != A64_XZR) regs[(*n)++] = r;
+}
+
+/* registers a machine instruction reads and writes */
+void sched_regs(struct sched_node *n)
+{
+	struct a64_inst *i = n->inst;
+	int *d = n->defs;
+	int *u = n->uses;
+	n->ndefs = 0;
+	n->nuses = 0;
+
+	switch (i->op)
+	{
+		case A64_MOV:
+		case A64_ADDI:
+		case A64_SUBI:
+		case A64_LSLI:
+		case A64_EORI:
+		case A64_ADDLO:
+		case A64_LDR:
+		case A64_LDRLO:
+			sched_reg(d, &n->ndefs, i->rd);
+			sched_reg(u, &n->nuses, i->rn);
+			break;
+		case A64_MOVI:
+		case A64_MOVZ:
+		case A64_MOVN:
+		case A64_ADRP:
+		case A64_LDRLIT:
+			sched_reg(d, &n->ndefs, i->rd);
+			break;
+		case A64_MOVK:
+			sched_reg(d, &n->ndefs, i->rd);
+			sched_reg(u, &n->nuses, i->rd);
+			break;
+		case A64_ADD:
+		case A64_SUB:
+		case A64_MUL:
+		case A64_SDIV:
+		case A64_AND:
+		case A64_ORR:
+		case A64_LDRX:
+			sched_reg(d, &n->ndefs, i->rd);
+			sched_reg(u, &n->nuses, i->rn);
+			sched_reg(u, &n->nuses, i->rm);
+			break;
+		case A64_MADD:
+		case A64_MSUB:
+			sched_reg(d, &n->ndefs, i->rd);
+			sched_reg(u, &n->nuses, i->rn);
+			sched_reg(u, &n->nuses, i->rm);
+			sched_reg(u, &n->nuses, i->ra);
+			break;
+		case A64_NEG:
+			sched_reg(d, &n->ndefs, i->rd);
+			sched_reg(u, &n->nuses, i->rm);
+			break;
+		case A64_CMP:
+			sched_reg(d, &n->ndefs, SCHED_FLAGS);
+			sched_reg(u, &n->nuses, i->rn);
+			sched_reg(u, &n->nuses, i->rm);
+			break;
+		case A64_CMPI:
+			sched_reg(d, &n->ndefs, SCHED_FLAGS);
+			sched_reg(u, &n->nuses, i->rn);
+			break;
+		case A64_CSET:
+			sched_reg(d, &n->ndefs, i->rd);
+			sched_reg(u, &n->nuses, SCHED_FLAGS);
+			break;
+		case A64_CINC:
+			sched_reg(d, &n->ndefs, i->rd);
+			sched_reg(u, &n->nuses, i->rn);
+			sched_reg(u, &n->nuses, SCHED_FLAGS);
+			break;
+		case A64_CSEL:
+		case A64_CSINC:
+		case A64_CSNEG:
+			sched_reg(d, &n->ndefs, i->rd);
+			sched_reg(u, &n->nuses, i->rn);
+			sched_reg(u, &n->nuses, i->rm);
+			sched_reg(u, &n->nuses, SCHED_FLAGS);
+			break;
+		case A64_STR:
+		case A64_STRLO:
+			sched_reg(u, &n->nuses, i->rd);
+			sched_reg(u, &n->nuses, i->rn);
+			break;
+		case A64_STRX:
+			sched_reg(u, &n->nuses, i->rd);
+			sched_reg(u, &n->nuses, i->rn);
+			sched_reg(u, &n->nuses, i->rm);
+			break;
+		case A64_LDR_POST:
+			sched_reg(d, &n->ndefs, i->rd);
+			sched_reg(d, &n->ndefs, i->rn);
+			sched_reg(u, &n->nuses, i->rn);
+			break;
+		case A64_STR_POST:
+			sched_reg(d, &n->ndefs, i->rn);
+			sched_reg(u, &n->nuses, i->rd);
+			sched_reg(u, &n->nuses, i->rn);
+			break;
+		case A64_LDP:
+			sched_reg(d, &n->ndefs, i->rd);
+			sched_reg(d, &n->ndefs, i->ra);
+			sched_reg(u, &n->nuses, i->rn);
+			break;
+		case A64_LDP_POST:
+			sched_reg(d, &n->ndefs, i->rd);
+			sched_reg(d, &n->ndefs, i->ra);
+			sched_reg(d, &n->ndefs, i->rn);
+			sched_reg(u, &n->nuses, i->rn);
+			break;
+		case A64_STP:
+		case A64_STP_PRE:
+			if (i->op == A64_STP_PRE) sched_reg(d, &n->ndefs, i->rn);
+			sched_reg(u, &n->nuses, i->rd);
+			sched_reg(u, &n->nuses, i->ra);
+			sched_reg(u, &n->nuses, i->rn);
+			break;
+		case A64_BCOND:
+			sched_reg(u, &n->nuses, SCHED_FLAGS);
+			break;
+		case A64_CBZ:
+		case A64_CBNZ:
+			sched_reg(u, &n->nuses, i->rn);
+			break;
+		case A64_LDRQ:
+		case A64_DUP:
+			sched_reg(d, &n->ndefs, SCHED_V0 + i->rd);
+			sched_reg(u, &n->nuses, i->rn);
+			break;
+		case A64_STRQ:
+			sched_reg(u, &n->nuses, SCHED_V0 + i->rd);
+			sched_reg(u, &n->nuses, i->rn);
+			break;
+		case A64_LDRQ_POST:
+			sched_reg(d, &n->ndefs, SCHED_V0 + i->rd);
+			sched_reg(d, &n->ndefs, i->rn);
+			sched_reg(u, &n->nuses, i->rn);
+			break;
+		case A64_STRQ_POST:
+			sched_reg(d, &n->ndefs, i->rn);
+			sched_reg(u, &n->nuses, SCHED_V0 + i->rd);
+			sched_reg(u, &n->nuses, i->rn);
+			break;
+		case A64_VADD:
+		case A64_VSUB:
+			sched_reg(d, &n->ndefs, SCHED_V0 + i->rd);
+			sched_reg(u, &n->nuses, SCHED_V0 + i->rn);
+			sched_reg(u, &n->nuses, SCHED_V0 + i->rm);
+			break;
+		case A64_ADDP:
+			sched_reg(d, &n->ndefs, SCHED_V0 + i->rd);
+			sched_reg(u, &n->nuses, SCHED_V0 + i->rn);
+			break;
+		case A64_FMOV:
+			sched_reg(d, &n->ndefs, i->rd);
+			sched_reg(u, &n->nuses, SCHED_V0 + i->rn);
+			break;
+		default:
+			// branches out, calls and returns end the region, everything before them stays before them anyway
+			break;
+	}
+}
+
+/* the memory a machine instruction accesses */
+void sched_mem(struct sched_node *n)
+{
+	struct a64_inst *i = n->inst;
+	n->mem    = SCHED_MEM_NONE;
+	n->store  = n->cls == SCHED_STORE;
+	n->offset = i->imm;
+	n->size   = 8;
+
+	switch (i->op)
+	{
+		case A64_LDRLO:
+		case A64_STRLO:
+			n->mem = SCHED_MEM_GLOBAL;
+			return;
+		case A64_LDRX:
+		case A64_STRX:
+			n->mem = SCHED_MEM_POINTER;
+			return;
+		case A64_LDR_POST:
+		case A64_STR_POST:
+		case A64_LDP_POST:
+		case A64_LDRQ_POST:
+		case A64_STRQ_POST:
+			n->offset = 0;
+			break;
+		case A64_LDR:
+		case A64_STR:
+		case A64_STP_PRE:
+			break;
+		case A64_LDP:
+		case A64_STP:
+		case A64_LDRQ:
+		case A64_STRQ:
+			n->size = 16;
+			break;
+		default:
+			return;
+	}
+	if (i->op == A64_LDP_POST || i->op == A64_LDRQ_POST || i->op == A64_STRQ_POST || i->op == A64_STP_PRE) n->size = 16;
+
+	n->base = i->rn;
+	n->mem  = i->rn == A64_SP || i->rn == 29 ? SCHED_MEM_STACK : SCHED_MEM_POINTER;
+}
+
+/* can a and b touch the same memory with at least one of them storing */
+int sched_mem_conflict(struct sched_node *a, struct sched_node *b)
+{
+	if (!a->mem || !b->mem || (!a->store && !b->store) || a->mem != b->mem) return 0;
+
+	switch (a->mem)
+	{
+		case SCHED_MEM_STACK:
+			return a->base != b->base || (a->offset < b->offset + b->size && b->offset < a->offset + a->size);
+		case SCHED_MEM_GLOBAL:
+			return !strcmp(a->inst->sym, b->inst->sym);
+		default:
+			return 1;
+	}
+}
+
+/* cycles until register r, written by n, can be read */
+int sched_latency(struct sched_node *n, int r)
+{
+	// the base of a post- or pre-indexed access is written back by the address adder, not the load
+	switch (n->inst->op)
+	{
+		case A64_LDR_POST:
+		case A64_STR_POST:
+		case A64_LDP_POST:
+		case A64_STP_PRE:
+		case A64_LDRQ_POST:
+		case A64_STRQ_POST:
+			if (r == n->inst->rn) return 1;
+			break;
+		default:
+			break;
+	}
+	return sched_cpu->cls[n->cls].latency;
+}
+
+/* record that to has to come latency cycles after from */
+void sched_edge_add(int from, int to, int latency)
+{
+	if (sched_nedges == sched_cap_edge)
+	{
+		sched_cap_edge = sched_cap_edge ? 2 * sched_cap_edge : 256;
+		sched_edges = realloc(sched_edges, sched_cap_edge * sizeof(*sched_edges));
+	}
+	sched_edges[sched_nedges].from    = from;
+	sched_edges[sched_nedges].to      = to;
+	sched_edges[sched_nedges].latency = latency;
+	sched_nedges++;
+}
+
+/* sort the edges by the node they come from, stably, and point every node at its own */
+void sched_edges_index(int n)
+{
+	int *count = calloc(n + 1, sizeof(int));
+	struct sched_edge *sorted = malloc((sched_nedges + 1) * sizeof(*sorted));
+	for (int e=0;e<sched_nedges;e++) count[sched_edges[e].from + 1]++;
+	for (int k=0;k<n;k++) count[k+1] += count[k];
+	for (int k=0;k<n;k++) sched_nodes[k].first_succ = count[k];
+	for (int e=0;e<sched_nedges;e++) sorted[count[sched_edges[e].from]++] = sched_edges[e];
+	memcpy(sched_edges, sorted, sched_nedges * sizeof(*sorted));
+	free(sorted);
+	free(count);
+}
+
+/* dependences between the n nodes of a region */
+void sched_dependences(int n)
+{
+	sched_nedges = 0;
+	char written[SCHED_NREGS];
+	for (int j=1;j<n;j++)
+	{
+		struct sched_node *b = &sched_nodes[j];
+		int last = j == n - 1 && sched_ends_region(b->inst);
+
+		// back from j, a register written again on the way isn't the value j sees, nor one it can overwrite early
+		memset(written, 0, sizeof(written));
+		for (int i=j-1;i>=0;i--)
+		{
+			struct sched_node *a = &sched_nodes[i];
+			int latency = -1;
+			for (int k=0;k<b->nuses;k++)
+			{
+				for (int l=0;l<a->ndefs;l++)
+				{
+					if (a->defs[l] == b->uses[k] && !written[a->defs[l]] && sched_latency(a, a->defs[l]) > latency)
+					{
+						latency = sched_latency(a, a->defs[l]);
+					}
+				}
+			}
+			for (int k=0;k<b->ndefs;k++)
+			{
+				if (written[b->defs[k]]) continue;
+				for (int l=0;l<a->nuses;l++) if (a->uses[l] == b->defs[k] && latency < 0) latency = 0;
+				for (int l=0;l<a->ndefs;l++) if (a->defs[l] == b->defs[k] && latency < 0) latency = 0;
+			}
+			if (latency < 0 && (last || sched_mem_conflict(a, b))) latency = 0;
+			if (latency >= 0) sched_edge_add(i, j, latency);
+
+			for (int l=0;l<a->ndefs;l++) written[a->defs[l]] = 1;
+		}
+	}
+	sched_edges_index(n);
+}
+
+/* first pipeline of unit that's free at cycle, -1 if none is */
+int sched_unit_free(int (*free_at)[SCHED_MAX_UNITS], int unit, int cycle)
+{
+	for (int k=0;k<sched_cpu->units[unit];k++) if (free_at[unit][k] <= cycle) return k;
+	return -1;
+}
+
+/* sched_cycles: cycles the region takes issuing its nodes in the order given */
+/*
+inputs
+- order: node indices, n of them
+*/
+int sched_cycles(int *order, int n)
+{
+	int ready[SCHED_NREGS];
+	int free_at[SCHED_NUNITS][SCHED_MAX_UNITS];
+	memset(ready, 0, sizeof(ready));
+	memset(free_at, 0, sizeof(free_at));
+
+	int cycle  = 0;
+	int issued = 0;
+	int end    = 0;
+	for (int k=0;k<n;k++)
+	{
+		struct sched_node *a = &sched_nodes[order[k]];
+		struct sched_class *c = &sched_cpu->cls[a->cls];
+
+		int t = cycle;
+		for (int u=0;u<a->nuses;u++) if (ready[a->uses[u]] > t) t = ready[a->uses[u]];
+		int p;
+		while ((t == cycle && issued == sched_cpu->width) || (p = sched_unit_free(free_at, c->unit, t)) < 0) t++;
+
+		if (t != cycle) issued = 0;
+		cycle = t;
+		issued++;
+		free_at[c->unit][p] = t + c->busy;
+		for (int d=0;d<a->ndefs;d++) ready[a->defs[d]] = t + sched_latency(a, a->defs[d]);
+		if (t + c->latency > end) end = t + c->latency;
+	}
+	return end > cycle + 1 ? end : cycle + 1;
+}
+
+/* sched_list: order the region's nodes into sched_order by list scheduling */
+void sched_list(int n)
+{
+	int free_at[SCHED_NUNITS][SCHED_MAX_UNITS];
+	memset(free_at, 0, sizeof(free_at));
+
+	// heights, last to first since every dependence goes forwards
+	for (int k=n-1;k>=0;k--)
+	{
+		struct sched_node *a = &sched_nodes[k];
+		int end = k + 1 < n ? sched_nodes[k+1].first_succ : sched_nedges;
+		a->height  = sched_cpu->cls[a->cls].latency;
+		a->npreds  = 0;
+		a->earliest = 0;
+		a->done    = 0;
+		for (int e=a->first_succ;e<end;e++)
+		{
+			int h = sched_edges[e].latency + sched_nodes[sched_edges[e].to].height;
+			if (h > a->height) a->height = h;
+		}
+	}
+	for (int e=0;e<sched_nedges;e++) sched_nodes[sched_edges[e].to].npreds++;
+
+	int placed = 0;
+	for (int cycle=0;placed<n;cycle++)
+	{
+		for (int issued=0;issued<sched_cpu->width;issued++)
+		{
+			int best = -1;
+			for (int k=0;k<n;k++)
+			{
+				struct sched_node *a = &sched_nodes[k];
+				if (a->done || a->npreds || a->earliest > cycle) continue;
+				if (sched_unit_free(free_at, sched_cpu->cls[a->cls].unit, cycle) < 0) continue;
+				if (best < 0 || a->height > sched_nodes[best].height) best = k;
+			}
+			if (best < 0) break;
+
+			struct sched_node *a = &sched_nodes[best];
+			struct sched_class *c = &sched_cpu->cls[a->cls];
+			free_at[c->unit][sched_unit_free(free_at, c->unit, cycle)] = cycle + c->busy;
+			a->done = 1;
+			sched_order[placed++] = best;
+
+			int end = best + 1 < n ? sched_nodes[best+1].first_succ : sched_nedges;
+			for (int e=a->first_succ;e<end;e++)
+			{
+				struct sched_node *s = &sched_nodes[sched_edges[e].to];
+				s->npreds--;
+				if (cycle + sched_edges[e].latency > s->earliest) s->earliest = cycle + sched_edges[e].latency;
+			}
+		}
+	}
+}
+
+/* schedule the n instructions of a region starting at *link, returns the link after it */
+/*
+output
+- the cycles before and after are added to mf's
+*/
+struct a64_inst ** sched_region(struct a64_func *mf, struct a64_inst **link, int n, int reorder)
+{
+	if (n > sched_cap)
+	{
+		sched_cap   = 2 * n;
+		sched_nodes = realloc(sched_nodes, sched_cap * sizeof(*sched_nodes));
+		sched_order = realloc(sched_order, sched_cap * sizeof(int));
+	}
+
+	struct a64_inst *i = *link;
+	for (int k=0;k<n;k++,i=i->next)
+	{
+		struct sched_node *a = &sched_nodes[k];
+		a->inst = i;
+		a->cls  = sched_class_of(i);
+		sched_regs(a);
+		sched_mem(a);
+		sched_order[k] = k;
+	}
+	struct a64_inst *after = i;
+
+	int before = sched_cycles(sched_order, n);
+	mf->cycles_before += before;
+	if (!reorder || n < 3)
+	{
+		mf->cycles_after += before;
+		for (int k=0;k<n;k++) link = &(*link)->next;
+		return link;
+	}
+
+	sched_dependences(n);
+	sched_list(n);
+	int cycles = sched_cycles(sched_order, n);
+	if (cycles >= before)
+	{
+		for (int k=0;k<n;k++) sched_order[k] = k;
+		cycles = before;
+	}
+	mf->cycles_after += cycles;
+
+	for (int k=0;k<n;k++)
+	{
+		*link = sched_nodes[sched_order[k]].inst;
+		link = &(*link)->next;
+	}
+	*link = after;
+	return link;
+}
+
+/* sched_func: predict the cycles every region of a function takes, scheduling them first if reorder is set */
+/*
+output
+- mf->cycles_before and mf->cycles_after, summed over the regions, each counted once
+*/
+void sched_func(struct a64_func *mf, int reorder)
+{
+	mf->cycles_before = 0;
+	mf->cycles_after  = 0;
+
+	struct a64_inst **link = &mf->first;
+	while (*link)
+	{
+		if ((*link)->op == A64_LABEL)
+		{
+			link = &(*link)->next;
+			continue;
+		}
+
+		int n = 0;
+		for (struct a64_inst *i = *link; i && i->op != A64_LABEL; i = i->next)
+		{
+			n++;
+			if (sched_ends_region(i)) break;
+		}
+		link = sched_region(mf, link, n, reorder);
+	}
+
+	mf->last = 0;
+	for (struct a64_inst *i = mf->first; i; i = i->next) mf->last = i;
+}
@@ -0,0 +1,46 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "aarch64.h"
+
+/*
+- list scheduling of selected AArch64 code, one straight run of instructions at a time, for the core -mcpu=
+  picks
+- a core is described by how many instructions it can issue a cycle, the pipelines it has and, for every class
+  of instruction, the pipeline it goes down, how long until its result can be used and how long it keeps the
+  pipeline busy
+*/
+
+// classes of instruction the cores tell apart
+enum { SCHED_ALU, SCHED_SHIFT, SCHED_MUL, SCHED_DIV, SCHED_LOAD, SCHED_STORE, SCHED_VEC, SCHED_VMOV, SCHED_BRANCH,
+	SCHED_NCLASSES };
+
+// pipelines
+enum { SCHED_UNIT_ALU, SCHED_UNIT_MUL, SCHED_UNIT_LOAD, SCHED_UNIT_STORE, SCHED_UNIT_VEC, SCHED_UNIT_BRANCH,
+	SCHED_NUNITS };
+
+#define SCHED_MAX_UNITS 2		// pipelines of one kind a core can have
+
+struct sched_class {
+	int unit;
+	int latency;				// cycles until the result can be read
+	int busy;					// cycles before the pipeline takes the next one, 1 when it's pipelined
+};
+
+struct sched_cpu {
+	const char *name;			// as -mcpu= spells it
+	int width;					// instructions issued per cycle
+	int units[SCHED_NUNITS];	// pipelines of each kind
+	struct sched_class cls[SCHED_NCLASSES];
+};
+
+extern struct sched_cpu sched_cortex_a72;
+extern struct sched_cpu sched_cortex_a53;
+
+extern struct sched_cpu *sched_cpu;	// the one scheduled for, the Cortex-A72 of a Raspberry Pi 4 unless -mcpu= says otherwise
+
+struct sched_cpu * sched_cpu_lookup( const char *name );
+
+void sched_func( struct a64_func *mf, int reorder );
+
+#endif
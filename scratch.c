@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /*
 - supporting functions
@@ -15,16 +16,17 @@
 - scratch_free  : marks an indicated register as available, frees it up in the table
 - scratch_name  : returns the name of a register given its number "r"
 - running out of scratch registers is possible but unlikely (these would be our local var regs x9-x15)
+- scratch registers are deliberately kept out of x0-x7, so call arguments can be placed straight into the argument
+  registers without trampling on values we're still holding
 */
 
 // declare a global table for scratch values
-// To keep the calling conventions simple, calls to functions with more than six arguments may fail with a "too many arguments" error
-int reg_table[6] = {0,0,0,0,0,0};
+int reg_table[SCRATCH_COUNT] = {0,0,0,0,0,0,0};
 
 /* scratch_alloc: find unused register in the table, mark it as in use, return the register number "r"*/
 int scratch_alloc()
 {
-	for (int i=0;i<6;i++)
+	for (int i=0;i<SCRATCH_COUNT;i++)
 	{
 		if (reg_table[i] == 0) // check if reg i is unused
 		{
@@ -42,7 +44,7 @@ int scratch_alloc()
 /* scratch_free: marks indicated register as available, frees it up in the table */
 void scratch_free(int r)
 {
-	if (r >= 0 && r < 6) reg_table[r] = 0;
+	if (r >= 0 && r < SCRATCH_COUNT) reg_table[r] = 0;
 	else
 	{
 		printf("codegen error: register %i does not exist\n", r);
@@ -59,28 +61,125 @@ const char * scratch_name(int r)
 	switch (r)
 	{
 		case 0:
-		    return "x0";
+		    return "x9";
 		case 1:
-		    return "x1";
+		    return "x10";
 		case 2:
-		    return "x2";
+		    return "x11";
 		case 3:
-		    return "x3";
+		    return "x12";
 		case 4:
-		    return "x4";
+		    return "x13";
 		case 5:
-		    return "x5";
-		case 19:
-			return "x19";
+		    return "x14";
+		case 6:
+		    return "x15";
 	}
 	printf("codegen error: register %i does not exist\n", r);
 	exit(1);
 }
 
+/* scratch_save: push every scratch register that currently holds a value, so it survives a call */
+/*
+- the callee is free to clobber x9-x15, so anything still in use right before a bl has to be saved
+- registers are pushed in pairs to keep sp 16-byte aligned
+- returns how many registers were pushed, their numbers are written to saved[]
+*/
+int scratch_save(int *saved, FILE *outfil)
+{
+	int n = 0;
+	for (int i=0;i<SCRATCH_COUNT;i++)
+	{
+		if (reg_table[i]) saved[n++] = i;
+	}
+
+	for (int i=0;i+1<n;i+=2)
+	{
+		fprintf(outfil, "\tstp\t%s, %s, [sp, -16]!\n", scratch_name(saved[i]), scratch_name(saved[i+1]));
+	}
+	if (n % 2)
+	{
+		fprintf(outfil, "\tstr\t%s, [sp, -16]!\n", scratch_name(saved[n-1]));
+	}
+
+	return n;
+}
+
+/* scratch_restore: pop the registers pushed by scratch_save, in reverse order */
+void scratch_restore(int *saved, int n, FILE *outfil)
+{
+	if (n % 2)
+	{
+		fprintf(outfil, "\tldr\t%s, [sp], 16\n", scratch_name(saved[n-1]));
+	}
+	for (int i=(n/2)*2-2;i>=0;i-=2)
+	{
+		fprintf(outfil, "\tldp\t%s, %s, [sp], 16\n", scratch_name(saved[i]), scratch_name(saved[i+1]));
+	}
+}
+
+/* scratch_move_parallel: move n registers into n destinations as if all the moves happened at once */
+/*
+- needed whenever values sitting in scratch registers have to land in fixed registers (call arguments)
+- a move is only emitted once nothing still waiting needs to read its destination
+- if every remaining move is blocked we have a cycle (e.g. x0 <-> x1), which gets broken by parking one value in x16
+*/
+void scratch_move_parallel(const char **dst, const char **src, int n, FILE *outfil)
+{
+	int done[8] = {0,0,0,0,0,0,0,0};
+
+	if (n > 8)
+	{
+		printf("codegen error: too many registers to move at once\n");
+		exit(1);
+	}
+
+	// moves onto themselves are already done
+	for (int i=0;i<n;i++) if (!strcmp(dst[i], src[i])) done[i] = 1;
+
+	while (1)
+	{
+		int pending  = 0;
+		int progress = 0;
+
+		for (int i=0;i<n;i++)
+		{
+			if (done[i]) continue;
+			pending++;
+
+			// is someone else still waiting to read the register we're about to overwrite?
+			int blocked = 0;
+			for (int j=0;j<n;j++)
+			{
+				if (j != i && !done[j] && !strcmp(src[j], dst[i])) blocked = 1;
+			}
+			if (blocked) continue;
+
+			fprintf(outfil, "\tmov\t%s, %s\n", dst[i], src[i]);
+			done[i]  = 1;
+			progress = 1;
+		}
+
+		if (!pending) break;
+
+		// only cycles left, free one of them up through the intra-procedure scratch register
+		if (!progress)
+		{
+			for (int i=0;i<n;i++)
+			{
+				if (done[i]) continue;
+				fprintf(outfil, "\tmov\tx16, %s\n", src[i]);
+				src[i] = "x16";
+				break;
+			}
+		}
+	}
+}
+
 void scratch_print()
 {
 	printf("scratch table: [");
-	for (int i=0;i<6;i++)
+	for (int i=0;i<SCRATCH_COUNT;i++)
 	{
 		printf("%i ",reg_table[i]);
 	}
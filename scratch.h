@@ -1,6 +1,11 @@
 #ifndef SCRATCH_H
 #define SCRATCH_H
 
+#include <stdio.h>
+
+/* scratch registers are x9-x15: caller-saved, and never used to pass arguments */
+#define SCRATCH_COUNT (7)
+
 void scratch_print();
 
 int scratch_alloc();
@@ -9,4 +14,10 @@ void scratch_free( int r );
 
 const char * scratch_name( int r );
 
+int scratch_save( int *saved, FILE *outfil );
+
+void scratch_restore( int *saved, int n, FILE *outfil );
+
+void scratch_move_parallel( const char **dst, const char **src, int n, FILE *outfil );
+
 #endif
\ No newline at end of file
@@ -0,0 +1,570 @@
+#include "ssa.h"
+#include "cfg.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+- builds and takes down SSA form, the control-flow graph has to be built first
+  - void ssa_build( struct ir_func *f );
+  - void ssa_destroy( struct ir_func *f );
+
+- construction is the classic one by Cytron et al.:
+  - only vregs with more than one definition (locals and parameters that get assigned) need anything done,
+    temporaries are already defined exactly once
+  - phis go on the iterated dominance frontier of the blocks that define a variable
+  - renaming walks the dominator tree, giving every definition a fresh vreg
+  - parameters keep their own vreg as the value they arrive with, the backend moves x0-x7 into those
+  - a variable read on a path where it was never assigned reads a zero, the same thing an uninitialized local starts as
+- taking it down:
+  - edges from a block with two successors into a block with phis are split, so every copy has a block of its own
+  - each phi becomes a parallel copy at the end of every predecessor, sequentialized with a temporary when the copies
+    form a cycle
+  - a copy straight after the instruction that computed its source writes the destination directly instead,
+    which takes "i = i + 1" back to a single add
+*/
+
+struct ssa_stack {
+	int *vals;
+	int n;
+	int cap;
+};
+
+/* push a value on a growable int stack */
+void ssa_push(struct ssa_stack *s, int v)
+{
+	if (s->n == s->cap)
+	{
+		s->cap  = s->cap ? 2 * s->cap : 4;
+		s->vals = realloc(s->vals, s->cap * sizeof(int));
+	}
+	s->vals[s->n++] = v;
+}
+
+/* ssa_defs: the instruction that defines each vreg, 0 for parameters, by vreg number */
+struct ir_inst ** ssa_defs(struct ir_func *f)
+{
+	struct ir_inst **defs = calloc(f->nvregs + 1, sizeof(*defs));
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			if (i->dst >= 0) defs[i->dst] = i;
+		}
+	}
+	return defs;
+}
+
+/* dominance frontiers, by block id, found by walking up from the predecessors of every join point */
+struct ir_block *** ssa_frontiers(struct ir_func *f, int **ndf)
+{
+	struct ir_block ***df = calloc(f->nblocks + 1, sizeof(*df));
+	int *cap = calloc(f->nblocks + 1, sizeof(int));
+	*ndf = calloc(f->nblocks + 1, sizeof(int));
+
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		if (bb->npreds < 2) continue;
+		for (int p=0;p<bb->npreds;p++)
+		{
+			for (struct ir_block *r = bb->preds[p]; r && r != bb->idom; r = r->idom)
+			{
+				int id = r->id;
+				if ((*ndf)[id] && df[id][(*ndf)[id] - 1] == bb) continue;	// added from another pred already
+				if ((*ndf)[id] == cap[id])
+				{
+					cap[id] = cap[id] ? 2 * cap[id] : 4;
+					df[id]  = realloc(df[id], cap[id] * sizeof(*df[id]));
+				}
+				df[id][(*ndf)[id]++] = bb;
+			}
+		}
+	}
+
+	free(cap);
+	return df;
+}
+
+/* put an empty phi for variable v at the top of bb */
+void ssa_phi_insert(struct ir_block *bb, int v)
+{
+	struct ir_inst *phi = ir_inst_create(IR_PHI, v, IR_NO_REG, IR_NO_REG);
+	phi->imm        = v;		// the variable, until renaming gives the phi a vreg of its own
+	phi->nargs      = bb->npreds;
+	phi->args       = malloc((bb->npreds + 1) * sizeof(int));
+	phi->phi_blocks = malloc((bb->npreds + 1) * sizeof(*phi->phi_blocks));
+	for (int p=0;p<bb->npreds;p++)
+	{
+		phi->args[p]       = IR_NO_REG;
+		phi->phi_blocks[p] = bb->preds[p];
+	}
+
+	if (bb->first) ir_inst_insert_before(bb->first, phi);
+	else           ir_inst_append(bb, phi);
+}
+
+/* the value read by a variable that was never assigned, a zero made once per function in the entry block */
+int ssa_undef(struct ir_func *f, int *undef)
+{
+	if (*undef == IR_NO_REG)
+	{
+		*undef = ir_vreg_new(f);
+		ir_inst_insert_before(f->blocks->last, ir_inst_create(IR_CONST, *undef, IR_NO_REG, IR_NO_REG));
+	}
+	return *undef;
+}
+
+/* ssa_build: put a function in SSA form */
+void ssa_build(struct ir_func *f)
+{
+	int nv = f->nvregs;
+	int nb = f->nblocks;
+
+	// variables are the vregs defined more than once, a parameter's first definition is on entry
+	int *ndefs = calloc(nv + 1, sizeof(int));
+	for (int p=0;p<f->nparams;p++) ndefs[p]++;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			if (i->dst >= 0) ndefs[i->dst]++;
+		}
+	}
+	char *is_var = calloc(nv + 1, 1);
+	int nvars = 0;
+	for (int v=0;v<nv;v++)
+	{
+		is_var[v] = ndefs[v] > 1;
+		nvars += is_var[v];
+	}
+	free(ndefs);
+	if (!nvars)
+	{
+		free(is_var);
+		return;
+	}
+
+	// blocks defining each variable, one list per variable packed into one array
+	int *dstart = calloc(nv + 2, sizeof(int));
+	for (int p=0;p<f->nparams;p++) if (is_var[p]) dstart[p + 1]++;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			if (i->dst >= 0 && is_var[i->dst]) dstart[i->dst + 1]++;
+		}
+	}
+	for (int v=0;v<nv;v++) dstart[v + 1] += dstart[v];
+	struct ir_block **dblocks = calloc(dstart[nv] + 1, sizeof(*dblocks));
+	int *dfill = calloc(nv + 1, sizeof(int));
+	for (int p=0;p<f->nparams;p++) if (is_var[p]) dblocks[dstart[p] + dfill[p]++] = f->blocks;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			if (i->dst >= 0 && is_var[i->dst]) dblocks[dstart[i->dst] + dfill[i->dst]++] = bb;
+		}
+	}
+
+	// phis on the iterated dominance frontier
+	int *ndf;
+	struct ir_block ***df = ssa_frontiers(f, &ndf);
+	int *has_phi = calloc(nb + 1, sizeof(int));
+	int *queued  = calloc(nb + 1, sizeof(int));
+	struct ir_block **work = calloc(nb + dstart[nv] + 1, sizeof(*work));
+	for (int b=0;b<=nb;b++) has_phi[b] = queued[b] = -1;
+
+	for (int v=0;v<nv;v++)
+	{
+		if (!is_var[v]) continue;
+
+		int nw = 0;
+		for (int k=dstart[v];k<dstart[v + 1];k++)
+		{
+			struct ir_block *bb = dblocks[k];
+			if (queued[bb->id] == v) continue;
+			queued[bb->id] = v;
+			work[nw++] = bb;
+		}
+		while (nw)
+		{
+			struct ir_block *x = work[--nw];
+			for (int k=0;k<ndf[x->id];k++)
+			{
+				struct ir_block *y = df[x->id][k];
+				if (has_phi[y->id] == v) continue;
+				has_phi[y->id] = v;
+				ssa_phi_insert(y, v);
+				if (queued[y->id] != v)
+				{
+					queued[y->id] = v;
+					work[nw++] = y;
+				}
+			}
+		}
+	}
+
+	// renaming, over the dominator tree with an explicit stack
+	struct ssa_stack *names = calloc(nv + 1, sizeof(*names));
+	struct ssa_stack pushed = { 0, 0, 0 };	// variables pushed so far, popped again on the way back up
+	int undef = IR_NO_REG;
+
+	for (int p=0;p<f->nparams;p++) if (is_var[p]) ssa_push(&names[p], p);
+
+	struct ir_block **stack = calloc(f->nrpo + 1, sizeof(*stack));
+	int *mark     = calloc(f->nrpo + 1, sizeof(int));
+	int *next_kid = calloc(nb + 1, sizeof(int));
+	int sp = 0;
+
+	stack[sp++] = f->blocks;
+	int entered = 0;
+	while (sp)
+	{
+		struct ir_block *bb = stack[sp - 1];
+
+		if (!entered)
+		{
+			mark[sp - 1] = pushed.n;
+
+			for (struct ir_inst *i = bb->first; i; i = i->next)
+			{
+				if (i->op != IR_PHI)
+				{
+					int *slot;
+					for (int k=0;(slot = ir_inst_use(i, k));k++)
+					{
+						int v = *slot;
+						if (v < 0 || v >= nv || !is_var[v]) continue;
+						if (names[v].n)
+						{
+							*slot = names[v].vals[names[v].n - 1];
+							continue;
+						}
+						*slot = ssa_undef(f, &undef);
+					}
+				}
+
+				int v = i->op == IR_PHI ? (int) i->imm : i->dst;
+				if (v >= 0 && v < nv && is_var[v])
+				{
+					i->dst = ir_vreg_new(f);
+					ssa_push(&names[v], i->dst);
+					ssa_push(&pushed, v);
+				}
+			}
+
+			// fill in this block's argument of the phis in its successors
+			for (int s=0;s<bb->nsuccs;s++)
+			{
+				struct ir_block *succ = bb->succs[s];
+				int k = cfg_pred_index(succ, bb);
+				for (struct ir_inst *phi = succ->first; phi && phi->op == IR_PHI; phi = phi->next)
+				{
+					int v = phi->imm;
+					phi->args[k] = names[v].n ? names[v].vals[names[v].n - 1] : ssa_undef(f, &undef);
+				}
+			}
+		}
+
+		if (next_kid[bb->id] < bb->ndom_children)
+		{
+			stack[sp++] = bb->dom_children[next_kid[bb->id]++];
+			entered = 0;
+			continue;
+		}
+
+		// leaving bb: pop every name it pushed
+		while (pushed.n > mark[sp - 1])
+		{
+			int v = pushed.vals[--pushed.n];
+			names[v].n--;
+		}
+		sp--;
+		entered = 1;
+	}
+
+	// phis only needed their variable while renaming
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i && i->op == IR_PHI; i = i->next) i->imm = 0;
+	}
+
+	for (int v=0;v<nv;v++) free(names[v].vals);
+	free(names);
+	free(pushed.vals);
+	free(stack);
+	free(mark);
+	free(next_kid);
+	for (int b=0;b<=nb;b++) free(df[b]);
+	free(df);
+	free(ndf);
+	free(has_phi);
+	free(queued);
+	free(work);
+	free(dstart);
+	free(dblocks);
+	free(dfill);
+	free(is_var);
+}
+
+/* ssa_dce: delete every instruction whose result nothing with a side effect ever depends on */
+/*
+- mark and sweep rather than counting uses, so a loop-carried phi that's never read outside its own cycle goes too
+- returns how many instructions were deleted
+*/
+int ssa_dce(struct ir_func *f)
+{
+	struct ir_inst **defs = ssa_defs(f);
+	char *live = calloc(f->nvregs + 1, 1);
+	int *work = calloc(f->nvregs + 1, sizeof(int));
+	int nw = 0;
+
+	// roots: everything that has to happen no matter what
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			if (!ir_has_side_effects(i)) continue;
+			int *slot;
+			for (int k=0;(slot = ir_inst_use(i, k));k++)
+			{
+				if (*slot >= 0 && !live[*slot])
+				{
+					live[*slot] = 1;
+					work[nw++] = *slot;
+				}
+			}
+		}
+	}
+
+	// and whatever those read, transitively
+	while (nw)
+	{
+		struct ir_inst *d = defs[work[--nw]];
+		if (!d) continue;
+		int *slot;
+		for (int k=0;(slot = ir_inst_use(d, k));k++)
+		{
+			if (*slot >= 0 && !live[*slot])
+			{
+				live[*slot] = 1;
+				work[nw++] = *slot;
+			}
+		}
+	}
+
+	int removed = 0;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		struct ir_inst *next;
+		for (struct ir_inst *i = bb->first; i; i = next)
+		{
+			next = i->next;
+			if (ir_has_side_effects(i) || i->dst < 0 || live[i->dst]) continue;
+			ir_inst_remove(i);
+			removed++;
+		}
+	}
+
+	free(defs);
+	free(live);
+	free(work);
+	return removed;
+}
+
+/* ssa_copies: emit the parallel copy dst[k] = src[k] for all k as plain moves in front of pos */
+/*
+- a copy can go once nothing still waiting reads its destination
+- when everything left is waiting on something else the copies form cycles, and one destination gets saved
+  in a fresh temporary to break them
+*/
+void ssa_copies(struct ir_func *f, struct ir_inst *pos, int *dst, int *src, int n)
+{
+	int left = n;
+	char *done = calloc(n + 1, 1);
+
+	for (int k=0;k<n;k++)
+	{
+		if (src[k] == IR_NO_REG || src[k] == dst[k])
+		{
+			done[k] = 1;
+			left--;
+		}
+	}
+
+	while (left)
+	{
+		int progress = 0;
+		for (int k=0;k<n;k++)
+		{
+			if (done[k]) continue;
+			int blocked = 0;
+			for (int j=0;j<n && !blocked;j++)
+			{
+				if (!done[j] && j != k && src[j] == dst[k]) blocked = 1;
+			}
+			if (blocked) continue;
+
+			ir_inst_insert_before(pos, ir_inst_create(IR_MOV, dst[k], src[k], IR_NO_REG));
+			done[k] = 1;
+			left--;
+			progress = 1;
+		}
+		if (progress) continue;
+
+		// only cycles left
+		for (int k=0;k<n;k++)
+		{
+			if (done[k]) continue;
+			int t = ir_vreg_new(f);
+			ir_inst_insert_before(pos, ir_inst_create(IR_MOV, t, dst[k], IR_NO_REG));
+			for (int j=0;j<n;j++)
+			{
+				if (!done[j] && src[j] == dst[k]) src[j] = t;
+			}
+			break;
+		}
+	}
+
+	free(done);
+}
+
+/* split the edge from pred into bb with a block of its own, returns that block */
+struct ir_block * ssa_split_edge(struct ir_func *f, struct ir_block *pred, struct ir_block *bb)
+{
+	struct ir_block *mid = ir_block_create(f);
+	struct ir_inst *j = ir_inst_create(IR_JMP, IR_NO_REG, IR_NO_REG, IR_NO_REG);
+	j->target = bb;
+	ir_inst_append(mid, j);
+
+	struct ir_inst *t = pred->last;
+	if (t->target == bb)       t->target       = mid;
+	if (t->target_false == bb) t->target_false = mid;
+
+	// right between the two when pred could fall into bb anyway, otherwise out of everyone's way at the end
+	if (pred->next == bb) ir_block_place_before(f, bb, mid);
+	else                  ir_block_place(f, mid);
+
+	for (struct ir_inst *phi = bb->first; phi && phi->op == IR_PHI; phi = phi->next)
+	{
+		for (int k=0;k<phi->nargs;k++)
+		{
+			if (phi->phi_blocks[k] == pred) phi->phi_blocks[k] = mid;
+		}
+	}
+	return mid;
+}
+
+/* ssa_coalesce: "t = x op y; v = mov t" becomes "v = x op y" when v isn't touched in between and t isn't used again */
+int ssa_coalesce(struct ir_func *f)
+{
+	int *uses = calloc(f->nvregs + 1, sizeof(int));
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			int *slot;
+			for (int k=0;(slot = ir_inst_use(i, k));k++) if (*slot >= 0) uses[*slot]++;
+		}
+	}
+
+	int merged = 0;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		struct ir_inst *next;
+		for (struct ir_inst *m = bb->first; m; m = next)
+		{
+			next = m->next;
+			if (m->op != IR_MOV) continue;
+			int v = m->dst;
+			int t = m->src[0];
+			if (t == v || t < f->nparams || uses[t] != 1) continue;
+
+			// find t's definition earlier in this block, giving up if v is read or written on the way
+			struct ir_inst *d = m->prev;
+			int clash = 0;
+			for (; d && d->dst != t; d = d->prev)
+			{
+				if (d->dst == v) clash = 1;
+				int *slot;
+				for (int k=0;(slot = ir_inst_use(d, k));k++) if (*slot == v) clash = 1;
+				if (clash) break;
+			}
+			if (!d || clash) continue;
+
+			d->dst = v;
+			ir_inst_remove(m);
+			uses[t] = 0;
+			merged++;
+		}
+	}
+
+	free(uses);
+	return merged;
+}
+
+/* ssa_destroy: replace every phi by copies, leaving ordinary IR the backends can take */
+void ssa_destroy(struct ir_func *f)
+{
+	// a branch whose targets are the same block is just a jump, and copies can go in front of a jump safely
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		struct ir_inst *t = bb->last;
+		if (t && t->op == IR_BR && t->target == t->target_false)
+		{
+			t->op     = IR_JMP;
+			t->src[0] = IR_NO_REG;
+		}
+	}
+
+	// split critical edges into blocks with phis
+	int split = 0;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		if (!bb->first || bb->first->op != IR_PHI) continue;
+		for (int p=0;p<bb->npreds;p++)
+		{
+			if (bb->preds[p]->nsuccs < 2) continue;
+			ssa_split_edge(f, bb->preds[p], bb);
+			split = 1;
+		}
+	}
+	if (split) cfg_build(f);
+
+	// copies at the end of every predecessor
+	int *dst = 0;
+	int *src = 0;
+	int cap = 0;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		int nphis = 0;
+		for (struct ir_inst *i = bb->first; i && i->op == IR_PHI; i = i->next) nphis++;
+		if (!nphis) continue;
+
+		if (nphis > cap)
+		{
+			cap = nphis;
+			dst = realloc(dst, cap * sizeof(int));
+			src = realloc(src, cap * sizeof(int));
+		}
+
+		for (int p=0;p<bb->npreds;p++)
+		{
+			int n = 0;
+			for (struct ir_inst *i = bb->first; i && i->op == IR_PHI; i = i->next)
+			{
+				dst[n]   = i->dst;
+				src[n++] = i->args[p];
+			}
+			ssa_copies(f, bb->preds[p]->last, dst, src, n);
+		}
+
+		while (bb->first && bb->first->op == IR_PHI) ir_inst_remove(bb->first);
+	}
+	free(dst);
+	free(src);
+
+	ssa_coalesce(f);
+	cfg_build(f);
+}
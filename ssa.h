@@ -0,0 +1,17 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include "ir.h"
+
+/*
+- SSA form for IR functions: after ssa_build every vreg has exactly one definition, with phis where control flow merges
+- the backends can't handle phis, ssa_destroy turns them back into copies before instruction selection
+*/
+
+void ssa_build( struct ir_func *f );
+int ssa_dce( struct ir_func *f );
+void ssa_destroy( struct ir_func *f );
+
+struct ir_inst ** ssa_defs( struct ir_func *f );
+
+#endif
@@ -3,6 +3,7 @@
 #include "scratch.h"
 #include "label.h"
 #include "library.h"
+#include "string_pool.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -13,6 +14,8 @@ extern int isvoid;
 extern int yylineno;
 
 extern int func_label;
+extern int func_entry_label;
+extern const char *func_name;
 
 /* create a statement */
 /*
@@ -214,6 +217,235 @@ void stmt_typecheck(struct stmt *s)
 	stmt_typecheck(s->next);
 }
 
+/*
+PRINT LOWERING
+- print a, " is ", b, "\n"; used to be one bl per argument, each of which ended up in printf
+- now constant arguments are merged into a descriptor string at compile time and runtime arguments
+  are passed alongside it in x1-x7, so the statement above is one call:
+  - print_values("\001 is \001\n", a, b);
+- each runtime argument shows up in the descriptor as one of the PRINT_ARG_* marker bytes from library.h
+- the descriptor is built from the decoded bytes and goes through the string pool, so identical print statements
+  share one
+*/
+
+// how many runtime values we try to keep live at once while building up one call, leaves room to evaluate the rest
+#define PRINT_CHUNK_ARGS 4
+
+/* append text to a growable descriptor string */
+void print_desc_append(char **desc, int *len, const char *text)
+{
+	int n = strlen(text);
+	*desc = realloc(*desc, *len + n + 1);
+	memcpy(*desc + *len, text, n + 1);
+	*len += n;
+}
+
+/* does the text have a byte print_values would take for a marker */
+int print_text_has_marker(const char *text)
+{
+	for (const char *c = text; *c; c++)
+	{
+		if (*c >= PRINT_ARG_INTEGER && *c <= PRINT_ARG_STRING) return 1;
+	}
+	return 0;
+}
+
+/* can this print argument be folded into the descriptor at compile time */
+/*
+- not when it holds a byte that reads as a marker, print_values would go looking for an argument that was never
+  passed, those are printed at runtime like any other string or character
+*/
+int print_expr_is_constant(struct expr *e)
+{
+	switch (e->kind)
+	{
+		case EXPR_INT_LITERAL:
+		case EXPR_BOOLEAN_LITERAL:
+			return 1;
+		case EXPR_STRING_LITERAL:
+		{
+			char *text = string_pool_decode(e->string_literal);
+			int marker = print_text_has_marker(text);
+			free(text);
+			return !marker;
+		}
+		case EXPR_CHAR_LITERAL:
+			// a null character would cut the descriptor short
+			return e->literal_value != 0 && (e->literal_value < PRINT_ARG_INTEGER || e->literal_value > PRINT_ARG_STRING);
+		default:
+			return 0;
+	}
+}
+
+/* fold a constant print argument into the descriptor */
+void print_desc_constant(char **desc, int *len, struct expr *e)
+{
+	char text[32];
+
+	switch (e->kind)
+	{
+		case EXPR_INT_LITERAL:
+			sprintf(text, "%ld", e->literal_value);
+			print_desc_append(desc, len, text);
+			break;
+		case EXPR_BOOLEAN_LITERAL:
+			print_desc_append(desc, len, e->literal_value ? "true" : "false");
+			break;
+		case EXPR_CHAR_LITERAL:
+			text[0] = (char) e->literal_value;
+			text[1] = 0;
+			print_desc_append(desc, len, text);
+			break;
+		case EXPR_STRING_LITERAL:
+		{
+			char *body = string_pool_decode(e->string_literal);
+			print_desc_append(desc, len, body);
+			free(body);
+			break;
+		}
+	}
+}
+
+/* append the marker byte for a runtime print argument, based on its type */
+void print_desc_marker(char **desc, int *len, struct expr *e)
+{
+	char marker[2] = { 0, 0 };
+	struct type *e_type = expr_typecheck(e);
+	switch (e_type->kind)
+	{
+		case TYPE_INTEGER:
+			marker[0] = PRINT_ARG_INTEGER;
+			break;
+		case TYPE_BOOLEAN:
+			marker[0] = PRINT_ARG_BOOLEAN;
+			break;
+		case TYPE_STRING:
+			marker[0] = PRINT_ARG_STRING;
+			break;
+		case TYPE_CHARACTER:
+			marker[0] = PRINT_ARG_CHARACTER;
+			break;
+	}
+	type_delete(e_type);
+	print_desc_append(desc, len, marker);
+}
+
+/* generate code for "return f(...)" as a jump instead of a call */
+/*
+inputs
+- e: the returned expression
+- outfil: output assembly file
+output
+- 1 if the return was generated as a tail call, 0 if it still needs generating
+notes
+- the arguments are set up exactly like a normal call, nothing is live across it
+- a call to the function we're in loops back to just after the prologue, so the frame is reused
+- anything else tears the frame down first and branches, the callee returns straight to our caller
+- calls with stack arguments are left alone, our incoming argument area may be too small for them
+*/
+int stmt_codegen_tail_call(struct expr *e, FILE *outfil)
+{
+	while (e && e->kind == EXPR_GROUP) e = e->right;
+	if (!e) return 0;
+
+	const char *callee;
+	struct expr *args[EXPR_CALL_REG_ARGS];
+	int nargs = 0;
+
+	if (e->kind == EXPR_FUNCCALL)
+	{
+		callee = e->left->name;
+		for (struct expr *er = e->right; er; er = er->next)
+		{
+			if (nargs == EXPR_CALL_REG_ARGS) return 0;
+			args[nargs++] = er;
+		}
+	}
+	else if (e->kind == EXPR_EXP)
+	{
+		callee = "integer_power";
+		args[nargs++] = e->left;
+		args[nargs++] = e->right;
+	}
+	else
+	{
+		return 0;
+	}
+
+	int stack_bytes = expr_codegen_args(args, nargs, outfil);
+	if (stack_bytes)
+	{
+		fprintf(outfil, "\tadd\tsp, sp, %i\n", stack_bytes);
+	}
+
+	if (func_name && !strcmp(callee, func_name))
+	{
+		fprintf(outfil, "\tb\t%s\n", label_name(func_entry_label));
+	}
+	else
+	{
+		fprintf(outfil, "\tldp\tx29, x30, [sp], %d\n", STACK_SIZE);
+		fprintf(outfil, "\tb\t%s\n", callee);
+	}
+
+	return 1;
+}
+
+/* generate code for a print statement */
+void stmt_codegen_print(struct expr *e, FILE *outfil)
+{
+	while (e)
+	{
+		char *desc = 0;
+		int  len   = 0;
+		int  regs[PRINT_VALUES_MAX_ARGS];
+		int  nargs = 0;
+
+		print_desc_append(&desc, &len, "");
+
+		// gather arguments until we run out of them or of registers to hold them in
+		for (; e; e = e->next)
+		{
+			if (print_expr_is_constant(e))
+			{
+				print_desc_constant(&desc, &len, e);
+				continue;
+			}
+
+			// calls inside an argument save whatever we're holding, so the only limit is registers
+			if (nargs == PRINT_CHUNK_ARGS) break;
+
+			expr_codegen(e, outfil);
+			regs[nargs++] = e->reg;
+
+			// mark where this value goes in the output
+			print_desc_marker(&desc, &len, e);
+		}
+
+		// runtime values go in x1-x7 in order, however they happened to be allocated
+		const char *dst[PRINT_VALUES_MAX_ARGS];
+		const char *src[PRINT_VALUES_MAX_ARGS];
+		char arg_names[PRINT_VALUES_MAX_ARGS][4];
+		for (int i=0;i<nargs;i++)
+		{
+			sprintf(arg_names[i], "x%i", i+1);
+			dst[i] = arg_names[i];
+			src[i] = scratch_name(regs[i]);
+		}
+		scratch_move_parallel(dst, src, nargs, outfil);
+
+		// the descriptor goes in x0 last, it may have been holding one of the values
+		const char *desc_label = string_pool_name(string_pool_intern_text(desc));
+		fprintf(outfil, "\tadrp\tx0, %s\n", desc_label);
+		fprintf(outfil, "\tadd\tx0, x0, :lo12:%s\n", desc_label);
+		fprintf(outfil, "\tbl\tprint_values\n");
+
+		for (int i=0;i<nargs;i++) scratch_free(regs[i]);
+
+		free(desc);
+	}
+}
+
 /* stmt code generation */
 void stmt_codegen(struct stmt *s, FILE *outfil)
 {
@@ -316,54 +548,32 @@ void stmt_codegen(struct stmt *s, FILE *outfil)
 			if (s->next_expr)
 			{
 				expr_codegen(s->next_expr, outfil);
+				scratch_free(s->next_expr->reg);
 			}
 			// it's time to leave
 			fprintf(outfil, "\tb\t%s\n", label_name(lbl_top));
 			fprintf(outfil, "%s:\n", label_name(lbl_don));
 			break;
 		case STMT_PRINT:   	// 4
-			// struct expr *s_expr = s->expr;
-			while (s->expr)
-			{
-				// fprintf(outfil, "");
+			// the whole statement becomes as few print_values calls as possible
+			stmt_codegen_print(s->expr, outfil);
+			break;
+		case STMT_RETURN:  	// 5
+			// returning the result of a call never needs to come back here
+			if (stmt_codegen_tail_call(s->expr, outfil)) break;
 
+			// a bare "return;" is parsed as an empty expression, there's no value to hand back
+			if (s->expr && (s->expr->kind != EXPR_ASSIGN || s->expr->left))
+			{
 				expr_codegen(s->expr, outfil);
-				// fprintf(outfil, "\tMOV %s, ")
-
-				// TODO fix array element printing, might be printing the address of the array instead of the element?
-
-				// TODO stress test printing and see if it's gonna have to forcibly send registers other than x0 to print, which would be bad
-
-				struct type *e_type = expr_typecheck(s->expr);
-				switch (e_type->kind)
-				{
-					case TYPE_INTEGER:
-						fprintf(outfil, "\tbl\tprint_integer\n");
-						break;
-					case TYPE_BOOLEAN:
-						fprintf(outfil, "\tbl\tprint_boolean\n");
-						break;
-					case TYPE_STRING:
-						fprintf(outfil, "\tbl\tprint_string\n");
-						break;
-					case TYPE_CHARACTER:
-						fprintf(outfil, "\tbl\tprint_character\n");
-						break;
-				}
-
+				// the return value goes back in x0
+				fprintf(outfil, "\tmov\tx0, %s\n", scratch_name(s->expr->reg));
 				scratch_free(s->expr->reg);
-				if (s->expr->next) s->expr = s->expr->next;
-				else               break;
 			}
-			break;
-		case STMT_RETURN:  	// 5
-			expr_codegen(s->expr, outfil);
-			// print some arm assembly
-			// fprintf(outfil,"\tmov %s, %s")
-			scratch_free(s->expr->reg);
 
 			// branch to our function epilogue
-			fprintf(outfil,"\tbl\t%s\n",label_name(func_label));
+			fprintf(outfil,"\tb\t%s\n",label_name(func_label));
+			break;
 		case STMT_BLOCK:    // 6
 			stmt_codegen(s->body, outfil);
 			break;
@@ -32,6 +32,13 @@ void stmt_resolve( struct stmt *s );
 void stmt_typecheck( struct stmt *s );
 
 void stmt_codegen( struct stmt *s, FILE *outfil );
+void stmt_codegen_print( struct expr *e, FILE *outfil );
+int  stmt_codegen_tail_call( struct expr *e, FILE *outfil );
+
+void print_desc_append( char **desc, int *len, const char *text );
+int  print_expr_is_constant( struct expr *e );
+void print_desc_constant( char **desc, int *len, struct expr *e );
+void print_desc_marker( char **desc, int *len, struct expr *e );
 
 void stmt_print( struct stmt *s, int indent );
 void stmt_print_tabs( int indent );
@@ -0,0 +1,230 @@
+#include "string_pool.h"
+#include "hash_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/*
+- every string literal the code generator comes across gets interned here instead of being emitted on the spot
+  - int string_pool_intern( const char *literal );
+  - int string_pool_intern_text( const char *text );
+  - char * string_pool_decode( const char *literal );
+  - const char * string_pool_name( int label );
+  - int string_pool_label( const char *name );
+  - void string_pool_keep( int label );
+  - int string_pool_prune( int *bytes );
+  - const char * string_pool_text( int label );
+  - int string_pool_next( int label );
+  - void string_pool_codegen( FILE *outfil );
+
+- string_pool_intern  : looks the literal up in the pool, adds it if it's new, and returns its label number either way
+  - identical literals share one label, so "\n" printed in twenty places only exists once in the binary
+- string_pool_intern_text : the same for bytes that are already decoded, what the print descriptors are built from
+- string_pool_decode  : the bytes a literal stands for, with the escapes the assembler's .string always gave them:
+  \n \t \r \b \f, up to three octal digits, \x and every hex digit after it, and a backslash followed by anything
+  else that character, cut at the first null since nothing prints past it
+  - literals are decoded once, here, and the pool only ever holds bytes, so the assembler, the VM and the object
+    writer can't read one differently
+- string_pool_name    : returns the label in string form, ex. label 3 = ".LC3"
+- string_pool_label   : the other way around, ".LC3" = label 3, -1 for a name that isn't a pool label
+- string_pool_keep    : marks a string as still used by the code that's left after dead code went away
+- string_pool_prune   : drops every string that wasn't kept, so strings only dead functions used aren't emitted
+  - a dropped string that gets interned again comes back
+- string_pool_text    : the bytes of a pooled string, for running the program without assembling it
+- string_pool_next    : walks the strings string_pool_codegen would emit, in the same order, for writing objects directly
+- string_pool_codegen : emits the whole pool once at the end of the file into a mergeable .rodata.str1.1 section
+  - every byte that isn't a plain printable character goes out as a 3 digit octal escape, which .string reads back
+    as exactly that byte
+  - code only ever references the pool labels, so functions never have to hop out of .text mid-body
+*/
+
+struct string_pool_entry {
+	char *text;     // the decoded bytes, null terminated
+	int label;
+	int kept;       // marked by string_pool_keep since the last prune
+	int dropped;    // pruned, not emitted
+	struct string_pool_entry *next;
+};
+
+struct hash_table *string_pool_table = 0;   // decoded bytes -> pool entry
+struct string_pool_entry *string_pool_head = 0; // entries in the order they were interned
+struct string_pool_entry *string_pool_tail = 0;
+
+int string_pool_count = 0;
+
+/* string_pool_intern_text: return the label of a decoded string, adding it to the pool if it hasn't been seen yet */
+int string_pool_intern_text(const char *text)
+{
+	// create the table the first time anything is interned
+	if (!string_pool_table) string_pool_table = hash_table_create(0, 0);
+
+	// already pooled, just reuse its label
+	struct string_pool_entry *p = hash_table_lookup(string_pool_table, text);
+	if (p)
+	{
+		p->dropped = 0;
+		return p->label;
+	}
+
+	// otherwise create a new entry and append it so output order matches source order
+	p = calloc(1, sizeof(*p));
+	p->text  = strdup(text);
+	p->label = string_pool_count++;
+
+	hash_table_insert(string_pool_table, text, p);
+
+	if (string_pool_tail) string_pool_tail->next = p;
+	else                  string_pool_head       = p;
+	string_pool_tail = p;
+
+	return p->label;
+}
+
+/* string_pool_intern: return the label of a quoted literal as written in the source */
+int string_pool_intern(const char *literal)
+{
+	char *text = string_pool_decode(literal);
+	int label = string_pool_intern_text(text);
+	free(text);
+	return label;
+}
+
+/* string_pool_decode: the null terminated bytes a quoted literal stands for, in a new buffer */
+char * string_pool_decode(const char *literal)
+{
+	char *out = malloc(strlen(literal) + 1);
+	int n = 0;
+	for (const char *c = literal + 1; *c && *c != '"'; c++)
+	{
+		if (*c != '\\' || !c[1])
+		{
+			out[n++] = *c;
+			continue;
+		}
+
+		c++;
+		int v = 0;
+		if (*c >= '0' && *c <= '7')
+		{
+			// up to three octal digits
+			for (int k=0;k<3 && *c >= '0' && *c <= '7';k++,c++) v = v*8 + (*c - '0');
+			c--;
+		}
+		else if (*c == 'x' && isxdigit((unsigned char) c[1]))
+		{
+			// every hex digit that follows, keeping the low byte of the value
+			for (c++; isxdigit((unsigned char) *c); c++) v = (v*16 + (isdigit((unsigned char) *c) ? *c - '0' : tolower((unsigned char) *c) - 'a' + 10)) & 0xff;
+			c--;
+		}
+		else
+		{
+			switch (*c)
+			{
+				case 'n': v = '\n'; break;
+				case 't': v = '\t'; break;
+				case 'r': v = '\r'; break;
+				case 'b': v = '\b'; break;
+				case 'f': v = '\f'; break;
+				default:  v = *c;   break;
+			}
+		}
+		if (!(char) v) break;
+		out[n++] = (char) v;
+	}
+	out[n] = 0;
+	return out;
+}
+
+/* string_pool_name: returns the name of a pooled string given its label number */
+const char * string_pool_name(int label)
+{
+	char *label_str = malloc(sizeof(char)*16);
+
+	sprintf(label_str, ".LC%i", label);
+
+	return label_str;
+}
+
+/* string_pool_label: returns the label number of a pooled string given its name, -1 if it isn't one */
+int string_pool_label(const char *name)
+{
+	if (!name || strncmp(name, ".LC", 3)) return -1;
+	return atoi(name + 3);
+}
+
+/* string_pool_keep: mark a pooled string as used, so the next prune leaves it be */
+void string_pool_keep(int label)
+{
+	for (struct string_pool_entry *p = string_pool_head; p; p = p->next)
+	{
+		if (p->label == label) p->kept = 1;
+	}
+}
+
+/* string_pool_prune: drop every string not kept since the last prune */
+/*
+outputs
+- how many strings were dropped, with the bytes they would have taken added to *bytes
+*/
+int string_pool_prune(int *bytes)
+{
+	int dropped = 0;
+	for (struct string_pool_entry *p = string_pool_head; p; p = p->next)
+	{
+		if (!p->kept && !p->dropped)
+		{
+			p->dropped = 1;
+			*bytes += strlen(p->text) + 1;
+			dropped++;
+		}
+		p->kept = 0;
+	}
+	return dropped;
+}
+
+/* string_pool_text: the null terminated bytes of a pooled string */
+const char * string_pool_text(int label)
+{
+	for (struct string_pool_entry *p = string_pool_head; p; p = p->next)
+	{
+		if (p->label == label) return p->text;
+	}
+	return 0;
+}
+
+/* string_pool_next: label of the first string emitted after label (-1 for the very first), -1 when there are no more */
+int string_pool_next(int label)
+{
+	for (struct string_pool_entry *p = string_pool_head; p; p = p->next)
+	{
+		if (p->label > label && !p->dropped) return p->label;
+	}
+	return -1;
+}
+
+/* string_pool_codegen: emit every pooled string into one mergeable read-only section */
+void string_pool_codegen(FILE *outfil)
+{
+	// nothing to do if the program never used a string, or only in code that went away
+	struct string_pool_entry *p = string_pool_head;
+	while (p && p->dropped) p = p->next;
+	if (!p) return;
+
+	// "aMS" = allocated, mergeable, null terminated strings with an entity size of 1 byte
+	fprintf(outfil, "\t.section\t.rodata.str1.1,\"aMS\",@progbits,1\n");
+
+	for (; p; p = p->next)
+	{
+		if (p->dropped) continue;
+		fprintf(outfil, "%s:\n", string_pool_name(p->label));
+		fprintf(outfil, "\t.string\t\"");
+		for (const char *c = p->text; *c; c++)
+		{
+			if (*c >= ' ' && *c <= '~' && *c != '"' && *c != '\\') fputc(*c, outfil);
+			else                                                 fprintf(outfil, "\\%03o", (unsigned char) *c);
+		}
+		fprintf(outfil, "\"\n");
+	}
+}
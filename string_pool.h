@@ -0,0 +1,26 @@
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include <stdio.h>
+
+int string_pool_intern( const char *literal );
+
+int string_pool_intern_text( const char *text );
+
+char * string_pool_decode( const char *literal );
+
+const char * string_pool_name( int label );
+
+int string_pool_label( const char *name );
+
+void string_pool_keep( int label );
+
+int string_pool_prune( int *bytes );
+
+const char * string_pool_text( int label );
+
+int string_pool_next( int label );
+
+void string_pool_codegen( FILE *outfil );
+
+#endif
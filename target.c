@@ -0,0 +1,43 @@
+#include "target.h"
+#include "aarch64.h"
+#include "x86_64.h"
+#include "vector.h"
+
+#include <string.h>
+
+/*
+- the targets the compiler knows about and the one -target= picked
+  - struct target * target_lookup( const char *name );
+*/
+
+/* bytes of AArch64 code a function comes to */
+int target_aarch64_size(struct ir_func *f)
+{
+	return aarch64_size(aarch64_select(f));
+}
+
+/* bytes of x86-64 code a function comes to */
+int target_x86_64_size(struct ir_func *f)
+{
+	return x86_64_size(x86_64_select(f));
+}
+
+struct target target_aarch64 = {
+	"aarch64", "\t.arch armv8-a\n", "\t.align\t3\n", ".xword", 1, VECTOR_FIXED,
+	aarch64_codegen, target_aarch64_size
+};
+
+struct target target_x86_64 = {
+	"x86_64", 0, "\t.align\t8\n", ".quad", 0, X64_VECTOR_FIXED,
+	x86_64_codegen, target_x86_64_size
+};
+
+struct target *target = &target_aarch64;
+
+/* target_lookup: the target called name, 0 if there is no such target */
+struct target * target_lookup(const char *name)
+{
+	if (!strcmp(name, "aarch64") || !strcmp(name, "arm64")) return &target_aarch64;
+	if (!strcmp(name, "x86_64")  || !strcmp(name, "x86-64") || !strcmp(name, "amd64")) return &target_x86_64;
+	return 0;
+}
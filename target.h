@@ -0,0 +1,31 @@
+#ifndef TARGET_H
+#define TARGET_H
+
+#include "ir.h"
+#include <stdio.h>
+
+/*
+- the machine the assembly is for, picked with -target=
+- lowering and every optimization pass are shared, a target brings its own instruction selection and register
+  file, plus the few assembler directives that differ between machines
+*/
+
+struct target {
+	const char *name;			// as -target= spells it
+	const char *arch;			// directive at the top of the file, 0 for none
+	const char *align8;			// aligns the next data to 8 bytes
+	const char *xword;			// a 64-bit data word
+	int ast_codegen;			// -O0 can emit straight from the AST, otherwise it goes through the IR unoptimized
+	int vector_fixed;			// vector registers the vectorizer may keep for a whole loop
+	void (*codegen)( struct ir_program *p, FILE *out );
+	int  (*size)( struct ir_func *f );	// bytes of machine code a function comes to
+};
+
+extern struct target target_aarch64;
+extern struct target target_x86_64;
+
+extern struct target *target;	// the one being generated for, AArch64 unless -target= says otherwise
+
+struct target * target_lookup( const char *name );
+
+#endif
@@ -0,0 +1,232 @@
+#include "unroll.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+
+/*
+- recognises the for loops the lowering can unroll
+  - int unroll_plan( struct stmt *s, struct unroll *u );
+  - int unroll_counted( struct stmt *s, struct unroll *u );
+
+- the shape: for (i = a; i < b; i++), with
+  - i a local or parameter nothing in the body assigns
+  - the condition i < b, i <= b, i > b or i >= b, counting in the direction that ends it
+  - the next expression i++, i--, i = i + c or i = i - c for a literal c
+  - b a literal, or a local, parameter or global the body can't change (no assignment to it, and no calls
+    at all when it's a global)
+- partial unrolling is only for straight-line bodies, the copies are meant to end up in one block
+- the trip count is known when a and b are both literals and the counter can't wrap around on the way
+- sizes are counted in AST nodes, a rough stand-in for instructions that's good enough to keep code growth in check
+*/
+
+int unroll_factor  = 4;
+int unroll_full    = 0;
+int unroll_partial = 0;
+
+/* e without the parentheses around it */
+struct expr * unroll_strip(struct expr *e)
+{
+	while (e && e->kind == EXPR_GROUP) e = e->right;
+	return e;
+}
+
+/* is e an integer literal, possibly negated */
+int unroll_literal(struct expr *e, long *v)
+{
+	e = unroll_strip(e);
+	if (!e) return 0;
+	if (e->kind == EXPR_INT_LITERAL)
+	{
+		*v = e->literal_value;
+		return 1;
+	}
+	if (e->kind == EXPR_NEG && unroll_literal(e->right, v))
+	{
+		*v = (long) -(unsigned long) *v;
+		return 1;
+	}
+	return 0;
+}
+
+/* is e the name of symbol s */
+int unroll_is_var(struct expr *e, struct symbol *s)
+{
+	e = unroll_strip(e);
+	return e && e->kind == EXPR_NAME && e->symbol == s;
+}
+
+/* expression nodes in e, following argument and print lists */
+int unroll_expr_size(struct expr *e)
+{
+	int n = 0;
+	for (; e; e = e->next) n += 1 + unroll_expr_size(e->left) + unroll_expr_size(e->right);
+	return n;
+}
+
+/* nodes in a statement list */
+int unroll_stmt_size(struct stmt *s)
+{
+	int n = 0;
+	for (; s; s = s->next)
+	{
+		n += 1;
+		if (s->decl) n += unroll_expr_size(s->decl->value);
+		n += unroll_expr_size(s->init_expr) + unroll_expr_size(s->expr) + unroll_expr_size(s->next_expr);
+		n += unroll_stmt_size(s->body) + unroll_stmt_size(s->else_body);
+	}
+	return n;
+}
+
+/* does a statement list branch or loop anywhere */
+int unroll_has_control(struct stmt *s)
+{
+	for (; s; s = s->next)
+	{
+		if (s->kind == STMT_IF_ELSE || s->kind == STMT_FOR || s->kind == STMT_RETURN) return 1;
+		if (unroll_has_control(s->body)) return 1;
+	}
+	return 0;
+}
+
+/* does e assign symbol s, or call anything when s is 0 */
+int unroll_expr_writes(struct expr *e, struct symbol *s)
+{
+	for (; e; e = e->next)
+	{
+		if (!s && e->kind == EXPR_FUNCCALL) return 1;
+		if ((e->kind == EXPR_ASSIGN || e->kind == EXPR_INCR || e->kind == EXPR_DECR) && unroll_is_var(e->left, s)) return 1;
+		if (unroll_expr_writes(e->left, s) || unroll_expr_writes(e->right, s)) return 1;
+	}
+	return 0;
+}
+
+/* does a statement list assign symbol s, or call anything when s is 0 */
+int unroll_stmt_writes(struct stmt *s, struct symbol *sym)
+{
+	for (; s; s = s->next)
+	{
+		if (s->decl && unroll_expr_writes(s->decl->value, sym)) return 1;
+		if (unroll_expr_writes(s->init_expr, sym) || unroll_expr_writes(s->expr, sym) || unroll_expr_writes(s->next_expr, sym)) return 1;
+		if (unroll_stmt_writes(s->body, sym) || unroll_stmt_writes(s->else_body, sym)) return 1;
+	}
+	return 0;
+}
+
+/* the step of a next expression that only changes counter s, 0 if it's anything else */
+long unroll_step(struct expr *e, struct symbol *s)
+{
+	long c;
+	e = unroll_strip(e);
+	if (!e || !unroll_is_var(e->left, s)) return 0;
+	if (e->kind == EXPR_INCR) return 1;
+	if (e->kind == EXPR_DECR) return -1;
+	if (e->kind != EXPR_ASSIGN) return 0;
+
+	struct expr *r = unroll_strip(e->right);
+	if (!r) return 0;
+	if (r->kind == EXPR_ADD && unroll_is_var(r->left, s) && unroll_literal(r->right, &c)) return c;
+	if (r->kind == EXPR_ADD && unroll_is_var(r->right, s) && unroll_literal(r->left, &c)) return c;
+	if (r->kind == EXPR_SUB && unroll_is_var(r->left, s) && unroll_literal(r->right, &c)) return (long) -(unsigned long) c;
+	return 0;
+}
+
+/* unroll_counted: is for loop s a counted loop, and if so which counter, bound and trip count */
+/*
+inputs
+- s: a STMT_FOR
+outputs
+- 1 with everything in u but full filled in when it is, 0 otherwise
+*/
+int unroll_counted(struct stmt *s, struct unroll *u)
+{
+	struct expr *cond = unroll_strip(s->expr);
+	if (!cond || !s->body) return 0;
+	if (cond->kind != EXPR_LT && cond->kind != EXPR_LE && cond->kind != EXPR_GT && cond->kind != EXPR_GE) return 0;
+
+	struct expr *var = unroll_strip(cond->left);
+	if (!var || var->kind != EXPR_NAME || var->symbol->kind == SYMBOL_GLOBAL) return 0;
+	u->var   = var->symbol;
+	u->cmp   = cond->kind;
+	u->bound = unroll_strip(cond->right);
+	u->step  = unroll_step(s->next_expr, u->var);
+
+	// counting towards the bound, and nothing else moves the counter
+	int up = u->cmp == EXPR_LT || u->cmp == EXPR_LE;
+	if (u->step == 0 || (u->step > 0) != up) return 0;
+	if (unroll_stmt_writes(s->body, u->var)) return 0;
+
+	long b;
+	int literal_bound = unroll_literal(u->bound, &b);
+	if (!literal_bound)
+	{
+		if (u->bound->kind != EXPR_NAME || u->bound->symbol == u->var) return 0;
+		if (unroll_stmt_writes(s->body, u->bound->symbol)) return 0;
+		if (u->bound->symbol->kind == SYMBOL_GLOBAL && unroll_stmt_writes(s->body, 0)) return 0;
+	}
+
+	// trip count, when the loop starts and ends at literals
+	/*
+	- worked out in unsigned arithmetic, where the distance between any two integers fits
+	- left unknown when it doesn't fit in a long, or when the step past the last trip would wrap the counter
+	  around, the loop doesn't stop where the count says it does then
+	*/
+	long a;
+	struct expr *init = unroll_strip(s->init_expr);
+	u->trips = -1;
+	if (literal_bound && init && init->kind == EXPR_ASSIGN && unroll_is_var(init->left, u->var) && unroll_literal(init->right, &a))
+	{
+		unsigned long step = u->step > 0 ? (unsigned long) u->step : -(unsigned long) u->step;
+		int inclusive = u->cmp == EXPR_LE || u->cmp == EXPR_GE;
+		u->start = a;
+		if (up ? (inclusive ? a > b : a >= b) : (inclusive ? a < b : a <= b))
+		{
+			u->trips = 0;
+		}
+		else
+		{
+			unsigned long dist = up ? (unsigned long) b - (unsigned long) a : (unsigned long) a - (unsigned long) b;
+			unsigned long room = up ? (unsigned long) LONG_MAX - (unsigned long) a : (unsigned long) a - (unsigned long) LONG_MIN;
+			unsigned long last = inclusive ? dist / step : (dist - 1) / step;	// steps to the counter's last value
+			if (last < LONG_MAX && room - last * step >= step) u->trips = last + 1;
+		}
+	}
+	return 1;
+}
+
+/* would unroll_plan unroll counted loop s completely */
+int unroll_is_short(struct stmt *s, struct unroll *u)
+{
+	int size = unroll_stmt_size(s->body) + unroll_expr_size(s->next_expr);
+	return u->trips >= 0 && u->trips <= UNROLL_FULL_TRIPS && u->trips * size <= UNROLL_FULL_SIZE;
+}
+
+/* unroll_plan: can for loop s be unrolled, and how */
+/*
+inputs
+- s: a STMT_FOR
+outputs
+- 1 with u filled in when it should be, 0 otherwise
+*/
+int unroll_plan(struct stmt *s, struct unroll *u)
+{
+	if (!unroll_counted(s, u)) return 0;
+
+	int size = unroll_stmt_size(s->body) + unroll_expr_size(s->next_expr);
+	if (unroll_is_short(s, u))
+	{
+		u->full = 1;
+		unroll_full++;
+		return 1;
+	}
+
+	u->full = 0;
+	if (unroll_factor < 2 || size > UNROLL_BODY_SIZE || unroll_has_control(s->body)) return 0;
+	if (u->trips >= 0 && u->trips < unroll_factor) return 0;
+
+	// the loop test looks unroll_factor - 1 steps ahead, which has to fit in a long
+	unsigned long step = u->step > 0 ? (unsigned long) u->step : -(unsigned long) u->step;
+	if (step > LONG_MAX / (unroll_factor - 1)) return 0;
+	unroll_partial++;
+	return 1;
+}
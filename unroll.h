@@ -0,0 +1,41 @@
+#ifndef UNROLL_H
+#define UNROLL_H
+
+#include "stmt.h"
+
+/*
+- loop unrolling, decided on the for statement itself before it's lowered: the counter, its step and its bound
+  all come straight from the init, condition and next expressions
+- small loops with a constant trip count are unrolled completely, other loops with a small straight-line body
+  get unroll_factor copies per trip plus whatever is left over
+*/
+
+#define UNROLL_FULL_TRIPS 16	// at most this many copies when unrolling completely
+#define UNROLL_FULL_SIZE  128	// and at most this much body in total, in AST nodes
+#define UNROLL_BODY_SIZE  40	// bigger bodies don't get partially unrolled
+
+extern int unroll_factor;		// -unroll=N, copies per trip of a partially unrolled loop, 1 turns that off
+extern int unroll_full;			// loops unrolled completely
+extern int unroll_partial;		// loops unrolled by unroll_factor
+
+struct unroll {
+	struct symbol *var;		// the counter, a local or parameter
+	long step;				// added to it by the next expression
+	expr_t cmp;				// EXPR_LT, EXPR_LE, EXPR_GT or EXPR_GE, with the counter on the left
+	struct expr *bound;		// right side of the condition, doesn't change in the loop
+	long start;				// where the counter starts, when trips is known
+	long trips;				// how often the body runs, -1 when that isn't known at compile time
+	int full;				// unroll completely, otherwise by unroll_factor
+};
+
+int unroll_counted( struct stmt *s, struct unroll *u );
+int unroll_is_short( struct stmt *s, struct unroll *u );
+int unroll_plan( struct stmt *s, struct unroll *u );
+
+// the vectorizer matches its loops with these too
+struct expr * unroll_strip( struct expr *e );
+int unroll_literal( struct expr *e, long *v );
+int unroll_is_var( struct expr *e, struct symbol *s );
+int unroll_stmt_writes( struct stmt *s, struct symbol *sym );
+
+#endif
@@ -0,0 +1,282 @@
+#include "vector.h"
+#include "target.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+- picks the loops the lowering vectorizes
+  - int vector_plan( struct stmt *s, const char *func, struct vector *v );
+  - void vector_report( FILE *out );
+
+- a loop qualifies when unroll_counted says it counts up by one to a bound that doesn't change, it isn't short
+  enough to be unrolled completely anyway, and its body is nothing but
+  - c[i] = e, with c a global array
+  - s = s + e (or e + s), with s a local nothing else in the body reads
+  where e is built with + and - out of elements x[i + k] of global arrays and out of literals and names the
+  loop doesn't change (integer arrays are all the backend lays out, and on integers + and - are all the lanes
+  can do: there's no 64-bit lane multiply)
+- no iteration may depend on another: an array the loop stores to is only ever accessed at exactly [i], so the
+  lanes of one vector step never need each other's results
+- every innermost loop gets a line in the report, saying either that it was vectorized or why not
+*/
+
+int vector_loops    = 0;
+int vector_rejected = 0;
+
+struct vector_note {
+	const char *func;
+	const char *var;	// 0 when the loop has no counter to name it by
+	const char *why;	// 0 when it was vectorized
+	struct vector_note *next;
+};
+
+struct vector_note  *vector_notes     = 0;
+struct vector_note **vector_notes_end = &vector_notes;
+
+struct vector_access {
+	struct symbol *array;
+	long off;
+	int store;
+};
+
+// the loop being looked at
+struct stmt          *vector_loop = 0;
+struct vector_access  vector_acc[VECTOR_MAX_ACCESSES];
+int                   vector_nacc = 0;
+const char           *vector_why  = 0;	// why it can't be vectorized, once that's known
+
+/* give up on the loop for the reason given, returns 0 so callers can pass that straight on */
+int vector_fail(const char *why)
+{
+	if (!vector_why) vector_why = why;
+	return 0;
+}
+
+/* does a statement list contain a for loop anywhere */
+int vector_has_loop(struct stmt *s)
+{
+	for (; s; s = s->next)
+	{
+		if (s->kind == STMT_FOR) return 1;
+		if (vector_has_loop(s->body) || vector_has_loop(s->else_body)) return 1;
+	}
+	return 0;
+}
+
+/* the symbol of a global array of integers named by e, 0 if it's anything else */
+struct symbol * vector_array(struct expr *e)
+{
+	e = unroll_strip(e);
+	if (!e || e->kind != EXPR_NAME || e->symbol->kind != SYMBOL_GLOBAL) return 0;
+	struct type *t = e->symbol->type;
+	if (t->kind != TYPE_ARRAY || !t->subtype || t->subtype->kind != TYPE_INTEGER) return 0;
+	return e->symbol;
+}
+
+/* vector_index: is an array index the counter var plus a constant *off */
+int vector_index(struct expr *index, struct symbol *var, long *off)
+{
+	struct expr *e = unroll_strip(index);
+	*off = 0;
+	if (unroll_is_var(e, var)) return 1;
+	if (!e || (e->kind != EXPR_ADD && e->kind != EXPR_SUB)) return 0;
+
+	if (unroll_is_var(e->left, var) && unroll_literal(e->right, off))
+	{
+		if (e->kind == EXPR_SUB) *off = -*off;
+		return 1;
+	}
+	return e->kind == EXPR_ADD && unroll_is_var(e->right, var) && unroll_literal(e->left, off);
+}
+
+/* vector_sum_operand: what "s = s + e" adds to s, 0 if the assignment isn't one of those */
+struct expr * vector_sum_operand(struct expr *assign)
+{
+	struct expr *l = unroll_strip(assign->left);
+	struct expr *r = unroll_strip(assign->right);
+	if (!l || l->kind != EXPR_NAME || !r || r->kind != EXPR_ADD) return 0;
+	if (unroll_is_var(r->left, l->symbol))  return r->right;
+	if (unroll_is_var(r->right, l->symbol)) return r->left;
+	return 0;
+}
+
+/* vector_value_reg: register the loop keeps value e broadcast in, -1 if there isn't one */
+int vector_value_reg(struct vector *v, struct expr *e)
+{
+	long a, b;
+	int literal = unroll_literal(e, &a);
+	e = unroll_strip(e);
+	for (int k=0;k<v->nfixed;k++)
+	{
+		struct expr *x = v->fixed[k].value;
+		if (!x) continue;
+		if (literal && unroll_literal(x, &b) && a == b) return VECTOR_FIXED + k;
+		if (!literal && e->kind == EXPR_NAME && x->kind == EXPR_NAME && x->symbol == e->symbol) return VECTOR_FIXED + k;
+	}
+	return -1;
+}
+
+/* vector_sum_reg: register the sum into local s accumulates in, -1 if there isn't one */
+int vector_sum_reg(struct vector *v, struct symbol *s)
+{
+	for (int k=0;k<v->nfixed;k++) if (v->fixed[k].sum == s) return VECTOR_FIXED + k;
+	return -1;
+}
+
+/* keep a value or a sum in a register of its own for the whole loop */
+int vector_add_fixed(struct vector *v, struct expr *value, struct symbol *sum)
+{
+	if (value && vector_value_reg(v, value) >= 0) return 1;
+	if (sum && vector_sum_reg(v, sum) >= 0) return 1;
+	if (v->nfixed == target->vector_fixed) return vector_fail("needs more vector registers than there are");
+	v->fixed[v->nfixed].value = value ? unroll_strip(value) : 0;
+	v->fixed[v->nfixed].sum   = sum;
+	v->nfixed++;
+	return 1;
+}
+
+/* note an array access */
+int vector_record(struct symbol *array, long off, int store)
+{
+	if (vector_nacc == VECTOR_MAX_ACCESSES) return vector_fail("accesses arrays too often");
+	vector_acc[vector_nacc].array = array;
+	vector_acc[vector_nacc].off   = off;
+	vector_acc[vector_nacc].store = store;
+	vector_nacc++;
+	return 1;
+}
+
+/* can expression e be computed two lanes at a time, its result going in temporary d */
+int vector_expr(struct vector *v, struct expr *e, int d)
+{
+	long k;
+	if (d >= VECTOR_TEMPS) return vector_fail("needs more vector registers than there are");
+	if (unroll_literal(e, &k)) return vector_add_fixed(v, e, 0);
+
+	e = unroll_strip(e);
+	switch (e->kind)
+	{
+		case EXPR_NAME:
+			if (e->symbol == v->u.var) return vector_fail("uses the counter as a value");
+			if (e->symbol->type->kind != TYPE_INTEGER) return vector_fail("uses a value that isn't an integer");
+			if (unroll_stmt_writes(vector_loop->body, e->symbol)) return vector_fail("reads a variable the loop changes");
+			return vector_add_fixed(v, e, 0);
+		case EXPR_ARRELEM:
+		{
+			struct symbol *a = vector_array(e->left);
+			if (!a) return vector_fail("reads something other than a global integer array");
+			if (!vector_index(e->right, v->u.var, &k)) return vector_fail("indexes an array with something other than the counter plus a constant");
+			return vector_record(a, k, 0);
+		}
+		case EXPR_MUL:
+			return vector_fail("multiplies, and there's no 64-bit lane multiply");
+		case EXPR_ADD:
+		case EXPR_SUB:
+			return vector_expr(v, e->left, d) && vector_expr(v, e->right, d + 1);
+		default:
+			return vector_fail("computes something there's no vector instruction for");
+	}
+}
+
+/* is every statement of a list one the vector loop can do */
+int vector_stmts(struct vector *v, struct stmt *s)
+{
+	long off;
+	for (; s; s = s->next)
+	{
+		if (s->kind == STMT_BLOCK)
+		{
+			if (!vector_stmts(v, s->body)) return 0;
+			continue;
+		}
+
+		struct expr *e = unroll_strip(s->expr);
+		if (s->kind != STMT_EXPR || !e || e->kind != EXPR_ASSIGN)
+			return vector_fail("has a statement that is neither an array element assignment nor a sum");
+
+		struct expr *l = unroll_strip(e->left);
+		if (l->kind == EXPR_ARRELEM)
+		{
+			struct symbol *a = vector_array(l->left);
+			if (!a) return vector_fail("stores to something other than a global integer array");
+			if (!vector_index(l->right, v->u.var, &off) || off) return vector_fail("stores to an element other than [counter]");
+			if (!vector_record(a, 0, 1) || !vector_expr(v, e->right, 0)) return 0;
+			continue;
+		}
+
+		struct expr *r = vector_sum_operand(e);
+		if (!r) return vector_fail("assigns a variable other than by adding to it");
+		if (l->symbol->kind == SYMBOL_GLOBAL) return vector_fail("sums into a global");
+		if (!vector_add_fixed(v, 0, l->symbol) || !vector_expr(v, r, 0)) return 0;
+	}
+	return 1;
+}
+
+/* do the iterations leave each other alone */
+int vector_independent()
+{
+	for (int k=0;k<vector_nacc;k++)
+	{
+		if (!vector_acc[k].store) continue;
+		for (int m=0;m<vector_nacc;m++)
+		{
+			if (vector_acc[m].array == vector_acc[k].array && vector_acc[m].off)
+				return vector_fail("reads an array at another index than the one it stores to, one iteration depends on another");
+		}
+	}
+	return 1;
+}
+
+/* vector_plan: should for loop s be vectorized */
+/*
+inputs
+- s: a STMT_FOR
+- func: the function it's in, for the report
+outputs
+- 1 with v filled in when it should be, 0 otherwise
+- either way an innermost loop gets its line in the report
+*/
+int vector_plan(struct stmt *s, const char *func, struct vector *v)
+{
+	if (!s->body || vector_has_loop(s->body)) return 0;
+
+	memset(v, 0, sizeof(*v));
+	vector_loop = s;
+	vector_nacc = 0;
+	vector_why  = 0;
+
+	int counted = unroll_counted(s, &v->u);
+	if      (!counted)                 vector_fail("has a trip count that can't be worked out before it runs");
+	else if (v->u.step != 1)           vector_fail("doesn't count up by one");
+	else if (unroll_is_short(s, &v->u)) vector_fail("is short enough to be unrolled completely");
+	else if (vector_stmts(v, s->body)) vector_independent();
+
+	struct vector_note *n = calloc(1, sizeof(*n));
+	n->func = func;
+	n->var  = counted ? v->u.var->name : 0;
+	n->why  = vector_why;
+	*vector_notes_end = n;
+	vector_notes_end  = &n->next;
+
+	if (vector_why)
+	{
+		vector_rejected++;
+		return 0;
+	}
+	vector_loops++;
+	return 1;
+}
+
+/* vector_report: print what happened to every innermost loop */
+void vector_report(FILE *out)
+{
+	for (struct vector_note *n = vector_notes; n; n = n->next)
+	{
+		fprintf(out, "vector: %s: loop", n->func);
+		if (n->var) fprintf(out, " over %s", n->var);
+		if (n->why) fprintf(out, " not vectorized, it %s\n", n->why);
+		else        fprintf(out, " vectorized\n");
+	}
+}
@@ -0,0 +1,46 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include "stmt.h"
+#include "unroll.h"
+
+#include <stdio.h>
+
+/*
+- vectorization of innermost counted for loops over global integer arrays, decided on the for statement
+  before it's lowered, the same way unrolling is
+- the vector loop does VECTOR_LANES elements per copy of the body with AArch64 Advanced SIMD (SSE2 on x86-64),
+  the elements left at the end go through the ordinary loop
+- integers are 64 bits, so a 128-bit register holds two of them, and there is no 64-bit lane multiply
+*/
+
+#define VECTOR_LANES  2		// elements per SIMD register
+#define VECTOR_TEMPS  8		// v0-v7 hold intermediate results, only within one statement
+#define VECTOR_FIXED  16	// v16-v31 hold broadcast values and sums for the whole loop, as many as the target has
+#define VECTOR_MAX_ACCESSES 32
+
+extern int vector_loops;	// loops vectorized
+extern int vector_rejected;	// innermost loops that weren't
+
+// something the vector loop keeps in a register from start to end, register VECTOR_FIXED + index
+struct vector_fixed {
+	struct expr *value;		// broadcast to both lanes before the loop: a literal or a name the loop doesn't change
+	struct symbol *sum;		// or the accumulator of a sum reduction into this local, zeroed before the loop
+};
+
+struct vector {
+	struct unroll u;
+	struct vector_fixed fixed[VECTOR_FIXED];
+	int nfixed;
+};
+
+int vector_plan( struct stmt *s, const char *func, struct vector *v );
+
+int vector_value_reg( struct vector *v, struct expr *e );
+int vector_sum_reg( struct vector *v, struct symbol *sum );
+int vector_index( struct expr *index, struct symbol *var, long *off );
+struct expr * vector_sum_operand( struct expr *assign );
+
+void vector_report( FILE *out );
+
+#endif
@@ -0,0 +1,894 @@
+#include "vm.h"
+#include "hash_table.h"
+#include "library.h"
+#include "string_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+- compiles the optimized IR to bytecode and runs it
+  - long vm_run( struct ir_program *p );
+
+- one bytecode function per IR function, its registers are the vregs plus one scratch register for addressing
+- the operands are register numbers, jump targets (instruction indexes), or indexes into a table:
+  - vm_consts: 64-bit constants that don't fit an operand, and addresses (strings, global arrays)
+  - vm_globals: a slot per global scalar, LOADG and STOREG go through it
+  - vm_args: the argument registers of every call, the count first
+- loads and stores take a base and an element index or a byte offset, an IR access with both gets its base
+  moved by the offset into the scratch register first
+- blocks are laid out in IR order, a jump to the next block disappears and a branch with one side falling
+  through tests just the other side
+- globals live in memory malloc'd here, so a VM address is a host address and LOAD/STORE use it directly
+- calls don't recurse in C: a frame remembers where to go back to, and the callee's registers start right
+  after the caller's on one shared register stack
+- a call the IR marks tail, whose result is returned right away, takes over the caller's frame and registers
+  instead, the way the native backends branch to it, so tail recursion runs in constant space
+- superinstructions, picked from the opcode pairs the benchmarks execute most (build with -DVM_PROFILE and
+  run with -vm-stats to see them):
+  - a compare only the branch after it reads becomes one compare-and-branch (lt + brf was the top pair)
+  - a vreg defined once, by a constant that fits an operand, is an immediate to add, sub and the
+    compare-and-branches, its CONST goes away when nothing reads it as a register any more
+  - a jump to a block of at most VM_THREAD_MAX instructions ending in a branch (a loop test) gets a copy of
+    that block instead, so the back edge of a loop is one compare-and-branch rather than jmp + lt + brf
+  - a move right before a jump moves and jumps in one (the copies SSA leaves at the end of a loop)
+- global accesses are quickened: the first time a LOADG or STOREG runs it looks its slot up and rewrites itself
+  into a LOADGQ or STOREGQ holding the slot's address
+*/
+
+int  vm_stats      = 0;
+int  vm_super      = 1;
+long vm_dispatches = 0;
+int  vm_fused      = 0;
+
+typedef enum {
+	VM_CONST,		// a = b
+	VM_CONSTK,		// a = vm_consts[b]
+	VM_MOV,			// a = b
+	VM_ADD,			// a = b + c, the same for everything down to VM_GE
+	VM_SUB,
+	VM_MUL,
+	VM_DIV,
+	VM_MOD,
+	VM_AND,
+	VM_OR,
+	VM_EQ,
+	VM_NE,
+	VM_LT,
+	VM_LE,
+	VM_GT,
+	VM_GE,
+	VM_ADDI,		// a = b + c, c a constant
+	VM_NEG,			// a = -b
+	VM_NOT,			// a = !b
+	VM_LOADG,		// a = global b, quickened on first use
+	VM_STOREG,		// global b = a, quickened on first use
+	VM_LOAD,		// a = [b + c*8]
+	VM_LOADK,		// a = [b + c], c a constant
+	VM_STORE,		// [b + c*8] = a
+	VM_STOREK,		// [b + c] = a, c a constant
+	VM_JMP,			// goto a
+	VM_BRT,			// if a goto b
+	VM_BRF,			// if !a goto b
+	VM_CALL,		// a = function b(vm_args + c), a may be -1
+	VM_TAILCALL,	// return function b(vm_args + c), in this frame
+	VM_NATIVE,		// a = native b(vm_args + c), a may be -1
+	VM_RET,			// return a, a may be -1
+	VM_VLOAD,		// vector a = the two elements at [b + c*8]
+	VM_VLOADK,		// vector a = the two elements at [b + c]
+	VM_VSTORE,		// the two elements at [b + c*8] = vector a
+	VM_VSTOREK,		// the two elements at [b + c] = vector a
+	VM_VDUP,		// vector a = b in both lanes
+	VM_VADD,		// vector a = vector b + vector c
+	VM_VSUB,		// vector a = vector b - vector c
+	VM_VSUM,		// a = the two lanes of vector b added
+	VM_LOADGQ,		// a = *slot
+	VM_STOREGQ,		// *slot = a
+	VM_BEQ,			// if a == b goto c, the same for everything down to VM_BGE
+	VM_BNE,
+	VM_BLT,
+	VM_BLE,
+	VM_BGT,
+	VM_BGE,
+	VM_BEQI,		// if a == b goto c, b a constant, the same for everything down to VM_BGEI
+	VM_BNEI,
+	VM_BLTI,
+	VM_BLEI,
+	VM_BGTI,
+	VM_BGEI,
+	VM_MOVJ,		// a = b, goto c
+	VM_CMOV,		// a = c if b, a stays as it is otherwise
+	VM_NOPS
+} vm_op_t;
+
+struct vm_inst {
+	int op;
+	int a;
+	union {
+		struct {
+			int b;
+			int c;
+		};
+		long *slot;					// quickened global accesses
+	};
+};
+
+struct vm_func {
+	const char *name;
+	struct ir_func *ir;
+	struct vm_inst *code;
+	int ncode;
+	int cap;
+	int nregs;
+};
+
+struct vm_global {
+	const char *name;
+	long *slot;
+};
+
+typedef long (*vm_native_t)( long *args );
+
+struct vm_native {
+	const char *name;
+	vm_native_t fn;
+};
+
+struct vm_frame {
+	struct vm_inst *ret;			// where the caller goes on
+	long *regs;						// the caller's registers
+	struct vm_func *func;
+	int dst;						// the caller's register the result goes in, -1 for none
+};
+
+struct vm_func   *vm_funcs   = 0;
+int               vm_nfuncs  = 0;
+struct vm_global *vm_globals = 0;
+int               vm_nglobals = 0;
+long *vm_consts  = 0;
+int   vm_nconsts = 0;
+int  *vm_args    = 0;
+int   vm_nargs   = 0;
+
+struct hash_table *vm_func_table   = 0;	// name -> index in vm_funcs + 1
+struct hash_table *vm_global_table = 0;	// name -> index in vm_globals + 1
+struct hash_table *vm_addr_table   = 0;	// name -> host address of a global array or string variable
+
+// per function, while it's compiled
+int *vm_uses     = 0;				// vreg -> times it's read
+int *vm_absorbed = 0;				// vreg -> times it's read as an immediate instead
+struct ir_inst **vm_kdef = 0;		// vreg -> the CONST that's its only definition, if there is one
+int  vm_block_start = 0;			// index of the first instruction of the block being compiled
+
+long vm_vectors[VM_VECTORS][2];
+
+#ifdef VM_PROFILE
+long vm_pairs[VM_NOPS + 1][VM_NOPS + 1];
+
+const char *vm_op_names[VM_NOPS + 1] = {
+	"const", "constk", "mov", "add", "sub", "mul", "div", "mod", "and", "or",
+	"eq", "ne", "lt", "le", "gt", "ge", "addi", "neg", "not",
+	"loadg", "storeg", "load", "loadk", "store", "storek",
+	"jmp", "brt", "brf", "call", "tailcall", "native", "ret",
+	"vload", "vloadk", "vstore", "vstorek", "vdup", "vadd", "vsub", "vsum",
+	"loadgq", "storegq", "beq", "bne", "blt", "ble", "bgt", "bge",
+	"beqi", "bnei", "blti", "blei", "bgti", "bgei", "movj", "cmov", "start"
+};
+
+/* the most frequent pairs of opcodes executed one after the other */
+void vm_profile_report(FILE *out)
+{
+	for (int n=0;n<20;n++)
+	{
+		int best_a = 0, best_b = 0;
+		for (int a=0;a<=VM_NOPS;a++)
+			for (int b=0;b<=VM_NOPS;b++)
+				if (vm_pairs[a][b] > vm_pairs[best_a][best_b]) { best_a = a; best_b = b; }
+		if (!vm_pairs[best_a][best_b]) break;
+		fprintf(out, "vm profile: %-7s %-7s %ld\n", vm_op_names[best_a], vm_op_names[best_b], vm_pairs[best_a][best_b]);
+		vm_pairs[best_a][best_b] = 0;
+	}
+}
+#endif
+
+/* natives: the runtime library, with the arguments the way the bytecode hands them over */
+long vm_native_print_values(long *a)
+{
+	print_values((const char *) a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+	return 0;
+}
+
+long vm_native_print_integer(long *a)   { print_integer(a[0]);               return 0; }
+long vm_native_print_string(long *a)    { print_string((const char *) a[0]); return 0; }
+long vm_native_print_boolean(long *a)   { print_boolean((int) a[0]);         return 0; }
+long vm_native_print_character(long *a) { print_character((char) a[0]);     return 0; }
+long vm_native_integer_power(long *a)   { return integer_power(a[0], a[1]); }
+
+struct vm_native vm_natives[] = {
+	{ "print_values",    vm_native_print_values    },
+	{ "print_integer",   vm_native_print_integer   },
+	{ "print_string",    vm_native_print_string    },
+	{ "print_boolean",   vm_native_print_boolean   },
+	{ "print_character", vm_native_print_character },
+	{ "integer_power",   vm_native_integer_power   },
+	{ 0, 0 }
+};
+
+/* stop on something the bytecode can't express */
+void vm_error(const char *what, const char *name)
+{
+	fprintf(stderr, "vm error: %s %s\n", what, name ? name : "");
+	exit(1);
+}
+
+/* add a constant to the pool, returns its index */
+int vm_const(long k)
+{
+	vm_consts = realloc(vm_consts, (vm_nconsts + 1) * sizeof(*vm_consts));
+	vm_consts[vm_nconsts] = k;
+	return vm_nconsts++;
+}
+
+/* append an instruction, returns its index */
+int vm_emit(struct vm_func *vf, int op, int a, int b, int c)
+{
+	if (vf->ncode == vf->cap)
+	{
+		vf->cap  = vf->cap ? 2 * vf->cap : 64;
+		vf->code = realloc(vf->code, vf->cap * sizeof(*vf->code));
+	}
+	struct vm_inst *i = &vf->code[vf->ncode];
+	i->op = op;
+	i->a  = a;
+	i->b  = b;
+	i->c  = c;
+	return vf->ncode++;
+}
+
+/* the value of an initializer element, 0 if there's none */
+long vm_init_value(struct expr *e)
+{
+	if (!e) return 0;
+	if (e->kind == EXPR_STRING_LITERAL) return (long) string_pool_text(string_pool_intern(e->string_literal));
+	return e->literal_value;
+}
+
+/* give every global variable its memory and initial value */
+void vm_data(struct decl *d)
+{
+	for (; d; d = d->next)
+	{
+		if (!d->symbol || d->symbol->kind != SYMBOL_GLOBAL) continue;
+		if (d->type->kind == TYPE_FUNCTION || d->type->kind == TYPE_PROTO || d->type->kind == TYPE_VOID) continue;
+
+		if (d->type->kind == TYPE_ARRAY)
+		{
+			long *elems = calloc(d->type->size ? d->type->size : 1, sizeof(long));
+			struct expr *e = d->value;
+			for (int k=0;e && k<d->type->size;k++,e = e->next) elems[k] = vm_init_value(e);
+			hash_table_insert(vm_addr_table, d->name, elems);
+			continue;
+		}
+
+		long *slot = malloc(sizeof(long));
+		*slot = vm_init_value(d->value);
+		hash_table_insert(vm_addr_table, d->name, slot);
+
+		vm_globals = realloc(vm_globals, (vm_nglobals + 1) * sizeof(*vm_globals));
+		vm_globals[vm_nglobals].name = d->name;
+		vm_globals[vm_nglobals].slot = slot;
+		hash_table_insert(vm_global_table, d->name, (void *) (long) (++vm_nglobals));
+	}
+}
+
+/* host address IR_ADDR names: a pooled string or a global */
+long vm_address(const char *name)
+{
+	int label = string_pool_label(name);
+	if (label >= 0) return (long) string_pool_text(label);
+
+	void *addr = hash_table_lookup(vm_addr_table, name);
+	if (!addr) vm_error("no global named", name);
+	return (long) addr;
+}
+
+/* global slot index of a name */
+int vm_global_index(const char *name)
+{
+	long k = (long) hash_table_lookup(vm_global_table, name);
+	if (!k) vm_error("no global named", name);
+	return k - 1;
+}
+
+/* a load or store of [base + idx*8 + imm] with the value register (or vector) r */
+void vm_emit_mem(struct vm_func *vf, int op_idx, int op_off, int r, int base, int idx, long imm)
+{
+	if (idx == IR_NO_REG)
+	{
+		vm_emit(vf, op_off, r, base, (int) imm);
+		return;
+	}
+	if (imm)
+	{
+		int scratch = vf->nregs - 1;
+		vm_emit(vf, VM_ADDI, scratch, base, (int) imm);
+		base = scratch;
+	}
+	vm_emit(vf, op_idx, r, base, idx);
+}
+
+/* a call to a bytecode function or a native */
+void vm_emit_call(struct vm_func *vf, struct ir_inst *i)
+{
+	int at = vm_nargs;
+	vm_args = realloc(vm_args, (vm_nargs + i->nargs + 1) * sizeof(*vm_args));
+	vm_args[vm_nargs++] = i->nargs;
+	for (int k=0;k<i->nargs;k++) vm_args[vm_nargs++] = i->args[k];
+
+	long f = (long) hash_table_lookup(vm_func_table, i->name);
+	if (f)
+	{
+		// a call whose result is returned right away doesn't have to come back here, the RET after it is dead
+		int tail = i->tail && i->next && i->next->op == IR_RET && i->next->src[0] == i->dst;
+		vm_emit(vf, tail ? VM_TAILCALL : VM_CALL, i->dst, f - 1, at);
+		return;
+	}
+	for (int k=0;vm_natives[k].name;k++)
+	{
+		if (strcmp(vm_natives[k].name, i->name)) continue;
+		if (i->nargs > 8) vm_error("too many arguments to", i->name);
+		vm_emit(vf, VM_NATIVE, i->dst, k, at);
+		return;
+	}
+	vm_error("call to undefined function", i->name);
+}
+
+/* is vreg v the same constant everywhere, one that fits an operand */
+int vm_konst(int v, int *k)
+{
+	if (!vm_super || v < 0 || !vm_kdef[v]) return 0;
+	*k = (int) vm_kdef[v]->imm;
+	return 1;
+}
+
+/* is i a compare only the branch right after it reads */
+int vm_fused_cmp(struct ir_inst *i)
+{
+	return vm_super && i && i->op >= IR_EQ && i->op <= IR_GE && i->next && i->next->op == IR_BR
+	    && i->next->src[0] == i->dst && vm_uses[i->dst] == 1;
+}
+
+/* the constant vreg instruction i takes as an immediate instead of a register, -1 if none */
+int vm_imm_operand(struct ir_inst *i)
+{
+	int k;
+	switch (i->op)
+	{
+		case IR_SUB:
+			return vm_konst(i->src[1], &k) && k != (int) (1U << 31) ? i->src[1] : -1;
+		case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+			if (!vm_fused_cmp(i)) return -1;
+			// fall through, a fused compare takes a constant on either side like add does
+		case IR_ADD:
+			if (vm_konst(i->src[1], &k)) return i->src[1];
+			if (vm_konst(i->src[0], &k)) return i->src[0];
+			return -1;
+		default:
+			return -1;
+	}
+}
+
+/* the compare that holds when op doesn't */
+ir_op_t vm_cond_invert(ir_op_t op)
+{
+	switch (op)
+	{
+		case IR_EQ: return IR_NE;
+		case IR_NE: return IR_EQ;
+		case IR_LT: return IR_GE;
+		case IR_LE: return IR_GT;
+		case IR_GT: return IR_LE;
+		default:    return IR_LT;
+	}
+}
+
+/* the compare that gives the same answer with its operands the other way around */
+ir_op_t vm_cond_swap(ir_op_t op)
+{
+	switch (op)
+	{
+		case IR_LT: return IR_GT;
+		case IR_LE: return IR_GE;
+		case IR_GT: return IR_LT;
+		case IR_GE: return IR_LE;
+		default:    return op;
+	}
+}
+
+/* can a jump to bb take a copy of it instead */
+int vm_threadable(struct ir_block *bb)
+{
+	if (!vm_super || !bb->last || bb->last->op != IR_BR) return 0;
+	int n = 0;
+	for (struct ir_inst *i = bb->first; i; i = i->next)
+	{
+		if (++n > VM_THREAD_MAX || i->op == IR_CALL) return 0;
+	}
+	return 1;
+}
+
+/* the compare c and the branch br after it as one compare-and-branch, next is the block that follows */
+void vm_emit_cmp_branch(struct vm_func *vf, struct ir_inst *c, struct ir_inst *br, struct ir_block *next)
+{
+	ir_op_t op = c->op;
+	struct ir_block *t = br->target;
+	struct ir_block *f = br->target_false;
+
+	// when the taken side is the one that follows, branch to the other side on the opposite condition
+	if (t == next)
+	{
+		op = vm_cond_invert(op);
+		t  = f;
+		f  = next;
+	}
+
+	int k;
+	int imm = vm_imm_operand(c);
+	if (imm >= 0 && imm == c->src[1])
+	{
+		vm_konst(imm, &k);
+		vm_emit(vf, VM_BEQI + (op - IR_EQ), c->src[0], k, t->id);
+	}
+	else if (imm >= 0)
+	{
+		vm_konst(imm, &k);
+		vm_emit(vf, VM_BEQI + (vm_cond_swap(op) - IR_EQ), c->src[1], k, t->id);
+	}
+	else
+	{
+		vm_emit(vf, VM_BEQ + (op - IR_EQ), c->src[0], c->src[1], t->id);
+	}
+	vm_fused++;
+
+	if (f != next) vm_emit(vf, VM_JMP, f->id, 0, 0);
+}
+
+/* vm_compile_inst: the bytecode of one IR instruction, next is the block laid out after the one it's compiled into */
+void vm_compile_inst(struct vm_func *vf, struct ir_inst *i, struct ir_block *next)
+{
+	int k;
+	int imm = vm_imm_operand(i);
+	switch (i->op)
+	{
+		case IR_CONST:
+			// every read of it takes the value as an immediate
+			if (vm_kdef[i->dst] == i && vm_absorbed[i->dst] == vm_uses[i->dst]) break;
+			if (i->imm == (int) i->imm) vm_emit(vf, VM_CONST, i->dst, (int) i->imm, 0);
+			else                        vm_emit(vf, VM_CONSTK, i->dst, vm_const(i->imm), 0);
+			break;
+		case IR_MOV:
+			if (i->dst != i->src[0]) vm_emit(vf, VM_MOV, i->dst, i->src[0], 0);
+			break;
+		case IR_ADD:
+		case IR_SUB:
+			if (imm >= 0)
+			{
+				vm_konst(imm, &k);
+				vm_emit(vf, VM_ADDI, i->dst, imm == i->src[1] ? i->src[0] : i->src[1], i->op == IR_SUB ? -k : k);
+				vm_fused++;
+				break;
+			}
+			// fall through
+		case IR_MUL: case IR_DIV: case IR_MOD: case IR_AND: case IR_OR:
+		case IR_EQ:  case IR_NE:  case IR_LT:  case IR_LE:  case IR_GT: case IR_GE:
+			// the branch right after does the compare
+			if (vm_fused_cmp(i)) break;
+			// the binary operators are in the same order in both
+			vm_emit(vf, VM_ADD + (i->op - IR_ADD), i->dst, i->src[0], i->src[1]);
+			break;
+		case IR_NEG:
+			vm_emit(vf, VM_NEG, i->dst, i->src[0], 0);
+			break;
+		case IR_NOT:
+			vm_emit(vf, VM_NOT, i->dst, i->src[0], 0);
+			break;
+		case IR_ADDR:
+			vm_emit(vf, VM_CONSTK, i->dst, vm_const(vm_address(i->name)), 0);
+			break;
+		case IR_LOADG:
+			vm_emit(vf, VM_LOADG, i->dst, vm_global_index(i->name), 0);
+			break;
+		case IR_STOREG:
+			vm_emit(vf, VM_STOREG, i->src[0], vm_global_index(i->name), 0);
+			break;
+		case IR_LOAD:
+			vm_emit_mem(vf, VM_LOAD, VM_LOADK, i->dst, i->src[0], i->src[1], i->imm);
+			break;
+		case IR_STORE:
+			vm_emit_mem(vf, VM_STORE, VM_STOREK, i->src[2], i->src[0], i->src[1], i->imm);
+			break;
+		case IR_VLOAD:
+			vm_emit_mem(vf, VM_VLOAD, VM_VLOADK, i->vec[0], i->src[0], i->src[1], i->imm);
+			break;
+		case IR_VSTORE:
+			vm_emit_mem(vf, VM_VSTORE, VM_VSTOREK, i->vec[0], i->src[0], i->src[1], i->imm);
+			break;
+		case IR_VDUP:
+			vm_emit(vf, VM_VDUP, i->vec[0], i->src[0], 0);
+			break;
+		case IR_VBIN:
+			vm_emit(vf, i->imm == IR_ADD ? VM_VADD : VM_VSUB, i->vec[0], i->vec[1], i->vec[2]);
+			break;
+		case IR_VSUM:
+			vm_emit(vf, VM_VSUM, i->dst, i->vec[1], 0);
+			break;
+		case IR_SEL:
+		{
+			// the false side, then the true side over it when the condition holds, in the scratch register
+			// when the destination is one of the other two
+			int d = i->dst == i->src[0] || i->dst == i->src[1] ? vf->nregs - 1 : i->dst;
+			if (d != i->src[2]) vm_emit(vf, VM_MOV, d, i->src[2], 0);
+			vm_emit(vf, VM_CMOV, d, i->src[0], i->src[1]);
+			if (d != i->dst) vm_emit(vf, VM_MOV, i->dst, d, 0);
+			break;
+		}
+		case IR_CALL:
+			vm_emit_call(vf, i);
+			break;
+		case IR_JMP:
+			// the target ids get turned into instruction indexes once every block has its start
+			if (i->target == next) break;
+			if (vm_threadable(i->target))
+			{
+				for (struct ir_inst *j = i->target->first; j; j = j->next) vm_compile_inst(vf, j, next);
+				vm_fused++;
+				break;
+			}
+			if (vm_super && vf->ncode > vm_block_start && vf->code[vf->ncode - 1].op == VM_MOV)
+			{
+				vf->code[vf->ncode - 1].op = VM_MOVJ;
+				vf->code[vf->ncode - 1].c  = i->target->id;
+				vm_fused++;
+				break;
+			}
+			vm_emit(vf, VM_JMP, i->target->id, 0, 0);
+			break;
+		case IR_BR:
+			if (vm_fused_cmp(i->prev))
+			{
+				vm_emit_cmp_branch(vf, i->prev, i, next);
+			}
+			else if (i->target_false == next)
+			{
+				vm_emit(vf, VM_BRT, i->src[0], i->target->id, 0);
+			}
+			else if (i->target == next)
+			{
+				vm_emit(vf, VM_BRF, i->src[0], i->target_false->id, 0);
+			}
+			else
+			{
+				vm_emit(vf, VM_BRT, i->src[0], i->target->id, 0);
+				vm_emit(vf, VM_JMP, i->target_false->id, 0, 0);
+			}
+			break;
+		case IR_RET:
+			vm_emit(vf, VM_RET, i->src[0], 0, 0);
+			break;
+		default:
+			vm_error("can't run instruction", ir_op_name(i->op));
+	}
+}
+
+/* vm_compile: the bytecode of one function */
+void vm_compile(struct vm_func *vf)
+{
+	struct ir_func *f = vf->ir;
+	int *start = calloc(f->nblocks + 1, sizeof(int));
+	int *defs  = calloc(f->nvregs + 1, sizeof(int));
+	vm_uses     = calloc(f->nvregs + 1, sizeof(int));
+	vm_absorbed = calloc(f->nvregs + 1, sizeof(int));
+	vm_kdef     = calloc(f->nvregs + 1, sizeof(*vm_kdef));
+
+	// find the vregs that hold one constant all along, parameters are defined on entry
+	for (int v=0;v<f->nparams;v++) defs[v]++;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			int *u;
+			for (int k=0;(u = ir_inst_use(i, k));k++) if (*u >= 0) vm_uses[*u]++;
+			if (i->dst < 0) continue;
+			defs[i->dst]++;
+			if (i->op == IR_CONST && i->imm == (int) i->imm) vm_kdef[i->dst] = i;
+		}
+	}
+	for (int v=0;v<f->nvregs;v++) if (defs[v] != 1) vm_kdef[v] = 0;
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			int imm = vm_imm_operand(i);
+			if (imm >= 0) vm_absorbed[imm]++;
+		}
+	}
+
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		start[bb->id] = vf->ncode;
+		vm_block_start = vf->ncode;
+		for (struct ir_inst *i = bb->first; i; i = i->next) vm_compile_inst(vf, i, bb->next);
+	}
+
+	for (int k=0;k<vf->ncode;k++)
+	{
+		struct vm_inst *i = &vf->code[k];
+		if      (i->op == VM_JMP)                               i->a = start[i->a];
+		else if (i->op == VM_BRT || i->op == VM_BRF)            i->b = start[i->b];
+		else if (i->op >= VM_BEQ && i->op <= VM_MOVJ)           i->c = start[i->c];
+	}
+	free(start);
+	free(defs);
+	free(vm_uses);
+	free(vm_absorbed);
+	free(vm_kdef);
+}
+
+#define VM_WRAP(x) ((long) (x))
+#define VM_U(x)    ((unsigned long) (x))
+
+/* vm_execute: run function entry to the end, returns what it returns */
+long vm_execute(struct vm_func *entry)
+{
+	// one label per opcode, in vm_op_t order
+	static const void *handlers[VM_NOPS] = {
+		&&op_const, &&op_constk, &&op_mov,
+		&&op_add, &&op_sub, &&op_mul, &&op_div, &&op_mod, &&op_and, &&op_or,
+		&&op_eq, &&op_ne, &&op_lt, &&op_le, &&op_gt, &&op_ge,
+		&&op_addi, &&op_neg, &&op_not,
+		&&op_loadg, &&op_storeg, &&op_load, &&op_loadk, &&op_store, &&op_storek,
+		&&op_jmp, &&op_brt, &&op_brf, &&op_call, &&op_tailcall, &&op_native, &&op_ret,
+		&&op_vload, &&op_vloadk, &&op_vstore, &&op_vstorek, &&op_vdup, &&op_vadd, &&op_vsub, &&op_vsum,
+		&&op_loadgq, &&op_storegq,
+		&&op_beq, &&op_bne, &&op_blt, &&op_ble, &&op_bgt, &&op_bge,
+		&&op_beqi, &&op_bnei, &&op_blti, &&op_blei, &&op_bgti, &&op_bgei, &&op_movj, &&op_cmov
+	};
+
+	long *stack = calloc(VM_STACK_SIZE, sizeof(long));
+	struct vm_frame *frames = calloc(VM_MAX_FRAMES, sizeof(struct vm_frame));
+	struct vm_frame *fp = frames;
+
+	struct vm_func *cur = entry;
+	struct vm_inst *pc  = entry->code;
+	long *r = stack;
+	long count = 0;
+	long result;
+
+#ifdef VM_PROFILE
+	int prev = VM_NOPS;
+	#define DISPATCH() do { count++; vm_pairs[prev][pc->op]++; prev = pc->op; goto *handlers[pc->op]; } while (0)
+#else
+	#define DISPATCH() do { count++; goto *handlers[pc->op]; } while (0)
+#endif
+	#define NEXT()     do { pc++; DISPATCH(); } while (0)
+
+	DISPATCH();
+
+op_const:  r[pc->a] = pc->b;                                NEXT();
+op_constk: r[pc->a] = vm_consts[pc->b];                     NEXT();
+op_mov:    r[pc->a] = r[pc->b];                             NEXT();
+op_add:    r[pc->a] = VM_WRAP(VM_U(r[pc->b]) + VM_U(r[pc->c])); NEXT();
+op_sub:    r[pc->a] = VM_WRAP(VM_U(r[pc->b]) - VM_U(r[pc->c])); NEXT();
+op_mul:    r[pc->a] = VM_WRAP(VM_U(r[pc->b]) * VM_U(r[pc->c])); NEXT();
+op_div:
+	{
+		// sdiv: dividing by zero gives 0, the most negative number over -1 gives itself
+		long x = r[pc->b], y = r[pc->c];
+		r[pc->a] = y == 0 ? 0 : y == -1 ? VM_WRAP(0UL - VM_U(x)) : x / y;
+		NEXT();
+	}
+op_mod:
+	{
+		// sdiv then msub, so x % 0 is x
+		long x = r[pc->b], y = r[pc->c];
+		r[pc->a] = y == 0 ? x : y == -1 ? 0 : x % y;
+		NEXT();
+	}
+op_and:    r[pc->a] = r[pc->b] & r[pc->c];                  NEXT();
+op_or:     r[pc->a] = r[pc->b] | r[pc->c];                  NEXT();
+op_eq:     r[pc->a] = r[pc->b] == r[pc->c];                 NEXT();
+op_ne:     r[pc->a] = r[pc->b] != r[pc->c];                 NEXT();
+op_lt:     r[pc->a] = r[pc->b] <  r[pc->c];                 NEXT();
+op_le:     r[pc->a] = r[pc->b] <= r[pc->c];                 NEXT();
+op_gt:     r[pc->a] = r[pc->b] >  r[pc->c];                 NEXT();
+op_ge:     r[pc->a] = r[pc->b] >= r[pc->c];                 NEXT();
+op_addi:   r[pc->a] = VM_WRAP(VM_U(r[pc->b]) + pc->c);      NEXT();
+op_neg:    r[pc->a] = VM_WRAP(0UL - VM_U(r[pc->b]));        NEXT();
+op_not:    r[pc->a] = !r[pc->b];                            NEXT();
+op_loadg:
+	// look the slot up once, from now on this instruction goes straight to it
+	pc->slot = vm_globals[pc->b].slot;
+	pc->op   = VM_LOADGQ;
+	goto op_loadgq;
+op_storeg:
+	pc->slot = vm_globals[pc->b].slot;
+	pc->op   = VM_STOREGQ;
+	goto op_storegq;
+op_loadgq:  r[pc->a] = *pc->slot;                           NEXT();
+op_storegq: *pc->slot = r[pc->a];                           NEXT();
+op_load:   r[pc->a] = ((long *) r[pc->b])[r[pc->c]];        NEXT();
+op_loadk:  r[pc->a] = *(long *) (r[pc->b] + pc->c);         NEXT();
+op_store:  ((long *) r[pc->b])[r[pc->c]] = r[pc->a];        NEXT();
+op_storek: *(long *) (r[pc->b] + pc->c) = r[pc->a];         NEXT();
+op_jmp:    pc = cur->code + pc->a;                          DISPATCH();
+op_brt:    pc = r[pc->a] ? cur->code + pc->b : pc + 1;      DISPATCH();
+op_brf:    pc = r[pc->a] ? pc + 1 : cur->code + pc->b;      DISPATCH();
+op_beq:    pc = r[pc->a] == r[pc->b] ? cur->code + pc->c : pc + 1; DISPATCH();
+op_bne:    pc = r[pc->a] != r[pc->b] ? cur->code + pc->c : pc + 1; DISPATCH();
+op_blt:    pc = r[pc->a] <  r[pc->b] ? cur->code + pc->c : pc + 1; DISPATCH();
+op_ble:    pc = r[pc->a] <= r[pc->b] ? cur->code + pc->c : pc + 1; DISPATCH();
+op_bgt:    pc = r[pc->a] >  r[pc->b] ? cur->code + pc->c : pc + 1; DISPATCH();
+op_bge:    pc = r[pc->a] >= r[pc->b] ? cur->code + pc->c : pc + 1; DISPATCH();
+op_beqi:   pc = r[pc->a] == pc->b    ? cur->code + pc->c : pc + 1; DISPATCH();
+op_bnei:   pc = r[pc->a] != pc->b    ? cur->code + pc->c : pc + 1; DISPATCH();
+op_blti:   pc = r[pc->a] <  pc->b    ? cur->code + pc->c : pc + 1; DISPATCH();
+op_blei:   pc = r[pc->a] <= pc->b    ? cur->code + pc->c : pc + 1; DISPATCH();
+op_bgti:   pc = r[pc->a] >  pc->b    ? cur->code + pc->c : pc + 1; DISPATCH();
+op_bgei:   pc = r[pc->a] >= pc->b    ? cur->code + pc->c : pc + 1; DISPATCH();
+op_movj:   r[pc->a] = r[pc->b]; pc = cur->code + pc->c;     DISPATCH();
+op_cmov:   if (r[pc->b]) r[pc->a] = r[pc->c];               NEXT();
+op_call:
+	{
+		struct vm_func *g = &vm_funcs[pc->b];
+		int *args = vm_args + pc->c;
+		long *callee = r + cur->nregs;
+		if (fp + 1 == frames + VM_MAX_FRAMES || callee + g->nregs > stack + VM_STACK_SIZE) vm_error("stack overflow in", g->name);
+
+		for (int k=0;k<args[0];k++) callee[k] = r[args[k+1]];
+		fp++;
+		fp->ret  = pc + 1;
+		fp->regs = r;
+		fp->func = cur;
+		fp->dst  = pc->a;
+
+		cur = g;
+		r   = callee;
+		pc  = g->code;
+		DISPATCH();
+	}
+op_tailcall:
+	{
+		// the arguments go above this frame's registers first, they may be read from where they land
+		struct vm_func *g = &vm_funcs[pc->b];
+		int *args = vm_args + pc->c;
+		long *tmp = r + cur->nregs;
+		if (tmp + g->nregs > stack + VM_STACK_SIZE) vm_error("stack overflow in", g->name);
+
+		for (int k=0;k<args[0];k++) tmp[k] = r[args[k+1]];
+		memmove(r, tmp, args[0] * sizeof(long));
+
+		cur = g;
+		pc  = g->code;
+		DISPATCH();
+	}
+op_native:
+	{
+		long a[8] = { 0 };
+		int *args = vm_args + pc->c;
+		for (int k=0;k<args[0];k++) a[k] = r[args[k+1]];
+		long v = vm_natives[pc->b].fn(a);
+		if (pc->a >= 0) r[pc->a] = v;
+		NEXT();
+	}
+op_ret:
+	{
+		long v = pc->a >= 0 ? r[pc->a] : 0;
+		if (fp == frames)
+		{
+			result = v;
+			goto done;
+		}
+		pc  = fp->ret;
+		r   = fp->regs;
+		cur = fp->func;
+		if (fp->dst >= 0) r[fp->dst] = v;
+		fp--;
+		DISPATCH();
+	}
+op_vload:
+	{
+		long *m = (long *) r[pc->b] + r[pc->c];
+		vm_vectors[pc->a][0] = m[0];
+		vm_vectors[pc->a][1] = m[1];
+		NEXT();
+	}
+op_vloadk:
+	{
+		long *m = (long *) (r[pc->b] + pc->c);
+		vm_vectors[pc->a][0] = m[0];
+		vm_vectors[pc->a][1] = m[1];
+		NEXT();
+	}
+op_vstore:
+	{
+		long *m = (long *) r[pc->b] + r[pc->c];
+		m[0] = vm_vectors[pc->a][0];
+		m[1] = vm_vectors[pc->a][1];
+		NEXT();
+	}
+op_vstorek:
+	{
+		long *m = (long *) (r[pc->b] + pc->c);
+		m[0] = vm_vectors[pc->a][0];
+		m[1] = vm_vectors[pc->a][1];
+		NEXT();
+	}
+op_vdup:
+	vm_vectors[pc->a][0] = r[pc->b];
+	vm_vectors[pc->a][1] = r[pc->b];
+	NEXT();
+op_vadd:
+	vm_vectors[pc->a][0] = VM_WRAP(VM_U(vm_vectors[pc->b][0]) + VM_U(vm_vectors[pc->c][0]));
+	vm_vectors[pc->a][1] = VM_WRAP(VM_U(vm_vectors[pc->b][1]) + VM_U(vm_vectors[pc->c][1]));
+	NEXT();
+op_vsub:
+	vm_vectors[pc->a][0] = VM_WRAP(VM_U(vm_vectors[pc->b][0]) - VM_U(vm_vectors[pc->c][0]));
+	vm_vectors[pc->a][1] = VM_WRAP(VM_U(vm_vectors[pc->b][1]) - VM_U(vm_vectors[pc->c][1]));
+	NEXT();
+op_vsum:
+	r[pc->a] = VM_WRAP(VM_U(vm_vectors[pc->b][0]) + VM_U(vm_vectors[pc->b][1]));
+	NEXT();
+
+done:
+	#undef NEXT
+	#undef DISPATCH
+	vm_dispatches = count;
+	free(frames);
+	free(stack);
+	return result;
+}
+
+/* vm_run: compile the whole program and run its main, returns what main returns */
+long vm_run(struct ir_program *p)
+{
+	vm_func_table   = hash_table_create(0, 0);
+	vm_global_table = hash_table_create(0, 0);
+	vm_addr_table   = hash_table_create(0, 0);
+
+	for (struct ir_func *f = p->funcs; f; f = f->next) vm_nfuncs++;
+	vm_funcs = calloc(vm_nfuncs + 1, sizeof(*vm_funcs));
+	int k = 0;
+	for (struct ir_func *f = p->funcs; f; f = f->next, k++)
+	{
+		vm_funcs[k].name  = f->name;
+		vm_funcs[k].ir    = f;
+		vm_funcs[k].nregs = f->nvregs + 1;
+		hash_table_insert(vm_func_table, f->name, (void *) (long) (k + 1));
+	}
+
+	vm_data(p->decls);
+	for (k=0;k<vm_nfuncs;k++) vm_compile(&vm_funcs[k]);
+
+	long main_index = (long) hash_table_lookup(vm_func_table, "main");
+	if (!main_index) vm_error("no function named", "main");
+
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	long result = vm_execute(&vm_funcs[main_index - 1]);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if (vm_stats)
+	{
+		double seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+		int ncode = 0;
+		for (k=0;k<vm_nfuncs;k++) ncode += vm_funcs[k].ncode;
+		fprintf(stderr, "vm: %i instructions of bytecode (%i fused), %ld executed in %.3f s, %.1f million per second\n",
+		        ncode, vm_fused, vm_dispatches, seconds, seconds > 0 ? vm_dispatches / seconds / 1e6 : 0.0);
+#ifdef VM_PROFILE
+		vm_profile_report(stderr);
+#endif
+	}
+	return result;
+}
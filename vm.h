@@ -0,0 +1,28 @@
+#ifndef VM_H
+#define VM_H
+
+#include "ir.h"
+
+/*
+- bytecode virtual machine: runs a program right on the build host instead of generating assembly for it
+- the checked AST goes through the IR and the optimizer as usual, then every function is compiled to a compact
+  register bytecode: one VM register per vreg, instructions of an opcode and three operands
+- dispatch is threaded with computed gotos (labels as values), every handler jumps straight to the next one
+- common sequences of instructions are compiled to superinstructions, compare and branch above all
+- the runtime library (library.c) is linked into the compiler, print and integer_power run as natives
+- the machine behaves like the AArch64 target: 64-bit wrapping arithmetic, division by zero gives 0
+*/
+
+#define VM_STACK_SIZE (1<<22)		// registers shared by every active frame
+#define VM_MAX_FRAMES (1<<18)		// calls deep
+#define VM_VECTORS    32			// SIMD registers of two lanes the vector instructions use
+#define VM_THREAD_MAX 4				// a jump to a block this small that ends in a branch takes a copy of it
+
+extern int  vm_stats;				// -vm-stats: report instructions executed and how fast on stderr
+extern int  vm_super;				// -vm-super=0 compiles without superinstructions, to see what they save
+extern long vm_dispatches;			// instructions executed by the last run
+extern int  vm_fused;				// superinstructions compiled
+
+long vm_run( struct ir_program *p );
+
+#endif
@@ -0,0 +1,1072 @@
+#include "x86_64.h"
+#include "regalloc.h"
+#include "label.h"
+#include "vector.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+- instruction selection from the IR into x86-64 for the System V ABI, plus the frame layout and printing
+  - struct x64_func * x86_64_select( struct ir_func *f );
+  - void x86_64_codegen( struct ir_program *p, FILE *out );
+
+- registers come from regalloc: values that die before the next call go in rcx, rsi, rdi, r8, r9, values that
+  live across a call go in rbx, r12-r15 (saved in the prologue), anything left over is spilled to the frame
+- rax, rdx, r10 and r11 are never handed out: idiv works in rax/rdx, r10 and r11 reload spilled operands
+- the caller-saved registers handed out are argument registers too, so the arguments of a call (and the
+  parameters on entry) are moved as one parallel move, r11 breaks the cycles
+- most instructions overwrite their first operand, "d = a op b" becomes a mov and the op, or a lea for an add
+- a constant that fits 32 bits is an immediate of whatever reads it, and isn't built at all when every read is
+- frame, when the function needs one:
+    [rbp]                 saved rbp, the return address above it
+    [rsp + out + 8*i]     callee-saved registers, then spill slots
+    [rsp + 0 .. out]      outgoing stack arguments for calls with more than 6 of them
+  incoming stack arguments are at [rbp + 16 + 8*(k-6)]
+- a leaf function that fits in caller-saved registers gets no frame at all
+- division is idiv, which traps on a zero divisor where AArch64 gives 0
+*/
+
+// allocation order
+const int x64_caller_regs[] = { X64_RCX, X64_RSI, X64_RDI, X64_R8, X64_R9 };
+const int x64_callee_regs[] = { X64_RBX, X64_R12, X64_R13, X64_R14, X64_R15 };
+
+// where the first 6 arguments go
+const int x64_arg_regs[] = { X64_RDI, X64_RSI, X64_RDX, X64_RCX, X64_R8, X64_R9 };
+
+#define X64_NCALLER (sizeof(x64_caller_regs) / sizeof(x64_caller_regs[0]))
+#define X64_NCALLEE (sizeof(x64_callee_regs) / sizeof(x64_callee_regs[0]))
+#define X64_NARGREGS 6
+
+// state for the function being selected
+struct x64_func  *x64_cur        = 0;
+struct regalloc  *x64_ra         = 0;
+int              *x64_block_lbl  = 0;	// label of each IR block, by id
+int               x64_epilogue   = 0;	// label of the epilogue
+int               x64_has_frame  = 0;
+int               x64_frame_sub  = 0;	// bytes below the saved rbp
+int               x64_out_bytes  = 0;	// outgoing argument area
+int               x64_saved[8];			// callee-saved registers this function uses
+int               x64_nsaved     = 0;
+struct ir_inst  **x64_const_def  = 0;	// by vreg, the constant it always holds if its only definition is one
+int              *x64_absorbed   = 0;	// by vreg, reads of it that became immediates
+
+/* append a machine instruction to the current function */
+struct x64_inst * x64_emit(x64_op_t op, int rd, int rs)
+{
+	struct x64_inst *i = calloc(1, sizeof(*i));
+	i->op    = op;
+	i->rd    = rd;
+	i->rs    = rs;
+	i->base  = -1;
+	i->index = -1;
+	i->label = -1;
+
+	if (x64_cur->last) x64_cur->last->next = i;
+	else               x64_cur->first      = i;
+	x64_cur->last = i;
+	return i;
+}
+
+/* append an instruction with a memory operand imm(base, index, scale) */
+struct x64_inst * x64_emit_mem(x64_op_t op, int rd, int base, int index, int scale, long imm)
+{
+	struct x64_inst *i = x64_emit(op, rd, 0);
+	i->base  = base;
+	i->index = index;
+	i->scale = scale;
+	i->imm   = imm;
+	return i;
+}
+
+/* stack offset of a spilled vreg */
+int x64_slot_offset(int v)
+{
+	return x64_out_bytes + 8 * (x64_nsaved + x64_ra->slot[v]);
+}
+
+/* get vreg v into a register for reading, reloading it into tmp if it was spilled */
+int x64_use(int v, int tmp)
+{
+	if (x64_ra->reg[v] != REGALLOC_NONE) return x64_ra->reg[v];
+
+	x64_emit_mem(X64_LOAD, tmp, X64_RSP, -1, 0, x64_slot_offset(v));
+	return tmp;
+}
+
+/* register to compute vreg v into, r10 if v lives in memory */
+int x64_def(int v)
+{
+	if (x64_ra->reg[v] != REGALLOC_NONE) return x64_ra->reg[v];
+	return X64_TMP0;
+}
+
+/* write back a value computed by x64_def if v lives in memory */
+void x64_def_done(int v, int r)
+{
+	if (x64_ra->reg[v] != REGALLOC_NONE) return;
+	if (x64_ra->slot[v] < 0) return; // never live, nothing to keep
+	x64_emit_mem(X64_STORE, r, X64_RSP, -1, 0, x64_slot_offset(v));
+}
+
+/* does imm fit the sign-extended 32-bit immediate most instructions take */
+int x64_imm32(long imm)
+{
+	return imm >= -2147483648L && imm <= 2147483647L;
+}
+
+/* is vreg v always a constant that fits an immediate, *imm */
+int x64_known(int v, long *imm)
+{
+	if (v < 0 || !x64_const_def[v] || !x64_imm32(x64_const_def[v]->imm)) return 0;
+	*imm = x64_const_def[v]->imm;
+	return 1;
+}
+
+/* the operand of i selection turns into an immediate, -1 if there isn't one */
+/*
+- the second operand of anything with an immediate form, or the first when the operation commutes,
+  x64_select_binary makes the same choice
+*/
+int x64_imm_operand(struct ir_inst *i)
+{
+	long k;
+	switch (i->op)
+	{
+		case IR_ADD:
+		case IR_MUL:
+		case IR_AND:
+		case IR_OR:
+			if (x64_known(i->src[1], &k)) return i->src[1];
+			if (x64_known(i->src[0], &k)) return i->src[0];
+			return -1;
+		case IR_SUB:
+		case IR_EQ:
+		case IR_NE:
+		case IR_LT:
+		case IR_LE:
+		case IR_GT:
+		case IR_GE:
+			return x64_known(i->src[1], &k) ? i->src[1] : -1;
+		default:
+			return -1;
+	}
+}
+
+/* put a 64-bit constant in register rd */
+void x64_const(int rd, long imm)
+{
+	if (!imm)                 x64_emit(X64_ZERO, rd, 0);
+	else if (x64_imm32(imm)) x64_emit(X64_MOVI, rd, 0)->imm = imm;
+	else                     x64_emit(X64_MOVABS, rd, 0)->imm = imm;
+}
+
+/* condition for an IR comparison */
+x64_cond_t x64_cond(ir_op_t op)
+{
+	switch (op)
+	{
+		case IR_EQ: return X64_E;
+		case IR_NE: return X64_NE;
+		case IR_LT: return X64_L;
+		case IR_LE: return X64_LE;
+		case IR_GT: return X64_G;
+		default:    return X64_GE;
+	}
+}
+
+/* the condition that holds exactly when c doesn't */
+x64_cond_t x64_cond_invert(x64_cond_t c)
+{
+	switch (c)
+	{
+		case X64_E:  return X64_NE;
+		case X64_NE: return X64_E;
+		case X64_L:  return X64_GE;
+		case X64_LE: return X64_G;
+		case X64_G:  return X64_LE;
+		default:     return X64_L;
+	}
+}
+
+/* xmm register for one of the vectorizer's registers */
+int x64_xmm(int v)
+{
+	return v < VECTOR_FIXED ? v : 8 + (v - VECTOR_FIXED);
+}
+
+/* emit a branch to an IR block */
+void x64_branch(x64_op_t op, struct ir_block *target)
+{
+	x64_emit(op, 0, 0)->label = x64_block_lbl[target->id];
+}
+
+/* restore callee-saved registers and pop the frame, everything but the ret */
+void x64_emit_teardown()
+{
+	if (!x64_has_frame) return;
+
+	for (int k=0;k<x64_nsaved;k++)
+	{
+		x64_emit_mem(X64_LOAD, x64_saved[k], X64_RSP, -1, 0, x64_out_bytes + 8 * k);
+	}
+	x64_emit(X64_LEAVE, 0, 0);
+}
+
+/* x64_parallel_move: dst[k] = src[k] for every k at once, as if every source were read before anything is written */
+/*
+- a move goes out once nothing still pending reads its destination
+- when only cycles are left, one destination's value is parked in r11 and whatever reads it reads r11 instead
+*/
+void x64_parallel_move(int *dst, int *src, int n)
+{
+	int done[X64_NARGREGS] = {0};
+	while (1)
+	{
+		int pending  = 0;
+		int progress = 0;
+		for (int k=0;k<n;k++)
+		{
+			if (done[k]) continue;
+			if (dst[k] == src[k])
+			{
+				done[k] = 1;
+				continue;
+			}
+			pending++;
+
+			int blocked = 0;
+			for (int j=0;j<n;j++) if (j != k && !done[j] && src[j] == dst[k]) blocked = 1;
+			if (blocked) continue;
+
+			x64_emit(X64_MOV, dst[k], src[k]);
+			done[k]  = 1;
+			progress = 1;
+		}
+		if (!pending) break;
+		if (progress) continue;
+
+		for (int k=0;k<n;k++)
+		{
+			if (done[k]) continue;
+			x64_emit(X64_MOV, X64_TMP1, dst[k]);
+			for (int j=0;j<n;j++) if (!done[j] && src[j] == dst[k]) src[j] = X64_TMP1;
+			break;
+		}
+	}
+}
+
+/* move call arguments into the argument registers and the outgoing area */
+/*
+- stack arguments first, while every source is still in the register it was allocated
+- then the register to register moves all together, then the reloads of spilled arguments
+*/
+void x64_call_args(struct ir_inst *i)
+{
+	int dst[X64_NARGREGS], src[X64_NARGREGS], n = 0;
+
+	for (int k=X64_NARGREGS;k<i->nargs;k++)
+	{
+		int r = x64_use(i->args[k], X64_TMP1);
+		x64_emit_mem(X64_STORE, r, X64_RSP, -1, 0, 8 * (k - X64_NARGREGS));
+	}
+	for (int k=0;k<i->nargs && k<X64_NARGREGS;k++)
+	{
+		int r = x64_ra->reg[i->args[k]];
+		if (r == REGALLOC_NONE) continue;
+		dst[n] = x64_arg_regs[k];
+		src[n] = r;
+		n++;
+	}
+	x64_parallel_move(dst, src, n);
+	for (int k=0;k<i->nargs && k<X64_NARGREGS;k++)
+	{
+		if (x64_ra->reg[i->args[k]] == REGALLOC_NONE) x64_use(i->args[k], x64_arg_regs[k]);
+	}
+}
+
+/* x64_select_binary: d = a op b for add, sub, mul, and, or */
+/*
+- a constant operand that fits becomes an immediate, the first one too when the operation commutes
+- an add into a register that's neither operand is a lea, a multiply by a constant the three operand imul
+- when the destination is the second operand it can't be overwritten with the first, a commuting operation
+  swaps them and a subtraction works out -b + a
+*/
+void x64_select_binary(struct ir_inst *i)
+{
+	x64_op_t op, opi;
+	switch (i->op)
+	{
+		case IR_ADD: op = X64_ADD;  opi = X64_ADDI;  break;
+		case IR_SUB: op = X64_SUB;  opi = X64_SUBI;  break;
+		case IR_MUL: op = X64_IMUL; opi = X64_IMULI; break;
+		case IR_AND: op = X64_AND;  opi = X64_ANDI;  break;
+		default:     op = X64_OR;   opi = X64_ORI;   break;
+	}
+
+	int s0 = i->src[0];
+	int s1 = i->src[1];
+	long k;
+	if (i->op != IR_SUB && x64_known(s0, &k) && !x64_known(s1, &k))
+	{
+		s0 = i->src[1];
+		s1 = i->src[0];
+	}
+
+	int a = x64_use(s0, X64_TMP0);
+	int d = x64_def(i->dst);
+
+	if (x64_known(s1, &k))
+	{
+		if (op == X64_IMUL)
+		{
+			x64_emit(X64_IMULI, d, a)->imm = k;
+		}
+		else if ((op == X64_ADD || (op == X64_SUB && x64_imm32(-k))) && d != a)
+		{
+			x64_emit_mem(X64_LEA, d, a, -1, 0, op == X64_ADD ? k : -k);
+		}
+		else
+		{
+			if (d != a) x64_emit(X64_MOV, d, a);
+			x64_emit(opi, d, 0)->imm = k;
+		}
+		x64_def_done(i->dst, d);
+		return;
+	}
+
+	int b = x64_use(s1, X64_TMP1);
+	if (op == X64_ADD && d != a && d != b)
+	{
+		x64_emit_mem(X64_LEA, d, a, b, 1, 0);
+	}
+	else if (d == b && d != a)
+	{
+		if (op == X64_SUB)
+		{
+			x64_emit(X64_NEG, d, 0);
+			x64_emit(X64_ADD, d, a);
+		}
+		else
+		{
+			x64_emit(op, d, a);
+		}
+	}
+	else
+	{
+		if (d != a) x64_emit(X64_MOV, d, a);
+		x64_emit(op, d, b);
+	}
+	x64_def_done(i->dst, d);
+}
+
+/* x64_select_sel: d = a if cc holds else b, for an IR_SEL once the flags are set */
+/*
+- the destination gets b and then a moved over it, or just a over b when it already holds b, or b moved over a
+  with the opposite condition when it already holds a
+*/
+void x64_select_sel(struct ir_inst *i, x64_cond_t cc)
+{
+	int d = x64_def(i->dst);
+	int a = x64_use(i->src[1], X64_TMP1);
+	int b = x64_use(i->src[2], X64_TMP2);
+	if (d == a)
+	{
+		x64_emit(X64_CMOV, d, b)->cond = x64_cond_invert(cc);
+	}
+	else
+	{
+		if (d != b) x64_emit(X64_MOV, d, b);
+		x64_emit(X64_CMOV, d, a)->cond = cc;
+	}
+	x64_def_done(i->dst, d);
+}
+
+/* x64_select_inst: select machine instructions for one IR instruction */
+/*
+returns the instruction to carry on from, which skips ahead when two IR instructions were selected together
+*/
+struct ir_inst * x64_select_inst(struct ir_inst *i, int *uses, struct ir_block *next_bb)
+{
+	int d, a, b, c;
+	long k;
+
+	switch (i->op)
+	{
+		case IR_CONST:
+			// nothing to build when every read of it is an immediate
+			if (x64_absorbed[i->dst] == uses[i->dst]) break;
+			d = x64_def(i->dst);
+			x64_const(d, i->imm);
+			x64_def_done(i->dst, d);
+			break;
+		case IR_MOV:
+			// a spilled source loads straight into the destination, a spilled destination stores straight from the source
+			d = x64_def(i->dst);
+			a = x64_use(i->src[0], d);
+			if (x64_ra->reg[i->dst] == REGALLOC_NONE) d = a;
+			if (d != a) x64_emit(X64_MOV, d, a);
+			x64_def_done(i->dst, d);
+			break;
+		case IR_ADD:
+		case IR_SUB:
+		case IR_MUL:
+		case IR_AND:
+		case IR_OR:
+			x64_select_binary(i);
+			break;
+		case IR_DIV:
+		case IR_MOD:
+			// rdx:rax / b, the quotient lands in rax and the remainder in rdx
+			if (x64_ra->reg[i->src[0]] == REGALLOC_NONE) x64_use(i->src[0], X64_RAX);
+			else x64_emit(X64_MOV, X64_RAX, x64_ra->reg[i->src[0]]);
+			b = x64_use(i->src[1], X64_TMP1);
+			x64_emit(X64_CQO, 0, 0);
+			x64_emit(X64_IDIV, 0, b);
+			d = x64_def(i->dst);
+			x64_emit(X64_MOV, d, i->op == IR_DIV ? X64_RAX : X64_RDX);
+			x64_def_done(i->dst, d);
+			break;
+		case IR_EQ:
+		case IR_NE:
+		case IR_LT:
+		case IR_LE:
+		case IR_GT:
+		case IR_GE:
+		{
+			a = x64_use(i->src[0], X64_TMP0);
+			if (x64_known(i->src[1], &k) && !k)
+			{
+				x64_emit(X64_TEST, a, 0);
+			}
+			else if (x64_known(i->src[1], &k))
+			{
+				x64_emit(X64_CMPI, a, 0)->imm = k;
+			}
+			else
+			{
+				b = x64_use(i->src[1], X64_TMP1);
+				x64_emit(X64_CMP, a, b);
+			}
+
+			// a comparison only feeding the branch right after it becomes the branch condition
+			struct ir_inst *br = i->next;
+			if (br && br->op == IR_BR && br->src[0] == i->dst && uses[i->dst] == 1)
+			{
+				x64_cond_t cc = x64_cond(i->op);
+				if (br->target == next_bb)
+				{
+					x64_emit(X64_JCC, 0, 0)->cond = x64_cond_invert(cc);
+					x64_cur->last->label = x64_block_lbl[br->target_false->id];
+				}
+				else
+				{
+					x64_emit(X64_JCC, 0, 0)->cond = cc;
+					x64_cur->last->label = x64_block_lbl[br->target->id];
+					if (br->target_false != next_bb) x64_branch(X64_JMP, br->target_false);
+				}
+				return br;
+			}
+
+			// or the select right after it picks with the flags
+			struct ir_inst *sel = i->next;
+			if (sel && sel->op == IR_SEL && sel->src[0] == i->dst && uses[i->dst] == 1)
+			{
+				x64_select_sel(sel, x64_cond(i->op));
+				return sel;
+			}
+
+			d = x64_def(i->dst);
+			x64_emit(X64_SETCC, X64_RAX, 0)->cond = x64_cond(i->op);
+			x64_emit(X64_MOVZB, d, X64_RAX);
+			x64_def_done(i->dst, d);
+			break;
+		}
+		case IR_NEG:
+			a = x64_use(i->src[0], X64_TMP0);
+			d = x64_def(i->dst);
+			if (d != a) x64_emit(X64_MOV, d, a);
+			x64_emit(X64_NEG, d, 0);
+			x64_def_done(i->dst, d);
+			break;
+		case IR_NOT:
+			// booleans are always 0 or 1
+			a = x64_use(i->src[0], X64_TMP0);
+			d = x64_def(i->dst);
+			if (d != a) x64_emit(X64_MOV, d, a);
+			x64_emit(X64_XORI, d, 0)->imm = 1;
+			x64_def_done(i->dst, d);
+			break;
+		case IR_SEL:
+			a = x64_use(i->src[0], X64_TMP0);
+			x64_emit(X64_TEST, a, 0);
+			x64_select_sel(i, X64_NE);
+			break;
+		case IR_ADDR:
+			d = x64_def(i->dst);
+			x64_emit(X64_LEARIP, d, 0)->sym = i->name;
+			x64_def_done(i->dst, d);
+			break;
+		case IR_LOADG:
+			d = x64_def(i->dst);
+			x64_emit(X64_LOADRIP, d, 0)->sym = i->name;
+			x64_def_done(i->dst, d);
+			break;
+		case IR_STOREG:
+			a = x64_use(i->src[0], X64_TMP0);
+			x64_emit(X64_STORERIP, a, 0)->sym = i->name;
+			break;
+		case IR_LOAD:
+		case IR_STORE:
+		{
+			// base + 8*index + offset is a single addressing mode
+			int load = i->op == IR_LOAD;
+			a = x64_use(i->src[0], X64_TMP0);
+			b = i->src[1] != IR_NO_REG ? x64_use(i->src[1], X64_TMP1) : -1;
+			c = load ? x64_def(i->dst) : x64_use(i->src[2], X64_TMP2);
+			x64_emit_mem(load ? X64_LOAD : X64_STORE, c, a, b, 8, i->imm);
+			if (load) x64_def_done(i->dst, c);
+			break;
+		}
+		case IR_VLOAD:
+		case IR_VSTORE:
+			a = x64_use(i->src[0], X64_TMP0);
+			b = i->src[1] != IR_NO_REG ? x64_use(i->src[1], X64_TMP1) : -1;
+			x64_emit_mem(i->op == IR_VLOAD ? X64_MOVDQU_LOAD : X64_MOVDQU_STORE, x64_xmm(i->vec[0]), a, b, 8, i->imm);
+			break;
+		case IR_VDUP:
+			a = x64_use(i->src[0], X64_TMP0);
+			x64_emit(X64_MOVQ_TO, x64_xmm(i->vec[0]), a);
+			x64_emit(X64_PUNPCKLQDQ, x64_xmm(i->vec[0]), x64_xmm(i->vec[0]));
+			break;
+		case IR_VBIN:
+		{
+			int vd = x64_xmm(i->vec[0]);
+			int vn = x64_xmm(i->vec[1]);
+			int vm = x64_xmm(i->vec[2]);
+			x64_op_t op = i->imm == IR_ADD ? X64_PADDQ : X64_PSUBQ;
+			if (vd == vn)
+			{
+				x64_emit(op, vd, vm);
+			}
+			else if (vd == vm && op == X64_PADDQ)
+			{
+				x64_emit(op, vd, vn);
+			}
+			else if (vd == vm)
+			{
+				x64_emit(X64_MOVDQA, X64_XMM_SCRATCH, vn);
+				x64_emit(op, X64_XMM_SCRATCH, vm);
+				x64_emit(X64_MOVDQA, vd, X64_XMM_SCRATCH);
+			}
+			else
+			{
+				x64_emit(X64_MOVDQA, vd, vn);
+				x64_emit(op, vd, vm);
+			}
+			break;
+		}
+		case IR_VSUM:
+			// swap the lanes into scratch and add, the low lane has the sum
+			d = x64_def(i->dst);
+			x64_emit(X64_PSHUFD, X64_XMM_SCRATCH, x64_xmm(i->vec[1]))->imm = 0x4e;
+			x64_emit(X64_PADDQ, X64_XMM_SCRATCH, x64_xmm(i->vec[1]));
+			x64_emit(X64_MOVQ_FROM, d, X64_XMM_SCRATCH);
+			x64_def_done(i->dst, d);
+			break;
+		case IR_CALL:
+			x64_call_args(i);
+
+			// a call whose result is returned right away doesn't have to come back here
+			if (i->tail && i->nargs <= X64_NARGREGS && i->next && i->next->op == IR_RET && i->next->src[0] == i->dst)
+			{
+				x64_emit_teardown();
+				x64_emit(X64_JMP, 0, 0)->sym = i->name;
+				return i->next;
+			}
+
+			x64_emit(X64_CALL, 0, 0)->sym = i->name;
+			if (i->dst != IR_NO_REG)
+			{
+				d = x64_def(i->dst);
+				x64_emit(X64_MOV, d, X64_RAX);
+				x64_def_done(i->dst, d);
+			}
+			break;
+		case IR_JMP:
+			if (i->target != next_bb) x64_branch(X64_JMP, i->target);
+			break;
+		case IR_BR:
+			a = x64_use(i->src[0], X64_TMP0);
+			x64_emit(X64_TEST, a, 0);
+			if (i->target == next_bb)
+			{
+				x64_emit(X64_JCC, 0, 0)->cond = X64_E;
+				x64_cur->last->label = x64_block_lbl[i->target_false->id];
+			}
+			else
+			{
+				x64_emit(X64_JCC, 0, 0)->cond = X64_NE;
+				x64_cur->last->label = x64_block_lbl[i->target->id];
+				if (i->target_false != next_bb) x64_branch(X64_JMP, i->target_false);
+			}
+			break;
+		case IR_RET:
+			if (i->src[0] != IR_NO_REG)
+			{
+				if (x64_ra->reg[i->src[0]] == REGALLOC_NONE) x64_use(i->src[0], X64_RAX);
+				else x64_emit(X64_MOV, X64_RAX, x64_ra->reg[i->src[0]]);
+			}
+			// the epilogue comes right after the last block
+			if (next_bb) x64_emit(X64_JMP, 0, 0)->label = x64_epilogue;
+			break;
+		case IR_PHI:
+			printf("codegen error: phi left in %s, SSA has to be taken down before instruction selection\n", x64_cur->name);
+			exit(1);
+	}
+
+	return i;
+}
+
+/* move the parameters from rdi, rsi, rdx, rcx, r8, r9 (or the caller's stack) to wherever they were allocated */
+void x64_params(struct ir_func *f)
+{
+	int dst[X64_NARGREGS], src[X64_NARGREGS], n = 0;
+
+	// spilled register parameters are stored before any argument register gets overwritten
+	for (int p=0;p<f->nparams && p<X64_NARGREGS;p++)
+	{
+		int r = x64_ra->reg[p];
+		if (r != REGALLOC_NONE)
+		{
+			dst[n] = r;
+			src[n] = x64_arg_regs[p];
+			n++;
+		}
+		else if (x64_ra->slot[p] >= 0)
+		{
+			x64_emit_mem(X64_STORE, x64_arg_regs[p], X64_RSP, -1, 0, x64_slot_offset(p));
+		}
+	}
+	x64_parallel_move(dst, src, n);
+
+	for (int p=X64_NARGREGS;p<f->nparams;p++)
+	{
+		int r    = x64_ra->reg[p];
+		int slot = x64_ra->slot[p];
+		if (r == REGALLOC_NONE && slot < 0) continue; // never used
+
+		int reg = r != REGALLOC_NONE ? r : X64_TMP0;
+		if (x64_has_frame) x64_emit_mem(X64_LOAD, reg, X64_RBP, -1, 0, 16 + 8 * (p - X64_NARGREGS));
+		else               x64_emit_mem(X64_LOAD, reg, X64_RSP, -1, 0, 8 + 8 * (p - X64_NARGREGS));
+		if (r == REGALLOC_NONE) x64_emit_mem(X64_STORE, reg, X64_RSP, -1, 0, x64_slot_offset(p));
+	}
+}
+
+/* x86_64_select: select instructions for a whole function, prologue and epilogue included */
+struct x64_func * x86_64_select(struct ir_func *f)
+{
+	struct x64_func *mf = calloc(1, sizeof(*mf));
+	mf->name = f->name;
+	x64_cur  = mf;
+
+	x64_ra = regalloc_run(f, x64_caller_regs, X64_NCALLER, x64_callee_regs, X64_NCALLEE);
+
+	// frame layout, rsp is 16-byte aligned once rbp is pushed so frame_sub keeps it that way for calls
+	x64_nsaved = 0;
+	for (int k=0;k<X64_NCALLEE;k++)
+	{
+		if (x64_ra->used & (1ULL << x64_callee_regs[k])) x64_saved[x64_nsaved++] = x64_callee_regs[k];
+	}
+	x64_out_bytes = x64_ra->max_args > X64_NARGREGS ? (x64_ra->max_args - X64_NARGREGS) * 8 : 0;
+	x64_frame_sub = (x64_out_bytes + 8 * (x64_nsaved + x64_ra->nslots) + 15) & ~15;
+	x64_has_frame = x64_ra->ncalls || x64_frame_sub;
+
+	// labels for every block, and how often each vreg gets read
+	x64_block_lbl = realloc(x64_block_lbl, (f->nblocks + 1) * sizeof(int));
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next) x64_block_lbl[bb->id] = label_create();
+	x64_epilogue = label_create();
+
+	int *uses = calloc(f->nvregs + 1, sizeof(int));
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			int *slot;
+			for (int k=0;(slot = ir_inst_use(i, k));k++) if (*slot >= 0) uses[*slot]++;
+		}
+	}
+
+	// vregs defined once, by a constant
+	int *ndefs = calloc(f->nvregs + 1, sizeof(int));
+	x64_const_def = realloc(x64_const_def, (f->nvregs + 1) * sizeof(*x64_const_def));
+	memset(x64_const_def, 0, (f->nvregs + 1) * sizeof(*x64_const_def));
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			if (i->dst < 0) continue;
+			ndefs[i->dst]++;
+			x64_const_def[i->dst] = i->op == IR_CONST && ndefs[i->dst] == 1 ? i : 0;
+		}
+	}
+	for (int p=0;p<f->nparams;p++) x64_const_def[p] = 0;
+	free(ndefs);
+
+	x64_absorbed = realloc(x64_absorbed, (f->nvregs + 1) * sizeof(int));
+	memset(x64_absorbed, 0, (f->nvregs + 1) * sizeof(int));
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			int v = x64_imm_operand(i);
+			if (v >= 0) x64_absorbed[v]++;
+		}
+	}
+
+	// prologue
+	if (x64_has_frame)
+	{
+		x64_emit(X64_PUSH, X64_RBP, 0);
+		x64_emit(X64_MOV, X64_RBP, X64_RSP);
+		if (x64_frame_sub) x64_emit(X64_SUBI, X64_RSP, 0)->imm = x64_frame_sub;
+
+		for (int k=0;k<x64_nsaved;k++)
+		{
+			x64_emit_mem(X64_STORE, x64_saved[k], X64_RSP, -1, 0, x64_out_bytes + 8 * k);
+		}
+	}
+	x64_params(f);
+
+	for (struct ir_block *bb = f->blocks; bb; bb = bb->next)
+	{
+		x64_emit(X64_LABEL, 0, 0)->label = x64_block_lbl[bb->id];
+		for (struct ir_inst *i = bb->first; i; i = i->next)
+		{
+			i = x64_select_inst(i, uses, bb->next);
+		}
+	}
+
+	// epilogue
+	x64_emit(X64_LABEL, 0, 0)->label = x64_epilogue;
+	x64_emit_teardown();
+	x64_emit(X64_RET, 0, 0);
+
+	// a jump straight to the label right after it does nothing, turn it into a label that gets dropped below
+	for (struct x64_inst *i = mf->first; i; i = i->next)
+	{
+		struct x64_inst *n = i->next;
+		if (i->op == X64_JMP && i->label >= 0 && n && n->op == X64_LABEL && n->label == i->label)
+		{
+			i->op    = X64_LABEL;
+			i->label = -1;
+		}
+	}
+
+	// drop the labels nothing jumps to
+	int *targeted = calloc(x64_epilogue + 1, sizeof(int));
+	for (struct x64_inst *i = mf->first; i; i = i->next)
+	{
+		if (i->op != X64_LABEL && i->label >= 0) targeted[i->label] = 1;
+	}
+	struct x64_inst **link = &mf->first;
+	mf->last = 0;
+	while (*link)
+	{
+		struct x64_inst *i = *link;
+		if (i->op == X64_LABEL && (i->label < 0 || !targeted[i->label]))
+		{
+			*link = i->next;
+			free(i);
+			continue;
+		}
+		mf->last = i;
+		link = &i->next;
+	}
+
+	free(targeted);
+	free(uses);
+	regalloc_delete(x64_ra);
+	x64_ra = 0;
+
+	return mf;
+}
+
+/* name of a general register, 64-bit unless it's the low 8 or 32 bits that are wanted */
+const char * x64_reg_name(int r, int bits)
+{
+	static const char *names64[] = { "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+		"r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15" };
+	static const char *names32[] = { "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+		"r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d" };
+	static const char *names8[]  = { "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+		"r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b" };
+	if (bits == 8)  return names8[r];
+	if (bits == 32) return names32[r];
+	return names64[r];
+}
+
+/* name of a condition code */
+const char * x64_cond_name(x64_cond_t c)
+{
+	switch (c)
+	{
+		case X64_E:  return "e";
+		case X64_NE: return "ne";
+		case X64_L:  return "l";
+		case X64_LE: return "le";
+		case X64_G:  return "g";
+		default:     return "ge";
+	}
+}
+
+/* print the memory operand of an instruction */
+void x64_print_mem(struct x64_inst *i, FILE *out)
+{
+	if (i->imm) fprintf(out, "%li", i->imm);
+	if (i->index >= 0) fprintf(out, "(%%%s,%%%s,%i)", x64_reg_name(i->base, 64), x64_reg_name(i->index, 64), i->scale);
+	else               fprintf(out, "(%%%s)", x64_reg_name(i->base, 64));
+}
+
+/* x86_64_print_inst: print one machine instruction */
+void x86_64_print_inst(struct x64_inst *i, FILE *out)
+{
+	const char *rd = x64_reg_name(i->rd, 64);
+	const char *rs = x64_reg_name(i->rs, 64);
+
+	switch (i->op)
+	{
+		case X64_LABEL:
+			fprintf(out, "%s:\n", label_name(i->label));
+			break;
+		case X64_MOV:
+			fprintf(out, "\tmovq\t%%%s, %%%s\n", rs, rd);
+			break;
+		case X64_MOVI:
+			fprintf(out, "\tmovq\t$%li, %%%s\n", i->imm, rd);
+			break;
+		case X64_MOVABS:
+			fprintf(out, "\tmovabsq\t$%li, %%%s\n", i->imm, rd);
+			break;
+		case X64_ZERO:
+			fprintf(out, "\txorl\t%%%s, %%%s\n", x64_reg_name(i->rd, 32), x64_reg_name(i->rd, 32));
+			break;
+		case X64_ADD:
+		case X64_SUB:
+		case X64_IMUL:
+		case X64_AND:
+		case X64_OR:
+		{
+			const char *op = i->op == X64_ADD ? "addq" : i->op == X64_SUB ? "subq" : i->op == X64_IMUL ? "imulq"
+				: i->op == X64_AND ? "andq" : "orq";
+			fprintf(out, "\t%s\t%%%s, %%%s\n", op, rs, rd);
+			break;
+		}
+		case X64_ADDI:
+		case X64_SUBI:
+		case X64_ANDI:
+		case X64_ORI:
+		case X64_XORI:
+		{
+			const char *op = i->op == X64_ADDI ? "addq" : i->op == X64_SUBI ? "subq" : i->op == X64_ANDI ? "andq"
+				: i->op == X64_ORI ? "orq" : "xorq";
+			fprintf(out, "\t%s\t$%li, %%%s\n", op, i->imm, rd);
+			break;
+		}
+		case X64_IMULI:
+			fprintf(out, "\timulq\t$%li, %%%s, %%%s\n", i->imm, rs, rd);
+			break;
+		case X64_NEG:
+			fprintf(out, "\tnegq\t%%%s\n", rd);
+			break;
+		case X64_CQO:
+			fprintf(out, "\tcqto\n");
+			break;
+		case X64_IDIV:
+			fprintf(out, "\tidivq\t%%%s\n", rs);
+			break;
+		case X64_CMP:
+			fprintf(out, "\tcmpq\t%%%s, %%%s\n", rs, rd);
+			break;
+		case X64_CMPI:
+			fprintf(out, "\tcmpq\t$%li, %%%s\n", i->imm, rd);
+			break;
+		case X64_TEST:
+			fprintf(out, "\ttestq\t%%%s, %%%s\n", rd, rd);
+			break;
+		case X64_SETCC:
+			fprintf(out, "\tset%s\t%%%s\n", x64_cond_name(i->cond), x64_reg_name(i->rd, 8));
+			break;
+		case X64_CMOV:
+			fprintf(out, "\tcmov%sq\t%%%s, %%%s\n", x64_cond_name(i->cond), rs, rd);
+			break;
+		case X64_MOVZB:
+			fprintf(out, "\tmovzbl\t%%%s, %%%s\n", x64_reg_name(i->rs, 8), x64_reg_name(i->rd, 32));
+			break;
+		case X64_LOAD:
+		case X64_LEA:
+			fprintf(out, "\t%s\t", i->op == X64_LOAD ? "movq" : "leaq");
+			x64_print_mem(i, out);
+			fprintf(out, ", %%%s\n", rd);
+			break;
+		case X64_STORE:
+			fprintf(out, "\tmovq\t%%%s, ", rd);
+			x64_print_mem(i, out);
+			fprintf(out, "\n");
+			break;
+		case X64_LOADRIP:
+			fprintf(out, "\tmovq\t%s(%%rip), %%%s\n", i->sym, rd);
+			break;
+		case X64_STORERIP:
+			fprintf(out, "\tmovq\t%%%s, %s(%%rip)\n", rd, i->sym);
+			break;
+		case X64_LEARIP:
+			fprintf(out, "\tleaq\t%s(%%rip), %%%s\n", i->sym, rd);
+			break;
+		case X64_JMP:
+			if (i->label >= 0) fprintf(out, "\tjmp\t%s\n", label_name(i->label));
+			else               fprintf(out, "\tjmp\t%s\n", i->sym);
+			break;
+		case X64_JCC:
+			fprintf(out, "\tj%s\t%s\n", x64_cond_name(i->cond), label_name(i->label));
+			break;
+		case X64_CALL:
+			fprintf(out, "\tcall\t%s\n", i->sym);
+			break;
+		case X64_PUSH:
+			fprintf(out, "\tpushq\t%%%s\n", rd);
+			break;
+		case X64_LEAVE:
+			fprintf(out, "\tleave\n");
+			break;
+		case X64_RET:
+			fprintf(out, "\tret\n");
+			break;
+		case X64_MOVDQU_LOAD:
+			fprintf(out, "\tmovdqu\t");
+			x64_print_mem(i, out);
+			fprintf(out, ", %%xmm%i\n", i->rd);
+			break;
+		case X64_MOVDQU_STORE:
+			fprintf(out, "\tmovdqu\t%%xmm%i, ", i->rd);
+			x64_print_mem(i, out);
+			fprintf(out, "\n");
+			break;
+		case X64_MOVDQA:
+		case X64_PUNPCKLQDQ:
+		case X64_PADDQ:
+		case X64_PSUBQ:
+		{
+			const char *op = i->op == X64_MOVDQA ? "movdqa" : i->op == X64_PUNPCKLQDQ ? "punpcklqdq"
+				: i->op == X64_PADDQ ? "paddq" : "psubq";
+			fprintf(out, "\t%s\t%%xmm%i, %%xmm%i\n", op, i->rs, i->rd);
+			break;
+		}
+		case X64_MOVQ_TO:
+			fprintf(out, "\tmovq\t%%%s, %%xmm%i\n", rs, i->rd);
+			break;
+		case X64_MOVQ_FROM:
+			fprintf(out, "\tmovq\t%%xmm%i, %%%s\n", i->rs, rd);
+			break;
+		case X64_PSHUFD:
+			fprintf(out, "\tpshufd\t$%li, %%xmm%i, %%xmm%i\n", i->imm, i->rs, i->rd);
+			break;
+	}
+}
+
+/* bytes a memory operand adds to an instruction: the ModRM byte, a SIB byte, the displacement */
+int x64_mem_size(struct x64_inst *i)
+{
+	int n = 1;
+	if (i->index >= 0 || i->base == X64_RSP || i->base == X64_R12) n++;
+	if (i->imm >= -128 && i->imm < 128)
+	{
+		if (i->imm || i->base == X64_RBP || i->base == X64_R13) n++;
+	}
+	else n += 4;
+	return n;
+}
+
+/* x86_64_size: bytes of code a selected function takes */
+/*
+the usual encodings, a REX prefix on every 64-bit instruction and the short immediate forms where they fit,
+close to what the assembler produces but not exact (a jump only gets short once the assembler knows the distance)
+*/
+int x86_64_size(struct x64_func *mf)
+{
+	int n = 0;
+	for (struct x64_inst *i = mf->first; i; i = i->next)
+	{
+		int imm8 = i->imm >= -128 && i->imm < 128;
+		switch (i->op)
+		{
+			case X64_LABEL:        break;
+			case X64_CQO:          n += 2; break;
+			case X64_ZERO:         n += i->rd >= 8 ? 3 : 2; break;
+			case X64_MOVI:         n += 7; break;
+			case X64_MOVABS:       n += 10; break;
+			case X64_ADDI:
+			case X64_SUBI:
+			case X64_ANDI:
+			case X64_ORI:
+			case X64_XORI:
+			case X64_CMPI:
+			case X64_IMULI:        n += imm8 ? 4 : 7; break;
+			case X64_IMUL:
+			case X64_CMOV:
+			case X64_MOVZB:        n += 4; break;
+			case X64_SETCC:        n += 3; break;
+			case X64_LOAD:
+			case X64_STORE:
+			case X64_LEA:          n += 2 + x64_mem_size(i); break;
+			case X64_LOADRIP:
+			case X64_STORERIP:
+			case X64_LEARIP:       n += 7; break;
+			case X64_JMP:
+			case X64_CALL:         n += 5; break;
+			case X64_JCC:          n += 6; break;
+			case X64_PUSH:
+			case X64_LEAVE:
+			case X64_RET:          n += 1; break;
+			case X64_MOVDQU_LOAD:
+			case X64_MOVDQU_STORE: n += 3 + x64_mem_size(i); break;
+			case X64_PSHUFD:       n += 5; break;
+			case X64_MOVQ_TO:
+			case X64_MOVQ_FROM:
+			case X64_MOVDQA:
+			case X64_PUNPCKLQDQ:
+			case X64_PADDQ:
+			case X64_PSUBQ:        n += 5; break;
+			default:               n += 3; break;
+		}
+	}
+	return n;
+}
+
+/* x86_64_print_func: print a selected function along with its directives */
+void x86_64_print_func(struct x64_func *mf, FILE *out)
+{
+	fprintf(out, "\t.text\n");
+	fprintf(out, "\t.p2align\t4\n");
+	fprintf(out, "\t.globl\t%s\n", mf->name);
+	fprintf(out, "\t.type\t%s, @function\n", mf->name);
+	fprintf(out, "%s:\n", mf->name);
+
+	for (struct x64_inst *i = mf->first; i; i = i->next)
+	{
+		x86_64_print_inst(i, out);
+	}
+
+	fprintf(out, "\t.size\t%s, .-%s\n", mf->name, mf->name);
+}
+
+/* x86_64_codegen: select and print every function of the program */
+void x86_64_codegen(struct ir_program *p, FILE *out)
+{
+	for (struct ir_func *f = p->funcs; f; f = f->next)
+	{
+		struct x64_func *mf = x86_64_select(f);
+		x86_64_print_func(mf, out);
+	}
+}
@@ -0,0 +1,129 @@
+#ifndef X86_64_H
+#define X86_64_H
+
+#include "ir.h"
+#include <stdio.h>
+
+/*
+- x86-64 backend: selects machine instructions from the IR, one function at a time, for the System V ABI
+- built the same way as the AArch64 backend, a list of instructions for the whole function that only gets
+  printed (in AT&T syntax) once the prologue is known
+*/
+
+// registers are numbered like the hardware encodes them
+#define X64_RAX (0)
+#define X64_RCX (1)
+#define X64_RDX (2)
+#define X64_RBX (3)
+#define X64_RSP (4)
+#define X64_RBP (5)
+#define X64_RSI (6)
+#define X64_RDI (7)
+#define X64_R8  (8)
+#define X64_R9  (9)
+#define X64_R10 (10)
+#define X64_R11 (11)
+#define X64_R12 (12)
+#define X64_R13 (13)
+#define X64_R14 (14)
+#define X64_R15 (15)
+
+// scratch registers the backend keeps to itself, rax (and rdx) also because idiv needs them
+#define X64_TMP0 (X64_R10)
+#define X64_TMP1 (X64_R11)
+#define X64_TMP2 (X64_RAX)
+
+// xmm0-xmm7 take the vectorizer's temporaries, xmm8-xmm14 its fixed registers, xmm15 is scratch
+#define X64_VECTOR_FIXED 7
+#define X64_XMM_SCRATCH  15
+
+typedef enum {
+	X64_LABEL,		// label:
+	X64_MOV,		// movq rs, rd
+	X64_MOVI,		// movq $imm, rd (sign-extended 32-bit immediate)
+	X64_MOVABS,		// movabsq $imm, rd
+	X64_ZERO,		// xorl rd, rd
+	X64_ADD,		// addq rs, rd
+	X64_SUB,		// subq rs, rd
+	X64_IMUL,		// imulq rs, rd
+	X64_AND,		// andq rs, rd
+	X64_OR,			// orq rs, rd
+	X64_ADDI,		// addq $imm, rd
+	X64_SUBI,		// subq $imm, rd
+	X64_IMULI,		// imulq $imm, rs, rd
+	X64_ANDI,		// andq $imm, rd
+	X64_ORI,		// orq $imm, rd
+	X64_XORI,		// xorq $imm, rd
+	X64_NEG,		// negq rd
+	X64_CQO,		// cqo
+	X64_IDIV,		// idivq rs
+	X64_CMP,		// cmpq rs, rd (flags of rd - rs)
+	X64_CMPI,		// cmpq $imm, rd
+	X64_TEST,		// testq rd, rd
+	X64_SETCC,		// setcc rd (low byte)
+	X64_MOVZB,		// movzbl rs (low byte), rd
+	X64_CMOV,		// cmovccq rs, rd
+	X64_LOAD,		// movq imm(base, index, scale), rd
+	X64_STORE,		// movq rd, imm(base, index, scale)
+	X64_LEA,		// leaq imm(base, index, scale), rd
+	X64_LOADRIP,	// movq sym(%rip), rd
+	X64_STORERIP,	// movq rd, sym(%rip)
+	X64_LEARIP,		// leaq sym(%rip), rd
+	X64_JMP,		// jmp label, or jmp sym for a tail call
+	X64_JCC,		// jcc label
+	X64_CALL,		// call sym
+	X64_PUSH,		// pushq rd
+	X64_LEAVE,		// leave
+	X64_RET,		// ret
+
+	// SSE2, rd/rs are xmm register numbers here (except the general registers noted)
+	X64_MOVDQU_LOAD,	// movdqu imm(base, index, scale), xmm rd
+	X64_MOVDQU_STORE,	// movdqu xmm rd, imm(base, index, scale)
+	X64_MOVDQA,		// movdqa xmm rs, xmm rd
+	X64_MOVQ_TO,	// movq rs, xmm rd
+	X64_MOVQ_FROM,	// movq xmm rs, rd
+	X64_PUNPCKLQDQ,	// punpcklqdq xmm rs, xmm rd
+	X64_PADDQ,		// paddq xmm rs, xmm rd
+	X64_PSUBQ,		// psubq xmm rs, xmm rd
+	X64_PSHUFD		// pshufd $imm, xmm rs, xmm rd
+} x64_op_t;
+
+typedef enum {
+	X64_E,
+	X64_NE,
+	X64_L,
+	X64_LE,
+	X64_G,
+	X64_GE
+} x64_cond_t;
+
+struct x64_inst {
+	x64_op_t op;
+	int rd;
+	int rs;
+	int base;			// memory operands, index is -1 when there isn't one
+	int index;
+	int scale;
+	long imm;
+	x64_cond_t cond;
+	const char *sym;
+	int label;			// -1 when the target is sym instead
+	struct x64_inst *next;
+};
+
+struct x64_func {
+	const char *name;
+	struct x64_inst *first;
+	struct x64_inst *last;
+};
+
+struct x64_func * x86_64_select( struct ir_func *f );
+
+int x86_64_size( struct x64_func *mf );
+
+void x86_64_print_inst( struct x64_inst *i, FILE *out );
+void x86_64_print_func( struct x64_func *mf, FILE *out );
+
+void x86_64_codegen( struct ir_program *p, FILE *out );
+
+#endif